@@ -0,0 +1,268 @@
+#include "Alarms.h"
+#include "RegisterChanges.h"
+#include <algorithm>
+#include <stdio.h>
+
+Alarms::Alarms() : m_last_tick_us(0), m_next_handle(1) {}
+
+bool Alarms::add(const AlarmDefinition &definition,
+                 const std::function<double(const ExpressionInput &)> &current_value, uint64_t time_us, char *error,
+                 size_t error_size) {
+    Alarm alarm;
+    alarm.definition = definition;
+    if (definition.kind != AlarmException) {
+        if (!alarm.expression.compile(definition.text, definition.slave_id, error, error_size)) {
+            return false;
+        }
+        for (const ExpressionInput &input : alarm.expression.inputs()) {
+            alarm.inputs.push_back(current_value(input));
+        }
+    }
+    alarm.update_us = time_us;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    alarm.handle = m_next_handle++;
+    m_alarms.push_back(std::move(alarm));
+    rebuild_index();
+    Alarm &added = m_alarms.back();
+    // a limit is checked against the current value right away, a rate needs a change first
+    if (added.definition.kind == AlarmHigh || added.definition.kind == AlarmLow ||
+        added.definition.kind == AlarmRateOfChange) {
+        evaluate(added, time_us);
+    }
+    return true;
+}
+
+void Alarms::remove(uint32_t handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_positions.find(handle);
+    if (found == m_positions.end()) {
+        return;
+    }
+    m_alarms.erase(m_alarms.begin() + found->second);
+    rebuild_index();
+}
+
+void Alarms::update(uint8_t id, uint8_t function, uint16_t reg_addr, const uint16_t *values, int count,
+                    const uint64_t *dirty, uint64_t time_us) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_alarms.empty()) {
+        return;
+    }
+    auto read = m_read_subscribers.find(uint16_t(id << 8 | function));
+    if (read != m_read_subscribers.end()) {
+        std::vector<ReadSubscriber> &subscribers = read->second;
+        auto iter = std::lower_bound(subscribers.begin(), subscribers.end(), reg_addr,
+                                     [](const ReadSubscriber &x, uint16_t addr) { return x.reg_addr < addr; });
+        for (; iter != subscribers.end() && iter->reg_addr < reg_addr + count; ++iter) {
+            Alarm &alarm = m_alarms[iter->alarm];
+            alarm.update_us = time_us;
+            set_condition(alarm, false, time_us);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!testDirty(dirty, i)) {
+            continue;
+        }
+        auto found = m_subscribers.find(register_key(id, function, uint16_t(reg_addr + i)));
+        if (found == m_subscribers.end()) {
+            continue;
+        }
+        for (const Subscriber &subscriber : found->second) {
+            Alarm &alarm = m_alarms[subscriber.alarm];
+            alarm.inputs[subscriber.input] = values[i];
+            if (!alarm.dirty) {
+                alarm.dirty = true;
+                m_dirty.push_back(subscriber.alarm);
+            }
+        }
+    }
+    for (uint32_t position : m_dirty) {
+        Alarm &alarm = m_alarms[position];
+        alarm.dirty = false;
+        evaluate(alarm, time_us);
+    }
+    m_dirty.clear();
+}
+
+void Alarms::slaveResult(uint8_t id, int error_code, uint64_t time_us) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t position : m_exception) {
+        Alarm &alarm = m_alarms[position];
+        if (alarm.definition.slave_id != id) {
+            continue;
+        }
+        if (error_code == 0) {
+            alarm.failures = 0;
+            set_condition(alarm, false, time_us);
+        } else {
+            alarm.failures++;
+            alarm.value = error_code;
+            set_condition(alarm, alarm.failures >= std::max(alarm.definition.limit, 1.0), time_us);
+        }
+    }
+}
+
+void Alarms::tick(uint64_t time_us) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_timed.empty() || time_us < m_last_tick_us + ALARM_TICK_US) {
+        return;
+    }
+    m_last_tick_us = time_us;
+    for (uint32_t position : m_timed) {
+        Alarm &alarm = m_alarms[position];
+        if (alarm.definition.kind == AlarmStale) {
+            alarm.value = (time_us - std::min(time_us, alarm.update_us)) / 1e6;
+            set_condition(alarm, alarm.value > alarm.definition.limit, time_us);
+        } else if (alarm.condition && time_us > alarm.change_us + ALARM_RATE_SETTLE_US) {
+            alarm.rate = 0;
+            set_condition(alarm, 0 > alarm.definition.limit - alarm.definition.hysteresis, time_us);
+        }
+    }
+}
+
+void Alarms::acknowledge(uint32_t handle, uint64_t time_us) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Alarm &alarm : m_alarms) {
+        if ((handle != 0 && alarm.handle != handle) || !alarm.active || alarm.acknowledged) {
+            continue;
+        }
+        alarm.acknowledged = true;
+        push_event(alarm, AlarmAcknowledged, time_us);
+        if (!alarm.condition) {
+            alarm.active = false;
+        }
+    }
+}
+
+size_t Alarms::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_alarms.size();
+}
+
+size_t Alarms::activeCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::count_if(m_alarms.begin(), m_alarms.end(), [](const Alarm &x) { return x.active; });
+}
+
+void Alarms::visit(size_t first, size_t count, const std::function<void(const Alarm &)> &visitor) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = first; i < first + count && i < m_alarms.size(); ++i) {
+        visitor(m_alarms[i]);
+    }
+}
+
+size_t Alarms::eventCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_events.size();
+}
+
+void Alarms::visitEvents(size_t first, size_t count, const std::function<void(const AlarmEvent &)> &visitor) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = first; i < first + count && i < m_events.size(); ++i) {
+        visitor(m_events[m_events.size() - 1 - i]);
+    }
+}
+
+void Alarms::clearEvents() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+}
+
+void Alarms::setEventCallback(std::function<void(const AlarmEvent &)> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_event_callback = std::move(callback);
+}
+
+void Alarms::evaluate(Alarm &alarm, uint64_t time_us) {
+    const AlarmDefinition &definition = alarm.definition;
+    double value = alarm.expression.evaluate(alarm.inputs.data());
+    bool condition = false;
+    if (definition.kind == AlarmHigh) {
+        condition = value > (alarm.condition ? definition.limit - definition.hysteresis : definition.limit);
+    } else if (definition.kind == AlarmLow) {
+        condition = value < (alarm.condition ? definition.limit + definition.hysteresis : definition.limit);
+    } else if (definition.kind == AlarmRateOfChange) {
+        alarm.rate = 0;
+        if (alarm.change_us != 0 && time_us > alarm.change_us && !isnan(value) && !isnan(alarm.value)) {
+            alarm.rate = (value - alarm.value) / ((time_us - alarm.change_us) / 1e6);
+        }
+        condition =
+            fabs(alarm.rate) > (alarm.condition ? definition.limit - definition.hysteresis : definition.limit);
+        alarm.change_us = time_us;
+    } else {
+        return;
+    }
+    alarm.value = value;
+    set_condition(alarm, condition, time_us);
+}
+
+void Alarms::set_condition(Alarm &alarm, bool condition, uint64_t time_us) {
+    if (condition == alarm.condition) {
+        return;
+    }
+    alarm.condition = condition;
+    if (condition) {
+        if (!alarm.active) {
+            alarm.active = true;
+            alarm.acknowledged = false;
+            alarm.since_us = time_us;
+        }
+        push_event(alarm, AlarmRaised, time_us);
+    } else {
+        push_event(alarm, AlarmCleared, time_us);
+        if (!alarm.definition.latching || alarm.acknowledged) {
+            alarm.active = false;
+        }
+    }
+}
+
+void Alarms::push_event(const Alarm &alarm, AlarmEventType type, uint64_t time_us) {
+    AlarmEvent event{time_us, alarm.handle, type, alarm.definition.kind == AlarmRateOfChange ? alarm.rate : alarm.value,
+                     {0}};
+    snprintf(event.name, sizeof(event.name), "%s", alarm.definition.name);
+    if (m_events.size() >= ALARM_MAX_EVENTS) {
+        m_events.pop_front();
+    }
+    m_events.push_back(event);
+    if (m_event_callback) {
+        m_event_callback(event);
+    }
+}
+
+void Alarms::rebuild_index() {
+    m_subscribers.clear();
+    m_read_subscribers.clear();
+    m_positions.clear();
+    m_timed.clear();
+    m_exception.clear();
+    m_dirty.clear();
+    for (uint32_t position = 0; position < m_alarms.size(); ++position) {
+        Alarm &alarm = m_alarms[position];
+        m_positions[alarm.handle] = position;
+        alarm.dirty = false;
+        if (alarm.definition.kind == AlarmException) {
+            m_exception.push_back(position);
+            continue;
+        }
+        if (alarm.definition.kind == AlarmStale || alarm.definition.kind == AlarmRateOfChange) {
+            m_timed.push_back(position);
+        }
+        const std::vector<ExpressionInput> &inputs = alarm.expression.inputs();
+        // a stale alarm only cares whether its registers are read, not what they hold
+        if (alarm.definition.kind == AlarmStale) {
+            for (const ExpressionInput &input : inputs) {
+                m_read_subscribers[uint16_t(input.id << 8 | input.function)].push_back(
+                    ReadSubscriber{input.reg_addr, position});
+            }
+            continue;
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            m_subscribers[register_key(inputs[i].id, inputs[i].function, inputs[i].reg_addr)].push_back(
+                Subscriber{position, uint32_t(i)});
+        }
+    }
+    for (auto &read : m_read_subscribers) {
+        std::sort(read.second.begin(), read.second.end(),
+                  [](const ReadSubscriber &a, const ReadSubscriber &b) { return a.reg_addr < b.reg_addr; });
+    }
+}
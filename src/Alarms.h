@@ -0,0 +1,169 @@
+#ifndef ALARMS_H
+#define ALARMS_H
+
+#include "Expression.h"
+#include <deque>
+#include <functional>
+#include <math.h>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define ALARM_NAME_MAX_LEN 64
+#define ALARM_TEXT_MAX_LEN 256
+// events kept for the history panel, the oldest are dropped beyond it
+#define ALARM_MAX_EVENTS 10000
+// a rate of change alarm takes a value that did not change for this long as steady
+#define ALARM_RATE_SETTLE_US 1000000ull
+// how often tick() looks at the stale and rate of change alarms
+#define ALARM_TICK_US 100000ull
+
+enum AlarmKind {
+    AlarmHigh = 0,
+    AlarmLow,
+    AlarmRateOfChange,
+    AlarmStale,
+    AlarmException,
+};
+
+enum AlarmEventType {
+    AlarmRaised = 0,
+    AlarmCleared,
+    AlarmAcknowledged,
+};
+
+struct AlarmDefinition {
+    char name[ALARM_NAME_MAX_LEN]{0};
+    // the expression of the value watched, not used by an exception alarm
+    char text[ALARM_TEXT_MAX_LEN]{0};
+    AlarmKind kind{AlarmHigh};
+    // the default slave of the expression, the slave an exception alarm watches
+    int slave_id{1};
+    // the value, its change per second, the seconds without a response or the failed requests in a row that raise
+    // the alarm
+    double limit{0};
+    // how far the value has to come back below a high limit, above a low limit or under a rate to clear the alarm
+    double hysteresis{0};
+    // stays active after its condition cleared until it is acknowledged
+    bool latching{false};
+};
+
+struct Alarm {
+    uint32_t handle{0};
+    AlarmDefinition definition;
+    Expression expression;
+    std::vector<double> inputs;
+    double value{NAN};
+    // when value last changed, 0 until a rate can be measured from it
+    uint64_t change_us{0};
+    double rate{0};
+    // of the last response that read any of the inputs
+    uint64_t update_us{0};
+    int failures{0};
+    // the condition with the hysteresis applied
+    bool condition{false};
+    // while the condition holds, and when latching until it is acknowledged
+    bool active{false};
+    bool acknowledged{true};
+    uint64_t since_us{0};
+    bool dirty{false};
+};
+
+struct AlarmEvent {
+    uint64_t time_us;
+    uint32_t handle;
+    AlarmEventType type;
+    double value;
+    char name[ALARM_NAME_MAX_LEN];
+};
+
+// the alarms of a master, checked in the response path. like the derived channels every register an alarm reads
+// subscribes it, so a response only checks the alarms of the registers that changed. stale and rate of change
+// alarms also need the passing of time and are looked at by tick(), exception alarms by the result of every request
+// of their slave. the io thread updates, the ui thread adds, acknowledges and reads
+class Alarms {
+  public:
+    Alarms();
+
+    // false with the message in error when the expression does not compile. the inputs start from current_value
+    bool add(const AlarmDefinition &definition, const std::function<double(const ExpressionInput &)> &current_value,
+             uint64_t time_us, char *error, size_t error_size);
+
+    void remove(uint32_t handle);
+
+    // count registers of slave id read by function, the first at reg_addr, of which those set in dirty changed
+    void update(uint8_t id, uint8_t function, uint16_t reg_addr, const uint16_t *values, int count,
+                const uint64_t *dirty, uint64_t time_us);
+
+    // a request of the slave was answered, error_code is 0, an exception code or the timeout
+    void slaveResult(uint8_t id, int error_code, uint64_t time_us);
+
+    void tick(uint64_t time_us);
+
+    // every unacknowledged alarm for handle 0
+    void acknowledge(uint32_t handle, uint64_t time_us);
+
+    size_t size();
+
+    size_t activeCount();
+
+    // calls visitor with the alarms [first, first + count) while they can not change
+    void visit(size_t first, size_t count, const std::function<void(const Alarm &)> &visitor);
+
+    size_t eventCount();
+
+    // the newest event first
+    void visitEvents(size_t first, size_t count, const std::function<void(const AlarmEvent &)> &visitor);
+
+    void clearEvents();
+
+    // receives every event, called with the alarms locked, it should only hand it on
+    void setEventCallback(std::function<void(const AlarmEvent &)> callback);
+
+  private:
+    struct Subscriber {
+        uint32_t alarm;
+        uint32_t input;
+    };
+
+    // a register a stale alarm reads
+    struct ReadSubscriber {
+        uint16_t reg_addr;
+        uint32_t alarm;
+    };
+
+    static uint32_t register_key(uint8_t id, uint8_t function, uint16_t reg_addr) {
+        return uint32_t(id) << 24 | uint32_t(function) << 16 | reg_addr;
+    }
+
+    void evaluate(Alarm &alarm, uint64_t time_us);
+
+    void set_condition(Alarm &alarm, bool condition, uint64_t time_us);
+
+    void push_event(const Alarm &alarm, AlarmEventType type, uint64_t time_us);
+
+    // the positions of the alarms change when one is removed
+    void rebuild_index();
+
+  private:
+    std::mutex m_mutex;
+    std::vector<Alarm> m_alarms;
+    std::unordered_map<uint32_t, std::vector<Subscriber>> m_subscribers;
+    // the inputs of the stale alarms by slave id << 8 | function, each sorted by address, refreshed by any response
+    // that read them whether they changed or not
+    std::unordered_map<uint16_t, std::vector<ReadSubscriber>> m_read_subscribers;
+    std::unordered_map<uint32_t, uint32_t> m_positions;
+    // positions of the stale and rate of change alarms, and of the exception alarms
+    std::vector<uint32_t> m_timed;
+    std::vector<uint32_t> m_exception;
+    // positions of the alarms marked by the response being processed
+    std::vector<uint32_t> m_dirty;
+    std::deque<AlarmEvent> m_events;
+    uint64_t m_last_tick_us;
+    uint32_t m_next_handle;
+    std::function<void(const AlarmEvent &)> m_event_callback;
+};
+
+#endif // ALARMS_H
@@ -0,0 +1,87 @@
+#include "AllocationCounter.h"
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <stdlib.h>
+
+static thread_local uint64_t allocation_count = 0;
+
+uint64_t threadAllocationCount() { return allocation_count; }
+
+#ifdef DMP_COUNT_ALLOCATIONS
+
+void *operator new(size_t size) {
+    allocation_count++;
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    allocation_count++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return operator new(size, std::nothrow); }
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete[](void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+// over-aligned types
+static void *aligned_malloc(size_t size, std::align_val_t align) {
+    size_t alignment = size_t(align);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    return aligned_alloc(alignment, ((size ? size : 1) + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static void aligned_free(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    allocation_count++;
+    void *ptr = aligned_malloc(size, align);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    allocation_count++;
+    return aligned_malloc(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return operator new(size, align, std::nothrow);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { aligned_free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t) noexcept { aligned_free(ptr); }
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { aligned_free(ptr); }
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { aligned_free(ptr); }
+
+#endif
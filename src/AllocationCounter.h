@@ -0,0 +1,10 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <stdint.h>
+
+// number of global operator new calls made by the calling thread, only counted when the build defines
+// DMP_COUNT_ALLOCATIONS (debug builds), otherwise always 0
+uint64_t threadAllocationCount();
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,149 @@
+#include "AsyncLog.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define ASYNC_LOG_IDLE_WAIT_MS 10
+#define BINARY_LOG_MAGIC 0x4c44
+
+AsyncLogSink::AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> target, AsyncLogOverflow overflow)
+    : m_target(target), m_overflow(overflow), m_records(new Record[ASYNC_LOG_QUEUE_SIZE]), m_enqueue_pos(0),
+      m_dequeue_pos(0), m_dropped(0), m_running(true) {
+    for (size_t i = 0; i < ASYNC_LOG_QUEUE_SIZE; ++i) {
+        m_records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread(&AsyncLogSink::run, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_stop_cv.notify_all();
+    m_thread.join();
+    m_target->flush();
+    delete[] m_records;
+}
+
+void AsyncLogSink::log(const spdlog::details::log_msg &msg) {
+    if (push(msg)) {
+        return;
+    }
+    if (m_overflow == AsyncLogOverflow_Drop && msg.level < spdlog::level::err) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    while (!push(msg)) {
+        std::this_thread::yield();
+    }
+}
+
+void AsyncLogSink::flush() { m_target->flush(); }
+
+void AsyncLogSink::set_pattern(const std::string &pattern) { m_target->set_pattern(pattern); }
+
+void AsyncLogSink::set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) {
+    m_target->set_formatter(std::move(sink_formatter));
+}
+
+// bounded multi producer queue after Dmitry Vyukov, a slot's sequence tells whether it is free for position pos
+// (sequence == pos) or holds the record of position pos (sequence == pos + 1)
+bool AsyncLogSink::push(const spdlog::details::log_msg &msg) {
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    Record *record = nullptr;
+    for (;;) {
+        record = &m_records[pos & (ASYNC_LOG_QUEUE_SIZE - 1)];
+        size_t sequence = record->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+        if (diff == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    record->time = msg.time;
+    record->source = msg.source;
+    record->thread_id = msg.thread_id;
+    record->level = msg.level;
+    size_t size = msg.payload.size();
+    if (size > ASYNC_LOG_PAYLOAD_SIZE) {
+        size = ASYNC_LOG_PAYLOAD_SIZE;
+        memcpy(record->payload, msg.payload.data(), size - 3);
+        memcpy(record->payload + size - 3, "...", 3);
+    } else {
+        memcpy(record->payload, msg.payload.data(), size);
+    }
+    record->size = uint16_t(size);
+    record->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLogSink::pop() {
+    Record &record = m_records[m_dequeue_pos & (ASYNC_LOG_QUEUE_SIZE - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != m_dequeue_pos + 1) {
+        return false;
+    }
+    spdlog::details::log_msg msg(record.time, record.source, spdlog::string_view_t(), record.level,
+                                 spdlog::string_view_t(record.payload, record.size));
+    msg.thread_id = record.thread_id;
+    m_target->log(msg);
+    if (record.level >= spdlog::level::err) {
+        m_target->flush();
+    }
+    record.sequence.store(m_dequeue_pos + ASYNC_LOG_QUEUE_SIZE, std::memory_order_release);
+    m_dequeue_pos++;
+    return true;
+}
+
+void AsyncLogSink::run() {
+    for (;;) {
+        while (pop()) {
+        }
+        uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            char text[64];
+            int size = snprintf(text, sizeof(text), "%llu log messages dropped, the queue was full",
+                                (unsigned long long)dropped);
+            m_target->log(spdlog::details::log_msg(spdlog::source_loc{}, spdlog::string_view_t(),
+                                                   spdlog::level::warn, spdlog::string_view_t(text, size)));
+        }
+        // producers never notify, the queue is drained at this interval at the latest
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            lock.unlock();
+            while (pop()) {
+            }
+            return;
+        }
+        m_stop_cv.wait_for(lock, std::chrono::milliseconds(ASYNC_LOG_IDLE_WAIT_MS));
+    }
+}
+
+void BinaryLogFormatter::format(const spdlog::details::log_msg &msg, spdlog::memory_buf_t &dest) {
+    char header[22];
+    uint16_t magic = BINARY_LOG_MAGIC;
+    uint8_t level = uint8_t(msg.level);
+    uint8_t reserved = 0;
+    uint32_t thread_id = uint32_t(msg.thread_id);
+    int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch()).count();
+    uint32_t line = uint32_t(msg.source.line);
+    uint16_t size = uint16_t(msg.payload.size() > 0xFFFF ? 0xFFFF : msg.payload.size());
+    memcpy(header, &magic, 2);
+    memcpy(header + 2, &level, 1);
+    memcpy(header + 3, &reserved, 1);
+    memcpy(header + 4, &thread_id, 4);
+    memcpy(header + 8, &time, 8);
+    memcpy(header + 16, &line, 4);
+    memcpy(header + 20, &size, 2);
+    dest.append(header, header + 22);
+    dest.append(msg.payload.data(), msg.payload.data() + size);
+}
+
+std::unique_ptr<spdlog::formatter> BinaryLogFormatter::clone() const {
+    return std::unique_ptr<spdlog::formatter>(new BinaryLogFormatter());
+}
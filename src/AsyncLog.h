@@ -0,0 +1,88 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <spdlog/formatter.h>
+#include <spdlog/sinks/sink.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+// messages longer than this are cut, a full frame dump still fits
+#define ASYNC_LOG_PAYLOAD_SIZE 512
+// power of two
+#define ASYNC_LOG_QUEUE_SIZE 4096
+
+enum AsyncLogOverflow {
+    // a full queue drops the message and counts it, the writer reports the count later
+    AsyncLogOverflow_Drop,
+    // a full queue makes the caller wait for the writer
+    AsyncLogOverflow_Block,
+};
+
+// sink that only copies the formatted message into a bounded lock-free queue, a writer thread applies the pattern
+// and hands the records to the target sink, so logging from the io threads never waits for a mutex or the disk,
+// errors and criticals always wait for room instead of being dropped
+class AsyncLogSink : public spdlog::sinks::sink {
+  public:
+    explicit AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> target,
+                          AsyncLogOverflow overflow = AsyncLogOverflow_Drop);
+
+    // writes everything still queued
+    ~AsyncLogSink() override;
+
+    void log(const spdlog::details::log_msg &msg) override;
+
+    void flush() override;
+
+    // both go to the target, which does the formatting
+    void set_pattern(const std::string &pattern) override;
+
+    void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+  private:
+    struct Record {
+        std::atomic<size_t> sequence;
+        spdlog::log_clock::time_point time;
+        spdlog::source_loc source;
+        size_t thread_id;
+        spdlog::level::level_enum level;
+        uint16_t size;
+        char payload[ASYNC_LOG_PAYLOAD_SIZE];
+    };
+
+    bool push(const spdlog::details::log_msg &msg);
+
+    bool pop();
+
+    void run();
+
+  private:
+    std::shared_ptr<spdlog::sinks::sink> m_target;
+    AsyncLogOverflow m_overflow;
+    Record *m_records;
+    std::atomic<size_t> m_enqueue_pos;
+    // only the writer thread touches it
+    size_t m_dequeue_pos;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+    std::thread m_thread;
+};
+
+// compact binary records instead of text lines, each one is
+//   u16 magic 0x4c44 ("DL"), u8 level, u8 reserved, u32 thread id, i64 time in ns since epoch, u32 source line,
+//   u16 message size, message bytes
+// in host byte order
+class BinaryLogFormatter : public spdlog::formatter {
+  public:
+    void format(const spdlog::details::log_msg &msg, spdlog::memory_buf_t &dest) override;
+
+    std::unique_ptr<spdlog::formatter> clone() const override;
+};
+
+#endif // ASYNCLOG_H
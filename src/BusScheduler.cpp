@@ -0,0 +1,127 @@
+#include "BusScheduler.h"
+#include "ModbusWindow.h"
+#include <algorithm>
+
+static const uint32_t scan_priority_weights[SCAN_PRIORITY_COUNT] = SCAN_PRIORITY_WEIGHTS;
+
+BusScheduler::BusScheduler() : m_system_virtual_time(0), m_current(-1) {
+    for (int i = 0; i < SCAN_PRIORITY_COUNT; ++i) {
+        m_virtual_time[i] = 0;
+        m_bus_time_us[i] = 0;
+    }
+    memset(m_slave_pending, 0, sizeof(m_slave_pending));
+}
+
+BusScheduler::~BusScheduler() {
+    for (auto &queue : m_queues) {
+        std::for_each(queue.begin(), queue.end(), [](ScheduledRequest &request) { delete request.packet; });
+    }
+}
+
+void BusScheduler::push(ScanPriority priority, ModbusPacket *packet, RegistersTableData *table,
+                        RegistersTableData *write_table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::list<ScheduledRequest> &queue = m_queues[priority];
+    if (queue.empty()) {
+        // an idle class does not bank credit for the time it had nothing to send
+        m_virtual_time[priority] = std::max(m_virtual_time[priority], m_system_virtual_time);
+    }
+    queue.push_back(ScheduledRequest{packet, table->id & 0xff, table, write_table});
+    m_slave_pending[table->id & 0xff]++;
+}
+
+bool BusScheduler::empty() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &queue : m_queues) {
+        if (!queue.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BusScheduler::current(ScheduledRequest &request) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_current < 0) {
+        for (int i = 0; i < SCAN_PRIORITY_COUNT; ++i) {
+            // ties go to the more important class
+            if (!m_queues[i].empty() && (m_current < 0 || m_virtual_time[i] < m_virtual_time[m_current])) {
+                m_current = i;
+            }
+        }
+        if (m_current < 0) {
+            return false;
+        }
+        m_system_virtual_time = m_virtual_time[m_current];
+    }
+    request = m_queues[m_current].front();
+    return true;
+}
+
+bool BusScheduler::pop(uint64_t bus_time_us, ScheduledRequest &request) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_current < 0) {
+        return false;
+    }
+    request = m_queues[m_current].front();
+    m_queues[m_current].pop_front();
+    RegistersTableData *table = request.table;
+    m_virtual_time[m_current] += bus_time_us / scan_priority_weights[m_current];
+    m_bus_time_us[m_current] += bus_time_us;
+    m_current = -1;
+    release(request);
+    request.table = table;
+    return true;
+}
+
+bool BusScheduler::pending(const RegistersTableData *table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &queue : m_queues) {
+        for (auto &request : queue) {
+            if (request.table == table) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool BusScheduler::slavePending(int slave_id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_slave_pending[slave_id & 0xff] > 0;
+}
+
+void BusScheduler::removeTable(const RegistersTableData *table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int i = 0; i < SCAN_PRIORITY_COUNT; ++i) {
+        std::list<ScheduledRequest> &queue = m_queues[i];
+        for (auto iter = queue.begin(); iter != queue.end();) {
+            if (iter->write_table == table) {
+                iter->write_table = nullptr;
+            }
+            if (iter->table != table) {
+                ++iter;
+            } else if (i == m_current && iter == queue.begin()) {
+                // the answer is still expected, pop() hands it over without a table
+                release(*iter);
+                ++iter;
+            } else {
+                release(*iter);
+                delete iter->packet;
+                iter = queue.erase(iter);
+            }
+        }
+    }
+}
+
+uint64_t BusScheduler::busTimeUs(ScanPriority priority) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bus_time_us[priority];
+}
+
+void BusScheduler::release(ScheduledRequest &request) {
+    if (request.table) {
+        m_slave_pending[request.slave_id]--;
+        request.table = nullptr;
+    }
+}
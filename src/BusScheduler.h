@@ -0,0 +1,75 @@
+#ifndef BUSSCHEDULER_H
+#define BUSSCHEDULER_H
+
+#include <list>
+#include <mutex>
+#include <stdint.h>
+
+struct ModbusPacket;
+struct RegistersTableData;
+
+enum ScanPriority {
+    ScanPriorityCritical,
+    ScanPriorityNormal,
+    ScanPriorityBackground,
+};
+
+#define SCAN_PRIORITY_COUNT 3
+// share of the bus time each class gets while all of them have requests queued
+#define SCAN_PRIORITY_WEIGHTS {8, 4, 1}
+
+struct ScheduledRequest {
+    ModbusPacket *packet{nullptr};
+    int slave_id{0};
+    // null once the table was removed while its request was on the bus
+    RegistersTableData *table{nullptr};
+    // the write table of a combined 23 request, its result is reported to both. null once removed
+    RegistersTableData *write_table{nullptr};
+};
+
+// orders the cyclic requests of a master, one queue per priority class served in start time fair order: every
+// answered or timed out request charges its bus time divided by the class weight to the class, and the backlogged
+// class that was charged least goes next, so slow or dead slaves of one class can not starve the others.
+// the scan timer pushes while the io thread and the timers take requests, so every call locks
+class BusScheduler {
+  public:
+    BusScheduler();
+
+    ~BusScheduler();
+
+    void push(ScanPriority priority, ModbusPacket *packet, RegistersTableData *table,
+              RegistersTableData *write_table = nullptr);
+
+    bool empty();
+
+    // picks the next request unless one is already on the bus, and returns that one until pop()
+    bool current(ScheduledRequest &request);
+
+    // takes the request on the bus off the queue, the caller owns its packet
+    bool pop(uint64_t bus_time_us, ScheduledRequest &request);
+
+    // queued or on the bus
+    bool pending(const RegistersTableData *table);
+
+    bool slavePending(int slave_id);
+
+    void removeTable(const RegistersTableData *table);
+
+    // bus time spent on each class since start
+    uint64_t busTimeUs(ScanPriority priority);
+
+  private:
+    void release(ScheduledRequest &request);
+
+  private:
+    std::mutex m_mutex;
+    std::list<ScheduledRequest> m_queues[SCAN_PRIORITY_COUNT];
+    uint64_t m_virtual_time[SCAN_PRIORITY_COUNT];
+    uint64_t m_bus_time_us[SCAN_PRIORITY_COUNT];
+    uint64_t m_system_virtual_time;
+    // class of the request on the bus, -1 when idle
+    int m_current;
+    int m_slave_pending[256];
+};
+
+#endif // BUSSCHEDULER_H
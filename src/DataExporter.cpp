@@ -0,0 +1,408 @@
+#include "DataExporter.h"
+#include "Timestamp.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <errno.h>
+#include <filesystem>
+#include <string.h>
+#include <tuple>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// the writer is woken early once this many registers wait, instead of at the next interval
+#define EXPORT_WAKE_WORDS (64u << 10)
+#define EXPORT_FILE_BUFFER_BYTES (256 * 1024)
+
+static const char *export_extensions[] = {"csv", "jsonl", "dmpx"};
+
+// always quoted, with quotes and backslashes escaped and control characters as \u00XX
+static void append_json_string(std::string &out, const char *text) {
+    out.push_back('"');
+    for (const char *c = text; *c; ++c) {
+        unsigned char x = (unsigned char)*c;
+        if (x == '"' || x == '\\') {
+            out.push_back('\\');
+            out.push_back(char(x));
+        } else if (x < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", x);
+            out.append(escaped);
+        } else {
+            out.push_back(char(x));
+        }
+    }
+    out.push_back('"');
+}
+
+template <class T> static void append_le(std::string &out, T value) {
+    char bytes[sizeof(T)];
+    myToLittleEndian<T>(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+DataExporter::DataExporter()
+    : m_running(false), m_file(nullptr), m_file_bytes(0), m_file_start_us(0), m_last_sync_us(0),
+      m_exported_values(0), m_dropped_values(0), m_bytes_written(0) {}
+
+DataExporter::~DataExporter() { stop(); }
+
+void DataExporter::setFormatter(
+    std::function<void(int format, const uint16_t *words, char *text, int size)> formatter) {
+    m_formatter = std::move(formatter);
+}
+
+bool DataExporter::start(const ExportOptions &options, std::vector<ExportTable> tables) {
+    stop();
+    m_options = options;
+    m_tables = std::move(tables);
+    for (auto &table : m_tables) {
+        std::sort(table.cells.begin(), table.cells.end(),
+                  [](const ExportCell &a, const ExportCell &b) { return a.offset < b.offset; });
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(m_options.directory, ec);
+    if (ec) {
+        LogError("can not create export directory {}: {}", m_options.directory, ec.message());
+        return false;
+    }
+    if (!open_file(timestampNow().wallUs())) {
+        return false;
+    }
+    // push() stops at these, growing a buffer in the response path would stall it under the lock
+    for (Buffer *buffer : {&m_front, &m_back}) {
+        buffer->words.reserve(EXPORT_MAX_BUFFERED_WORDS);
+        buffer->records.reserve(EXPORT_MAX_BUFFERED_RECORDS);
+    }
+    m_exported_values = 0;
+    m_dropped_values = 0;
+    m_bytes_written = 0;
+    m_running = true;
+    m_thread = std::thread(&DataExporter::run, this);
+    return true;
+}
+
+void DataExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    close_file();
+}
+
+void DataExporter::push(const RegistersTableData *table, int offset, int quantity, const uint16_t *values,
+                        uint64_t time_us) {
+    if (!m_running || quantity <= 0) {
+        return;
+    }
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // a master polls a handful of tables, a scan over them is cheap
+        auto found = std::find_if(m_tables.begin(), m_tables.end(),
+                                  [table](const ExportTable &x) { return x.table == table; });
+        if (found == m_tables.end() || offset < 0 || offset + quantity > found->quantity) {
+            return;
+        }
+        if (m_front.words.size() + quantity > EXPORT_MAX_BUFFERED_WORDS ||
+            m_front.records.size() >= EXPORT_MAX_BUFFERED_RECORDS) {
+            m_dropped_values += quantity;
+            return;
+        }
+        m_front.records.push_back(Record{time_us, uint16_t(found - m_tables.begin()), uint16_t(offset),
+                                         uint16_t(quantity), uint32_t(m_front.words.size())});
+        m_front.words.insert(m_front.words.end(), values, values + quantity);
+        wake = m_front.words.size() >= EXPORT_WAKE_WORDS;
+    }
+    if (wake) {
+        m_cv.notify_one();
+    }
+}
+
+void DataExporter::removeTable(const RegistersTableData *table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &x : m_tables) {
+        if (x.table == table) {
+            x.table = nullptr;
+        }
+    }
+}
+
+std::string DataExporter::currentFile() {
+    std::lock_guard<std::mutex> lock(m_file_name_mutex);
+    return m_file_name;
+}
+
+std::string DataExporter::lastError() {
+    std::lock_guard<std::mutex> lock(m_file_name_mutex);
+    return m_error;
+}
+
+void DataExporter::run() {
+    bool running = true;
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait_for(lock, std::chrono::milliseconds(EXPORT_FLUSH_INTERVAL_MS),
+                          [this] { return !m_running || m_front.words.size() >= EXPORT_WAKE_WORDS; });
+            // the buffer written last time comes back empty, with its capacity
+            std::swap(m_front, m_back);
+            running = m_running;
+        }
+        write_buffer(m_back);
+        m_back.records.clear();
+        m_back.words.clear();
+    }
+}
+
+bool DataExporter::open_file(uint64_t now_us) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s-%020llu.%s", m_options.prefix[0] ? m_options.prefix : "export",
+             (unsigned long long)now_us, export_extensions[m_options.format]);
+    std::string path = (std::filesystem::path(m_options.directory) / name).string();
+    m_file = fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        char error[512];
+        snprintf(error, sizeof(error), "can not create export file %s: %s", path.c_str(), strerror(errno));
+        std::lock_guard<std::mutex> lock(m_file_name_mutex);
+        // retried every cycle, logged once until a file is created again
+        if (m_error.empty()) {
+            LogError("{}", error);
+        }
+        m_error = error;
+        return false;
+    }
+    setvbuf(m_file, nullptr, _IOFBF, EXPORT_FILE_BUFFER_BYTES);
+    m_file_bytes = 0;
+    m_file_start_us = now_us;
+    m_last_sync_us = now_us;
+    if (m_options.format == ExportFormat_CSV) {
+        m_out = "timestamp_us,table,slave_id,function,address,alias,format,value\n";
+        write_out(m_out.data(), m_out.size());
+    } else if (m_options.format == ExportFormat_Binary) {
+        write_binary_header();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_file_name_mutex);
+        m_file_name = path;
+        m_error.clear();
+    }
+    LogInfo("exporting to {}", path);
+    return true;
+}
+
+void DataExporter::close_file() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void DataExporter::write_buffer(const Buffer &buffer) {
+    uint64_t now_us = timestampNow().wallUs();
+    if (m_file && ((m_options.rotate_mb > 0 && m_file_bytes >= (uint64_t(m_options.rotate_mb) << 20)) ||
+                   (m_options.rotate_minutes > 0 &&
+                    now_us - m_file_start_us >= uint64_t(m_options.rotate_minutes) * 60000000ull))) {
+        close_file();
+    }
+    if (m_file == nullptr) {
+        open_file(now_us);
+    }
+    if (m_file == nullptr) {
+        m_dropped_values += buffer.words.size();
+        return;
+    }
+    if (!buffer.records.empty()) {
+        if (m_options.format == ExportFormat_CSV) {
+            write_csv(buffer);
+        } else if (m_options.format == ExportFormat_JSON) {
+            write_json(buffer);
+        } else {
+            write_binary(buffer);
+        }
+        fflush(m_file);
+    }
+    if (m_options.sync == ExportSync_Write ||
+        (m_options.sync == ExportSync_Second && now_us >= m_last_sync_us + 1000000)) {
+        m_last_sync_us = now_us;
+#ifdef _WIN32
+        _commit(_fileno(m_file));
+#else
+        fsync(fileno(m_file));
+#endif
+    }
+}
+
+template <class Visit> void DataExporter::for_each_cell(const Buffer &buffer, const Record &record, Visit visit) {
+    const ExportTable &table = m_tables[record.table];
+    auto cell = std::lower_bound(table.cells.begin(), table.cells.end(), record.offset,
+                                 [](const ExportCell &x, uint16_t offset) { return x.offset < offset; });
+    for (; cell != table.cells.end() && cell->offset + cell->width <= record.offset + record.quantity; ++cell) {
+        visit(table, *cell, &buffer.words[record.first_word + cell->offset - record.offset]);
+    }
+}
+
+void DataExporter::format_cell(const ExportCell &cell, const uint16_t *words, char *text, int size) {
+    // a text format may read past the registers of its cell, it gets them terminated
+    uint16_t cell_words[5]{0};
+    memcpy(cell_words, words, std::min<size_t>(cell.width, 4) * sizeof(uint16_t));
+    if (m_formatter) {
+        m_formatter(cell.format, cell_words, text, size);
+    } else {
+        snprintf(text, size, "%u", cell_words[0]);
+    }
+}
+
+void DataExporter::write_csv(const Buffer &buffer) {
+    char text[64];
+    uint64_t values = 0;
+    m_out.clear();
+    for (const Record &record : buffer.records) {
+        for_each_cell(buffer, record, [&](const ExportTable &table, const ExportCell &cell, const uint16_t *words) {
+            format_cell(cell, words, text, sizeof(text));
+            char fields[64];
+            snprintf(fields, sizeof(fields), "%llu,", (unsigned long long)record.time_us);
+            m_out.append(fields);
+            appendCsvField(m_out, table.title.c_str());
+            snprintf(fields, sizeof(fields), ",%u,%u,%u,", table.id, table.function, table.reg_start + cell.offset);
+            m_out.append(fields);
+            appendCsvField(m_out, cell.alias.c_str());
+            m_out.push_back(',');
+            m_out.append(cell.format_name);
+            m_out.push_back(',');
+            appendCsvField(m_out, text);
+            m_out.push_back('\n');
+            values++;
+        });
+    }
+    write_out(m_out.data(), m_out.size());
+    m_exported_values += values;
+}
+
+void DataExporter::write_json(const Buffer &buffer) {
+    char text[64];
+    char fields[128];
+    uint64_t values = 0;
+    m_out.clear();
+    for (const Record &record : buffer.records) {
+        const ExportTable &table = m_tables[record.table];
+        snprintf(fields, sizeof(fields), "{\"timestamp_us\":%llu,\"table\":", (unsigned long long)record.time_us);
+        m_out.append(fields);
+        append_json_string(m_out, table.title.c_str());
+        snprintf(fields, sizeof(fields), ",\"slave_id\":%u,\"function\":%u,\"cells\":[", table.id, table.function);
+        m_out.append(fields);
+        bool first = true;
+        for_each_cell(buffer, record, [&](const ExportTable &, const ExportCell &cell, const uint16_t *words) {
+            format_cell(cell, words, text, sizeof(text));
+            snprintf(fields, sizeof(fields), "%s{\"address\":%u,\"alias\":", first ? "" : ",",
+                     table.reg_start + cell.offset);
+            m_out.append(fields);
+            append_json_string(m_out, cell.alias.c_str());
+            m_out.append(",\"format\":\"").append(cell.format_name).append("\",\"value\":");
+            if (cell.text) {
+                append_json_string(m_out, text);
+            } else if (isdigit((unsigned char)text[0]) || (text[0] == '-' && isdigit((unsigned char)text[1]))) {
+                m_out.append(text);
+            } else {
+                // nan and inf have no json number
+                m_out.append("null");
+            }
+            m_out.push_back('}');
+            first = false;
+            values++;
+        });
+        m_out.append("]}\n");
+    }
+    write_out(m_out.data(), m_out.size());
+    m_exported_values += values;
+}
+
+// file:  "DMPX", uint16 version, uint16 table count, tables, then blocks up to the end
+// table: uint8 slave id, uint8 function, uint16 start address, uint16 quantity, uint8 title size, title,
+//        uint16 cell count, cells
+// cell:  uint16 offset, uint8 registers, uint8 format, uint8 alias size, alias
+// block: "BLK1", uint16 table index, uint16 offset, uint16 quantity, uint32 rows, uint64 timestamp_us[rows], then
+//        for each of the quantity registers uint16 values[rows]
+// everything little-endian, a block holds the responses of one request range written at once
+void DataExporter::write_binary_header() {
+    m_out.assign("DMPX");
+    append_le<uint16_t>(m_out, 1);
+    append_le<uint16_t>(m_out, uint16_t(m_tables.size()));
+    for (auto &table : m_tables) {
+        m_out.push_back(char(table.id));
+        m_out.push_back(char(table.function));
+        append_le<uint16_t>(m_out, table.reg_start);
+        append_le<uint16_t>(m_out, table.quantity);
+        uint8_t title_size = uint8_t(std::min<size_t>(table.title.size(), 255));
+        m_out.push_back(char(title_size));
+        m_out.append(table.title, 0, title_size);
+        append_le<uint16_t>(m_out, uint16_t(table.cells.size()));
+        for (auto &cell : table.cells) {
+            append_le<uint16_t>(m_out, cell.offset);
+            m_out.push_back(char(cell.width));
+            m_out.push_back(char(cell.format));
+            uint8_t alias_size = uint8_t(std::min<size_t>(cell.alias.size(), 255));
+            m_out.push_back(char(alias_size));
+            m_out.append(cell.alias, 0, alias_size);
+        }
+    }
+    write_out(m_out.data(), m_out.size());
+}
+
+void DataExporter::write_binary(const Buffer &buffer) {
+    // the records of one request range become the rows of a block, in the order they arrived
+    std::vector<uint32_t> order(buffer.records.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buffer](uint32_t a, uint32_t b) {
+        const Record &x = buffer.records[a];
+        const Record &y = buffer.records[b];
+        return std::tie(x.table, x.offset, x.quantity) < std::tie(y.table, y.offset, y.quantity);
+    });
+    uint64_t values = 0;
+    m_out.clear();
+    for (size_t first = 0; first < order.size();) {
+        const Record &head = buffer.records[order[first]];
+        size_t last = first + 1;
+        while (last < order.size() && buffer.records[order[last]].table == head.table &&
+               buffer.records[order[last]].offset == head.offset &&
+               buffer.records[order[last]].quantity == head.quantity) {
+            last++;
+        }
+        m_out.append("BLK1");
+        append_le<uint16_t>(m_out, head.table);
+        append_le<uint16_t>(m_out, head.offset);
+        append_le<uint16_t>(m_out, head.quantity);
+        append_le<uint32_t>(m_out, uint32_t(last - first));
+        for (size_t i = first; i < last; ++i) {
+            append_le<uint64_t>(m_out, buffer.records[order[i]].time_us);
+        }
+        for (int column = 0; column < head.quantity; ++column) {
+            for (size_t i = first; i < last; ++i) {
+                append_le<uint16_t>(m_out, buffer.words[buffer.records[order[i]].first_word + column]);
+            }
+        }
+        values += uint64_t(last - first) * head.quantity;
+        first = last;
+    }
+    write_out(m_out.data(), m_out.size());
+    m_exported_values += values;
+}
+
+void DataExporter::write_out(const void *data, size_t size) {
+    if (fwrite(data, 1, size, m_file) != size) {
+        LogError("export write failed: {}", strerror(errno));
+    }
+    m_file_bytes += size;
+    m_bytes_written += size;
+}
@@ -0,0 +1,173 @@
+#ifndef DATAEXPORTER_H
+#define DATAEXPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RegistersTableData;
+
+// registers and responses buffered for the writer thread at most, beyond them responses are dropped instead of
+// waiting for the disk. both buffers are reserved this large, so the io thread never grows one
+#define EXPORT_MAX_BUFFERED_WORDS (1u << 20)
+#define EXPORT_MAX_BUFFERED_RECORDS (64u << 10)
+// the writer takes the buffer over after this long even when little arrived
+#define EXPORT_FLUSH_INTERVAL_MS 200
+
+enum ExportFormat {
+    ExportFormat_CSV = 0,
+    ExportFormat_JSON,
+    ExportFormat_Binary,
+};
+
+enum ExportSync {
+    // left to the operating system
+    ExportSync_None = 0,
+    ExportSync_Second,
+    ExportSync_Write,
+};
+
+struct ExportOptions {
+    char directory[256]{0};
+    char prefix[64]{0};
+    ExportFormat format{ExportFormat_CSV};
+    ExportSync sync{ExportSync_None};
+    // a new file is started beyond either, 0 turns one off
+    uint32_t rotate_mb{0};
+    uint32_t rotate_minutes{0};
+};
+
+// a cell of a table as it is exported, the first of the registers it spans
+struct ExportCell {
+    uint16_t offset;
+    uint16_t width;
+    int format;
+    std::string alias;
+    std::string format_name;
+    // text and json values are written quoted
+    bool text;
+};
+
+// a table as it was when the export started, later changes of its aliases and formats are not picked up
+struct ExportTable {
+    const RegistersTableData *table;
+    std::string title;
+    uint8_t id;
+    uint8_t function;
+    uint16_t reg_start;
+    uint16_t quantity;
+    std::vector<ExportCell> cells;
+};
+
+// writes the answered reads of a master, decoded with the aliases and formats of their cells, to csv, json lines or
+// a binary file with a column per register. the io thread only copies the raw registers of a response into the
+// front buffer, a thread of its own takes it over in exchange for the one it wrote and decodes, writes, syncs and
+// rotates the files, so neither the io thread nor the ui waits for the disk
+class DataExporter {
+  public:
+    DataExporter();
+
+    ~DataExporter();
+
+    DataExporter(const DataExporter &) = delete;
+    DataExporter &operator=(const DataExporter &) = delete;
+
+    // the text of a cell of a format, as the tables show it
+    void setFormatter(std::function<void(int format, const uint16_t *words, char *text, int size)> formatter);
+
+    bool start(const ExportOptions &options, std::vector<ExportTable> tables);
+
+    // writes what is buffered and closes the file
+    void stop();
+
+    bool running() const { return m_running; }
+
+    // quantity raw values of table, the first one at register offset
+    void push(const RegistersTableData *table, int offset, int quantity, const uint16_t *values, uint64_t time_us);
+
+    // the table is going away, its responses are not exported anymore
+    void removeTable(const RegistersTableData *table);
+
+    uint64_t exportedValues() const { return m_exported_values; }
+
+    uint64_t droppedValues() const { return m_dropped_values; }
+
+    uint64_t bytesWritten() const { return m_bytes_written; }
+
+    std::string currentFile();
+
+    // why the file could not be created, empty while it is written. the writer tries again every cycle
+    std::string lastError();
+
+  private:
+    struct Record {
+        uint64_t time_us;
+        uint16_t table;
+        uint16_t offset;
+        uint16_t quantity;
+        // into the words of the buffer
+        uint32_t first_word;
+    };
+
+    struct Buffer {
+        std::vector<Record> records;
+        std::vector<uint16_t> words;
+    };
+
+    void run();
+
+    bool open_file(uint64_t now_us);
+
+    void close_file();
+
+    void write_buffer(const Buffer &buffer);
+
+    void format_cell(const ExportCell &cell, const uint16_t *words, char *text, int size);
+
+    void write_csv(const Buffer &buffer);
+
+    void write_json(const Buffer &buffer);
+
+    void write_binary(const Buffer &buffer);
+
+    void write_binary_header();
+
+    void write_out(const void *data, size_t size);
+
+    // the cells of a record that it holds whole, calls visit with each and its first word
+    template <class Visit> void for_each_cell(const Buffer &buffer, const Record &record, Visit visit);
+
+  private:
+    ExportOptions m_options;
+    std::vector<ExportTable> m_tables;
+    std::function<void(int, const uint16_t *, char *, int)> m_formatter;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+    // guards the front buffer and the tables of the io thread
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Buffer m_front;
+    // only touched by the writer thread
+    Buffer m_back;
+    FILE *m_file;
+    // guards the file name and the error read by the ui
+    std::mutex m_file_name_mutex;
+    std::string m_file_name;
+    std::string m_error;
+    uint64_t m_file_bytes;
+    uint64_t m_file_start_us;
+    uint64_t m_last_sync_us;
+    std::string m_out;
+    std::atomic<uint64_t> m_exported_values;
+    std::atomic<uint64_t> m_dropped_values;
+    std::atomic<uint64_t> m_bytes_written;
+};
+
+#endif // DATAEXPORTER_H
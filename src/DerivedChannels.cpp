@@ -0,0 +1,129 @@
+#include "DerivedChannels.h"
+#include "RegisterChanges.h"
+#include <algorithm>
+#include <stdio.h>
+
+bool DerivedChannels::add(const char *name, const char *text, int default_id,
+                          const std::function<double(const ExpressionInput &)> &current_value, char *error,
+                          size_t error_size) {
+    DerivedChannel channel;
+    if (!channel.expression.compile(text, default_id, error, error_size)) {
+        return false;
+    }
+    snprintf(channel.name, sizeof(channel.name), "%s", name);
+    snprintf(channel.text, sizeof(channel.text), "%s", text);
+    for (const ExpressionInput &input : channel.expression.inputs()) {
+        channel.inputs.push_back(current_value(input));
+    }
+    channel.value = channel.expression.evaluate(channel.inputs.data());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    channel.handle = m_next_handle++;
+    uint32_t position = uint32_t(m_channels.size());
+    const std::vector<ExpressionInput> &inputs = channel.expression.inputs();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        m_subscribers[register_key(inputs[i].id, inputs[i].function, inputs[i].reg_addr)].push_back(
+            Subscriber{position, uint32_t(i)});
+    }
+    m_positions[channel.handle] = position;
+    m_channels.push_back(std::move(channel));
+    return true;
+}
+
+void DerivedChannels::remove(uint32_t handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_positions.find(handle);
+    if (found == m_positions.end()) {
+        return;
+    }
+    m_channels.erase(m_channels.begin() + found->second);
+    rebuild_index();
+}
+
+void DerivedChannels::update(uint8_t id, uint8_t function, uint16_t reg_addr, const uint16_t *values, int count,
+                             const uint64_t *dirty) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_subscribers.empty()) {
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!testDirty(dirty, i)) {
+            continue;
+        }
+        auto found = m_subscribers.find(register_key(id, function, uint16_t(reg_addr + i)));
+        if (found == m_subscribers.end()) {
+            continue;
+        }
+        for (const Subscriber &subscriber : found->second) {
+            DerivedChannel &channel = m_channels[subscriber.channel];
+            channel.inputs[subscriber.input] = values[i];
+            if (!channel.dirty) {
+                channel.dirty = true;
+                m_dirty.push_back(subscriber.channel);
+            }
+        }
+    }
+}
+
+void DerivedChannels::evaluate(std::vector<uint32_t> &changed) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t position : m_dirty) {
+        DerivedChannel &channel = m_channels[position];
+        channel.dirty = false;
+        double value = channel.expression.evaluate(channel.inputs.data());
+        if (value != channel.value && !(isnan(value) && isnan(channel.value))) {
+            channel.value = value;
+            changed.push_back(channel.handle);
+        }
+    }
+    m_dirty.clear();
+}
+
+bool DerivedChannels::value(uint32_t handle, double &value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_positions.find(handle);
+    if (found == m_positions.end()) {
+        return false;
+    }
+    value = m_channels[found->second].value;
+    return true;
+}
+
+bool DerivedChannels::expression(uint32_t handle, Expression &expression) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_positions.find(handle);
+    if (found == m_positions.end()) {
+        return false;
+    }
+    expression = m_channels[found->second].expression;
+    return true;
+}
+
+size_t DerivedChannels::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_channels.size();
+}
+
+void DerivedChannels::visit(size_t first, size_t count, const std::function<void(const DerivedChannel &)> &visitor) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = first; i < first + count && i < m_channels.size(); ++i) {
+        visitor(m_channels[i]);
+    }
+}
+
+void DerivedChannels::rebuild_index() {
+    m_subscribers.clear();
+    m_positions.clear();
+    m_dirty.clear();
+    for (uint32_t position = 0; position < m_channels.size(); ++position) {
+        DerivedChannel &channel = m_channels[position];
+        const std::vector<ExpressionInput> &inputs = channel.expression.inputs();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            m_subscribers[register_key(inputs[i].id, inputs[i].function, inputs[i].reg_addr)].push_back(
+                Subscriber{position, uint32_t(i)});
+        }
+        m_positions[channel.handle] = position;
+        if (channel.dirty) {
+            m_dirty.push_back(position);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef DERIVEDCHANNELS_H
+#define DERIVEDCHANNELS_H
+
+#include "Expression.h"
+#include <functional>
+#include <math.h>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define DERIVED_NAME_MAX_LEN 64
+// room for sum(r40001@2, ...) over 64 registers
+#define DERIVED_TEXT_MAX_LEN 1024
+
+// a virtual register, the value of an expression over polled registers
+struct DerivedChannel {
+    // stays the same while the channel exists, unlike its position
+    uint32_t handle{0};
+    char name[DERIVED_NAME_MAX_LEN]{0};
+    char text[DERIVED_TEXT_MAX_LEN]{0};
+    Expression expression;
+    // the last value of every input of the expression
+    std::vector<double> inputs;
+    double value{NAN};
+    bool dirty{false};
+};
+
+// the derived channels of a master. every register an expression reads subscribes its channel, a response only looks
+// up the registers that changed and marks their channels, and only the marked channels are evaluated again, so a
+// channel costs nothing while its inputs hold still. the io thread updates, the ui thread adds and reads
+class DerivedChannels {
+  public:
+    // false with the message in error when text does not compile. the inputs start from current_value, which is
+    // asked once for every register the expression reads
+    bool add(const char *name, const char *text, int default_id,
+             const std::function<double(const ExpressionInput &)> &current_value, char *error, size_t error_size);
+
+    void remove(uint32_t handle);
+
+    // count registers of slave id read by function, the first at reg_addr, of which those set in dirty changed
+    void update(uint8_t id, uint8_t function, uint16_t reg_addr, const uint16_t *values, int count,
+                const uint64_t *dirty);
+
+    // evaluates the channels marked by update, the handles of those whose value changed go to changed
+    void evaluate(std::vector<uint32_t> &changed);
+
+    bool value(uint32_t handle, double &value);
+
+    // a copy of the compiled expression, for evaluating it over history
+    bool expression(uint32_t handle, Expression &expression);
+
+    size_t size();
+
+    // calls visitor with the channels [first, first + count) while they can not change
+    void visit(size_t first, size_t count, const std::function<void(const DerivedChannel &)> &visitor);
+
+  private:
+    struct Subscriber {
+        uint32_t channel;
+        uint32_t input;
+    };
+
+    static uint32_t register_key(uint8_t id, uint8_t function, uint16_t reg_addr) {
+        return uint32_t(id) << 24 | uint32_t(function) << 16 | reg_addr;
+    }
+
+    // the positions of the channels change when one is removed
+    void rebuild_index();
+
+  private:
+    std::mutex m_mutex;
+    std::vector<DerivedChannel> m_channels;
+    std::unordered_map<uint32_t, std::vector<Subscriber>> m_subscribers;
+    std::unordered_map<uint32_t, uint32_t> m_positions;
+    // positions of the marked channels
+    std::vector<uint32_t> m_dirty;
+    uint32_t m_next_handle{1};
+};
+
+#endif // DERIVEDCHANNELS_H
@@ -0,0 +1,604 @@
+#include "Expression.h"
+#include "ModbusFrameInfo.h"
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum ExpressionOp : uint8_t {
+    Op_Const,
+    Op_Input,
+    Op_Neg,
+    Op_Not,
+    Op_BitNot,
+    Op_Add,
+    Op_Sub,
+    Op_Mul,
+    Op_Div,
+    Op_Mod,
+    Op_Shl,
+    Op_Shr,
+    Op_BitAnd,
+    Op_BitOr,
+    Op_BitXor,
+    Op_Lt,
+    Op_Le,
+    Op_Gt,
+    Op_Ge,
+    Op_Eq,
+    Op_Ne,
+    Op_And,
+    Op_Or,
+    Op_Select,
+    Op_Abs,
+    Op_Sqrt,
+    Op_Round,
+    Op_Floor,
+    Op_Ceil,
+    Op_Bit,
+    Op_S16,
+    Op_S32,
+    Op_F32,
+    Op_Sum,
+    Op_Avg,
+    Op_Min,
+    Op_Max,
+};
+
+struct BinaryOperator {
+    const char *token;
+    int level;
+    uint8_t op;
+};
+
+// the longer tokens first, so < does not match the start of <<. a higher level binds tighter
+static const BinaryOperator binary_operators[] = {
+    {"||", 0, Op_Or},
+    {"&&", 1, Op_And},
+    {"==", 5, Op_Eq},
+    {"!=", 5, Op_Ne},
+    {"<<", 7, Op_Shl},
+    {">>", 7, Op_Shr},
+    {"<=", 6, Op_Le},
+    {">=", 6, Op_Ge},
+    {"|", 2, Op_BitOr},
+    {"^", 3, Op_BitXor},
+    {"&", 4, Op_BitAnd},
+    {"<", 6, Op_Lt},
+    {">", 6, Op_Gt},
+    {"+", 8, Op_Add},
+    {"-", 8, Op_Sub},
+    {"*", 9, Op_Mul},
+    {"/", 9, Op_Div},
+    {"%", 9, Op_Mod}};
+
+#define BINARY_LEVELS 10
+
+struct ExpressionFunction {
+    const char *name;
+    uint8_t op;
+    int min_args;
+    int max_args;
+};
+
+static const ExpressionFunction expression_functions[] = {
+    {"abs", Op_Abs, 1, 1},
+    {"sqrt", Op_Sqrt, 1, 1},
+    {"round", Op_Round, 1, 1},
+    {"floor", Op_Floor, 1, 1},
+    {"ceil", Op_Ceil, 1, 1},
+    {"bit", Op_Bit, 2, 2},
+    {"if", Op_Select, 3, 3},
+    {"s16", Op_S16, 1, 1},
+    {"s32", Op_S32, 1, 1},
+    {"f32", Op_F32, 1, 1},
+    {"sum", Op_Sum, 1, EXPRESSION_MAX_ARGS},
+    {"avg", Op_Avg, 1, EXPRESSION_MAX_ARGS},
+    {"min", Op_Min, 1, EXPRESSION_MAX_ARGS},
+    {"max", Op_Max, 1, EXPRESSION_MAX_ARGS}};
+
+// rows per pass of the block evaluation, the stack of a block stays in the first level cache
+#define EXPRESSION_BLOCK_ROWS 256
+
+// the integer part, saturated, for the bitwise operators
+static inline int64_t to_int(double value) {
+    if (value > -9.2e18 && value < 9.2e18) {
+        return int64_t(value);
+    }
+    return isnan(value) ? 0 : value > 0 ? INT64_MAX : INT64_MIN;
+}
+
+static inline double from_f32_bits(double value) {
+    uint32_t bits = uint32_t(to_int(value));
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+bool Expression::compile(const char *text, int default_id, char *error, size_t error_size) {
+    m_code.clear();
+    m_constants.clear();
+    m_inputs.clear();
+    m_max_depth = 0;
+    m_text = text;
+    m_pos = 0;
+    m_default_id = default_id;
+    m_depth = 0;
+    m_error = error;
+    m_error_size = error_size;
+    bool ok = parse_conditional();
+    if (ok) {
+        skip_space();
+        if (m_text[m_pos] != '\0') {
+            ok = fail("unexpected character");
+        } else if (m_code.empty()) {
+            ok = fail("empty expression");
+        }
+    }
+    if (!ok) {
+        m_code.clear();
+        m_inputs.clear();
+    }
+    m_text = nullptr;
+    return ok;
+}
+
+double Expression::evaluate(const double *inputs) const {
+    if (m_code.empty()) {
+        return NAN;
+    }
+    double stack[EXPRESSION_MAX_STACK];
+    run(stack, 1, [inputs](uint32_t index, double *top) { *top = inputs[index]; });
+    return stack[0];
+}
+
+void Expression::evaluate(const double *const *columns, size_t rows, double *out) const {
+    if (m_code.empty()) {
+        std::fill(out, out + rows, NAN);
+        return;
+    }
+    std::vector<double> stack(size_t(m_max_depth) * EXPRESSION_BLOCK_ROWS);
+    for (size_t first = 0; first < rows; first += EXPRESSION_BLOCK_ROWS) {
+        size_t count = std::min<size_t>(EXPRESSION_BLOCK_ROWS, rows - first);
+        run(stack.data(), count, [columns, first, count](uint32_t index, double *top) {
+            memcpy(top, columns[index] + first, count * sizeof(double));
+        });
+        memcpy(out + first, stack.data(), count * sizeof(double));
+    }
+}
+
+template <class Load> void Expression::run(double *stack, size_t rows, Load load) const {
+    double *top = stack;
+    for (const Instruction &instruction : m_code) {
+        if (instruction.op == Op_Const) {
+            std::fill(top, top + rows, m_constants[instruction.index]);
+        } else if (instruction.op == Op_Input) {
+            load(instruction.index, top);
+        } else {
+            top -= instruction.argc * rows;
+            apply(instruction, top, rows);
+        }
+        top += rows;
+    }
+}
+
+void Expression::apply(const Instruction &instruction, double *a, size_t rows) {
+    double *b = a + rows;
+    double *c = a + 2 * rows;
+    switch (instruction.op) {
+    case Op_Neg:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = -a[r];
+        }
+        break;
+    case Op_Not:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] == 0;
+        }
+        break;
+    case Op_BitNot:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(~to_int(a[r]));
+        }
+        break;
+    case Op_Add:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] += b[r];
+        }
+        break;
+    case Op_Sub:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] -= b[r];
+        }
+        break;
+    case Op_Mul:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] *= b[r];
+        }
+        break;
+    case Op_Div:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] /= b[r];
+        }
+        break;
+    case Op_Mod:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = fmod(a[r], b[r]);
+        }
+        break;
+    case Op_Shl:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(int64_t(uint64_t(to_int(a[r])) << (to_int(b[r]) & 63)));
+        }
+        break;
+    case Op_Shr:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(to_int(a[r]) >> (to_int(b[r]) & 63));
+        }
+        break;
+    case Op_BitAnd:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(to_int(a[r]) & to_int(b[r]));
+        }
+        break;
+    case Op_BitOr:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(to_int(a[r]) | to_int(b[r]));
+        }
+        break;
+    case Op_BitXor:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(to_int(a[r]) ^ to_int(b[r]));
+        }
+        break;
+    case Op_Lt:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] < b[r];
+        }
+        break;
+    case Op_Le:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] <= b[r];
+        }
+        break;
+    case Op_Gt:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] > b[r];
+        }
+        break;
+    case Op_Ge:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] >= b[r];
+        }
+        break;
+    case Op_Eq:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] == b[r];
+        }
+        break;
+    case Op_Ne:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] != b[r];
+        }
+        break;
+    case Op_And:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] != 0 && b[r] != 0;
+        }
+        break;
+    case Op_Or:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] != 0 || b[r] != 0;
+        }
+        break;
+    case Op_Select:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = a[r] != 0 ? b[r] : c[r];
+        }
+        break;
+    case Op_Abs:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = fabs(a[r]);
+        }
+        break;
+    case Op_Sqrt:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = sqrt(a[r]);
+        }
+        break;
+    case Op_Round:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = round(a[r]);
+        }
+        break;
+    case Op_Floor:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = floor(a[r]);
+        }
+        break;
+    case Op_Ceil:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = ceil(a[r]);
+        }
+        break;
+    case Op_Bit:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = double(to_int(a[r]) >> (to_int(b[r]) & 63) & 1);
+        }
+        break;
+    case Op_S16:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = int16_t(uint16_t(to_int(a[r])));
+        }
+        break;
+    case Op_S32:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = int32_t(uint32_t(to_int(a[r])));
+        }
+        break;
+    case Op_F32:
+        for (size_t r = 0; r < rows; ++r) {
+            a[r] = from_f32_bits(a[r]);
+        }
+        break;
+    case Op_Sum:
+    case Op_Avg:
+        for (int k = 1; k < instruction.argc; ++k) {
+            const double *x = a + k * rows;
+            for (size_t r = 0; r < rows; ++r) {
+                a[r] += x[r];
+            }
+        }
+        if (instruction.op == Op_Avg) {
+            for (size_t r = 0; r < rows; ++r) {
+                a[r] /= instruction.argc;
+            }
+        }
+        break;
+    case Op_Min:
+        for (int k = 1; k < instruction.argc; ++k) {
+            const double *x = a + k * rows;
+            for (size_t r = 0; r < rows; ++r) {
+                a[r] = x[r] < a[r] ? x[r] : a[r];
+            }
+        }
+        break;
+    case Op_Max:
+        for (int k = 1; k < instruction.argc; ++k) {
+            const double *x = a + k * rows;
+            for (size_t r = 0; r < rows; ++r) {
+                a[r] = x[r] > a[r] ? x[r] : a[r];
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+bool Expression::parse_conditional() {
+    if (!parse_binary(0)) {
+        return false;
+    }
+    if (!accept("?")) {
+        return true;
+    }
+    if (!parse_conditional()) {
+        return false;
+    }
+    if (!accept(":")) {
+        return fail("expected :");
+    }
+    return parse_conditional() && emit(Op_Select, 3);
+}
+
+bool Expression::parse_binary(int level) {
+    if (level >= BINARY_LEVELS) {
+        return parse_unary();
+    }
+    if (!parse_binary(level + 1)) {
+        return false;
+    }
+    while (true) {
+        skip_space();
+        const BinaryOperator *op = nullptr;
+        for (const BinaryOperator &x : binary_operators) {
+            if (strncmp(m_text + m_pos, x.token, strlen(x.token)) == 0) {
+                op = &x;
+                break;
+            }
+        }
+        if (op == nullptr || op->level != level) {
+            return true;
+        }
+        m_pos += strlen(op->token);
+        if (!parse_binary(level + 1) || !emit(op->op, 2)) {
+            return false;
+        }
+    }
+}
+
+bool Expression::parse_unary() {
+    if (accept("-")) {
+        return parse_unary() && emit(Op_Neg, 1);
+    } else if (accept("+")) {
+        return parse_unary();
+    } else if (accept("!")) {
+        return parse_unary() && emit(Op_Not, 1);
+    } else if (accept("~")) {
+        return parse_unary() && emit(Op_BitNot, 1);
+    }
+    return parse_primary();
+}
+
+bool Expression::parse_primary() {
+    skip_space();
+    const char *start = m_text + m_pos;
+    if (accept("(")) {
+        if (!parse_conditional()) {
+            return false;
+        }
+        return accept(")") || fail("expected )");
+    }
+    if (isdigit((unsigned char)*start) || *start == '.') {
+        char *end = nullptr;
+        double value = strtod(start, &end);
+        if (end == start) {
+            return fail("bad number");
+        }
+        m_pos += end - start;
+        m_constants.push_back(value);
+        emit_value(Op_Const, uint32_t(m_constants.size() - 1));
+        return m_depth <= EXPRESSION_MAX_STACK || fail("expression too deep");
+    }
+    if (isalpha((unsigned char)*start) || *start == '_') {
+        size_t length = 0;
+        while (isalnum((unsigned char)start[length]) || start[length] == '_') {
+            length++;
+        }
+        m_pos += length;
+        if ((start[0] == 'r' || start[0] == 'R') && length > 1 &&
+            std::all_of(start + 1, start + length, [](char x) { return isdigit((unsigned char)x); })) {
+            return parse_register(start, length);
+        }
+        return parse_call(start, length);
+    }
+    return fail(*start ? "unexpected character" : "unexpected end");
+}
+
+bool Expression::parse_register(const char *name, size_t length) {
+    // the digits after the type are the register number, which starts at 1
+    int digits = int(length) - 2;
+    if (digits != 4 && digits != 5) {
+        return fail("a register has 5 or 6 digits");
+    }
+    int number = atoi(name + 2);
+    if (number < 1 || number > (digits == 4 ? 9999 : 65536)) {
+        return fail("register number out of range");
+    }
+    ExpressionInput input{uint8_t(m_default_id), 0, uint16_t(number - 1)};
+    switch (name[1]) {
+    case '0':
+        input.function = ModbusReadCoils;
+        break;
+    case '1':
+        input.function = ModbusReadDescreteInputs;
+        break;
+    case '3':
+        input.function = ModbusReadInputRegisters;
+        break;
+    case '4':
+        input.function = ModbusReadHoldingRegisters;
+        break;
+    default:
+        return fail("a register starts with 0, 1, 3 or 4");
+    }
+    if (m_text[m_pos] == '@') {
+        m_pos++;
+        const char *start = m_text + m_pos;
+        char *end = nullptr;
+        long id = strtol(start, &end, 10);
+        if (end == start || id < 0 || id > 255) {
+            return fail("bad slave id");
+        }
+        m_pos += end - start;
+        input.id = uint8_t(id);
+    }
+    // a register read twice is one input
+    auto found = std::find_if(m_inputs.begin(), m_inputs.end(), [&input](const ExpressionInput &x) {
+        return x.id == input.id && x.function == input.function && x.reg_addr == input.reg_addr;
+    });
+    if (found == m_inputs.end()) {
+        m_inputs.push_back(input);
+        found = std::prev(m_inputs.end());
+    }
+    emit_value(Op_Input, uint32_t(found - m_inputs.begin()));
+    return m_depth <= EXPRESSION_MAX_STACK || fail("expression too deep");
+}
+
+bool Expression::parse_call(const char *name, size_t length) {
+    const ExpressionFunction *function = nullptr;
+    for (const ExpressionFunction &x : expression_functions) {
+        if (strlen(x.name) == length && strncmp(x.name, name, length) == 0) {
+            function = &x;
+            break;
+        }
+    }
+    if (function == nullptr) {
+        m_pos -= length;
+        return fail("unknown name");
+    }
+    if (!accept("(")) {
+        return fail("expected (");
+    }
+    int argc = 0;
+    if (!accept(")")) {
+        do {
+            if (!parse_conditional()) {
+                return false;
+            }
+            argc++;
+        } while (accept(","));
+        if (!accept(")")) {
+            return fail("expected )");
+        }
+    }
+    if (argc < function->min_args || argc > function->max_args) {
+        return fail("wrong number of arguments");
+    }
+    return emit(function->op, argc);
+}
+
+void Expression::skip_space() {
+    while (isspace((unsigned char)m_text[m_pos])) {
+        m_pos++;
+    }
+}
+
+bool Expression::accept(const char *token) {
+    skip_space();
+    size_t length = strlen(token);
+    if (strncmp(m_text + m_pos, token, length) != 0) {
+        return false;
+    }
+    m_pos += length;
+    return true;
+}
+
+bool Expression::fail(const char *message) {
+    if (m_error && m_error_size > 0) {
+        snprintf(m_error, m_error_size, "%s at %zu", message, m_pos + 1);
+    }
+    return false;
+}
+
+void Expression::emit_value(uint8_t op, uint32_t index) {
+    m_code.push_back(Instruction{op, 0, index});
+    m_depth++;
+    m_max_depth = std::max(m_max_depth, m_depth);
+}
+
+bool Expression::emit(uint8_t op, int argc) {
+    Instruction instruction{op, uint8_t(argc), 0};
+    m_depth -= argc - 1;
+    size_t first = m_code.size() - argc;
+    bool constant = std::all_of(m_code.begin() + first, m_code.end(),
+                                [](const Instruction &x) { return x.op == Op_Const; });
+    if (!constant) {
+        m_code.push_back(instruction);
+        return true;
+    }
+    // the constants of the operands are the last ones added, the folded value takes their place
+    double values[EXPRESSION_MAX_ARGS];
+    for (int i = 0; i < argc; ++i) {
+        values[i] = m_constants[m_code[first + i].index];
+    }
+    apply(instruction, values, 1);
+    m_code.resize(first);
+    m_constants.resize(m_constants.size() - argc);
+    m_constants.push_back(values[0]);
+    m_code.push_back(Instruction{Op_Const, 0, uint32_t(m_constants.size() - 1)});
+    return true;
+}
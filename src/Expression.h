@@ -0,0 +1,83 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// of the variadic functions sum, avg, min and max
+#define EXPRESSION_MAX_ARGS 64
+// values an expression may keep on its stack at once, the arguments of a variadic call and what is nested around it
+#define EXPRESSION_MAX_STACK (EXPRESSION_MAX_ARGS + 32)
+
+// a register an expression reads, function is the read function of its data space, see modbusReadSpace()
+struct ExpressionInput {
+    uint8_t id;
+    uint8_t function;
+    uint16_t reg_addr;
+};
+
+// an expression over polled registers, parsed once into a flat postfix program with its constant parts folded.
+// registers are written in modicon notation, r40001 is the first holding register, r30001 the first input register,
+// r10001 the first discrete input and r00001 the first coil, six digits reach up to r465536. r40001@2 reads slave 2,
+// without @ the default slave. a register reads as its unsigned 16 bit value, coils as 0 or 1. the operators are
+// those of c, with the bitwise and shift operators working on the integer part, plus the functions abs, sqrt, round,
+// floor, ceil, bit(x, n), if(c, a, b), s16(x) and s32(x) for two's complement, f32(x) for the float with the bits
+// of x, and sum, avg, min and max of up to 64 arguments, e.g. f32(r40001 << 16 | r40002) * 0.01
+class Expression {
+  public:
+    // false when text does not parse, error then gets the message and where it happened
+    bool compile(const char *text, int default_id, char *error, size_t error_size);
+
+    // every register the expression reads once, in the order evaluate() takes their values
+    const std::vector<ExpressionInput> &inputs() const { return m_inputs; }
+
+    double evaluate(const double *inputs) const;
+
+    // rows at once, columns[i] holds the rows of input i. each instruction runs over a block of rows before the
+    // next one, so the dispatch is paid once per block instead of once per row
+    void evaluate(const double *const *columns, size_t rows, double *out) const;
+
+  private:
+    struct Instruction {
+        uint8_t op;
+        uint8_t argc;
+        // of the constant or the input
+        uint32_t index;
+    };
+
+    // replaces the top argc stack slots, argc columns of rows values each, by the result in the first
+    static void apply(const Instruction &instruction, double *top, size_t rows);
+
+    template <class Load> void run(double *stack, size_t rows, Load load) const;
+
+    bool parse_conditional();
+    bool parse_binary(int level);
+    bool parse_unary();
+    bool parse_primary();
+    bool parse_register(const char *name, size_t length);
+    bool parse_call(const char *name, size_t length);
+
+    void skip_space();
+    bool accept(const char *token);
+    bool fail(const char *message);
+
+    void emit_value(uint8_t op, uint32_t index);
+    // folds the operation when all its operands are constants
+    bool emit(uint8_t op, int argc);
+
+  private:
+    std::vector<Instruction> m_code;
+    std::vector<double> m_constants;
+    std::vector<ExpressionInput> m_inputs;
+    int m_max_depth{0};
+    // state of compile()
+    const char *m_text{nullptr};
+    size_t m_pos{0};
+    int m_default_id{1};
+    int m_depth{0};
+    char *m_error{nullptr};
+    size_t m_error_size{0};
+};
+
+#endif // EXPRESSION_H
@@ -0,0 +1,127 @@
+#include "GlyphCache.h"
+#include "imgui_impl_opengl2.h"
+#include "imgui_internal.h"
+#include "utils.h"
+#include <SDL.h>
+#include <fstream>
+#include <libintl.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define MO_MAGIC 0x950412de
+#define MO_MAGIC_SWAPPED 0xde120495
+
+GlyphCache::GlyphCache(const void *font_data, int font_data_size, float size_pixels)
+    : m_font_data(font_data), m_font_data_size(font_data_size), m_size_pixels(size_pixels), m_glyph_count(0),
+      m_dirty(true), m_last_build_ms(0) {
+    // printable latin-1, the ascii ui text and hex dumps never need a rebuild
+    for (unsigned int c = 0x20; c <= 0xFF; ++c) {
+        if (c < 0x7F || c >= 0xA0) {
+            m_builder.SetBit(c);
+            m_glyph_count++;
+        }
+    }
+}
+
+void GlyphCache::addCatalog(const char *domain) {
+    // gettext answers the empty msgid with the catalog header, it names the language of the loaded catalog
+    const char *header = dgettext(domain, "");
+    const char *language = strstr(header, "Language: ");
+    if (language == nullptr) {
+        return;
+    }
+    language += strlen("Language: ");
+    std::string name(language, strcspn(language, "\r\n"));
+    const char *dir = bindtextdomain(domain, nullptr);
+    while (!name.empty()) {
+        std::string file_name = std::string(dir) + "/" + name + "/LC_MESSAGES/" + domain + ".mo";
+        if (loadCatalog(file_name.c_str())) {
+            return;
+        }
+        // zh_CN falls back to zh like gettext does
+        size_t pos = name.find_last_of("_@.");
+        name.erase(pos == std::string::npos ? 0 : pos);
+    }
+    LogWarn("can not read the {} catalog, translated text is added as it is typed", domain);
+}
+
+bool GlyphCache::loadCatalog(const char *file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 20) {
+        return false;
+    }
+    uint32_t magic;
+    memcpy(&magic, data.data(), 4);
+    if (magic != MO_MAGIC && magic != MO_MAGIC_SWAPPED) {
+        return false;
+    }
+    auto read_u32 = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, data.data() + offset, 4);
+        if (magic == MO_MAGIC_SWAPPED) {
+            value = (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+        }
+        return value;
+    };
+    uint32_t count = read_u32(8);
+    uint32_t translations = read_u32(16);
+    if (translations + uint64_t(count) * 8 > data.size()) {
+        return false;
+    }
+    // each entry is a length and an offset, the strings are nul terminated
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t length = read_u32(translations + i * 8);
+        uint32_t offset = read_u32(translations + i * 8 + 4);
+        if (offset + uint64_t(length) >= data.size()) {
+            return false;
+        }
+        addText(data.data() + offset);
+    }
+    LogInfo("{} strings of {} added to the glyph cache", count, file_name);
+    return true;
+}
+
+void GlyphCache::addText(const char *text) {
+    while (*text) {
+        unsigned int c = 0;
+        int length = ImTextCharFromUtf8(&c, text, nullptr);
+        if (length == 0) {
+            break;
+        }
+        text += length;
+        if (c <= IM_UNICODE_CODEPOINT_MAX && !m_builder.GetBit(c)) {
+            m_builder.SetBit(c);
+            m_glyph_count++;
+            m_dirty = true;
+        }
+    }
+}
+
+bool GlyphCache::rebuildIfNeeded() {
+    if (!m_dirty) {
+        return false;
+    }
+    m_dirty = false;
+    uint64_t start = SDL_GetPerformanceCounter();
+    m_ranges.clear();
+    m_builder.BuildRanges(&m_ranges);
+    ImFontAtlas *fonts = ImGui::GetIO().Fonts;
+    fonts->Clear();
+    ImFontConfig config;
+    // the font is a static array, the atlas must not free it when it is cleared
+    config.FontDataOwnedByAtlas = false;
+    ImFont *font = fonts->AddFontFromMemoryTTF((void *)m_font_data, m_font_data_size, m_size_pixels, &config,
+                                               m_ranges.Data);
+    IM_ASSERT(font != nullptr);
+    fonts->Build();
+    ImGui_ImplOpenGL2_DestroyFontsTexture();
+    ImGui_ImplOpenGL2_CreateFontsTexture();
+    m_last_build_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    LogInfo("font atlas rebuilt with {} glyphs in {:.1f} ms", m_glyph_count, m_last_build_ms);
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include <imgui.h>
+#include <stdint.h>
+
+// keeps the font atlas down to the characters the ui can actually show instead of rasterising every cjk glyph
+// up front: latin-1, the translations of the gettext catalog, then whatever text is typed or pasted, the atlas
+// is rebuilt between frames when new characters turned up
+class GlyphCache {
+  public:
+    GlyphCache(const void *font_data, int font_data_size, float size_pixels);
+
+    // adds every translated string of the catalog that gettext loaded for domain
+    void addCatalog(const char *domain);
+
+    // utf-8, cheap for characters already in the atlas
+    void addText(const char *text);
+
+    // call before ImGui::NewFrame(), returns true when the atlas was rebuilt
+    bool rebuildIfNeeded();
+
+    int glyphCount() const { return m_glyph_count; }
+
+    double lastBuildMs() const { return m_last_build_ms; }
+
+  private:
+    bool loadCatalog(const char *file_name);
+
+  private:
+    const void *m_font_data;
+    int m_font_data_size;
+    float m_size_pixels;
+    ImFontGlyphRangesBuilder m_builder;
+    // must stay alive until the atlas is built
+    ImVector<ImWchar> m_ranges;
+    int m_glyph_count;
+    bool m_dirty;
+    double m_last_build_ms;
+};
+
+#endif // GLYPHCACHE_H
@@ -0,0 +1,257 @@
+#include "Historian.h"
+#include <algorithm>
+
+Historian::Historian(size_t budget_bytes) : m_budget(budget_bytes), m_used(0) {}
+
+Historian::~Historian() { clear(); }
+
+void Historian::append(const RegistersTableData *table, int offset, int quantity, const uint16_t *values,
+                       uint64_t time_us, bool changed) {
+    if (quantity <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // a table is polled in a handful of fixed ranges, a scan over them is cheap
+    auto stream = std::find_if(m_streams.begin(), m_streams.end(), [&](const Stream &x) {
+        return x.table == table && x.offset == offset && x.quantity == quantity;
+    });
+    if (stream == m_streams.end()) {
+        m_streams.push_back(Stream{table, offset, quantity, {}});
+        stream = std::prev(m_streams.end());
+    }
+    Chunk *chunk = stream->chunks.empty() ? nullptr : stream->chunks.back();
+    if (!changed && chunk && chunk->rows > 0 && time_us < chunk->last_us + HISTORIAN_HEARTBEAT_US) {
+        return;
+    }
+    if (chunk == nullptr || chunk->rows >= HISTORIAN_CHUNK_ROWS) {
+        if (chunk) {
+            m_sealed.push_back(chunk);
+            spill(chunk);
+        }
+        chunk = new Chunk{&*stream, time_us, time_us, 0, time_us, std::vector<uint16_t>(quantity, 0), {}, {}, 0};
+        chunk->columns.resize(quantity);
+        chunk->bytes = chunk_bytes(chunk);
+        m_used += chunk->bytes;
+        stream->chunks.push_back(chunk);
+    }
+    m_used -= chunk->bytes;
+    // the clock may step back, times are kept non decreasing
+    time_us = std::max(time_us, chunk->prev_us);
+    put_varint(chunk->times, time_us - chunk->prev_us);
+    chunk->prev_us = time_us;
+    chunk->last_us = time_us;
+    for (int i = 0; i < quantity; ++i) {
+        int16_t delta = int16_t(values[i] - chunk->prev_values[i]);
+        put_varint(chunk->columns[i], uint16_t((delta << 1) ^ (delta >> 15)));
+        chunk->prev_values[i] = values[i];
+    }
+    chunk->rows++;
+    chunk->bytes = chunk_bytes(chunk);
+    m_used += chunk->bytes;
+    evict();
+}
+
+size_t Historian::query(const RegistersTableData *table, int offset, int count, uint64_t begin_us, uint64_t end_us,
+                        std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    times_us.clear();
+    words.clear();
+    // manual reads of a part of the table form their own streams, the rows of all of them are merged by time
+    int stream_count = 0;
+    for (auto &stream : m_streams) {
+        if (stream.table != table || offset < stream.offset || offset + count > stream.offset + stream.quantity) {
+            continue;
+        }
+        stream_count++;
+        for (const Chunk *chunk : stream.chunks) {
+            if (chunk->rows > 0 && chunk->first_us <= end_us && chunk->last_us >= begin_us) {
+                decode(chunk, offset - stream.offset, count, begin_us, end_us, times_us, words);
+            }
+        }
+    }
+    if (stream_count > 1) {
+        std::vector<size_t> order(times_us.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return times_us[a] < times_us[b]; });
+        std::vector<uint64_t> sorted_times(order.size());
+        std::vector<uint16_t> sorted_words(words.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted_times[i] = times_us[order[i]];
+            std::copy_n(&words[order[i] * count], count, &sorted_words[i * count]);
+        }
+        times_us.swap(sorted_times);
+        words.swap(sorted_words);
+    }
+    return times_us.size();
+}
+
+void Historian::removeTable(const RegistersTableData *table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sealed.erase(std::remove_if(m_sealed.begin(), m_sealed.end(),
+                                  [table](const Chunk *chunk) { return chunk->stream->table == table; }),
+                   m_sealed.end());
+    for (auto iter = m_streams.begin(); iter != m_streams.end();) {
+        if (iter->table == table) {
+            if (!iter->chunks.empty()) {
+                spill(iter->chunks.back());
+            }
+            for (Chunk *chunk : iter->chunks) {
+                release(chunk);
+            }
+            iter = m_streams.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void Historian::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &stream : m_streams) {
+        for (Chunk *chunk : stream.chunks) {
+            release(chunk);
+        }
+    }
+    m_streams.clear();
+    m_sealed.clear();
+}
+
+void Historian::setBudget(size_t budget_bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budget_bytes;
+    evict();
+}
+
+size_t Historian::budget() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t Historian::usedBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+uint64_t Historian::oldestUs() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t oldest = 0;
+    for (auto &stream : m_streams) {
+        if (!stream.chunks.empty() && stream.chunks.front()->rows > 0 &&
+            (oldest == 0 || stream.chunks.front()->first_us < oldest)) {
+            oldest = stream.chunks.front()->first_us;
+        }
+    }
+    return oldest;
+}
+
+void Historian::setSealedCallback(
+    std::function<void(const RegistersTableData *table, int offset, int quantity, std::vector<uint64_t> &times_us,
+                       std::vector<uint16_t> &words)>
+        callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sealed_callback = callback;
+}
+
+void Historian::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &stream : m_streams) {
+        if (!stream.chunks.empty()) {
+            spill(stream.chunks.back());
+        }
+    }
+}
+
+void Historian::put_varint(std::vector<uint8_t> &bytes, uint64_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(uint8_t(value));
+}
+
+uint64_t Historian::get_varint(const uint8_t *&ptr) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (*ptr & 0x80) {
+        value |= uint64_t(*ptr++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= uint64_t(*ptr++) << shift;
+    return value;
+}
+
+size_t Historian::chunk_bytes(const Chunk *chunk) {
+    size_t bytes = sizeof(Chunk) + chunk->times.capacity() + chunk->prev_values.capacity() * sizeof(uint16_t);
+    for (auto &column : chunk->columns) {
+        bytes += sizeof(column) + column.capacity();
+    }
+    return bytes;
+}
+
+void Historian::decode(const Chunk *chunk, int column, int count, uint64_t begin_us, uint64_t end_us,
+                       std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+    // the times tell which rows fall into the range, then only the requested columns are walked
+    m_times_scratch.resize(chunk->rows);
+    const uint8_t *ptr = chunk->times.data();
+    uint64_t time_us = chunk->first_us;
+    int first_row = chunk->rows;
+    int end_row = chunk->rows;
+    for (int row = 0; row < chunk->rows; ++row) {
+        time_us += get_varint(ptr);
+        m_times_scratch[row] = time_us;
+        if (time_us < begin_us) {
+            continue;
+        }
+        if (time_us > end_us) {
+            end_row = row;
+            break;
+        }
+        first_row = std::min(first_row, row);
+    }
+    if (first_row >= end_row) {
+        return;
+    }
+    size_t base = times_us.size();
+    times_us.insert(times_us.end(), m_times_scratch.begin() + first_row, m_times_scratch.begin() + end_row);
+    words.resize((base + end_row - first_row) * count);
+    for (int i = 0; i < count; ++i) {
+        ptr = chunk->columns[column + i].data();
+        uint16_t value = 0;
+        for (int row = 0; row < end_row; ++row) {
+            uint16_t zigzag = uint16_t(get_varint(ptr));
+            value += uint16_t((zigzag >> 1) ^ -(zigzag & 1));
+            if (row >= first_row) {
+                words[(base + row - first_row) * count + i] = value;
+            }
+        }
+    }
+}
+
+void Historian::spill(const Chunk *chunk) {
+    if (!m_sealed_callback || chunk->rows == 0) {
+        return;
+    }
+    // the callback may take the vectors
+    std::vector<uint64_t> times_us;
+    std::vector<uint16_t> words;
+    int quantity = chunk->stream->quantity;
+    decode(chunk, 0, quantity, 0, UINT64_MAX, times_us, words);
+    m_sealed_callback(chunk->stream->table, chunk->stream->offset, quantity, times_us, words);
+}
+
+void Historian::release(Chunk *chunk) {
+    m_used -= chunk->bytes;
+    delete chunk;
+}
+
+void Historian::evict() {
+    while (m_used > m_budget && !m_sealed.empty()) {
+        Chunk *chunk = m_sealed.front();
+        m_sealed.pop_front();
+        // a stream seals its chunks in order, so the oldest sealed chunk is the first of its stream
+        chunk->stream->chunks.pop_front();
+        release(chunk);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef HISTORIAN_H
+#define HISTORIAN_H
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct RegistersTableData;
+
+// rows per chunk, a full chunk is sealed and becomes eligible for eviction
+#define HISTORIAN_CHUNK_ROWS 1024
+#define HISTORIAN_DEFAULT_BUDGET_MB 64
+#define HISTORIAN_HEARTBEAT_US 60000000ull
+
+// keeps every answered read of a master in memory. the rows of one request range of a table form a stream of
+// chunks, each chunk stores its timestamps and every register as its own column of zigzag varint deltas, so a
+// register that does not change costs one byte per poll and reading one register back only decodes its column.
+// when the budget is exceeded the oldest sealed chunks are dropped. the io thread appends, the ui thread queries
+class Historian {
+  public:
+    explicit Historian(size_t budget_bytes);
+
+    ~Historian();
+
+    Historian(const Historian &) = delete;
+    Historian &operator=(const Historian &) = delete;
+
+    // quantity raw values of table, the first one at register offset. a row without changes is only kept once per
+    // heartbeat interval, to show the registers were still read
+    void append(const RegistersTableData *table, int offset, int quantity, const uint16_t *values, uint64_t time_us,
+                bool changed = true);
+
+    // the rows within [begin_us, end_us] that hold the registers [offset, offset + count) of table, in time order.
+    // words gets count values per row. returns the number of rows
+    size_t query(const RegistersTableData *table, int offset, int count, uint64_t begin_us, uint64_t end_us,
+                 std::vector<uint64_t> &times_us, std::vector<uint16_t> &words);
+
+    // the rows of a table are handed to the sealed callback before they are dropped
+    void removeTable(const RegistersTableData *table);
+
+    void clear();
+
+    void setBudget(size_t budget_bytes);
+
+    size_t budget();
+
+    size_t usedBytes();
+
+    // time of the oldest row still held, 0 when empty
+    uint64_t oldestUs();
+
+    // receives the rows of every chunk that is full, quantity words per row. called with the historian locked, it
+    // should only hand them on
+    void setSealedCallback(std::function<void(const RegistersTableData *table, int offset, int quantity,
+                                              std::vector<uint64_t> &times_us, std::vector<uint16_t> &words)>
+                               callback);
+
+    // hands the rows of the chunks that are not full yet to the sealed callback, before the master goes away
+    void flush();
+
+  private:
+    struct Stream;
+
+    struct Chunk {
+        Stream *stream;
+        uint64_t first_us;
+        uint64_t last_us;
+        int rows;
+        // the row before the next one, what the deltas refer to
+        uint64_t prev_us;
+        std::vector<uint16_t> prev_values;
+        std::vector<uint8_t> times;
+        std::vector<std::vector<uint8_t>> columns;
+        size_t bytes;
+    };
+
+    struct Stream {
+        const RegistersTableData *table;
+        int offset;
+        int quantity;
+        // oldest first, only the last one is still open
+        std::deque<Chunk *> chunks;
+    };
+
+    static void put_varint(std::vector<uint8_t> &bytes, uint64_t value);
+
+    static uint64_t get_varint(const uint8_t *&ptr);
+
+    static size_t chunk_bytes(const Chunk *chunk);
+
+    // decodes the rows of chunk within the time range, column by column
+    void decode(const Chunk *chunk, int column, int count, uint64_t begin_us, uint64_t end_us,
+                std::vector<uint64_t> &times_us, std::vector<uint16_t> &words);
+
+    // decodes all rows of chunk for the sealed callback
+    void spill(const Chunk *chunk);
+
+    void release(Chunk *chunk);
+
+    void evict();
+
+  private:
+    std::mutex m_mutex;
+    std::list<Stream> m_streams;
+    // sealed chunks of all streams in the order they were sealed, the front is the oldest
+    std::deque<Chunk *> m_sealed;
+    size_t m_budget;
+    size_t m_used;
+    // scratch of decode()
+    std::vector<uint64_t> m_times_scratch;
+    std::function<void(const RegistersTableData *, int, int, std::vector<uint64_t> &, std::vector<uint16_t> &)>
+        m_sealed_callback;
+};
+
+#endif // HISTORIAN_H
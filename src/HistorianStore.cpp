@@ -0,0 +1,542 @@
+#include "HistorianStore.h"
+#include "Timestamp.h"
+#include "utils.h"
+#include <algorithm>
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <errno.h>
+#include <filesystem>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SEGMENT_MAGIC "DMPHSEG1"
+#define SEGMENT_INDEX_MAGIC "DMPHIDX1"
+#define BLOCK_MAGIC "BLK1"
+// magic and creation time
+#define SEGMENT_HEADER_BYTES 16
+
+namespace {
+
+class BitWriter {
+  public:
+    explicit BitWriter(std::vector<uint8_t> &bytes) : m_bytes(bytes), m_free(0) {}
+
+    void write(uint64_t value, int bits) {
+        while (bits > 0) {
+            if (m_free == 0) {
+                m_bytes.push_back(0);
+                m_free = 8;
+            }
+            int take = std::min(bits, m_free);
+            uint8_t part = uint8_t((value >> (bits - take)) & ((1u << take) - 1));
+            m_bytes.back() |= uint8_t(part << (m_free - take));
+            m_free -= take;
+            bits -= take;
+        }
+    }
+
+    // the next column starts on a byte boundary
+    void align() { m_free = 0; }
+
+  private:
+    std::vector<uint8_t> &m_bytes;
+    int m_free;
+};
+
+class BitReader {
+  public:
+    explicit BitReader(const uint8_t *ptr) : m_ptr(ptr), m_used(0) {}
+
+    uint64_t read(int bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            int take = std::min(bits, 8 - m_used);
+            value = (value << take) | ((*m_ptr >> (8 - m_used - take)) & ((1u << take) - 1));
+            m_used += take;
+            bits -= take;
+            if (m_used == 8) {
+                m_ptr++;
+                m_used = 0;
+            }
+        }
+        return value;
+    }
+
+    int64_t readSigned(int bits) { return int64_t(read(bits) << (64 - bits)) >> (64 - bits); }
+
+  private:
+    const uint8_t *m_ptr;
+    int m_used;
+};
+
+int leading_zeros16(uint16_t value) {
+    int count = 0;
+    while (!(value & 0x8000)) {
+        value <<= 1;
+        count++;
+    }
+    return count;
+}
+
+int trailing_zeros16(uint16_t value) {
+    int count = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        count++;
+    }
+    return count;
+}
+
+uint32_t crc32(const void *data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+} // namespace
+
+HistorianStore::Segment::~Segment() = default;
+
+HistorianStore::HistorianStore() : m_open(false), m_file(nullptr) {}
+
+HistorianStore::~HistorianStore() { close(); }
+
+bool HistorianStore::open(const std::string &directory) {
+    if (m_open) {
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        LogError("can not create history directory {}: {}", directory, ec.message());
+        return false;
+    }
+    m_directory = directory;
+    std::vector<std::string> paths;
+    for (auto &entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".dmph") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    // the names carry the zero padded creation time, so they sort in time order
+    std::sort(paths.begin(), paths.end());
+    for (auto &path : paths) {
+        load_segment(path);
+    }
+    if (!start_segment()) {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        m_segments.clear();
+        return false;
+    }
+    m_open = true;
+    m_thread = std::thread(&HistorianStore::run, this);
+    LogInfo("history segments in {}: {}", directory, m_segments.size());
+    return true;
+}
+
+void HistorianStore::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        if (!m_open) {
+            return;
+        }
+        m_open = false;
+    }
+    m_queue_cv.notify_all();
+    m_thread.join();
+    seal_segment();
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_segments.clear();
+}
+
+void HistorianStore::push(const HistorianKey &key, std::vector<uint64_t> times_us, std::vector<uint16_t> words) {
+    if (times_us.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        if (!m_open) {
+            return;
+        }
+        m_queue.push_back(PendingBlock{key, std::move(times_us), std::move(words)});
+    }
+    m_queue_cv.notify_one();
+}
+
+size_t HistorianStore::query(uint8_t id, uint8_t function, uint16_t reg_addr, int count, uint64_t begin_us,
+                             uint64_t end_us, std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+    times_us.clear();
+    words.clear();
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    for (auto &segment : m_segments) {
+        bool mapped = false;
+        for (auto &entry : segment->index) {
+            if (entry.id != id || entry.function != function || reg_addr < entry.reg_addr ||
+                reg_addr + count > entry.reg_addr + entry.quantity || entry.first_us > end_us ||
+                entry.last_us < begin_us) {
+                continue;
+            }
+            if (!mapped && !(mapped = map_segment(*segment))) {
+                break;
+            }
+            const uint8_t *block = static_cast<const uint8_t *>(segment->region->get_address()) + entry.offset;
+            decode(block, reg_addr - entry.reg_addr, count, begin_us, end_us, times_us, words);
+        }
+    }
+    // blocks of different request ranges holding the same register interleave in time
+    if (!std::is_sorted(times_us.begin(), times_us.end())) {
+        std::vector<size_t> order(times_us.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return times_us[a] < times_us[b]; });
+        std::vector<uint64_t> sorted_times(order.size());
+        std::vector<uint16_t> sorted_words(words.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted_times[i] = times_us[order[i]];
+            std::copy_n(&words[order[i] * count], count, &sorted_words[i * count]);
+        }
+        times_us.swap(sorted_times);
+        words.swap(sorted_words);
+    }
+    return times_us.size();
+}
+
+size_t HistorianStore::diskBytes() {
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    size_t bytes = 0;
+    for (auto &segment : m_segments) {
+        bytes += segment->size;
+    }
+    return bytes;
+}
+
+void HistorianStore::run() {
+    for (;;) {
+        PendingBlock block;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait(lock, [this] { return !m_queue.empty() || !m_open; });
+            // the queue is drained before the thread ends
+            if (m_queue.empty()) {
+                break;
+            }
+            block = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        write_block(block);
+    }
+}
+
+bool HistorianStore::load_segment(const std::string &path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec || size < SEGMENT_HEADER_BYTES) {
+        LogWarn("skipping history segment {}, it is too short", path);
+        return false;
+    }
+    std::unique_ptr<Segment> segment(new Segment);
+    segment->path = path;
+    segment->size = size;
+    if (!map_segment(*segment)) {
+        return false;
+    }
+    const uint8_t *data = static_cast<const uint8_t *>(segment->region->get_address());
+    if (memcmp(data, SEGMENT_MAGIC, 8) != 0) {
+        LogWarn("skipping history segment {}, it is not one", path);
+        return false;
+    }
+    if (size >= SEGMENT_HEADER_BYTES + sizeof(FooterTail)) {
+        FooterTail tail;
+        memcpy(&tail, data + size - sizeof(FooterTail), sizeof(tail));
+        if (memcmp(tail.magic, SEGMENT_INDEX_MAGIC, 8) == 0 &&
+            tail.index_offset + uint64_t(tail.count) * sizeof(IndexEntry) + sizeof(FooterTail) == size &&
+            crc32(data + tail.index_offset, tail.count * sizeof(IndexEntry)) == tail.crc) {
+            if (tail.count == 0) {
+                // a session that recorded nothing
+                segment->region.reset();
+                segment->mapping.reset();
+                std::filesystem::remove(path, ec);
+                return false;
+            }
+            segment->index.resize(tail.count);
+            memcpy(segment->index.data(), data + tail.index_offset, tail.count * sizeof(IndexEntry));
+            std::lock_guard<std::mutex> lock(m_index_mutex);
+            m_segments.push_back(std::move(segment));
+            return true;
+        }
+    }
+    // not sealed, keep the blocks that are complete and intact
+    uint64_t offset = SEGMENT_HEADER_BYTES;
+    while (offset + sizeof(BlockHeader) <= size) {
+        BlockHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (memcmp(header.magic, BLOCK_MAGIC, 4) != 0 || header.header_crc != header_crc(header) ||
+            offset + sizeof(BlockHeader) + header.payload_bytes > size ||
+            crc32(data + offset + sizeof(BlockHeader), header.payload_bytes) != header.payload_crc) {
+            break;
+        }
+        segment->index.push_back(IndexEntry{header.first_us, header.last_us, offset, header.reg_addr,
+                                            header.quantity, header.id, header.function, header.rows});
+        offset += sizeof(BlockHeader) + header.payload_bytes;
+    }
+    LogWarn("history segment {} was not sealed, recovered {} blocks, cut {} bytes", path, segment->index.size(),
+            size - offset);
+    segment->region.reset();
+    segment->mapping.reset();
+    std::filesystem::resize_file(path, offset, ec);
+    FILE *file = ec ? nullptr : fopen(path.c_str(), "ab");
+    if (file == nullptr) {
+        LogWarn("can not repair history segment {}", path);
+        return false;
+    }
+    FooterTail tail{offset, uint32_t(segment->index.size()), 0, {0}};
+    tail.crc = crc32(segment->index.data(), segment->index.size() * sizeof(IndexEntry));
+    memcpy(tail.magic, SEGMENT_INDEX_MAGIC, 8);
+    fwrite(segment->index.data(), sizeof(IndexEntry), segment->index.size(), file);
+    fwrite(&tail, sizeof(tail), 1, file);
+    fclose(file);
+    segment->size = offset + segment->index.size() * sizeof(IndexEntry) + sizeof(tail);
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_segments.push_back(std::move(segment));
+    return true;
+}
+
+bool HistorianStore::start_segment() {
+    uint64_t now_us = timestampNow().wallUs();
+    char name[64];
+    snprintf(name, sizeof(name), "segment-%020llu.dmph", (unsigned long long)now_us);
+    std::unique_ptr<Segment> segment(new Segment);
+    segment->path = (std::filesystem::path(m_directory) / name).string();
+    m_file = fopen(segment->path.c_str(), "wb");
+    if (m_file == nullptr) {
+        LogError("can not create history segment {}: {}", segment->path, strerror(errno));
+        return false;
+    }
+    fwrite(SEGMENT_MAGIC, 1, 8, m_file);
+    fwrite(&now_us, sizeof(now_us), 1, m_file);
+    fflush(m_file);
+    segment->size = SEGMENT_HEADER_BYTES;
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_segments.push_back(std::move(segment));
+    return true;
+}
+
+void HistorianStore::seal_segment() {
+    if (m_file == nullptr) {
+        return;
+    }
+    // the index only changes on this thread, the lock is for the readers of size
+    Segment &segment = *m_segments.back();
+    FooterTail tail{segment.size, uint32_t(segment.index.size()), 0, {0}};
+    tail.crc = crc32(segment.index.data(), segment.index.size() * sizeof(IndexEntry));
+    memcpy(tail.magic, SEGMENT_INDEX_MAGIC, 8);
+    fwrite(segment.index.data(), sizeof(IndexEntry), segment.index.size(), m_file);
+    fwrite(&tail, sizeof(tail), 1, m_file);
+    fclose(m_file);
+    m_file = nullptr;
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    segment.size += segment.index.size() * sizeof(IndexEntry) + sizeof(tail);
+}
+
+void HistorianStore::write_block(const PendingBlock &block) {
+    if (m_file == nullptr) {
+        return;
+    }
+    encode(block, m_payload);
+    BlockHeader header{};
+    header.first_us = block.times_us.front();
+    header.last_us = block.times_us.back();
+    memcpy(header.magic, BLOCK_MAGIC, 4);
+    header.payload_bytes = uint32_t(m_payload.size());
+    header.payload_crc = crc32(m_payload.data(), m_payload.size());
+    header.rows = uint16_t(block.times_us.size());
+    header.reg_addr = block.key.reg_addr;
+    header.quantity = block.key.quantity;
+    header.id = block.key.id;
+    header.function = block.key.function;
+    header.header_crc = header_crc(header);
+    Segment &segment = *m_segments.back();
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+        fwrite(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size() || fflush(m_file) != 0) {
+        // the partial block fails its checksum when the segment is read again, where it is cut off
+        LogError("can not write history segment {}: {}", segment.path, strerror(errno));
+        fclose(m_file);
+        m_file = nullptr;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        segment.index.push_back(IndexEntry{header.first_us, header.last_us, segment.size, header.reg_addr,
+                                           header.quantity, header.id, header.function, header.rows});
+        segment.size += sizeof(header) + m_payload.size();
+    }
+    if (segment.size >= HISTORIAN_SEGMENT_MAX_BYTES) {
+        seal_segment();
+        start_segment();
+    }
+}
+
+void HistorianStore::encode(const PendingBlock &block, std::vector<uint8_t> &payload) {
+    int rows = int(block.times_us.size());
+    int quantity = block.key.quantity;
+    // the end of every column, the timestamps first, relative to the end of this table
+    size_t table_bytes = (quantity + 1) * sizeof(uint32_t);
+    payload.assign(table_bytes, 0);
+    BitWriter writer(payload);
+    uint64_t prev_us = block.times_us[0];
+    int64_t prev_delta = 0;
+    for (int row = 1; row < rows; ++row) {
+        int64_t delta = int64_t(block.times_us[row] - prev_us);
+        int64_t dod = delta - prev_delta;
+        prev_us = block.times_us[row];
+        prev_delta = delta;
+        // gorilla's buckets, widened for microseconds
+        if (dod == 0) {
+            writer.write(0, 1);
+        } else if (dod >= -128 && dod < 128) {
+            writer.write(0b10, 2);
+            writer.write(uint64_t(dod), 8);
+        } else if (dod >= -8192 && dod < 8192) {
+            writer.write(0b110, 3);
+            writer.write(uint64_t(dod), 14);
+        } else if (dod >= -(1 << 23) && dod < (1 << 23)) {
+            writer.write(0b1110, 4);
+            writer.write(uint64_t(dod), 24);
+        } else {
+            writer.write(0b1111, 4);
+            writer.write(uint64_t(dod), 64);
+        }
+    }
+    uint32_t end = uint32_t(payload.size() - table_bytes);
+    memcpy(&payload[0], &end, sizeof(end));
+    for (int column = 0; column < quantity; ++column) {
+        writer.align();
+        uint16_t prev = block.words[column];
+        writer.write(prev, 16);
+        int prev_leading = -1;
+        int prev_trailing = 0;
+        for (int row = 1; row < rows; ++row) {
+            uint16_t value = block.words[size_t(row) * quantity + column];
+            uint16_t xor_value = value ^ prev;
+            prev = value;
+            if (xor_value == 0) {
+                writer.write(0, 1);
+                continue;
+            }
+            writer.write(1, 1);
+            int leading = leading_zeros16(xor_value);
+            int trailing = trailing_zeros16(xor_value);
+            if (prev_leading >= 0 && leading >= prev_leading && trailing >= prev_trailing) {
+                // fits the bits that changed last time
+                writer.write(0, 1);
+                writer.write(xor_value >> prev_trailing, 16 - prev_leading - prev_trailing);
+            } else {
+                int length = 16 - leading - trailing;
+                writer.write(1, 1);
+                writer.write(leading, 4);
+                writer.write(length - 1, 4);
+                writer.write(xor_value >> trailing, length);
+                prev_leading = leading;
+                prev_trailing = trailing;
+            }
+        }
+        end = uint32_t(payload.size() - table_bytes);
+        memcpy(&payload[(column + 1) * sizeof(uint32_t)], &end, sizeof(end));
+    }
+}
+
+void HistorianStore::decode(const uint8_t *block, int column, int count, uint64_t begin_us, uint64_t end_us,
+                            std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+    BlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    const uint8_t *payload = block + sizeof(header);
+    const uint8_t *data = payload + (header.quantity + 1) * sizeof(uint32_t);
+    int rows = header.rows;
+    size_t base = times_us.size();
+    // the rows before the range are decoded and dropped, the ones after it are not decoded at all
+    int first_row = rows;
+    int end_row = rows;
+    BitReader times_reader(data);
+    uint64_t time_us = header.first_us;
+    int64_t delta = 0;
+    for (int row = 0; row < rows; ++row) {
+        if (row > 0) {
+            int64_t dod;
+            if (times_reader.read(1) == 0) {
+                dod = 0;
+            } else if (times_reader.read(1) == 0) {
+                dod = times_reader.readSigned(8);
+            } else if (times_reader.read(1) == 0) {
+                dod = times_reader.readSigned(14);
+            } else if (times_reader.read(1) == 0) {
+                dod = times_reader.readSigned(24);
+            } else {
+                dod = int64_t(times_reader.read(64));
+            }
+            delta += dod;
+            time_us += delta;
+        }
+        if (time_us < begin_us) {
+            continue;
+        }
+        if (time_us > end_us) {
+            end_row = row;
+            break;
+        }
+        if (first_row == rows) {
+            first_row = row;
+        }
+        times_us.push_back(time_us);
+    }
+    if (first_row >= end_row) {
+        return;
+    }
+    words.resize((base + end_row - first_row) * count);
+    for (int i = 0; i < count; ++i) {
+        uint32_t start = 0;
+        memcpy(&start, payload + (column + i) * sizeof(uint32_t), sizeof(start));
+        BitReader reader(data + start);
+        uint16_t value = uint16_t(reader.read(16));
+        int leading = 0;
+        int trailing = 0;
+        for (int row = 0; row < end_row; ++row) {
+            if (row > 0 && reader.read(1) == 1) {
+                if (reader.read(1) == 1) {
+                    leading = int(reader.read(4));
+                    trailing = 16 - leading - int(reader.read(4)) - 1;
+                }
+                value ^= uint16_t(reader.read(16 - leading - trailing) << trailing);
+            }
+            if (row >= first_row) {
+                words[(base + row - first_row) * count + i] = value;
+            }
+        }
+    }
+}
+
+uint32_t HistorianStore::header_crc(const BlockHeader &header) {
+    return crc32(&header, offsetof(BlockHeader, header_crc));
+}
+
+bool HistorianStore::map_segment(Segment &segment) {
+    if (segment.region && segment.region->get_size() >= segment.size) {
+        return true;
+    }
+    try {
+        if (!segment.mapping) {
+            segment.mapping.reset(
+                new boost::interprocess::file_mapping(segment.path.c_str(), boost::interprocess::read_only));
+        }
+        // the segment being written grows, its mapping is renewed when a query needs the newer blocks
+        segment.region.reset(new boost::interprocess::mapped_region(*segment.mapping, boost::interprocess::read_only,
+                                                                    0, segment.size));
+    } catch (const boost::interprocess::interprocess_exception &e) {
+        LogWarn("can not map history segment {}: {}", segment.path, e.what());
+        segment.region.reset();
+        return false;
+    }
+    return true;
+}
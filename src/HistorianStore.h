@@ -0,0 +1,153 @@
+#ifndef HISTORIANSTORE_H
+#define HISTORIANSTORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a segment is sealed with its index and a new one started beyond this size
+#define HISTORIAN_SEGMENT_MAX_BYTES (256u << 20)
+
+// the registers a block holds, stable across sessions unlike the table it was read into
+struct HistorianKey {
+    uint8_t id{0};
+    uint8_t function{0};
+    uint16_t reg_addr{0};
+    uint16_t quantity{0};
+};
+
+namespace boost {
+namespace interprocess {
+class file_mapping;
+class mapped_region;
+} // namespace interprocess
+} // namespace boost
+
+// spills the sealed chunks of the historian to append-only segment files, one block per chunk. a block stores its
+// timestamps as gorilla style delta of deltas and every register as its own column of xor deltas against the
+// previous value, so a register that does not change costs one bit per row. a sealed segment ends with an index of
+// its blocks (time range and registers of each), the index of a segment that was not sealed, after a crash, is
+// rebuilt by walking the blocks up to the first one whose checksum fails, the rest is cut off. queries map the
+// segments and decode only the blocks and columns they need. blocks are written by a thread of their own
+class HistorianStore {
+  public:
+    HistorianStore();
+
+    ~HistorianStore();
+
+    HistorianStore(const HistorianStore &) = delete;
+    HistorianStore &operator=(const HistorianStore &) = delete;
+
+    // reads the segments already in directory, creating it when needed, and starts a new segment
+    bool open(const std::string &directory);
+
+    // writes the queued blocks and seals the current segment
+    void close();
+
+    bool isOpen() const { return m_open; }
+
+    // rows of key.quantity words each, queued for the writer thread
+    void push(const HistorianKey &key, std::vector<uint64_t> times_us, std::vector<uint16_t> words);
+
+    // the rows within [begin_us, end_us] of the registers [reg_addr, reg_addr + count) of a slave, from every block
+    // that holds all of them, in time order. words gets count values per row. returns the number of rows
+    size_t query(uint8_t id, uint8_t function, uint16_t reg_addr, int count, uint64_t begin_us, uint64_t end_us,
+                 std::vector<uint64_t> &times_us, std::vector<uint16_t> &words);
+
+    size_t diskBytes();
+
+  private:
+    // stored in host byte order, like the rest of the segment
+    struct BlockHeader {
+        uint64_t first_us;
+        uint64_t last_us;
+        char magic[4];
+        uint32_t payload_bytes;
+        uint32_t payload_crc;
+        uint16_t rows;
+        uint16_t reg_addr;
+        uint16_t quantity;
+        uint8_t id;
+        uint8_t function;
+        // of the fields above
+        uint32_t header_crc;
+    };
+
+    struct IndexEntry {
+        uint64_t first_us;
+        uint64_t last_us;
+        uint64_t offset;
+        uint16_t reg_addr;
+        uint16_t quantity;
+        uint8_t id;
+        uint8_t function;
+        uint16_t rows;
+    };
+
+    struct FooterTail {
+        uint64_t index_offset;
+        uint32_t count;
+        uint32_t crc;
+        char magic[8];
+    };
+
+    struct Segment {
+        std::string path;
+        std::vector<IndexEntry> index;
+        uint64_t size{0};
+        std::unique_ptr<boost::interprocess::file_mapping> mapping;
+        std::unique_ptr<boost::interprocess::mapped_region> region;
+        ~Segment();
+    };
+
+    struct PendingBlock {
+        HistorianKey key;
+        std::vector<uint64_t> times_us;
+        std::vector<uint16_t> words;
+    };
+
+    void run();
+
+    // opens the segment, from its footer or by walking its blocks
+    bool load_segment(const std::string &path);
+
+    bool start_segment();
+
+    void seal_segment();
+
+    void write_block(const PendingBlock &block);
+
+    static void encode(const PendingBlock &block, std::vector<uint8_t> &payload);
+
+    // decodes the rows of the block within the time range, columns [column, column + count)
+    static void decode(const uint8_t *block, int column, int count, uint64_t begin_us, uint64_t end_us,
+                       std::vector<uint64_t> &times_us, std::vector<uint16_t> &words);
+
+    static uint32_t header_crc(const BlockHeader &header);
+
+    // maps the bytes written so far, false when the file can not be mapped
+    bool map_segment(Segment &segment);
+
+  private:
+    std::atomic<bool> m_open;
+    std::string m_directory;
+    std::thread m_thread;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::deque<PendingBlock> m_queue;
+    // guards the segments and their indices, taken by the writer after a block is on disk
+    std::mutex m_index_mutex;
+    std::vector<std::unique_ptr<Segment>> m_segments;
+    // the segment being appended, always the last one, only touched by the writer thread
+    FILE *m_file;
+    std::vector<uint8_t> m_payload;
+};
+
+#endif // HISTORIANSTORE_H
@@ -30,3 +30,24 @@ namespace ImGui{
         return ret;
     }
 }
+
+void render_combo_box(ComboBoxData &combo_box_data, const char *combo_box_label, const char **items, int start, int end)
+{
+    combo_box_data.text = items[combo_box_data.index];
+    if (ImGui::BeginCombo(combo_box_label, combo_box_data.text))
+    {
+        for (int i = start; i <= end; ++i)
+        {
+            combo_box_data.item_selected = (i == combo_box_data.index);
+            if (ImGui::Selectable(items[i], &combo_box_data.item_selected))
+            {
+                combo_box_data.index = i;
+            }
+            if (combo_box_data.item_selected)
+            {
+                ImGui::SetItemDefaultFocus();
+            }
+        }
+        ImGui::EndCombo();
+    }
+}
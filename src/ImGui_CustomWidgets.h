@@ -3,8 +3,12 @@
 
 
 #include "imgui_internal.h"
+#include "utils.h"
 
 namespace ImGui{
     bool SelectableInput(const char* str_id, bool selected, ImGuiSelectableFlags flags, char* buf, size_t buf_size);
 }
+
+void render_combo_box(ComboBoxData &combo_box_data, const char *combo_box_label, const char **items, int start,
+                      int end);
 #endif // __IMGUI_CUSTOMWIDGETS_H__
\ No newline at end of file
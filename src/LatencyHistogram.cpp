@@ -0,0 +1,84 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+void LatencyHistogram::record(uint64_t value_us) {
+    if (value_us > UINT32_MAX) {
+        value_us = UINT32_MAX;
+    }
+    m_counts[bucketIndex(value_us)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value_us, std::memory_order_relaxed);
+    if (value_us > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(uint32_t(value_us), std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto &count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    m_total.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t total = count();
+    return total ? double(m_sum.load(std::memory_order_relaxed)) / total : 0;
+}
+
+uint32_t LatencyHistogram::percentile(double percent) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = uint64_t(percent / 100.0 * total + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        seen += bucketCount(i);
+        if (seen >= target) {
+            // the bucket's upper end overstates the largest sample when it is the last one
+            uint32_t highest = bucketHighest(i);
+            return highest < max() ? highest : max();
+        }
+    }
+    return max();
+}
+
+int LatencyHistogram::bucketIndex(uint64_t value_us) {
+    if (value_us < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return int(value_us);
+    }
+    int shift = 1;
+    while ((value_us >> shift) >= LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        shift++;
+    }
+    // value >> shift is within [HALF, SUB)
+    return LATENCY_HISTOGRAM_SUB_BUCKETS + (shift - 1) * LATENCY_HISTOGRAM_HALF_BUCKETS +
+           int(value_us >> shift) - LATENCY_HISTOGRAM_HALF_BUCKETS;
+}
+
+uint32_t LatencyHistogram::bucketLowest(int index) {
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return uint32_t(index);
+    }
+    int shift = (index - LATENCY_HISTOGRAM_SUB_BUCKETS) / LATENCY_HISTOGRAM_HALF_BUCKETS + 1;
+    uint64_t sub =
+        (index - LATENCY_HISTOGRAM_SUB_BUCKETS) % LATENCY_HISTOGRAM_HALF_BUCKETS + LATENCY_HISTOGRAM_HALF_BUCKETS;
+    return uint32_t(sub << shift);
+}
+
+uint32_t LatencyHistogram::bucketHighest(int index) {
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return uint32_t(index);
+    }
+    int shift = (index - LATENCY_HISTOGRAM_SUB_BUCKETS) / LATENCY_HISTOGRAM_HALF_BUCKETS + 1;
+    uint64_t sub =
+        (index - LATENCY_HISTOGRAM_SUB_BUCKETS) % LATENCY_HISTOGRAM_HALF_BUCKETS + LATENCY_HISTOGRAM_HALF_BUCKETS;
+    uint64_t highest = ((sub + 1) << shift) - 1;
+    return highest > UINT32_MAX ? UINT32_MAX : uint32_t(highest);
+}
@@ -0,0 +1,49 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// values below this are counted exactly, above it every power of two is split into half as many linear buckets,
+// which keeps the relative error of a reported percentile below 1/32
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 64
+#define LATENCY_HISTOGRAM_HALF_BUCKETS (LATENCY_HISTOGRAM_SUB_BUCKETS / 2)
+// values are microseconds, up to 2^32 us (about 71 minutes)
+#define LATENCY_HISTOGRAM_BUCKETS (LATENCY_HISTOGRAM_SUB_BUCKETS + 26 * LATENCY_HISTOGRAM_HALF_BUCKETS)
+
+// fixed size hdr style histogram of round trip times, one thread records while the ui thread reads
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void record(uint64_t value_us);
+
+    void reset();
+
+    uint64_t count() const { return m_total.load(std::memory_order_relaxed); }
+
+    uint32_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    double mean() const;
+
+    // highest value of the bucket that holds the given percentile, 0 when empty
+    uint32_t percentile(double percent) const;
+
+    uint32_t bucketCount(int index) const { return m_counts[index].load(std::memory_order_relaxed); }
+
+    // lowest value counted in a bucket
+    static uint32_t bucketLowest(int index);
+
+    static uint32_t bucketHighest(int index);
+
+    static int bucketIndex(uint64_t value_us);
+
+  private:
+    std::atomic<uint32_t> m_counts[LATENCY_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint32_t> m_max;
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,6 +1,9 @@
 #include "MainWindow.h"
+#include "AllocationCounter.h"
+#include "ImGui_CustomWidgets.h"
 #include "ModbusFrameInfo.h"
 #include "ModbusWindow.h"
+#include "RenderLoop.h"
 #include "MySerialPort.h"
 #include "implot.h"
 #include "modbus_ascii.h"
@@ -17,55 +20,74 @@
 #include <libintl.h>
 #include <unordered_map>
 
-const char *protocols[] = {"Modbus UDP", "Modbus RTU", "Modbus ASCII", "Modbus TCP"};
+static const Option<itas109::BaudRate> baud_rate_options[] = {
+    {"1200", itas109::BaudRate1200},   {"2400", itas109::BaudRate2400},   {"4800", itas109::BaudRate4800},
+    {"9600", itas109::BaudRate9600},   {"19200", itas109::BaudRate19200}, {"38400", itas109::BaudRate38400},
+    {"57600", itas109::BaudRate57600}, {"115200", itas109::BaudRate115200}};
 
-MainWindow::MainWindow(bool *should_close) {
+static const Option<itas109::DataBits> data_bits_options[] = {
+    {"5", itas109::DataBits5}, {"6", itas109::DataBits6}, {"7", itas109::DataBits7}, {"8", itas109::DataBits8}};
+
+static const Option<itas109::StopBits> stop_bits_options[] = {
+    {"1", itas109::StopOne}, {"1.5", itas109::StopOneAndHalf}, {"2", itas109::StopTwo}};
+
+static const Option<itas109::Parity> parity_options[] = {
+    {N_("None"), itas109::ParityNone}, {N_("Odd"), itas109::ParityOdd}, {N_("Even"), itas109::ParityEven}};
+
+static const Option<itas109::FlowControl> flow_control_options[] = {{N_("None"), itas109::FlowNone},
+                                                                    {N_("Hardware"), itas109::FlowHardware},
+                                                                    {N_("Software"), itas109::FlowSoftware}};
+
+static const Option<ModbusIdentifier> identifier_options[] = {{N_("Modbus Master"), ModbusMaster},
+                                                              {N_("Modbus Slave"), ModbusSlave}};
+
+// the routes show a contiguous range of this table, see render()
+static const Option<Protocols> protocol_options[] = {
+    {"Modbus UDP", MODBUS_UDP}, {"Modbus RTU", MODBUS_RTU}, {"Modbus ASCII", MODBUS_ASCII}, {"Modbus TCP", MODBUS_TCP}};
+
+MainWindow::MainWindow(bool *should_close)
+    : m_baud_rate_options(baud_rate_options), m_data_bits_options(data_bits_options),
+      m_stop_bits_options(stop_bits_options), m_parity_options(parity_options),
+      m_flow_control_options(flow_control_options), m_identifier_options(identifier_options),
+      m_protocol_options(protocol_options) {
     m_tcp_server_port = 19980;
+    m_serial_port_generation = 0;
+    m_serial_port_discovery.setChangedCallback(
+        [](std::shared_ptr<const SerialPortSnapshot>) { requestRedraw(0); });
+    m_serial_port_discovery.start();
     memset(m_tcp_client_addr, 0, sizeof(m_tcp_client_addr));
     m_tcp_client_remote_port = 19980;
     memset(m_udp_addr, 0, sizeof(m_udp_addr));
     m_udp_port = 19980;
     m_route_type = RouteType_SerialPort;
     m_should_close = should_close;
-    baud_rate_map = {{"1200", itas109::BaudRate1200},   {"2400", itas109::BaudRate2400},
-                     {"4800", itas109::BaudRate4800},   {"9600", itas109::BaudRate9600},
-                     {"19200", itas109::BaudRate19200}, {"38400", itas109::BaudRate38400},
-                     {"57600", itas109::BaudRate57600}, {"115200", itas109::BaudRate115200}};
-
-    data_bits_map = {
-        {"5", itas109::DataBits5}, {"6", itas109::DataBits6}, {"7", itas109::DataBits7}, {"8", itas109::DataBits8}};
-
-    stop_bits_map = {{"1", itas109::StopOne}, {"1.5", itas109::StopOneAndHalf}, {"2", itas109::StopTwo}};
-
-    parity_map = {{gettext("None"), itas109::ParityNone},
-                  {gettext("Odd"), itas109::ParityOdd},
-                  {gettext("Even"), itas109::ParityEven}};
-
-    flow_control_map = {{gettext("None"), itas109::FlowNone},
-                        {gettext("Hardware"), itas109::FlowHardware},
-                        {gettext("Software"), itas109::FlowSoftware}};
-
-    identifier_map = {{gettext("Modbus Master"), ModbusMaster}, {gettext("Modbus Slave"), ModbusSlave}};
-    modbus_map = {{"Modbus UDP", new Modbus_TCP()},
-                  {"Modbus TCP", new Modbus_TCP()},
-                  {"Modbus RTU", new Modbus_RTU()},
-                  {"Modbus ASCII", new Modbus_ASCII()}};
-    protocol_map = {{"Modbus UDP", MODBUS_UDP},
-                    {"Modbus TCP", MODBUS_TCP},
-                    {"MODBUS ASCII", MODBUS_ASCII},
-                    {"MODBUS RTU", MODBUS_RTU}};
+    m_modbus_codecs[MODBUS_RTU] = new Modbus_RTU();
+    m_modbus_codecs[MODBUS_ASCII] = new Modbus_ASCII();
+    m_modbus_codecs[MODBUS_TCP] = new Modbus_TCP();
+    m_modbus_codecs[MODBUS_UDP] = new Modbus_TCP();
+#ifdef DMP_COUNT_ALLOCATIONS
+    m_last_allocation_count = threadAllocationCount();
+    m_frame_allocations = 0;
+#endif
 }
 
 MainWindow::~MainWindow() {
+    m_serial_port_discovery.stop();
     for (auto iter = m_modbus_windows.begin(); iter != m_modbus_windows.end(); ++iter) {
         delete *iter;
     }
-    for (auto iter = modbus_map.begin(); iter != modbus_map.end(); ++iter) {
-        delete iter->second;
+    for (ModbusBase *modbus : m_modbus_codecs) {
+        delete modbus;
     }
 }
 
 void MainWindow::render() {
+#ifdef DMP_COUNT_ALLOCATIONS
+    // everything the ui thread allocated since the previous frame started
+    uint64_t allocation_count = threadAllocationCount();
+    m_frame_allocations = allocation_count - m_last_allocation_count;
+    m_last_allocation_count = allocation_count;
+#endif
     ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
     static bool open = true;
     if (!open) {
@@ -94,9 +116,17 @@ void MainWindow::render() {
             break;
         }
         }
-        render_combo_box(m_protocol_combo_box_data, gettext("Protocol"), protocols, protocol_start, protocol_end);
-        render_combo_box(m_identifier_combo_box_data, gettext("Identify"),
-                         (const char **)getKeysOfMap(identifier_map).data(), 0, 1);
+        render_combo_box(m_protocol_combo_box_data, gettext("Protocol"), m_protocol_options.labels(), protocol_start,
+                         protocol_end);
+        render_combo_box(m_identifier_combo_box_data, gettext("Identify"), m_identifier_options.labels(), 0,
+                         m_identifier_options.last());
+        RenderLoopStats render_stats = renderLoopStats();
+        ImGui::TextDisabled("%.1f fps, %.1f%% cpu", render_stats.frames_per_second, render_stats.cpu_percent);
+        ImGui::TextDisabled("first frame %.0f ms, font atlas %d glyphs in %.1f ms", render_stats.first_frame_ms,
+                            render_stats.atlas_glyphs, render_stats.atlas_build_ms);
+#ifdef DMP_COUNT_ALLOCATIONS
+        ImGui::TextDisabled("%s %llu", gettext("Allocations per frame:"), (unsigned long long)m_frame_allocations);
+#endif
         render_serial_port_route();
         render_tcp_server_route();
         render_tcp_client_route();
@@ -112,6 +142,8 @@ void MainWindow::render() {
             iter = m_modbus_windows.erase(iter);
         }
     }
+    // after the windows, a trace removed this frame is forgotten by its window in the next one
+    m_plot_workspace.render();
 }
 
 void MainWindow::render_serial_port_route() {
@@ -123,38 +155,51 @@ void MainWindow::render_serial_port_route() {
     }
     m_route_type = RouteType_SerialPort;
     using namespace itas109;
-    std::vector<SerialPortInfo> serial_port_info_list = CSerialPortInfo::availablePortInfos();
-    const char **serial_port_name_list = new const char *[serial_port_info_list.size()];
-    for (int i = 0; i < serial_port_info_list.size(); ++i) {
-        serial_port_name_list[i] = serial_port_info_list[i].portName;
-    }
-    render_combo_box(m_serial_port_name_combo_box_data, gettext("Port Name"), serial_port_name_list, 0,
-                     serial_port_info_list.size() - 1);
-    render_combo_box(m_serial_port_baud_rate_combo_box_data, gettext("Baud Rate"), getKeysOfMap(baud_rate_map).data(),
-                     0, baud_rate_map.size() - 1);
-    render_combo_box(m_serial_port_data_bits_combo_box_data, gettext("Data Bits"), getKeysOfMap(data_bits_map).data(),
-                     0, data_bits_map.size() - 1);
-    render_combo_box(m_serial_port_stop_bits_combo_box_data, gettext("Stop Bits"), getKeysOfMap(stop_bits_map).data(),
-                     0, stop_bits_map.size() - 1);
-    render_combo_box(m_serial_port_parity_combo_box_data, gettext("Parity"), getKeysOfMap(parity_map).data(), 0,
-                     parity_map.size() - 1);
+    std::shared_ptr<const SerialPortSnapshot> serial_ports = m_serial_port_discovery.snapshot();
+    if (serial_ports->generation != m_serial_port_generation) {
+        m_serial_port_generation = serial_ports->generation;
+        m_serial_port_name_combo_box_data.index = 0;
+        for (size_t i = 0; i < serial_ports->names.size(); ++i) {
+            if (m_serial_port_name == serial_ports->names[i]) {
+                m_serial_port_name_combo_box_data.index = int(i);
+            }
+        }
+    }
+    if (serial_ports->names.empty()) {
+        m_serial_port_name_combo_box_data.text = nullptr;
+        ImGui::TextDisabled("%s", gettext("No serial port found"));
+    } else {
+        render_combo_box(m_serial_port_name_combo_box_data, gettext("Port Name"),
+                         (const char **)serial_ports->names.data(), 0, int(serial_ports->names.size()) - 1);
+        m_serial_port_name = m_serial_port_name_combo_box_data.text;
+    }
+    render_combo_box(m_serial_port_baud_rate_combo_box_data, gettext("Baud Rate"), m_baud_rate_options.labels(), 0,
+                     m_baud_rate_options.last());
+    render_combo_box(m_serial_port_data_bits_combo_box_data, gettext("Data Bits"), m_data_bits_options.labels(), 0,
+                     m_data_bits_options.last());
+    render_combo_box(m_serial_port_stop_bits_combo_box_data, gettext("Stop Bits"), m_stop_bits_options.labels(), 0,
+                     m_stop_bits_options.last());
+    render_combo_box(m_serial_port_parity_combo_box_data, gettext("Parity"), m_parity_options.labels(), 0,
+                     m_parity_options.last());
     render_combo_box(m_serial_port_flow_control_combo_box_data, gettext("Flow Control"),
-                     getKeysOfMap(flow_control_map).data(), 0, flow_control_map.size() - 1);
-    if (ImGui::Button(gettext("Open"), ImVec2(ImGui::GetWindowContentRegionMax().x - 50, 35))) {
+                     m_flow_control_options.labels(), 0, m_flow_control_options.last());
+    if (ImGui::Button(gettext("Open"), ImVec2(ImGui::GetWindowContentRegionMax().x - 50, 35)) &&
+        m_serial_port_name_combo_box_data.text) {
         CSerialPort *cserial_port = new CSerialPort();
         cserial_port->setPortName(m_serial_port_name_combo_box_data.text);
-        cserial_port->setBaudRate(baud_rate_map[m_serial_port_baud_rate_combo_box_data.text]);
-        cserial_port->setDataBits(data_bits_map[m_serial_port_data_bits_combo_box_data.text]);
-        cserial_port->setStopBits(stop_bits_map[m_serial_port_stop_bits_combo_box_data.text]);
-        cserial_port->setParity(parity_map[m_serial_port_parity_combo_box_data.text]);
-        cserial_port->setFlowControl(flow_control_map[m_serial_port_flow_control_combo_box_data.text]);
+        cserial_port->setBaudRate(m_baud_rate_options.value(m_serial_port_baud_rate_combo_box_data.index));
+        cserial_port->setDataBits(m_data_bits_options.value(m_serial_port_data_bits_combo_box_data.index));
+        cserial_port->setStopBits(m_stop_bits_options.value(m_serial_port_stop_bits_combo_box_data.index));
+        cserial_port->setParity(m_parity_options.value(m_serial_port_parity_combo_box_data.index));
+        cserial_port->setFlowControl(m_flow_control_options.value(m_serial_port_flow_control_combo_box_data.index));
         MySerialPort *serial_port = new MySerialPort(cserial_port);
+        Protocols protocol = m_protocol_options.value(m_protocol_combo_box_data.index);
         ModbusWindow *modbus_window = new ModbusWindow(
-            serial_port, m_serial_port_name_combo_box_data.text, identifier_map[m_identifier_combo_box_data.text],
-            protocol_map[m_protocol_combo_box_data.text], modbus_map[m_protocol_combo_box_data.text]);
+            serial_port, m_serial_port_name_combo_box_data.text,
+            m_identifier_options.value(m_identifier_combo_box_data.index), protocol, m_modbus_codecs[protocol],
+            &m_plot_workspace);
         m_modbus_windows.push_back(modbus_window);
     }
-    delete[] serial_port_name_list;
 }
 
 void MainWindow::render_tcp_server_route() {
@@ -168,8 +213,8 @@ void MainWindow::render_tcp_server_route() {
     ImGui::InputInt(gettext("Port"), &m_tcp_server_port, 1, 100);
     if (ImGui::Button(gettext("Listen"), ImVec2(ImGui::GetWindowContentRegionMax().x - 50, 35))) {
         MyTcpSocket *tcp_server = new MyTcpSocket();
-        m_tcp_server_identifier_map[tcp_server] = identifier_map[m_identifier_combo_box_data.text];
-        m_tcp_server_protocol_map[tcp_server] = m_protocol_combo_box_data.text;
+        m_tcp_server_identifier_map[tcp_server] = m_identifier_options.value(m_identifier_combo_box_data.index);
+        m_tcp_server_protocol_map[tcp_server] = m_protocol_options.value(m_protocol_combo_box_data.index);
         tcp_server->bind(m_tcp_server_port);
         tcp_server->setNewConnectionCallback(
             std::bind(&MainWindow::tcp_new_connection_callback, this, std::placeholders::_1, std::placeholders::_2));
@@ -208,18 +253,20 @@ void MainWindow::render_udp_route() {
         MyUdpSocket *udp_socket = new MyUdpSocket();
         bool socket_create_successed = false;
         char window_name[128];
-        if (identifier_map[m_identifier_combo_box_data.text] == ModbusMaster) {
+        ModbusIdentifier identifier = m_identifier_options.value(m_identifier_combo_box_data.index);
+        if (identifier == ModbusMaster) {
             socket_create_successed = udp_socket->connectTo(m_udp_addr, m_udp_port);
             snprintf(window_name, sizeof(window_name), "UDP %s:%u", m_udp_addr, m_udp_port);
-        } else if (identifier_map[m_identifier_combo_box_data.text] == ModbusSlave) {
+        } else if (identifier == ModbusSlave) {
             socket_create_successed = udp_socket->bind(m_udp_port);
             snprintf(window_name, sizeof(window_name), "UDP localhost:%u", m_udp_port);
         }
         if (socket_create_successed) {
             udp_socket->setErrorCallback(std::bind(&MainWindow::error_callback, this, std::placeholders::_1));
-            ModbusWindow *modbus_window = new ModbusWindow(
-                udp_socket, window_name, identifier_map[m_identifier_combo_box_data.text],
-                protocol_map[m_protocol_combo_box_data.text], modbus_map[m_protocol_combo_box_data.text]);
+            Protocols protocol = m_protocol_options.value(m_protocol_combo_box_data.index);
+            ModbusWindow *modbus_window =
+                new ModbusWindow(udp_socket, window_name, identifier, protocol, m_modbus_codecs[protocol],
+                                 &m_plot_workspace);
             m_modbus_windows.push_back(modbus_window);
         }
     }
@@ -230,10 +277,11 @@ void MainWindow::error_callback(const char *msg) { LogError(msg); }
 void MainWindow::tcp_new_connection_callback(MyTcpSocket *socket, MyTcpSocket *server) {
     char window_name[128];
     snprintf(window_name, sizeof(window_name), "%s:%u", socket->peerAddress(), socket->peerPort());
-    ModbusWindow *modbus_window = new ModbusWindow(socket, window_name, m_tcp_server_identifier_map[server],
-                                                   protocol_map[m_tcp_server_protocol_map[server]],
-                                                   modbus_map[m_tcp_server_protocol_map[server]]);
+    Protocols protocol = m_tcp_server_protocol_map[server];
+    ModbusWindow *modbus_window = new ModbusWindow(socket, window_name, m_tcp_server_identifier_map[server], protocol,
+                                                   m_modbus_codecs[protocol], &m_plot_workspace);
     m_modbus_windows.push_back(modbus_window);
+    requestRedraw(0);
 }
 
 void MainWindow::tcp_connected_callback(bool connected) {
@@ -241,9 +289,11 @@ void MainWindow::tcp_connected_callback(bool connected) {
         char window_name[128];
         snprintf(window_name, sizeof(window_name), "%s:%u", m_connecting_client->peerAddress(),
                  m_connecting_client->peerPort());
+        Protocols protocol = m_protocol_options.value(m_protocol_combo_box_data.index);
         ModbusWindow *modbus_window =
-            new ModbusWindow(m_connecting_client, window_name, ModbusMaster,
-                             protocol_map[m_protocol_combo_box_data.text], modbus_map[m_protocol_combo_box_data.text]);
+            new ModbusWindow(m_connecting_client, window_name, ModbusMaster, protocol, m_modbus_codecs[protocol],
+                             &m_plot_workspace);
         m_modbus_windows.push_back(modbus_window);
     }
+    requestRedraw(0);
 }
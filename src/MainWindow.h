@@ -8,6 +8,10 @@
 #include "utils.h"
 #include "ModbusFrameInfo.h"
 #include "ModbusBase.h"
+#include "SerialPortDiscovery.h"
+#include "OptionTable.h"
+#include "PlotWorkspace.h"
+#include <string>
 
 class MyTcpSocket;
 
@@ -56,18 +60,29 @@ private:
     int m_udp_port;
     RouteType m_route_type;
     bool *m_should_close;
-    std::unordered_map<const char *, itas109::BaudRate> baud_rate_map;
-    std::unordered_map<const char *, itas109::DataBits> data_bits_map;
-    std::unordered_map<const char *, itas109::StopBits> stop_bits_map;
-    std::unordered_map<const char *, itas109::Parity> parity_map;
-    std::unordered_map<const char *, itas109::FlowControl> flow_control_map;
-    std::unordered_map<const char *, ModbusIdentifier> identifier_map;
-    std::unordered_map<const char *, ModbusBase *> modbus_map;
-    std::unordered_map<const char *, Protocols> protocol_map;
+    OptionTable<itas109::BaudRate> m_baud_rate_options;
+    OptionTable<itas109::DataBits> m_data_bits_options;
+    OptionTable<itas109::StopBits> m_stop_bits_options;
+    OptionTable<itas109::Parity> m_parity_options;
+    OptionTable<itas109::FlowControl> m_flow_control_options;
+    OptionTable<ModbusIdentifier> m_identifier_options;
+    OptionTable<Protocols> m_protocol_options;
+    // one codec per protocol, shared by the windows opened with it
+    ModbusBase *m_modbus_codecs[MODBUS_UDP + 1];
+    // the plots of every window, outlives them
+    PlotWorkspace m_plot_workspace;
     std::vector<ModbusWindow *> m_modbus_windows;
     std::unordered_map<MyTcpSocket *, ModbusIdentifier> m_tcp_server_identifier_map;
-    std::unordered_map<MyTcpSocket *, const char *> m_tcp_server_protocol_map;
+    std::unordered_map<MyTcpSocket *, Protocols> m_tcp_server_protocol_map;
     MyTcpSocket *m_connecting_client;
+    SerialPortDiscovery m_serial_port_discovery;
+    // the selected port is kept by name so it survives ports appearing or disappearing before it
+    std::string m_serial_port_name;
+    uint64_t m_serial_port_generation;
+#ifdef DMP_COUNT_ALLOCATIONS
+    uint64_t m_last_allocation_count;
+    uint64_t m_frame_allocations;
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "ModbusFrameInfo.h"
 #include <stdlib.h>
+#include <string.h>
 class ModbusBase
 {
 public:
@@ -13,6 +14,49 @@ public:
     virtual size_t masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buffer) = 0;
     virtual ModbusFrameInfo slavePack2Frame(const char *buffer, size_t buffer_size) = 0;
     virtual size_t slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buffer) = 0;
+    // decode the framing only, scratch must hold MODBUS_PDU_SCRATCH_SIZE bytes and is only used by ascii
+    virtual ModbusPduView pack2View(const char *buffer, size_t buffer_size, uint8_t *scratch) = 0;
+
+    ModbusRequestHeader requestHeader(const char *buffer, size_t buffer_size) {
+        uint8_t scratch[MODBUS_PDU_SCRATCH_SIZE];
+        ModbusPduView view = pack2View(buffer, buffer_size, scratch);
+        ModbusRequestHeader header;
+        header.trans_id = view.trans_id;
+        header.id = view.id;
+        header.function = view.function;
+        if (view.data_size >= 4) {
+            header.reg_addr = view.word(0);
+            header.quantity = view.word(2);
+        }
+        if (header.function == ModbusWriteSingleCoil || header.function == ModbusWriteSingleRegister ||
+            header.function == ModbusMaskWriteRegister) {
+            header.quantity = 1;
+        }
+        // the 08 function keeps its data in quantity so the echo can be matched
+        if (header.function == ModbusEncapsulatedInterface && view.data_size >= 3) {
+            header.reg_addr = view.data[1];
+            header.quantity = view.data[2];
+        }
+        return header;
+    }
+
+    // request of one chunk of a scan table, values are the chunk values (coils as 0/1) and unused by reads
+    size_t scanFrame2Pack(int id, int function, int reg_addr, int quantity, const uint16_t *values, char *buffer) {
+        ModbusFrameInfo frame_info{};
+        frame_info.id = id;
+        frame_info.function = function;
+        frame_info.reg_addr = reg_addr;
+        frame_info.quantity = quantity;
+        if (function == ModbusWriteSingleCoil || function == ModbusWriteMultipleCoils) {
+            for (int i = 0; i < quantity; ++i) {
+                frame_info.coils.set(i, values[i]);
+            }
+            frame_info.reg_values[0] = values[0] ? 0xFF00 : 0x0000;
+        } else if (function == ModbusWriteSingleRegister || function == ModbusWriteMultipleRegisters) {
+            memcpy(frame_info.reg_values, values, quantity * sizeof(uint16_t));
+        }
+        return masterFrame2Pack(frame_info, buffer);
+    }
 };
 
 #endif // MODBUSBASE_H
@@ -1,8 +1,20 @@
 #ifndef MODBUSFRAMEINFO_H
 #define MODBUSFRAMEINFO_H
 
+#include <stddef.h>
 #include <stdint.h>
-#define MODBUS_FRAME_MAX_REGISTERS 123
+// protocol limits of a single request, see the modbus application protocol specification
+#define MODBUS_MAX_READ_REGISTERS 125
+#define MODBUS_MAX_WRITE_REGISTERS 123
+#define MODBUS_MAX_READ_COILS 2000
+#define MODBUS_MAX_WRITE_COILS 1968
+#define MODBUS_MAX_RW_WRITE_REGISTERS 121
+// big enough to hold the binary form of any modbus adu, used to hex decode ascii packs
+#define MODBUS_PDU_SCRATCH_SIZE 260
+// bytes a pdu may carry after its function code
+#define MODBUS_MAX_PDU_DATA 252
+// mei type of the 43 function used for read device identification
+#define MODBUS_MEI_READ_DEVICE_ID 0x0E
 
 enum ModbusIdentifier{
     ModbusMaster,
@@ -23,8 +35,12 @@ enum ModbusFunctions{
     ModbusReadInputRegisters = 0x04,
     ModbusWriteSingleCoil = 0x05,
     ModbusWriteSingleRegister = 0x06,
+    ModbusDiagnostics = 0x08,
     ModbusWriteMultipleCoils = 0x0F,
     ModbusWriteMultipleRegisters = 0x10,
+    ModbusMaskWriteRegister = 0x16,
+    ModbusReadWriteMultipleRegisters = 0x17,
+    ModbusEncapsulatedInterface = 0x2B,
     ModbusCoilStatus = ModbusReadCoils,
     ModbusInputStatus = ModbusReadDescreteInputs,
     ModbusHoldingRegisters = ModbusReadHoldingRegisters,
@@ -32,6 +48,28 @@ enum ModbusFunctions{
     ModbusFunctionError = 0x80,
 };
 
+// sub-functions of the 08 function
+enum ModbusDiagnosticsSubFunctions{
+    ModbusDiagReturnQueryData = 0x00,
+    ModbusDiagClearCounters = 0x0A,
+    ModbusDiagBusMessageCount = 0x0B,
+    ModbusDiagBusCommErrorCount = 0x0C,
+    ModbusDiagBusExceptionErrorCount = 0x0D,
+    ModbusDiagSlaveMessageCount = 0x0E,
+    ModbusDiagSlaveNoResponseCount = 0x0F,
+};
+
+// read device id codes and objects of the 43/14 function
+enum ModbusDeviceIdentification{
+    ModbusDeviceIdBasicStream = 0x01,
+    ModbusDeviceIdRegularStream = 0x02,
+    ModbusDeviceIdExtendedStream = 0x03,
+    ModbusDeviceIdSpecificObject = 0x04,
+    ModbusDeviceIdVendorName = 0x00,
+    ModbusDeviceIdProductCode = 0x01,
+    ModbusDeviceIdMajorMinorRevision = 0x02,
+};
+
 enum ModbusErrorCode{
     ModbusErrorCode_Timeout = -1,
     ModbusErrorCode_OK = 0x00,
@@ -47,6 +85,55 @@ enum ModbusErrorCode{
     ModbusErrorCode_Gateway_Target_Device_Failed_To_Respond = 0x11,
 };
 
+// packed coils or discrete inputs, bit 0 of byte 0 is the first coil as on the wire
+struct ModbusCoils{
+    uint8_t bytes[(MODBUS_MAX_READ_COILS + 7) / 8]{0};
+
+    uint16_t get(int index) const
+    {
+        return bytes[index / 8] >> (index % 8) & 0x01;
+    }
+
+    void set(int index, uint16_t value)
+    {
+        if(value)
+        {
+            bytes[index / 8] |= uint8_t(1 << (index % 8));
+        }
+        else
+        {
+            bytes[index / 8] &= uint8_t(~(1 << (index % 8)));
+        }
+    }
+};
+
+// the largest quantity a single request of this function may carry
+inline int modbusMaxQuantity(int function)
+{
+    switch(function)
+    {
+    case ModbusReadCoils:
+    case ModbusReadDescreteInputs:
+        return MODBUS_MAX_READ_COILS;
+    case ModbusReadHoldingRegisters:
+    case ModbusReadInputRegisters:
+    case ModbusReadWriteMultipleRegisters:
+        return MODBUS_MAX_READ_REGISTERS;
+    case ModbusWriteMultipleCoils:
+        return MODBUS_MAX_WRITE_COILS;
+    case ModbusWriteMultipleRegisters:
+        return MODBUS_MAX_WRITE_REGISTERS;
+    default:
+        return 1;
+    }
+}
+
+// the read function whose data space a read function polls, the 23 function reads the holding registers as 03 does
+inline int modbusReadSpace(int function)
+{
+    return function == ModbusReadWriteMultipleRegisters ? ModbusReadHoldingRegisters : function;
+}
+
 struct ModbusFrameInfo{
     //tcp,udp transaction identifier
     uint16_t  trans_id{};
@@ -57,7 +144,18 @@ struct ModbusFrameInfo{
     //register or coil address
     int32_t reg_addr{};
     int32_t quantity{};
-    uint16_t reg_values[MODBUS_FRAME_MAX_REGISTERS]{0};
+    uint16_t reg_values[MODBUS_MAX_READ_REGISTERS]{0};
+    //coils of the 01, 02 and 15 functions
+    ModbusCoils coils{};
+    //write half of the 23 function, reg_addr and quantity describe its read half
+    int32_t write_reg_addr{};
+    int32_t write_quantity{};
+    uint16_t write_reg_values[MODBUS_MAX_RW_WRITE_REGISTERS]{0};
+    //08 function: reg_addr holds the sub-function and reg_values[0] the data
+    //43 function: reg_addr holds the mei type and read device id code, quantity the object id,
+    //mei_data is the response after the function code
+    uint8_t mei_data[MODBUS_MAX_PDU_DATA]{0};
+    int32_t mei_data_size{};
 
     char *toString() const
     {
@@ -70,4 +168,47 @@ struct ModbusFrameInfo{
     }
 };
 
+// read-only view of a received pack, data points into the receive buffer (or the scratch buffer for ascii)
+// and is only valid while that buffer is
+struct ModbusPduView {
+    //tcp,udp transaction identifier
+    uint16_t trans_id{};
+    int32_t id{};
+    int32_t function{};
+    //bytes after the function code, without crc/lrc
+    const uint8_t *data{nullptr};
+    size_t data_size{0};
+
+    uint16_t word(size_t offset) const { return uint16_t(data[offset]) << 8 | data[offset + 1]; }
+
+    //byte count field of the read responses
+    uint8_t byteCount() const { return data_size > 0 ? data[0] : 0; }
+
+    //number of complete registers of a read response
+    int regCount() const {
+        size_t byte_count = byteCount();
+        if (byte_count + 1 > data_size) {
+            byte_count = data_size > 0 ? data_size - 1 : 0;
+        }
+        return int(byte_count / 2);
+    }
+
+    //register of a read response, already converted from big-endian
+    uint16_t regValue(int index) const { return word(1 + 2 * index); }
+
+    //coil or discrete input of a read response
+    uint16_t coil(int index) const { return data[1 + index / 8] >> (index % 8) & 0x01; }
+
+    uint8_t exceptionCode() const { return data_size > 0 ? data[0] : 0; }
+};
+
+// the fields of a request needed to interpret its response, decoded once when the request is sent
+struct ModbusRequestHeader {
+    uint16_t trans_id{};
+    int32_t id{};
+    int32_t function{};
+    int32_t reg_addr{};
+    int32_t quantity{};
+};
+
 #endif // MODBUSFRAMEINFO_H
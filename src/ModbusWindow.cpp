@@ -3,7 +3,9 @@
 #include "MainWindow.h"
 #include "ModbusBase.h"
 #include "ModbusFrameInfo.h"
+#include "RenderLoop.h"
 #include "implot.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -13,78 +15,208 @@
 #include <libintl.h>
 #include <time.h>
 
+static const Option<ModbusFunctions> function_options[] = {
+    {N_("01 Read Coils (0x)"), ModbusReadCoils},
+    {N_("02 Read Descrete Inputs (1x)"), ModbusReadDescreteInputs},
+    {N_("03 Read Holding Registers (4x)"), ModbusReadHoldingRegisters},
+    {N_("04 Read Input Registers (3x)"), ModbusReadInputRegisters},
+    {N_("05 Write Single Coil"), ModbusWriteSingleCoil},
+    {N_("06 Write Single Register"), ModbusWriteSingleRegister},
+    {N_("15 Write Multiple Coils"), ModbusWriteMultipleCoils},
+    {N_("16 Write Multiple Registers"), ModbusWriteMultipleRegisters}};
+
+static const Option<ModbusErrorCode> error_code_options[] = {
+    {N_("Timeout Error"), ModbusErrorCode_Timeout},
+    {N_("Illegal Function"), ModbusErrorCode_Illegal_Function},
+    {N_("Illegal Data Address"), ModbusErrorCode_Illegal_Data_Address},
+    {N_("Illegal Data Value"), ModbusErrorCode_Illegal_Data_Value},
+    {N_("Slave Device Failure"), ModbusErrorCode_Slave_Device_Failure},
+    {N_("Acknowledge"), ModbusErrorCode_Acknowledge},
+    {N_("Slave Device Busy"), ModbusErrorCode_Slave_Device_Busy},
+    {N_("Negative Acknowledgment"), ModbusErrorCode_Negative_Acknowledgment},
+    {N_("Memory Parity Error"), ModbusErrorCode_Memory_Parity_Error},
+    {N_("Gateway Path Unavailable"), ModbusErrorCode_Gateway_Path_Unavailable},
+    {N_("Gateway Target Device Failed To Respond"), ModbusErrorCode_Gateway_Target_Device_Failed_To_Respond}};
+
+static const Option<ModbusErrorCode> error_comment_options[] = {
+    {N_("The slave did not reply within the specified time."), ModbusErrorCode_Timeout},
+    {N_("The function code received in the request is not an authorized action for the slave. The slave may be in "
+        "the wrong state to process a specific request."),
+     ModbusErrorCode_Illegal_Function},
+    {N_("The data address received by the slave is not an authorized address for the slave."),
+     ModbusErrorCode_Illegal_Data_Address},
+    {N_("The value in the request data field is not an authorized value for the slave."),
+     ModbusErrorCode_Illegal_Data_Value},
+    {N_("The slave fails to perform a requested action because of an unrecoverable error."),
+     ModbusErrorCode_Slave_Device_Failure},
+    {N_("The slave accepts the request but needs a long time to process it."), ModbusErrorCode_Acknowledge},
+    {N_("The slave is busy processing another command. The master must send the request once the slave is "
+        "available."),
+     ModbusErrorCode_Slave_Device_Busy},
+    {N_("The slave cannot perform the programming request sent by the master."),
+     ModbusErrorCode_Negative_Acknowledgment},
+    {N_("The slave detects a parity error in the memory when attempting to read extended memory."),
+     ModbusErrorCode_Memory_Parity_Error},
+    {N_("The gateway is overloaded or not correctly configured."), ModbusErrorCode_Gateway_Path_Unavailable},
+    {N_("The slave is not present on the network."), ModbusErrorCode_Gateway_Target_Device_Failed_To_Respond}};
+
+static const Option<ScanPriority> scan_priority_options[] = {
+    {N_("Critical"), ScanPriorityCritical},
+    {N_("Normal"), ScanPriorityNormal},
+    {N_("Background"), ScanPriorityBackground}};
+
+static const Option<AlarmKind> alarm_kind_options[] = {
+    {N_("High Limit"), AlarmHigh},
+    {N_("Low Limit"), AlarmLow},
+    {N_("Rate Of Change"), AlarmRateOfChange},
+    {N_("Stale Data"), AlarmStale},
+    {N_("Exception"), AlarmException}};
+
+static const char *alarm_event_names[] = {N_("Raised"), N_("Cleared"), N_("Acknowledged")};
+
+static const Option<ExportFormat> export_format_options[] = {
+    {N_("CSV"), ExportFormat_CSV},
+    {N_("JSON Lines"), ExportFormat_JSON},
+    {N_("Binary Columns"), ExportFormat_Binary}};
+
+static const Option<ExportSync> export_sync_options[] = {
+    {N_("None"), ExportSync_None},
+    {N_("Every Second"), ExportSync_Second},
+    {N_("Every Write"), ExportSync_Write}};
+
+// names of the formats in exported files, for tools reading them rather than for people
+static const char *export_format_name(CellFormat format) {
+    switch (format) {
+    case Format_Coil:
+        return "coil";
+    case Format_Signed:
+        return "int16";
+    case Format_Unsigned:
+        return "uint16";
+    case Format_Hex:
+        return "hex16";
+    case Format_Ascii_Hex:
+        return "ascii16";
+    case Format_Binary:
+        return "bin16";
+    case Format_32_Bit_Signed_Big_Endian:
+        return "int32_abcd";
+    case Format_32_Bit_Signed_Little_Endian:
+        return "int32_cdab";
+    case Format_32_Bit_Signed_Big_Endian_Byte_Swap:
+        return "int32_badc";
+    case Format_32_Bit_Signed_Little_Endian_Byte_Swap:
+        return "int32_dcba";
+    case Format_32_Bit_Unsigned_Big_Endian:
+        return "uint32_abcd";
+    case Format_32_Bit_Unsigned_Little_Endian:
+        return "uint32_cdab";
+    case Format_32_Bit_Unsigned_Big_Endian_Byte_Swap:
+        return "uint32_badc";
+    case Format_32_Bit_Unsigned_Little_Endian_Byte_Swap:
+        return "uint32_dcba";
+    case Format_32_Bit_Float_Big_Endian:
+        return "float_abcd";
+    case Format_32_Bit_Float_Little_Endian:
+        return "float_cdab";
+    case Format_32_Bit_Float_Big_Endian_Byte_Swap:
+        return "float_badc";
+    case Format_32_Bit_Float_Little_Endian_Byte_Swap:
+        return "float_dcba";
+    case Format_64_Bit_Signed_Big_Endian:
+        return "int64_abcdefgh";
+    case Format_64_Bit_Signed_Little_Endian:
+        return "int64_ghefcdab";
+    case Format_64_Bit_Signed_Big_Endian_Byte_Swap:
+        return "int64_badcfehg";
+    case Format_64_Bit_Signed_Little_Endian_Byte_Swap:
+        return "int64_hgfedcba";
+    case Format_64_Bit_Unsigned_Big_Endian:
+        return "uint64_abcdefgh";
+    case Format_64_Bit_Unsigned_Little_Endian:
+        return "uint64_ghefcdab";
+    case Format_64_Bit_Unsigned_Big_Endian_Byte_Swap:
+        return "uint64_badcfehg";
+    case Format_64_Bit_Unsigned_Little_Endian_Byte_Swap:
+        return "uint64_hgfedcba";
+    case Format_64_Bit_Float_Big_Endian:
+        return "double_abcdefgh";
+    case Format_64_Bit_Float_Little_Endian:
+        return "double_ghefcdab";
+    case Format_64_Bit_Float_Big_Endian_Byte_Swap:
+        return "double_badcfehg";
+    case Format_64_Bit_Float_Little_Endian_Byte_Swap:
+        return "double_hgfedcba";
+    default:
+        return "none";
+    }
+}
+
+static const Option<CellFormat> write_format_options[] = {
+    {N_("Signed"), Format_Signed},
+    {N_("Unsigned"), Format_Unsigned},
+    {N_("Long ABCD"), Format_32_Bit_Signed_Big_Endian},
+    {N_("Long CDAB"), Format_32_Bit_Signed_Little_Endian},
+    {N_("Long BADC"), Format_32_Bit_Signed_Big_Endian_Byte_Swap},
+    {N_("Long DCBA"), Format_32_Bit_Signed_Little_Endian_Byte_Swap},
+    {N_("Float ABCD"), Format_32_Bit_Float_Big_Endian},
+    {N_("Float CDAB"), Format_32_Bit_Float_Little_Endian},
+    {N_("Float BADC"), Format_32_Bit_Float_Big_Endian_Byte_Swap},
+    {N_("Float DCBA"), Format_32_Bit_Float_Little_Endian_Byte_Swap},
+    {N_("Double ABCDEFGH"), Format_64_Bit_Float_Big_Endian},
+    {N_("Double GHEFCDAB"), Format_64_Bit_Float_Little_Endian},
+    {N_("Double BADCFEHG"), Format_64_Bit_Float_Big_Endian_Byte_Swap},
+    {N_("Double HGFEDCBA"), Format_64_Bit_Float_Little_Endian_Byte_Swap}};
+
 ModbusWindow::ModbusWindow(MyIODevice *myIODevice, const char *window_name, ModbusIdentifier identifier,
-                           Protocols protocol, ModbusBase *modbus_base)
+                           Protocols protocol, ModbusBase *modbus_base, PlotWorkspace *plot_workspace)
     : m_myIODevice(myIODevice), m_visible(true), m_identifier(identifier), m_protocol(protocol),
       m_add_registers_dialog_visible(false), m_modify_registers_dialog_visible(false),
       m_communication_traffic_dialog_visible(false), m_error_counter_dialog_visible(false),
       m_timeout_setting_dialog_visible(false), m_modbus_function_05_dialog_visible(false),
       m_modbus_function_06_dialog_visible(false), m_modbus_function_15_dialog_visible(false),
-      m_modbus_function_16_dialog_visible(false), m_inplut_plot_reg_data_dialog_visible(false),
-      m_master_last_send_data(nullptr), m_modbus(modbus_base), m_trans_id(0), m_recv_timeout_ms(300),
+      m_modbus_function_16_dialog_visible(false), m_modbus_function_22_dialog_visible(false),
+      m_diagnostics_dialog_visible(false), m_latency_dialog_visible(false),
+      m_history_setting_dialog_visible(false), m_derived_channels_dialog_visible(false),
+      m_alarms_dialog_visible(false), m_export_setting_dialog_visible(false),
+      m_inplut_plot_reg_data_dialog_visible(false), m_register_write_packet(nullptr),
+      m_plot_workspace(plot_workspace), m_historian(size_t(HISTORIAN_DEFAULT_BUDGET_MB) << 20),
+      m_history_budget_mb(HISTORIAN_DEFAULT_BUDGET_MB), m_history_to_disk(false), m_alarm_journal(nullptr),
+      m_master_last_send_data(nullptr), m_modbus(modbus_base),
+      m_probe_timer_id(0), m_latency_selected(-1),
+      m_function_options(function_options), m_error_code_options(error_code_options),
+      m_error_comment_options(error_comment_options), m_write_format_options(write_format_options),
+      m_scan_priority_options(scan_priority_options), m_alarm_kind_options(alarm_kind_options),
+      m_export_format_options(export_format_options), m_export_sync_options(export_sync_options),
+      m_trans_id(0), m_recv_timeout_ms(300),
+      // a serial answer has no transaction id, one arriving after a short timeout would be taken for the next request
+      m_adaptive_timeout(protocol == MODBUS_TCP || protocol == MODBUS_UDP), m_min_recv_timeout_ms(50),
+      m_combine_read_write(false), m_max_redraw_rate(1000 / RENDER_DATA_INTERVAL_MS),
       m_last_selected_table_name(nullptr), m_tmp_recv_timeout_ms(m_recv_timeout_ms) {
     strcpy(m_window_name, window_name);
+    snprintf(m_history_directory, sizeof(m_history_directory), "history");
+    m_historian.setSealedCallback([this](const RegistersTableData *table, int offset, int quantity,
+                                         std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+        if (m_history_store.isOpen()) {
+            HistorianKey key{uint8_t(table->id), table->function, uint16_t(table->reg_start + offset),
+                             uint16_t(quantity)};
+            m_history_store.push(key, std::move(times_us), std::move(words));
+        }
+    });
+    m_alarms.setEventCallback([this](const AlarmEvent &event) { record_alarm_event(event); });
+    snprintf(m_export_options.directory, sizeof(m_export_options.directory), "export");
+    snprintf(m_export_options.prefix, sizeof(m_export_options.prefix), "modbus");
+    // called on the writer thread, the formatting touches no state of the window
+    m_exporter.setFormatter([this](int format, const uint16_t *words, char *text, int size) {
+        get_value_by_format(CellFormat(format), words, text, size);
+    });
+    m_add_reg_def_data.priority_combo_box_data.index = m_scan_priority_options.indexOf(ScanPriorityNormal);
+    for (auto &latency : m_slave_latency) {
+        latency = nullptr;
+    }
     // read call back, get the data then use modbus parse it
     m_myIODevice->setReadDataCallback(
         std::bind(&ModbusWindow::read_data_callback, this, std::placeholders::_1, std::placeholders::_2));
-    modbus_function_map = {{gettext("01 Read Coils (0x)"), ModbusReadCoils},
-                           {gettext("02 Read Descrete Inputs (1x)"), ModbusReadDescreteInputs},
-                           {gettext("03 Read Holding Registers (4x)"), ModbusReadHoldingRegisters},
-                           {gettext("04 Read Input Registers (3x)"), ModbusReadInputRegisters},
-                           {gettext("05 Write Single Coil"), ModbusWriteSingleCoil},
-                           {gettext("06 Write Single Register"), ModbusWriteSingleRegister},
-                           {gettext("15 Write Multiple Coils"), ModbusWriteMultipleCoils},
-                           {gettext("16 Write Multiple Registers"), ModbusWriteMultipleRegisters}};
-    modbus_slave_function_map = {{gettext("01 Read Coils (0x)"), ModbusReadCoils},
-                                 {gettext("02 Read Descrete Inputs (1x)"), ModbusReadDescreteInputs},
-                                 {gettext("03 Read Holding Registers (4x)"), ModbusReadHoldingRegisters},
-                                 {gettext("04 Read Input Registers (3x)"), ModbusReadInputRegisters}};
-    modbus_error_code_map = {
-        {ModbusErrorCode_Timeout, gettext("Timeout Error")},
-        {ModbusErrorCode_Illegal_Function, gettext("Illegal Function")},
-        {ModbusErrorCode_Illegal_Data_Address, gettext("Illegal Data Address")},
-        {ModbusErrorCode_Illegal_Data_Value, gettext("Illegal Data Value")},
-        {ModbusErrorCode_Slave_Device_Failure, gettext("Slave Device Failure")},
-        {ModbusErrorCode_Acknowledge, gettext("Acknowledge")},
-        {ModbusErrorCode_Slave_Device_Busy, gettext("Slave Device Busy")},
-        {ModbusErrorCode_Negative_Acknowledgment, gettext("Negative Acknowledgment")},
-        {ModbusErrorCode_Memory_Parity_Error, gettext("Memory Parity Error")},
-        {ModbusErrorCode_Gateway_Path_Unavailable, gettext("Gateway Path Unavailable")},
-        {ModbusErrorCode_Gateway_Target_Device_Failed_To_Respond, gettext("Gateway Target Device Failed To Respond")}};
-    modbus_error_code_comment_map = {
-        {ModbusErrorCode_Timeout, gettext("The slave did not reply within the specified time.")},
-        {ModbusErrorCode_Illegal_Function,
-         gettext("The function code received in the request is not an authorized action for the slave. The slave may "
-                 "be in the wrong state to process a specific request.")},
-        {ModbusErrorCode_Illegal_Data_Address,
-         gettext("The data address received by the slave is not an authorized address for the slave.")},
-        {ModbusErrorCode_Illegal_Data_Value,
-         gettext("The value in the request data field is not an authorized value for the slave.")},
-        {ModbusErrorCode_Slave_Device_Failure,
-         gettext("The slave fails to perform a requested action because of an unrecoverable error.")},
-        {ModbusErrorCode_Acknowledge, gettext("The slave accepts the request but needs a long time to process it.")},
-        {ModbusErrorCode_Slave_Device_Busy, gettext("The slave is busy processing another command. The master must "
-                                                    "send the request once the slave is available.")},
-        {ModbusErrorCode_Negative_Acknowledgment,
-         gettext("The slave cannot perform the programming request sent by the master.")},
-        {ModbusErrorCode_Memory_Parity_Error,
-         gettext("The slave detects a parity error in the memory when attempting to read extended memory.")},
-        {ModbusErrorCode_Gateway_Path_Unavailable, gettext("The gateway is overloaded or not correctly configured.")},
-        {ModbusErrorCode_Gateway_Target_Device_Failed_To_Respond, gettext("The slave is not present on the network.")}};
-    m_write_format_map = {{gettext("Signed"), Format_Signed},
-                          {gettext("Unsigned"), Format_Unsigned},
-                          {gettext("Long ABCD"), Format_32_Bit_Signed_Big_Endian},
-                          {gettext("Long CDAB"), Format_32_Bit_Signed_Little_Endian},
-                          {gettext("Long BADC"), Format_32_Bit_Signed_Big_Endian_Byte_Swap},
-                          {gettext("Long DCBA"), Format_32_Bit_Signed_Little_Endian_Byte_Swap},
-                          {gettext("Float ABCD"), Format_32_Bit_Float_Big_Endian},
-                          {gettext("Float CDAB"), Format_32_Bit_Float_Little_Endian},
-                          {gettext("Float BADC"), Format_32_Bit_Float_Big_Endian_Byte_Swap},
-                          {gettext("Float DCBA"), Format_32_Bit_Float_Little_Endian_Byte_Swap},
-                          {gettext("Double ABCDEFGH"), Format_64_Bit_Float_Big_Endian},
-                          {gettext("Double GHEFCDAB"), Format_64_Bit_Float_Little_Endian},
-                          {gettext("Double BADCFEHG"), Format_64_Bit_Float_Big_Endian_Byte_Swap},
-                          {gettext("Double HGFEDCBA"), Format_64_Bit_Float_Little_Endian_Byte_Swap}};
     // if this is a master, should have a cycle timer to scan the register values, the slave just receive and reply
     if (m_identifier == ModbusMaster) {
         m_scan_timer_id = SDL_AddTimer(1, Scan_timer_callback, this);
@@ -96,14 +228,22 @@ ModbusWindow::~ModbusWindow() {
     SDL_RemoveTimer(m_scan_timer_id);
     SDL_RemoveTimer(m_send_timer_id);
     SDL_RemoveTimer(m_recv_timer_id);
+    SDL_RemoveTimer(m_probe_timer_id);
     delete m_myIODevice;
     std::for_each(m_registers_table_datas.begin(), m_registers_table_datas.end(),
                   [](RegistersTableData *data) { delete data; });
-    std::for_each(m_cycle_list.begin(), m_cycle_list.end(), [](ModbusPacket *data) { delete data; });
     std::for_each(m_manual_list.begin(), m_manual_list.end(), [](ModbusPacket *data) { delete data; });
+    for (auto &latency : m_slave_latency) {
+        delete latency.load();
+    }
+    // the io device is gone, nothing appends anymore
+    m_historian.flush();
+    close_history_store();
+    m_exporter.stop();
 }
 
 void ModbusWindow::render() {
+    write_alarm_journal();
     ImGui::SetNextWindowSize(ImVec2(400, 700), ImGuiCond_FirstUseEver);
     if (ImGui::Begin(m_window_name, &m_visible, ImGuiWindowFlags_MenuBar)) {
         render_menu_bar();
@@ -137,10 +277,31 @@ void ModbusWindow::render() {
     if (m_modbus_function_16_dialog_visible) {
         render_modbus_function_16_dialog();
     }
+    if (m_modbus_function_22_dialog_visible) {
+        render_modbus_function_22_dialog();
+    }
+    if (m_diagnostics_dialog_visible) {
+        render_diagnostics_dialog();
+    }
+    if (m_latency_dialog_visible) {
+        render_latency_dialog();
+    }
+    if (m_history_setting_dialog_visible) {
+        render_history_setting_dialog();
+    }
+    if (m_export_setting_dialog_visible) {
+        render_export_setting_dialog();
+    }
+    if (m_derived_channels_dialog_visible) {
+        render_derived_channels_dialog();
+    }
+    if (m_alarms_dialog_visible) {
+        render_alarms_dialog();
+    }
     if (m_inplut_plot_reg_data_dialog_visible) {
         render_input_plot_reg_data_dialog();
     }
-    render_register_plots();
+    prune_register_plots();
 }
 
 void ModbusWindow::render_menu_bar() {
@@ -160,11 +321,19 @@ void ModbusWindow::render_master_menu() {
         ImGui::MenuItem(gettext("Modify registers"), nullptr, &m_modify_registers_dialog_visible);
         ImGui::MenuItem(gettext("Communication traffic"), nullptr, &m_communication_traffic_dialog_visible);
         ImGui::MenuItem(gettext("Error counter"), nullptr, &m_error_counter_dialog_visible);
+        ImGui::MenuItem(gettext("Diagnostics"), nullptr, &m_diagnostics_dialog_visible);
+        ImGui::MenuItem(gettext("Latency"), nullptr, &m_latency_dialog_visible);
+        ImGui::MenuItem(gettext("Derived channels"), nullptr, &m_derived_channels_dialog_visible);
+        ImGui::MenuItem(gettext("Alarms"), nullptr, &m_alarms_dialog_visible);
         ImGui::EndMenu();
     }
 
     if (ImGui::BeginMenu(gettext("Settings"))) {
         ImGui::MenuItem(gettext("Timeout Setting"), nullptr, &m_timeout_setting_dialog_visible);
+        ImGui::MenuItem(gettext("History Setting"), nullptr, &m_history_setting_dialog_visible);
+        ImGui::MenuItem(gettext("Export Setting"), nullptr, &m_export_setting_dialog_visible);
+        ImGui::MenuItem(gettext("Combine Write And Read (FC23)"), nullptr, &m_combine_read_write);
+        ImGui::SliderInt(gettext("Max Redraw Rate (fps)"), &m_max_redraw_rate, 1, 60);
         ImGui::EndMenu();
     }
 
@@ -173,6 +342,7 @@ void ModbusWindow::render_master_menu() {
         ImGui::MenuItem(gettext("06 : Write Single Register"), nullptr, &m_modbus_function_06_dialog_visible);
         ImGui::MenuItem(gettext("15 : Write Multiple Coils"), nullptr, &m_modbus_function_15_dialog_visible);
         ImGui::MenuItem(gettext("16 : Write Multiple Registers"), nullptr, &m_modbus_function_16_dialog_visible);
+        ImGui::MenuItem(gettext("22 : Mask Write Register"), nullptr, &m_modbus_function_22_dialog_visible);
         ImGui::EndMenu();
     }
 }
@@ -184,6 +354,11 @@ void ModbusWindow::render_slave_menu() {
         ImGui::MenuItem(gettext("Communication traffic"), nullptr, &m_communication_traffic_dialog_visible);
         ImGui::EndMenu();
     }
+
+    if (ImGui::BeginMenu(gettext("Settings"))) {
+        ImGui::SliderInt(gettext("Max Redraw Rate (fps)"), &m_max_redraw_rate, 1, 60);
+        ImGui::EndMenu();
+    }
 }
 
 void ModbusWindow::render_registers_tables() {
@@ -212,8 +387,18 @@ void ModbusWindow::render_registers_tables() {
                     ImGui::PopID();
                     ImGui::TableNextColumn();
 
-                    // show the value in the cell with the format
-                    get_value_by_format(x->cell_formats[i], &x->reg_values[i], value_str, sizeof(value_str));
+                    // show the value in the cell with the format, formatted again only when it changed
+                    CellText &cell_text = x->cell_texts[i];
+                    int width = std::min(cellFormatWidth(x->cell_formats[i]), x->reg_quantity - i);
+                    if (!cell_text.valid || cell_text.format != x->cell_formats[i] ||
+                        memcmp(cell_text.raw, &x->reg_values[i], width * sizeof(uint16_t)) != 0) {
+                        get_value_by_format(x->cell_formats[i], &x->reg_values[i], cell_text.text,
+                                            sizeof(cell_text.text));
+                        memcpy(cell_text.raw, &x->reg_values[i], width * sizeof(uint16_t));
+                        cell_text.format = x->cell_formats[i];
+                        cell_text.valid = true;
+                    }
+                    memcpy(value_str, cell_text.text, sizeof(value_str));
                     ImGui::PushID(i + x->reg_quantity);
                     if (ImGui::SelectableInput("##i", x->reg_values_selected[i], ImGuiSelectableFlags_None, value_str,
                                                sizeof(value_str))) {
@@ -405,14 +590,26 @@ void ModbusWindow::render_registers_tables() {
                             }
                             ImGui::EndMenu();
                         }
+                        if (m_identifier == ModbusMaster && ImGui::BeginMenu(gettext("Deadband"))) {
+                            if (ImGui::InputFloat(gettext("Absolute"), &x->deadband_abs[i])) {
+                                x->deadband_abs[i] = std::max(x->deadband_abs[i], 0.0f);
+                            }
+                            if (ImGui::InputFloat(gettext("Percent"), &x->deadband_pct[i])) {
+                                x->deadband_pct[i] = std::max(x->deadband_pct[i], 0.0f);
+                            }
+                            ImGui::SetItemTooltip("%s", gettext("Changes of the value smaller than both deadbands "
+                                                                "are not recorded or plotted, 0 turns one off. The "
+                                                                "value is the cell as the table formats it, a plot "
+                                                                "of it in another format is not thinned"));
+                            ImGui::EndMenu();
+                        }
                         if (m_identifier == ModbusMaster && ImGui::Button(gettext("Add to Plot"))) {
-                            std::vector<const char *> write_formats = getKeysOfMap(m_write_format_map);
                             m_input_plot_reg_data.format_combo_box_data.index =
-                                std::distance(write_formats.begin(),
-                                              std::find(write_formats.begin(), write_formats.end(),
-                                                        getKeyOfValueInMap(m_write_format_map, x->cell_formats[i])));
+                                std::max(m_write_format_options.indexOf(x->cell_formats[i]), 0);
                             strcpy(m_input_plot_reg_data.title, x->reg_alias[i]);
                             m_input_plot_reg_data.reg_addr = x->reg_start + i;
+                            m_input_plot_reg_data.table = x;
+                            m_input_plot_reg_data.channel = 0;
                             m_inplut_plot_reg_data_dialog_visible = true;
                         }
                         ImGui::EndPopup();
@@ -428,6 +625,23 @@ void ModbusWindow::render_registers_tables() {
         if ((*iter)->table_visible) {
             ++iter;
         } else {
+            m_bus_scheduler.removeTable(*iter);
+            m_write_combiner.removeTable(*iter);
+            m_historian.removeTable(*iter);
+            m_exporter.removeTable(*iter);
+            for (auto &plot : m_plot_register_datas) {
+                if (plot.table == *iter) {
+                    plot.table = nullptr;
+                }
+            }
+            if (m_input_plot_reg_data.table == *iter) {
+                m_input_plot_reg_data.table = nullptr;
+            }
+            for (auto &write : m_register_writes) {
+                if (write.table == *iter) {
+                    write.table = nullptr;
+                }
+            }
             delete *iter;
             iter = m_registers_table_datas.erase(iter);
         }
@@ -593,6 +807,72 @@ void ModbusWindow::get_value_by_format(CellFormat format, const uint16_t *value_
     }
 }
 
+double ModbusWindow::get_double_by_format(CellFormat format, const uint16_t *value_ptr) {
+    switch (format) {
+    case Format_None:
+        return 0;
+    case Format_Coil:
+        return *value_ptr ? 1 : 0;
+    case Format_Signed:
+        return int16_t(*value_ptr);
+    case Format_Unsigned:
+    case Format_Hex:
+    case Format_Ascii_Hex:
+    case Format_Binary:
+        return *value_ptr;
+    case Format_32_Bit_Signed_Big_Endian:
+        return myFromBigEndian<int32_t>(value_ptr);
+    case Format_32_Bit_Signed_Little_Endian:
+        return myFromLittleEndian<int32_t>(value_ptr);
+    case Format_32_Bit_Signed_Big_Endian_Byte_Swap:
+        return myFromBigEndianByteSwap<int32_t>(value_ptr);
+    case Format_32_Bit_Signed_Little_Endian_Byte_Swap:
+        return myFromLittleEndianByteSwap<int32_t>(value_ptr);
+    case Format_32_Bit_Unsigned_Big_Endian:
+        return myFromBigEndian<uint32_t>(value_ptr);
+    case Format_32_Bit_Unsigned_Little_Endian:
+        return myFromLittleEndian<uint32_t>(value_ptr);
+    case Format_32_Bit_Unsigned_Big_Endian_Byte_Swap:
+        return myFromBigEndianByteSwap<uint32_t>(value_ptr);
+    case Format_32_Bit_Unsigned_Little_Endian_Byte_Swap:
+        return myFromLittleEndianByteSwap<uint32_t>(value_ptr);
+    case Format_32_Bit_Float_Big_Endian:
+        return myFromBigEndian<float>(value_ptr);
+    case Format_32_Bit_Float_Little_Endian:
+        return myFromLittleEndian<float>(value_ptr);
+    case Format_32_Bit_Float_Big_Endian_Byte_Swap:
+        return myFromBigEndianByteSwap<float>(value_ptr);
+    case Format_32_Bit_Float_Little_Endian_Byte_Swap:
+        return myFromLittleEndianByteSwap<float>(value_ptr);
+    case Format_64_Bit_Signed_Big_Endian:
+        return double(myFromBigEndian<int64_t>(value_ptr));
+    case Format_64_Bit_Signed_Little_Endian:
+        return double(myFromLittleEndian<int64_t>(value_ptr));
+    case Format_64_Bit_Signed_Big_Endian_Byte_Swap:
+        return double(myFromBigEndianByteSwap<int64_t>(value_ptr));
+    case Format_64_Bit_Signed_Little_Endian_Byte_Swap:
+        return double(myFromLittleEndianByteSwap<int64_t>(value_ptr));
+    case Format_64_Bit_Unsigned_Big_Endian:
+        return double(myFromBigEndian<uint64_t>(value_ptr));
+    case Format_64_Bit_Unsigned_Little_Endian:
+        return double(myFromLittleEndian<uint64_t>(value_ptr));
+    case Format_64_Bit_Unsigned_Big_Endian_Byte_Swap:
+        return double(myFromBigEndianByteSwap<uint64_t>(value_ptr));
+    case Format_64_Bit_Unsigned_Little_Endian_Byte_Swap:
+        return double(myFromLittleEndianByteSwap<uint64_t>(value_ptr));
+    case Format_64_Bit_Float_Big_Endian:
+        return myFromBigEndian<double>(value_ptr);
+    case Format_64_Bit_Float_Little_Endian:
+        return myFromLittleEndian<double>(value_ptr);
+    case Format_64_Bit_Float_Big_Endian_Byte_Swap:
+        return myFromBigEndianByteSwap<double>(value_ptr);
+    case Format_64_Bit_Float_Little_Endian_Byte_Swap:
+        return myFromLittleEndianByteSwap<double>(value_ptr);
+    default:
+        return 0;
+    }
+}
+
 void ModbusWindow::set_value_by_format(CellFormat format, uint16_t *value_ptr, const char *value_str) {
     switch (format) {
     case Format_Coil: {
@@ -778,17 +1058,19 @@ void ModbusWindow::set_value_by_format(CellFormat format, uint16_t *value_ptr, c
 void ModbusWindow::render_add_registers_dialog() {
     char window_name[160];
     snprintf(window_name, sizeof(window_name), "%s(%s)", gettext("Add Registers"), m_window_name);
-    std::unordered_map<const char *, ModbusFunctions> &function_map =
-        (m_identifier == ModbusMaster) ? modbus_function_map : modbus_slave_function_map;
+    int last_function = (m_identifier == ModbusMaster) ? m_function_options.last()
+                                                       : m_function_options.indexOf(ModbusReadInputRegisters);
     if (ImGui::Begin(window_name, &m_add_registers_dialog_visible)) {
         ImGui::InputInt("ID", &m_add_reg_def_data.id, 1, 10);
-        render_combo_box(m_add_reg_def_data.function_combo_box_data, gettext("Function"),
-                         getKeysOfMap(function_map).data(), 0, function_map.size() - 1);
-        ModbusFunctions function = function_map[m_add_reg_def_data.function_combo_box_data.text];
+        render_combo_box(m_add_reg_def_data.function_combo_box_data, gettext("Function"), m_function_options.labels(), 0,
+                         last_function);
+        ModbusFunctions function = m_function_options.value(m_add_reg_def_data.function_combo_box_data.index);
         ImGui::InputInt(gettext("Address"), &m_add_reg_def_data.reg_addr, 10, 1000);
         ImGui::InputInt(gettext("Quantity"), &m_add_reg_def_data.quantity, 10, 100);
         if (m_identifier == ModbusMaster) {
             ImGui::InputInt(gettext("Scan Rate"), &m_add_reg_def_data.scan_rate, 100, 1000);
+            render_combo_box(m_add_reg_def_data.priority_combo_box_data, gettext("Priority"),
+                             m_scan_priority_options.labels(), 0, m_scan_priority_options.last());
             ImGui::Separator();
             if (m_add_reg_def_data.frame_info.id != m_add_reg_def_data.id ||
                 m_add_reg_def_data.frame_info.function != function ||
@@ -812,6 +1094,7 @@ void ModbusWindow::render_add_registers_dialog() {
                 new RegistersTableData(m_add_reg_def_data.id, m_add_reg_def_data.reg_addr,
                                        m_add_reg_def_data.reg_addr + m_add_reg_def_data.quantity - 1, function,
                                        m_add_reg_def_data.scan_rate, m_identifier);
+            regs_table_data->priority = m_scan_priority_options.value(m_add_reg_def_data.priority_combo_box_data.index);
             if (m_identifier == ModbusMaster) {
                 memcpy(regs_table_data->packet, m_add_reg_def_data.packet, m_add_reg_def_data.packet_size);
                 regs_table_data->packet_size = m_add_reg_def_data.packet_size;
@@ -835,19 +1118,17 @@ void ModbusWindow::render_modify_registers_dialog() {
         return;
     }
     if (ImGui::Begin(gettext("Modify Registers"), &m_modify_registers_dialog_visible)) {
-        std::vector<const char *> reg_table_names;
-        reg_table_names.reserve(m_registers_table_datas.size());
+        m_reg_table_names.clear();
         std::for_each(m_registers_table_datas.begin(), m_registers_table_datas.end(),
-                      [&](RegistersTableData *x) { reg_table_names.push_back(x->table_title); });
-        render_combo_box(m_modify_table_names_combo_box_data, gettext("Registers Tables"), reg_table_names.data(), 0,
-                         reg_table_names.size() - 1);
+                      [this](RegistersTableData *x) { m_reg_table_names.push_back(x->table_title); });
+        render_combo_box(m_modify_table_names_combo_box_data, gettext("Registers Tables"), m_reg_table_names.data(), 0,
+                         m_reg_table_names.size() - 1);
         auto reg_table_iter =
             std::find_if(m_registers_table_datas.begin(), m_registers_table_datas.end(), [this](RegistersTableData *x) {
                 return strcmp(x->table_title, m_modify_table_names_combo_box_data.text) == 0;
             });
-        std::unordered_map<const char *, ModbusFunctions> &function_map =
-            (m_identifier == ModbusMaster) ? modbus_function_map : modbus_slave_function_map;
-        std::vector<const char *> function_names = getKeysOfMap(function_map);
+        int last_function = (m_identifier == ModbusMaster) ? m_function_options.last()
+                                                           : m_function_options.indexOf(ModbusReadInputRegisters);
         if (m_last_selected_table_name == nullptr ||
             strcmp(m_last_selected_table_name, m_modify_table_names_combo_box_data.text) != 0) {
             m_last_selected_table_name = m_modify_table_names_combo_box_data.text;
@@ -855,30 +1136,30 @@ void ModbusWindow::render_modify_registers_dialog() {
             m_modify_reg_def_data.reg_addr = (*reg_table_iter)->reg_start;
             m_modify_reg_def_data.quantity = (*reg_table_iter)->reg_quantity;
             m_modify_reg_def_data.scan_rate = (*reg_table_iter)->scan_rate;
+            m_modify_reg_def_data.priority_combo_box_data.index =
+                m_scan_priority_options.indexOf((*reg_table_iter)->priority);
             m_modify_reg_def_data.packet_size = (*reg_table_iter)->packet_size;
-            for (int i = 0; i < function_names.size(); ++i) {
-                if (function_map[function_names[i]] == (*reg_table_iter)->function) {
-                    m_modify_reg_def_data.function_combo_box_data.index = i;
-                }
-            }
+            m_modify_reg_def_data.function_combo_box_data.index =
+                std::max(m_function_options.indexOf((ModbusFunctions)(*reg_table_iter)->function), 0);
         }
 
         ImGui::InputInt(gettext("ID"), &m_modify_reg_def_data.id, 1, 10);
-        render_combo_box(m_modify_reg_def_data.function_combo_box_data, gettext("Function"), function_names.data(), 0,
-                         function_names.size() - 1);
+        render_combo_box(m_modify_reg_def_data.function_combo_box_data, gettext("Function"),
+                         m_function_options.labels(), 0, last_function);
+        ModbusFunctions function = m_function_options.value(m_modify_reg_def_data.function_combo_box_data.index);
         ImGui::InputInt(gettext("Address"), &m_modify_reg_def_data.reg_addr, 1, 10);
         ImGui::InputInt(gettext("Quantity"), &m_modify_reg_def_data.quantity, 1, 10);
         if (m_identifier == ModbusMaster) {
             ImGui::InputInt(gettext("Scan Rate"), &m_modify_reg_def_data.scan_rate, 10, 100);
+            render_combo_box(m_modify_reg_def_data.priority_combo_box_data, gettext("Priority"),
+                             m_scan_priority_options.labels(), 0, m_scan_priority_options.last());
             ImGui::Separator();
             if (m_modify_reg_def_data.frame_info.id != m_modify_reg_def_data.id ||
-                m_modify_reg_def_data.frame_info.function !=
-                    function_map[m_modify_reg_def_data.function_combo_box_data.text] ||
+                m_modify_reg_def_data.frame_info.function != function ||
                 m_modify_reg_def_data.frame_info.reg_addr != m_modify_reg_def_data.reg_addr ||
                 m_modify_reg_def_data.frame_info.quantity != m_modify_reg_def_data.quantity) {
                 m_modify_reg_def_data.frame_info.id = m_modify_reg_def_data.id;
-                m_modify_reg_def_data.frame_info.function =
-                    function_map[m_modify_reg_def_data.function_combo_box_data.text];
+                m_modify_reg_def_data.frame_info.function = function;
                 m_modify_reg_def_data.frame_info.reg_addr = m_modify_reg_def_data.reg_addr;
                 m_modify_reg_def_data.frame_info.quantity = m_modify_reg_def_data.quantity;
                 m_modify_reg_def_data.packet_size =
@@ -893,12 +1174,18 @@ void ModbusWindow::render_modify_registers_dialog() {
             for (int i = 0; i < (*reg_table_iter)->reg_quantity; ++i) {
                 delete[](*reg_table_iter)->reg_alias[i];
             }
+            // the recorded rows refer to the old registers, they are spilled under those before they are dropped
+            m_historian.removeTable(*reg_table_iter);
+            // the export goes on without it, its registers are not those the files were started with
+            m_exporter.removeTable(*reg_table_iter);
             (*reg_table_iter)->id = m_modify_reg_def_data.id;
-            (*reg_table_iter)->function = function_map[m_modify_reg_def_data.function_combo_box_data.text];
+            (*reg_table_iter)->function = function;
             (*reg_table_iter)->reg_start = m_modify_reg_def_data.reg_addr;
             (*reg_table_iter)->reg_end = m_modify_reg_def_data.reg_addr + m_modify_reg_def_data.quantity - 1;
             (*reg_table_iter)->reg_quantity = m_modify_reg_def_data.quantity;
             (*reg_table_iter)->scan_rate = m_modify_reg_def_data.scan_rate;
+            (*reg_table_iter)->priority =
+                m_scan_priority_options.value(m_modify_reg_def_data.priority_combo_box_data.index);
             memcpy((*reg_table_iter)->packet, m_modify_reg_def_data.packet, m_modify_reg_def_data.packet_size);
             (*reg_table_iter)->packet_size = m_modify_reg_def_data.packet_size;
             snprintf((*reg_table_iter)->table_title, sizeof((*reg_table_iter)->table_title),
@@ -954,8 +1241,8 @@ void ModbusWindow::render_communication_traffic_dialog() {
 void ModbusWindow::render_error_counter_dialog() {
     if (ImGui::Begin(gettext("Error Counter"), &m_error_counter_dialog_visible)) {
         for (auto iter = m_error_count_map.begin(); iter != m_error_count_map.end(); ++iter) {
-            ImGui::Text("\t%d\t\t%s", iter->second, modbus_error_code_map[iter->first]);
-            ImGui::SetItemTooltip("%s", modbus_error_code_comment_map[iter->first]);
+            ImGui::Text("\t%d\t\t%s", iter->second, m_error_code_options.labelOf(iter->first));
+            ImGui::SetItemTooltip("%s", m_error_comment_options.labelOf(iter->first));
             ImGui::Separator();
         }
     }
@@ -972,10 +1259,471 @@ void ModbusWindow::render_timeout_setting_dialog() {
             }
             m_timeout_setting_dialog_visible = false;
         }
+        ImGui::Checkbox(gettext("Adaptive Timeout"), &m_adaptive_timeout);
+        ImGui::SetItemTooltip("%s", gettext("Derive the timeout of each slave from its round trip times, up to the "
+                                            "timeout above. Off by default on RTU and ASCII, where a late answer "
+                                            "can not be told apart from the answer to the next request. Slaves that "
+                                            "stop answering are polled less often either way"));
+        if (m_adaptive_timeout) {
+            if (ImGui::InputInt(gettext("Min Timeout(ms)"), &m_min_recv_timeout_ms, 10, 100)) {
+                m_min_recv_timeout_ms = std::max(10, std::min(m_min_recv_timeout_ms, int(m_recv_timeout_ms)));
+            }
+        }
+        if (ImGui::Button(gettext("Reset"))) {
+            for (auto &timeout : m_slave_timeouts) {
+                timeout.reset();
+            }
+        }
+        uint32_t tick = SDL_GetTicks();
+        if (ImGui::BeginTable("timeouts", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn(gettext("Slave ID"));
+            ImGui::TableSetupColumn("SRTT (ms)");
+            ImGui::TableSetupColumn("RTTVAR (ms)");
+            ImGui::TableSetupColumn(gettext("Timeout(ms)"));
+            ImGui::TableSetupColumn(gettext("Failures"));
+            ImGui::TableSetupColumn(gettext("Suspended(ms)"));
+            ImGui::TableHeadersRow();
+            for (int id = 1; id < IM_ARRAYSIZE(m_slave_timeouts); ++id) {
+                const ResponseTimeout &timeout = m_slave_timeouts[id];
+                if (!timeout.measured() && timeout.failures() == 0) {
+                    continue;
+                }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", id);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", timeout.srttUs() / 1000.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", timeout.rttvarUs() / 1000.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", response_timeout_ms(id));
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", timeout.failures());
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", timeout.suspendedForMs(tick));
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_history_setting_dialog() {
+    if (ImGui::Begin(gettext("History Setting"), &m_history_setting_dialog_visible)) {
+        if (ImGui::InputInt(gettext("Memory Budget(MB)"), &m_history_budget_mb, 16, 256)) {
+            m_history_budget_mb = std::max(1, std::min(m_history_budget_mb, 16384));
+            m_historian.setBudget(size_t(m_history_budget_mb) << 20);
+        }
+        ImGui::SetItemTooltip("%s", gettext("Every answered read is recorded, a register added to a plot starts with "
+                                            "its recorded values. The oldest records are dropped beyond this size"));
+        ImGui::Text(gettext("Used: %.1f MB"), m_historian.usedBytes() / 1048576.0);
+        uint64_t polled_registers = m_bus_stats.polled_registers;
+        if (polled_registers > 0) {
+            ImGui::Text(gettext("Changed: %.1f%% of the polled registers"),
+                        m_bus_stats.changed_registers * 100.0 / polled_registers);
+        }
+        uint64_t oldest_us = m_historian.oldestUs();
+        if (oldest_us != 0) {
+            char time_str[32];
+            time_t oldest = time_t(oldest_us / 1000000);
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&oldest));
+            ImGui::Text(gettext("Since: %s"), time_str);
+        }
+        if (ImGui::Button(gettext("Clear"))) {
+            m_historian.clear();
+        }
+        ImGui::Separator();
+        ImGui::BeginDisabled(m_history_to_disk);
+        ImGui::InputText(gettext("Directory"), m_history_directory, sizeof(m_history_directory));
+        ImGui::EndDisabled();
+        if (ImGui::Checkbox(gettext("Record To Disk"), &m_history_to_disk)) {
+            if (m_history_to_disk) {
+                open_history_store();
+            } else {
+                close_history_store();
+            }
+        }
+        ImGui::SetItemTooltip("%s", gettext("Full chunks of the history are also written to compressed segment files, "
+                                            "a register added to a plot starts with what they hold"));
+        if (m_history_to_disk) {
+            ImGui::Text(gettext("On Disk: %.1f MB"), m_history_store.diskBytes() / 1048576.0);
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_export_setting_dialog() {
+    if (ImGui::Begin(gettext("Export Setting"), &m_export_setting_dialog_visible)) {
+        bool running = m_exporter.running();
+        ImGui::BeginDisabled(running);
+        ImGui::InputText(gettext("Directory"), m_export_options.directory, sizeof(m_export_options.directory));
+        ImGui::InputText(gettext("File Prefix"), m_export_options.prefix, sizeof(m_export_options.prefix));
+        render_combo_box(m_export_format_combo_box_data, gettext("Format"), m_export_format_options.labels(), 0,
+                         m_export_format_options.last());
+        m_export_options.format = m_export_format_options.value(m_export_format_combo_box_data.index);
+        ImGui::SetItemTooltip("%s", gettext("CSV and JSON Lines hold a value per cell as the table shows it, "
+                                            "Binary Columns the raw registers of every response in blocks"));
+        render_combo_box(m_export_sync_combo_box_data, gettext("Sync To Disk"), m_export_sync_options.labels(), 0,
+                         m_export_sync_options.last());
+        m_export_options.sync = m_export_sync_options.value(m_export_sync_combo_box_data.index);
+        int rotate_mb = int(m_export_options.rotate_mb);
+        if (ImGui::InputInt(gettext("New File After (MB)"), &rotate_mb, 16, 256)) {
+            m_export_options.rotate_mb = uint32_t(std::max(0, std::min(rotate_mb, 65536)));
+        }
+        int rotate_minutes = int(m_export_options.rotate_minutes);
+        if (ImGui::InputInt(gettext("New File After (minutes)"), &rotate_minutes, 10, 60)) {
+            m_export_options.rotate_minutes = uint32_t(std::max(0, std::min(rotate_minutes, 10080)));
+        }
+        ImGui::SetItemTooltip("%s", gettext("0 keeps writing to the same file"));
+        ImGui::EndDisabled();
+        if (running) {
+            if (ImGui::Button(gettext("Stop"))) {
+                m_exporter.stop();
+            }
+        } else if (ImGui::Button(gettext("Start"))) {
+            start_export();
+        }
+        ImGui::SetItemTooltip("%s", gettext("The aliases and formats of the tables are taken when the export starts"));
+        std::string file = m_exporter.currentFile();
+        if (!file.empty()) {
+            ImGui::Text(gettext("File: %s"), file.c_str());
+        }
+        std::string error = m_exporter.lastError();
+        if (running && !error.empty()) {
+            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s", error.c_str());
+        }
+        ImGui::Text(gettext("Exported: %llu values, %.1f MB"), (unsigned long long)m_exporter.exportedValues(),
+                    m_exporter.bytesWritten() / 1048576.0);
+        if (m_exporter.droppedValues() > 0) {
+            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), gettext("Dropped: %llu values"),
+                               (unsigned long long)m_exporter.droppedValues());
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::start_export() {
+    std::vector<ExportTable> tables;
+    for (auto *x : m_registers_table_datas) {
+        ExportTable table{x, x->table_title, uint8_t(x->id), x->function, x->reg_start, x->reg_quantity, {}};
+        for (int i = 0; i < x->reg_quantity;) {
+            CellFormat format = x->cell_formats[i];
+            int width = cellFormatWidth(format);
+            // a cell cut off by the end of the table is exported as raw registers, like publish_changes does
+            if (width > x->reg_quantity - i) {
+                format = Format_Unsigned;
+                width = 1;
+            }
+            if (format != Format_None) {
+                bool text = format == Format_Hex || format == Format_Ascii_Hex || format == Format_Binary;
+                table.cells.push_back(ExportCell{uint16_t(i), uint16_t(width), format, x->reg_alias[i],
+                                                 export_format_name(format), text});
+            }
+            i += width;
+        }
+        tables.push_back(std::move(table));
+    }
+    if (!m_exporter.start(m_export_options, std::move(tables))) {
+        error_handle(gettext("can not start the export"));
+    }
+}
+
+void ModbusWindow::render_derived_channels_dialog() {
+    if (ImGui::Begin(gettext("Derived Channels"), &m_derived_channels_dialog_visible)) {
+        DerivedChannelInputData &input = m_derived_input_data;
+        ImGui::InputText(gettext("Name"), input.name, sizeof(input.name));
+        ImGui::InputText(gettext("Expression"), input.text, sizeof(input.text));
+        ImGui::SetItemTooltip("%s", gettext("Registers in modicon notation, r40001 is the first holding register, "
+                                            "r30001 the first input register, r40001@2 is read from slave 2.\n"
+                                            "Operators of C, abs, sqrt, round, floor, ceil, bit(x, n), if(c, a, b), "
+                                            "s16, s32, f32 and sum, avg, min, max.\n"
+                                            "e.g. f32(r40001 << 16 | r40002) * 0.01"));
+        if (ImGui::InputInt(gettext("Default Slave ID"), &input.default_id)) {
+            input.default_id = std::max(0, std::min(input.default_id, 255));
+        }
+        if (ImGui::Button(gettext("Add"))) {
+            const char *name = input.name[0] ? input.name : input.text;
+            if (m_derived_channels.add(
+                    name, input.text, input.default_id,
+                    [this](const ExpressionInput &x) { return current_register_value(x); }, input.error,
+                    sizeof(input.error))) {
+                input.name[0] = '\0';
+                input.text[0] = '\0';
+                input.error[0] = '\0';
+            }
+        }
+        if (input.error[0]) {
+            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s", input.error);
+        }
+        uint32_t remove_handle = 0;
+        uint32_t plot_handle = 0;
+        if (ImGui::BeginTable("##derived", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupColumn(gettext("Name"));
+            ImGui::TableSetupColumn(gettext("Expression"));
+            ImGui::TableSetupColumn(gettext("Value"));
+            ImGui::TableSetupColumn("");
+            ImGui::TableHeadersRow();
+            // only the visible rows are looked at, there may be thousands
+            ImGuiListClipper clipper;
+            clipper.Begin(int(m_derived_channels.size()));
+            while (clipper.Step()) {
+                m_derived_channels.visit(
+                    clipper.DisplayStart, clipper.DisplayEnd - clipper.DisplayStart, [&](const DerivedChannel &x) {
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(x.name);
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(x.text);
+                        ImGui::TableNextColumn();
+                        if (isnan(x.value)) {
+                            ImGui::TextUnformatted("--");
+                        } else {
+                            ImGui::Text("%g", x.value);
+                        }
+                        ImGui::TableNextColumn();
+                        ImGui::PushID(int(x.handle));
+                        if (ImGui::SmallButton(gettext("Add to Plot"))) {
+                            plot_handle = x.handle;
+                            snprintf(m_input_plot_reg_data.title, sizeof(m_input_plot_reg_data.title), "%s",
+                                     x.name);
+                        }
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton(gettext("Remove"))) {
+                            remove_handle = x.handle;
+                        }
+                        ImGui::PopID();
+                    });
+            }
+            ImGui::EndTable();
+        }
+        // the channels are locked while they are visited
+        if (remove_handle != 0) {
+            m_derived_channels.remove(remove_handle);
+        }
+        if (plot_handle != 0) {
+            m_input_plot_reg_data.channel = plot_handle;
+            m_input_plot_reg_data.table = nullptr;
+            m_inplut_plot_reg_data_dialog_visible = true;
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_alarms_dialog() {
+    if (ImGui::Begin(gettext("Alarms"), &m_alarms_dialog_visible)) {
+        uint64_t now_us = timestampNow().wallUs();
+        if (ImGui::CollapsingHeader(gettext("New Alarm"))) {
+            AlarmInputData &input = m_alarm_input_data;
+            AlarmDefinition &definition = input.definition;
+            ImGui::InputText(gettext("Name"), definition.name, sizeof(definition.name));
+            render_combo_box(input.kind_combo_box_data, gettext("Kind"), m_alarm_kind_options.labels(), 0,
+                             m_alarm_kind_options.last());
+            definition.kind = m_alarm_kind_options.value(input.kind_combo_box_data.index);
+            ImGui::BeginDisabled(definition.kind == AlarmException);
+            ImGui::InputText(gettext("Expression"), definition.text, sizeof(definition.text));
+            ImGui::SetItemTooltip("%s", gettext("The value watched, as the expression of a derived channel, "
+                                                "e.g. r40001 or s16(r30001) * 0.1"));
+            ImGui::EndDisabled();
+            if (ImGui::InputInt(gettext("Slave ID"), &definition.slave_id)) {
+                definition.slave_id = std::max(0, std::min(definition.slave_id, 255));
+            }
+            const char *limit_labels[] = {gettext("Limit"), gettext("Limit"), gettext("Limit (per second)"),
+                                          gettext("Limit (seconds)"), gettext("Failed Requests")};
+            ImGui::InputDouble(limit_labels[definition.kind], &definition.limit);
+            ImGui::BeginDisabled(definition.kind == AlarmStale || definition.kind == AlarmException);
+            if (ImGui::InputDouble(gettext("Hysteresis"), &definition.hysteresis)) {
+                definition.hysteresis = std::max(definition.hysteresis, 0.0);
+            }
+            ImGui::EndDisabled();
+            ImGui::Checkbox(gettext("Latching"), &definition.latching);
+            ImGui::SetItemTooltip("%s", gettext("The alarm stays active until it is acknowledged"));
+            if (ImGui::Button(gettext("Add"))) {
+                if (definition.name[0] == '\0') {
+                    snprintf(definition.name, sizeof(definition.name), "%s",
+                             definition.kind == AlarmException ? m_alarm_kind_options.labelOf(definition.kind)
+                                                               : definition.text);
+                }
+                if (m_alarms.add(
+                        definition, [this](const ExpressionInput &x) { return current_register_value(x); }, now_us,
+                        input.error, sizeof(input.error))) {
+                    definition.name[0] = '\0';
+                    input.error[0] = '\0';
+                }
+            }
+            if (input.error[0]) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s", input.error);
+            }
+        }
+        ImGui::Text(gettext("Active: %zu"), m_alarms.activeCount());
+        ImGui::SameLine();
+        if (ImGui::Button(gettext("Acknowledge All"))) {
+            m_alarms.acknowledge(0, now_us);
+        }
+        uint32_t ack_handle = 0;
+        uint32_t remove_handle = 0;
+        char time_str[32];
+        if (ImGui::BeginTable("##alarms", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupColumn(gettext("Name"));
+            ImGui::TableSetupColumn(gettext("Kind"));
+            ImGui::TableSetupColumn(gettext("Value"));
+            ImGui::TableSetupColumn(gettext("State"));
+            ImGui::TableSetupColumn(gettext("Since"));
+            ImGui::TableSetupColumn("");
+            ImGui::TableHeadersRow();
+            ImGuiListClipper clipper;
+            clipper.Begin(int(m_alarms.size()));
+            while (clipper.Step()) {
+                m_alarms.visit(clipper.DisplayStart, clipper.DisplayEnd - clipper.DisplayStart, [&](const Alarm &x) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(x.definition.name);
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(m_alarm_kind_options.labelOf(x.definition.kind));
+                    ImGui::TableNextColumn();
+                    if (x.definition.kind == AlarmException) {
+                        ModbusErrorCode error_code = ModbusErrorCode(int(x.value));
+                        ImGui::TextUnformatted(x.failures > 0 ? m_error_code_options.labelOf(error_code) : "--");
+                    } else if (x.definition.kind == AlarmRateOfChange) {
+                        ImGui::Text("%g/s", x.rate);
+                    } else if (isnan(x.value)) {
+                        ImGui::TextUnformatted("--");
+                    } else {
+                        ImGui::Text("%g", x.value);
+                    }
+                    ImGui::TableNextColumn();
+                    if (x.active && !x.acknowledged) {
+                        ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s",
+                                           x.condition ? gettext("Active") : gettext("Cleared, Unacknowledged"));
+                    } else if (x.active) {
+                        ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.0f, 1.0f), "%s", gettext("Acknowledged"));
+                    } else {
+                        ImGui::TextUnformatted(gettext("Normal"));
+                    }
+                    ImGui::TableNextColumn();
+                    if (x.active) {
+                        formatTimestamp(Timestamp{0, int64_t(x.since_us) * 1000}, time_str, sizeof(time_str), 3);
+                        ImGui::TextUnformatted(time_str);
+                    }
+                    ImGui::TableNextColumn();
+                    ImGui::PushID(int(x.handle));
+                    ImGui::BeginDisabled(!x.active || x.acknowledged);
+                    if (ImGui::SmallButton(gettext("Acknowledge"))) {
+                        ack_handle = x.handle;
+                    }
+                    ImGui::EndDisabled();
+                    ImGui::SameLine();
+                    if (ImGui::SmallButton(gettext("Remove"))) {
+                        remove_handle = x.handle;
+                    }
+                    ImGui::PopID();
+                });
+            }
+            ImGui::EndTable();
+        }
+        // the alarms are locked while they are visited
+        if (ack_handle != 0) {
+            m_alarms.acknowledge(ack_handle, now_us);
+        }
+        if (remove_handle != 0) {
+            m_alarms.remove(remove_handle);
+        }
+        if (ImGui::CollapsingHeader(gettext("History"))) {
+            if (ImGui::Button(gettext("Clear"))) {
+                m_alarms.clearEvents();
+            }
+            if (ImGui::BeginTable("##alarm_events", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable |
+                                                           ImGuiTableFlags_ScrollY,
+                                  ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 12))) {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn(gettext("Time"));
+                ImGui::TableSetupColumn(gettext("Name"));
+                ImGui::TableSetupColumn(gettext("Event"));
+                ImGui::TableSetupColumn(gettext("Value"));
+                ImGui::TableHeadersRow();
+                ImGuiListClipper clipper;
+                clipper.Begin(int(m_alarms.eventCount()));
+                while (clipper.Step()) {
+                    m_alarms.visitEvents(clipper.DisplayStart, clipper.DisplayEnd - clipper.DisplayStart,
+                                         [&](const AlarmEvent &x) {
+                                             ImGui::TableNextRow();
+                                             ImGui::TableNextColumn();
+                                             formatTimestamp(Timestamp{0, int64_t(x.time_us) * 1000}, time_str,
+                                                             sizeof(time_str), 3);
+                                             ImGui::TextUnformatted(time_str);
+                                             ImGui::TableNextColumn();
+                                             ImGui::TextUnformatted(x.name);
+                                             ImGui::TableNextColumn();
+                                             ImGui::TextUnformatted(gettext(alarm_event_names[x.type]));
+                                             ImGui::TableNextColumn();
+                                             ImGui::Text("%g", x.value);
+                                         });
+                }
+                ImGui::EndTable();
+            }
+        }
     }
     ImGui::End();
 }
 
+void ModbusWindow::open_history_store() {
+    char name[sizeof(m_window_name)];
+    snprintf(name, sizeof(name), "%s", m_window_name);
+    for (char *c = name; *c; ++c) {
+        if (!isalnum((unsigned char)*c)) {
+            *c = '_';
+        }
+    }
+    std::string directory = std::string(m_history_directory) + "/" + name;
+    if (!m_history_store.open(directory)) {
+        m_history_to_disk = false;
+        error_handle(gettext("can not open the history directory"));
+        return;
+    }
+    m_alarm_journal = fopen((directory + "/alarms.csv").c_str(), "a");
+    if (m_alarm_journal == nullptr) {
+        LogWarn("can not open the alarm journal in {}", directory);
+    }
+}
+
+void ModbusWindow::close_history_store() {
+    m_history_store.close();
+    write_alarm_journal();
+    if (m_alarm_journal) {
+        fclose(m_alarm_journal);
+        m_alarm_journal = nullptr;
+    }
+}
+
+void ModbusWindow::record_alarm_event(const AlarmEvent &event) {
+    LogWarn("alarm {} {}, value {}", event.name, alarm_event_names[event.type], event.value);
+    std::lock_guard<std::mutex> lock(m_alarm_journal_mutex);
+    m_alarm_journal_queue.push_back(event);
+}
+
+void ModbusWindow::write_alarm_journal() {
+    {
+        std::lock_guard<std::mutex> lock(m_alarm_journal_mutex);
+        if (m_alarm_journal_queue.empty()) {
+            return;
+        }
+        m_alarm_journal_events.swap(m_alarm_journal_queue);
+    }
+    if (m_alarm_journal) {
+        char fields[64];
+        for (const AlarmEvent &event : m_alarm_journal_events) {
+            // microseconds since the epoch, like the history segments
+            snprintf(fields, sizeof(fields), "%llu,", (unsigned long long)event.time_us);
+            m_alarm_journal_line.assign(fields);
+            appendCsvField(m_alarm_journal_line, event.name);
+            snprintf(fields, sizeof(fields), ",%s,%g\n", alarm_event_names[event.type], event.value);
+            m_alarm_journal_line.append(fields);
+            fputs(m_alarm_journal_line.c_str(), m_alarm_journal);
+        }
+        fflush(m_alarm_journal);
+    }
+    m_alarm_journal_events.clear();
+}
+
 void ModbusWindow::render_modbus_function_05_dialog() {
     if (ImGui::Begin(gettext("05:Write Single Coil"), &m_modbus_function_05_dialog_visible)) {
         ImGui::DragInt(gettext("Slave ID"), &m_function_05_data.slave_id, 1, 1, 255);
@@ -1076,7 +1824,7 @@ void ModbusWindow::render_modbus_function_15_dialog() {
         ImGui::BeginChild("left_panel", ImVec2(ImGui::GetWindowWidth() / 2, 0));
         ImGui::DragInt(gettext("Slave ID"), &m_function_15_data.slave_id, 1, 1, 255);
         ImGui::InputInt(gettext("Address"), &m_function_15_data.address);
-        ImGui::DragInt(gettext("Quantity"), &m_function_15_data.quantity, 1, 1, MODBUS_FRAME_MAX_REGISTERS);
+        ImGui::DragInt(gettext("Quantity"), &m_function_15_data.quantity, 1, 1, MODBUS_MAX_WRITE_COILS);
         ImGui::EndChild();
         ImGui::EndGroup();
         ImGui::SameLine();
@@ -1101,11 +1849,8 @@ void ModbusWindow::render_modbus_function_15_dialog() {
             frame_info.function = ModbusWriteMultipleCoils;
             frame_info.reg_addr = m_function_15_data.address;
             frame_info.quantity = m_function_15_data.quantity;
-            uint8_t *coils = (uint8_t *)frame_info.reg_values;
             for (int i = 0; i < m_function_15_data.quantity; ++i) {
-                int byte_index = i / 8;
-                int bit_index = i % 8;
-                setBit(coils[byte_index], bit_index, m_function_15_data.values[i].bool_value);
+                frame_info.coils.set(i, m_function_15_data.values[i].bool_value);
             }
             ModbusPacket *mdb_pack = new ModbusPacket;
             mdb_pack->packet_size = m_modbus->masterFrame2Pack(frame_info, mdb_pack->packet);
@@ -1126,10 +1871,18 @@ void ModbusWindow::render_modbus_function_16_dialog() {
         ImGui::BeginChild("left_panel", ImVec2(ImGui::GetWindowWidth() / 2, 0));
         ImGui::DragInt(gettext("Slave ID"), &m_function_16_data.slave_id, 1, 1, 255);
         ImGui::InputInt(gettext("Address"), &m_function_16_data.address);
-        ImGui::DragInt(gettext("Quantity"), &m_function_16_data.quantity, 1, 1, MODBUS_FRAME_MAX_REGISTERS);
-        render_combo_box(m_function_16_data.format_combo_box_data, gettext("Format"),
-                         getKeysOfMap(m_write_format_map).data(), 0, m_write_format_map.size() - 1);
-        m_function_16_data.format = m_write_format_map[m_function_16_data.format_combo_box_data.text];
+        render_combo_box(m_function_16_data.format_combo_box_data, gettext("Format"), m_write_format_options.labels(), 0,
+                         m_write_format_options.last());
+        m_function_16_data.format = m_write_format_options.value(m_function_16_data.format_combo_box_data.index);
+        // every value takes 1, 2 or 4 registers, keep the whole frame within the protocol limit
+        int max_values = MODBUS_MAX_WRITE_REGISTERS;
+        if (m_function_16_data.format >= Format_64_Bit_Signed_Big_Endian) {
+            max_values = MODBUS_MAX_WRITE_REGISTERS / 4;
+        } else if (m_function_16_data.format >= Format_32_Bit_Signed_Big_Endian) {
+            max_values = MODBUS_MAX_WRITE_REGISTERS / 2;
+        }
+        ImGui::DragInt(gettext("Quantity"), &m_function_16_data.quantity, 1, 1, max_values);
+        m_function_16_data.quantity = std::min(m_function_16_data.quantity, max_values);
         ImGui::EndChild();
         ImGui::EndGroup();
         ImGui::SameLine();
@@ -1290,17 +2043,287 @@ void ModbusWindow::render_modbus_function_16_dialog() {
     ImGui::End();
 }
 
+void ModbusWindow::render_modbus_function_22_dialog() {
+    if (ImGui::Begin(gettext("22:Mask Write Register"), &m_modbus_function_22_dialog_visible)) {
+        ImGui::DragInt(gettext("Slave ID"), &m_function_22_data.slave_id, 1, 1, 255);
+        ImGui::InputInt(gettext("Address"), &m_function_22_data.address);
+        ImGui::Separator();
+        ImGui::DragInt(gettext("And Mask"), &m_function_22_data.and_mask, 1, 0, 0xFFFF, "0x%04X");
+        ImGui::DragInt(gettext("Or Mask"), &m_function_22_data.or_mask, 1, 0, 0xFFFF, "0x%04X");
+        ImGui::Text("%s", gettext("Result = (Current AND And_Mask) OR (Or_Mask AND (NOT And_Mask))"));
+        ImGui::Separator();
+        if (m_write_frame_info.id != m_function_22_data.slave_id ||
+            m_write_frame_info.function != ModbusMaskWriteRegister ||
+            m_write_frame_info.reg_addr != m_function_22_data.address ||
+            m_write_frame_info.reg_values[0] != uint16_t(m_function_22_data.and_mask) ||
+            m_write_frame_info.reg_values[1] != uint16_t(m_function_22_data.or_mask)) {
+            m_write_frame_info.id = m_function_22_data.slave_id;
+            m_write_frame_info.function = ModbusMaskWriteRegister;
+            m_write_frame_info.reg_addr = m_function_22_data.address;
+            m_write_frame_info.quantity = 1;
+            m_write_frame_info.reg_values[0] = uint16_t(m_function_22_data.and_mask);
+            m_write_frame_info.reg_values[1] = uint16_t(m_function_22_data.or_mask);
+            m_function_22_data.packet_size = m_modbus->masterFrame2Pack(m_write_frame_info, m_function_22_data.packet);
+            toHexString((const uint8_t *)m_function_22_data.packet, m_function_22_data.packet_size,
+                        m_function_22_data.hex_str);
+        }
+        ImGui::Text("%s", m_function_22_data.hex_str);
+        ImGui::Separator();
+        if (ImGui::Button(gettext("Send"), ImVec2(ImGui::GetWindowWidth() / 3, 35))) {
+            ModbusPacket *mdb_pack = new ModbusPacket;
+            memcpy(mdb_pack->packet, m_function_22_data.packet, m_function_22_data.packet_size);
+            mdb_pack->packet_size = m_function_22_data.packet_size;
+            m_manual_list.push_back(mdb_pack);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button(gettext("Cancel"), ImVec2(ImGui::GetWindowWidth() / 3, 35))) {
+            m_modbus_function_22_dialog_visible = false;
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_diagnostics_dialog() {
+    ImGui::SetNextWindowSize(ImVec2(500, 600), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin(gettext("Diagnostics"), &m_diagnostics_dialog_visible)) {
+        DeviceDiagnosticsData &diag_data = m_device_diagnostics_data;
+        ImGui::DragInt(gettext("Slave ID"), &diag_data.slave_id, 1, 1, 247);
+        ModbusFrameInfo frame_info{};
+        frame_info.id = diag_data.slave_id;
+        if (ImGui::Button(gettext("Read Device Identification"))) {
+            frame_info.function = ModbusEncapsulatedInterface;
+            frame_info.reg_addr = MODBUS_MEI_READ_DEVICE_ID << 8 | ModbusDeviceIdBasicStream;
+            frame_info.quantity = ModbusDeviceIdVendorName;
+            queue_manual_frame(frame_info);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button(gettext("Read Bus Counters"))) {
+            frame_info.function = ModbusDiagnostics;
+            for (int sub_function = ModbusDiagBusMessageCount; sub_function <= ModbusDiagSlaveNoResponseCount;
+                 ++sub_function) {
+                frame_info.reg_addr = sub_function;
+                queue_manual_frame(frame_info);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button(gettext("Clear Counters"))) {
+            frame_info.function = ModbusDiagnostics;
+            frame_info.reg_addr = ModbusDiagClearCounters;
+            queue_manual_frame(frame_info);
+            std::fill(std::begin(diag_data.counters), std::end(diag_data.counters), -1);
+        }
+        ImGui::Separator();
+        ImGui::Text("%s: %s", gettext("Vendor Name"), diag_data.vendor_name);
+        ImGui::Text("%s: %s", gettext("Product Code"), diag_data.product_code);
+        ImGui::Text("%s: %s", gettext("Revision"), diag_data.revision);
+        if (diag_data.conformity_level >= 0) {
+            ImGui::Text("%s: 0x%02X", gettext("Conformity Level"), diag_data.conformity_level);
+        }
+        const char *counter_names[] = {gettext("Bus Message Count"), gettext("Bus Communication Error Count"),
+                                       gettext("Bus Exception Error Count"), gettext("Slave Message Count"),
+                                       gettext("Slave No Response Count")};
+        for (int i = 0; i < IM_ARRAYSIZE(counter_names); ++i) {
+            if (diag_data.counters[i] < 0) {
+                ImGui::Text("%s: -", counter_names[i]);
+            } else {
+                ImGui::Text("%s: %d", counter_names[i], diag_data.counters[i]);
+            }
+        }
+        ImGui::Separator();
+        ImGui::Text("%s", gettext("Latency Probe (08 Echo)"));
+        LatencyProbeData &probe_data = m_latency_probe_data;
+        ImGui::BeginDisabled(probe_data.running.load());
+        ImGui::DragInt(gettext("Probe Interval (ms)"), &probe_data.interval_ms, 1, 10, 10000);
+        ImGui::EndDisabled();
+        if (!probe_data.running) {
+            if (ImGui::Button(gettext("Start"), ImVec2(ImGui::GetWindowWidth() / 3, 35))) {
+                probe_data.start(diag_data.slave_id);
+                m_probe_timer_id = SDL_AddTimer(probe_data.interval_ms, Probe_timer_callback, this);
+            }
+        } else if (ImGui::Button(gettext("Stop"), ImVec2(ImGui::GetWindowWidth() / 3, 35))) {
+            SDL_RemoveTimer(m_probe_timer_id);
+            m_probe_timer_id = 0;
+            probe_data.running = false;
+        }
+        const LatencyHistogram &rtt = probe_data.rtt;
+        ImGui::Text("%s: %llu  %s: %d", gettext("Samples"), (unsigned long long)rtt.count(), gettext("Timeouts"),
+                    probe_data.timeout_count.load());
+        if (rtt.count() > 0) {
+            ImGui::Text("avg %.2f ms  p50 %.2f ms  p99 %.2f ms  max %.2f ms", rtt.mean() / 1000.0,
+                        rtt.percentile(50) / 1000.0, rtt.percentile(99) / 1000.0, rtt.max() / 1000.0);
+            render_latency_histogram(rtt);
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_latency_dialog() {
+    ImGui::SetNextWindowSize(ImVec2(600, 600), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin(gettext("Latency"), &m_latency_dialog_visible)) {
+        uint32_t tick = SDL_GetTicks();
+        if (tick - m_bus_stats.sample_tick >= 1000) {
+            uint64_t busy_us = m_bus_stats.busy_us.load(), timeout_us = m_bus_stats.timeout_us.load();
+            float elapsed_us = (tick - m_bus_stats.sample_tick) * 1000.0f;
+            m_bus_stats.utilisation = std::min(1.0f, (busy_us - m_bus_stats.sample_busy_us) / elapsed_us);
+            m_bus_stats.timeout_share = std::min(1.0f, (timeout_us - m_bus_stats.sample_timeout_us) / elapsed_us);
+            m_bus_stats.sample_tick = tick;
+            m_bus_stats.sample_busy_us = busy_us;
+            m_bus_stats.sample_timeout_us = timeout_us;
+        }
+        ImGui::Text("%s: %.1f%%", gettext("Bus Utilisation"), m_bus_stats.utilisation * 100);
+        ImGui::Text("%s: %.1f%% (%.1f s)", gettext("Waiting For Timeouts"), m_bus_stats.timeout_share * 100,
+                    m_bus_stats.timeout_us.load() / 1e6);
+        for (int i = 0; i < m_scan_priority_options.size(); ++i) {
+            ImGui::SameLine();
+            ImGui::Text("%s: %.1f s", m_scan_priority_options.label(i),
+                        m_bus_scheduler.busTimeUs(m_scan_priority_options.value(i)) / 1e6);
+        }
+        if (ImGui::Button(gettext("Reset"))) {
+            for (auto &x : m_registers_table_datas) {
+                x->latency.reset();
+            }
+            for (auto &latency : m_slave_latency) {
+                if (latency.load()) {
+                    latency.load()->reset();
+                }
+            }
+        }
+        const LatencyHistogram *selected = nullptr;
+        if (ImGui::BeginTable("latency", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn(gettext("Source"));
+            ImGui::TableSetupColumn(gettext("Count"));
+            ImGui::TableSetupColumn("p50 (ms)");
+            ImGui::TableSetupColumn("p95 (ms)");
+            ImGui::TableSetupColumn("p99 (ms)");
+            ImGui::TableSetupColumn("max (ms)");
+            ImGui::TableHeadersRow();
+            auto render_row = [&](const char *name, const LatencyHistogram &latency, int key) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if (ImGui::Selectable(name, m_latency_selected == key, ImGuiSelectableFlags_SpanAllColumns)) {
+                    m_latency_selected = key;
+                }
+                if (m_latency_selected == key) {
+                    selected = &latency;
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)latency.count());
+                for (double percent : {50.0, 95.0, 99.0}) {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", latency.percentile(percent) / 1000.0);
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", latency.max() / 1000.0);
+            };
+            char name[64];
+            for (int id = 0; id < IM_ARRAYSIZE(m_slave_latency); ++id) {
+                LatencyHistogram *latency = m_slave_latency[id].load();
+                if (latency) {
+                    snprintf(name, sizeof(name), "%s %d", gettext("Slave"), id);
+                    render_row(name, *latency, id);
+                }
+            }
+            for (int i = 0; i < int(m_registers_table_datas.size()); ++i) {
+                render_row(m_registers_table_datas[i]->table_title, m_registers_table_datas[i]->latency, -1 - i);
+            }
+            ImGui::EndTable();
+        }
+        if (selected && selected->count() > 0) {
+            render_latency_histogram(*selected);
+        }
+    }
+    ImGui::End();
+}
+
+void ModbusWindow::render_latency_histogram(const LatencyHistogram &latency) {
+    // only the occupied range, the buckets double in width every 32 entries
+    int first = LatencyHistogram::bucketIndex(0), last = LatencyHistogram::bucketIndex(latency.max());
+    while (first < last && latency.bucketCount(first) == 0) {
+        first++;
+    }
+    m_latency_plot_xs.clear();
+    m_latency_plot_ys.clear();
+    for (int i = first; i <= last; ++i) {
+        m_latency_plot_xs.push_back(LatencyHistogram::bucketLowest(i) / 1000.0);
+        m_latency_plot_ys.push_back(latency.bucketCount(i));
+    }
+    if (ImPlot::BeginPlot(gettext("Round Trip Time"))) {
+        ImPlot::SetupAxes("ms", gettext("Count"), ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+        ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);
+        ImPlot::PlotStairs("RTT", m_latency_plot_xs.data(), m_latency_plot_ys.data(), int(m_latency_plot_xs.size()),
+                           ImPlotStairsFlags_Shaded);
+        ImPlot::EndPlot();
+    }
+}
+
+uint64_t ModbusWindow::bus_time_us(const Timestamp &timestamp) {
+    return timestamp.sinceNs(m_master_last_send_time) / 1000;
+}
+
+void ModbusWindow::record_latency(RegistersTableData *regs_table_data, int slave_id, uint64_t latency_us) {
+    if (regs_table_data) {
+        regs_table_data->latency.record(latency_us);
+    }
+    if (slave_id < 0 || slave_id >= IM_ARRAYSIZE(m_slave_latency)) {
+        return;
+    }
+    if (slave_id > 0) {
+        m_slave_timeouts[slave_id].onResponse(latency_us);
+    }
+    LatencyHistogram *latency = m_slave_latency[slave_id].load();
+    if (latency == nullptr) {
+        latency = new LatencyHistogram();
+        m_slave_latency[slave_id].store(latency);
+    }
+    latency->record(latency_us);
+}
+
+uint32_t ModbusWindow::response_timeout_ms(int slave_id) {
+    if (!m_adaptive_timeout || slave_id <= 0 || slave_id >= IM_ARRAYSIZE(m_slave_timeouts)) {
+        return m_recv_timeout_ms;
+    }
+    return m_slave_timeouts[slave_id].timeoutMs(m_min_recv_timeout_ms, m_recv_timeout_ms);
+}
+
 void ModbusWindow::render_input_plot_reg_data_dialog() {
     if (ImGui::Begin(gettext("Add Reg to Plot"), &m_inplut_plot_reg_data_dialog_visible)) {
         ImGui::InputText(gettext("Plot Name"), m_input_plot_reg_data.title, sizeof(m_input_plot_reg_data.title));
-        ImGui::InputInt(gettext("Register Address"), &m_input_plot_reg_data.reg_addr);
-        render_combo_box(m_input_plot_reg_data.format_combo_box_data, gettext("Register Format"),
-                         getKeysOfMap(m_write_format_map).data(), 0, m_write_format_map.size() - 1);
-        m_input_plot_reg_data.format = m_write_format_map[m_input_plot_reg_data.format_combo_box_data.text];
+        RegistersTableData *table = m_input_plot_reg_data.table;
+        bool coils = table && (table->function == ModbusReadCoils || table->function == ModbusReadDescreteInputs);
+        // a derived channel has no register of its own
+        if (m_input_plot_reg_data.channel == 0) {
+            ImGui::InputInt(gettext("Register Address"), &m_input_plot_reg_data.reg_addr);
+            if (coils) {
+                m_input_plot_reg_data.format = Format_Coil;
+            } else {
+                render_combo_box(m_input_plot_reg_data.format_combo_box_data, gettext("Register Format"),
+                                 m_write_format_options.labels(), 0, m_write_format_options.last());
+                m_input_plot_reg_data.format =
+                    m_write_format_options.value(m_input_plot_reg_data.format_combo_box_data.index);
+            }
+        }
         ImGui::InputDouble(gettext("Max Value"), &m_input_plot_reg_data.max_value);
         ImGui::InputDouble(gettext("Min Value"), &m_input_plot_reg_data.min_value);
         if (ImGui::Button(gettext("OK"), ImVec2(ImGui::GetWindowWidth(), 35))) {
-            m_plot_register_datas.push_back(m_input_plot_reg_data);
+            auto trace = std::make_shared<PlotTrace>(PLOT_SERIES_CAPACITY);
+            snprintf(trace->name, sizeof(trace->name), "%s: %s", m_window_name, m_input_plot_reg_data.title);
+            trace->min_value = m_input_plot_reg_data.min_value;
+            trace->max_value = m_input_plot_reg_data.max_value;
+            trace->stairs = coils;
+            m_input_plot_reg_data.trace = trace;
+            if (table) {
+                m_input_plot_reg_data.slave_id = uint8_t(table->id);
+                m_input_plot_reg_data.function = uint8_t(modbusReadSpace(table->function));
+            }
+            PlotRegisterData plot = m_input_plot_reg_data;
+            // filled before the io thread sees it
+            backfill_plot(plot);
+            {
+                std::lock_guard<std::mutex> lock(m_plot_mutex);
+                m_plot_register_datas.push_back(plot);
+                rebuild_plot_subscriptions();
+            }
+            m_plot_workspace->add(trace);
             m_input_plot_reg_data.clearState();
             m_inplut_plot_reg_data_dialog_visible = false;
         }
@@ -1308,94 +2331,239 @@ void ModbusWindow::render_input_plot_reg_data_dialog() {
     ImGui::End();
 }
 
-void ModbusWindow::render_register_plots() {
-    if (m_plot_register_datas.empty()) {
+size_t ModbusWindow::query_history(const RegistersTableData *table, int offset, int count,
+                                  std::vector<uint64_t> &times_us, std::vector<uint16_t> &words) {
+    times_us.clear();
+    words.clear();
+    std::vector<uint64_t> memory_times_us;
+    std::vector<uint16_t> memory_words;
+    size_t rows = m_historian.query(table, offset, count, 0, UINT64_MAX, memory_times_us, memory_words);
+    // what is still in memory is also on disk, the disk only adds what came before it
+    if (m_history_store.isOpen()) {
+        uint64_t end_us = rows > 0 ? memory_times_us[0] - 1 : UINT64_MAX;
+        rows += m_history_store.query(uint8_t(table->id), table->function, uint16_t(table->reg_start + offset), count,
+                                      0, end_us, times_us, words);
+    }
+    times_us.insert(times_us.end(), memory_times_us.begin(), memory_times_us.end());
+    words.insert(words.end(), memory_words.begin(), memory_words.end());
+    return rows;
+}
+
+void ModbusWindow::backfill_plot(PlotRegisterData &plot) {
+    if (plot.channel != 0) {
+        backfill_derived_plot(plot);
         return;
     }
-    if (ImGui::Begin(gettext("Plots"))) {
-        ImGui::Checkbox(gettext("Local Time"), &ImPlot::GetStyle().UseLocalTime);
-        ImGui::SameLine();
-        ImGui::Checkbox(gettext("ISO 8601"), &ImPlot::GetStyle().UseISO8601);
-        ImGui::SameLine();
-        ImGui::Checkbox(gettext("24 Hour Clock"), &ImPlot::GetStyle().Use24HourClock);
-        for (auto iter = m_plot_register_datas.begin(); iter != m_plot_register_datas.end();) {
-            if (ImGui::CollapsingHeader(iter->title, &iter->visible) && iter->x_data.size() != 0) {
-                if (ImPlot::BeginPlot(iter->title)) {
-                    ImPlot::SetupAxes("Time", "Value");
-                    ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
-                    ImPlot::SetupAxesLimits(iter->x_data[0], iter->x_data.back() + 60, iter->min_value,
-                                            iter->max_value);
-                    ImPlot::PlotLine(iter->title, iter->x_data.data(), iter->y_data.data(), iter->x_data.size());
-                    ImPlot::EndPlot();
-                }
+    RegistersTableData *table = plot.table;
+    int count = cellFormatWidth(plot.format);
+    int offset = plot.reg_addr - (table ? table->reg_start : 0);
+    if (table == nullptr || offset < 0 || offset + count > table->reg_quantity) {
+        return;
+    }
+    std::vector<uint64_t> times_us;
+    std::vector<uint16_t> words;
+    size_t rows = query_history(table, offset, count, times_us, words);
+    for (size_t i = 0; i < rows; ++i) {
+        double value = get_double_by_format(plot.format, &words[i * count]);
+        plot.last_append_x = times_us[i] / 1e6;
+        plot.trace->ring.append(plot.last_append_x, value);
+        plot.trace->last_y = value;
+    }
+    LogInfo("plot {} starts with {} recorded samples", plot.title, rows);
+}
+
+void ModbusWindow::backfill_derived_plot(PlotRegisterData &plot) {
+    Expression expression;
+    if (!m_derived_channels.expression(plot.channel, expression)) {
+        return;
+    }
+    const std::vector<ExpressionInput> &inputs = expression.inputs();
+    std::vector<std::vector<uint64_t>> input_times_us(inputs.size());
+    std::vector<std::vector<uint16_t>> input_words(inputs.size());
+    std::vector<uint64_t> times_us;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        RegistersTableData *table = find_read_table(inputs[i]);
+        if (table) {
+            query_history(table, inputs[i].reg_addr - table->reg_start, 1, input_times_us[i], input_words[i]);
+            times_us.insert(times_us.end(), input_times_us[i].begin(), input_times_us[i].end());
+        }
+    }
+    std::sort(times_us.begin(), times_us.end());
+    times_us.erase(std::unique(times_us.begin(), times_us.end()), times_us.end());
+    size_t rows = times_us.size();
+    // every input holds its recorded value until its next record and is unknown before its first one, an input no
+    // table polls is 0 as it is live
+    std::vector<std::vector<double>> columns(inputs.size());
+    std::vector<const double *> column_ptrs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        bool polled = find_read_table(inputs[i]) != nullptr;
+        columns[i].assign(rows, polled ? NAN : 0);
+        size_t k = 0;
+        for (size_t row = 0; row < rows && polled; ++row) {
+            while (k < input_times_us[i].size() && input_times_us[i][k] <= times_us[row]) {
+                k++;
             }
-            if (iter->visible) {
-                ++iter;
-            } else {
-                iter = m_plot_register_datas.erase(iter);
+            if (k > 0) {
+                columns[i][row] = input_words[i][k - 1];
             }
         }
+        column_ptrs[i] = columns[i].data();
+    }
+    std::vector<double> values(rows);
+    expression.evaluate(column_ptrs.data(), rows, values.data());
+    // only changes are appended, as they are live
+    size_t samples = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        double x = times_us[row] / 1e6;
+        if (isnan(values[row]) || (samples > 0 && values[row] == plot.trace->last_y)) {
+            plot.trace->last_poll_x = x;
+            continue;
+        }
+        if (samples > 0 && plot.trace->last_poll_x > plot.last_append_x) {
+            plot.trace->ring.append(plot.trace->last_poll_x, plot.trace->last_y);
+        }
+        plot.trace->ring.append(x, values[row]);
+        plot.last_append_x = x;
+        plot.trace->last_poll_x = x;
+        plot.trace->last_y = values[row];
+        samples++;
+    }
+    LogInfo("plot {} starts with {} samples computed from {} recorded rows", plot.title, samples, rows);
+}
+
+void ModbusWindow::prune_register_plots() {
+    // only the ui thread changes the list, it is read without the lock
+    bool removed = std::any_of(m_plot_register_datas.begin(), m_plot_register_datas.end(),
+                               [](const PlotRegisterData &x) { return x.trace->removed.load(); });
+    if (!removed) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_plot_mutex);
+    m_plot_register_datas.remove_if([](const PlotRegisterData &x) { return x.trace->removed.load(); });
+    rebuild_plot_subscriptions();
+}
+
+void ModbusWindow::rebuild_plot_subscriptions() {
+    m_plot_subscriptions.clear();
+    m_derived_plots.clear();
+    for (auto &plot : m_plot_register_datas) {
+        if (plot.channel != 0) {
+            m_derived_plots.push_back(&plot);
+            continue;
+        }
+        if (plot.function == 0) {
+            continue;
+        }
+        std::vector<PlotSubscription> &subscriptions =
+            m_plot_subscriptions[uint16_t(plot.slave_id << 8 | plot.function)];
+        auto iter = std::lower_bound(subscriptions.begin(), subscriptions.end(), plot,
+                                     [](const PlotSubscription &x, const PlotRegisterData &y) {
+                                         return x.reg_addr < y.reg_addr ||
+                                                (x.reg_addr == y.reg_addr && x.format < y.format);
+                                     });
+        if (iter != subscriptions.end() && iter->reg_addr == plot.reg_addr && iter->format == plot.format) {
+            iter->plots.push_back(&plot);
+        } else {
+            subscriptions.insert(iter, PlotSubscription{uint16_t(plot.reg_addr), plot.format, {&plot}});
+        }
+    }
+}
+
+void ModbusWindow::publish_plot_samples(RegistersTableData *regs_table_data, int offset, int quantity) {
+    std::lock_guard<std::mutex> lock(m_plot_mutex);
+    auto found =
+        m_plot_subscriptions.find(uint16_t(regs_table_data->id << 8 | modbusReadSpace(regs_table_data->function)));
+    if (found == m_plot_subscriptions.end()) {
+        return;
+    }
+    std::vector<PlotSubscription> &subscriptions = found->second;
+    int first_addr = regs_table_data->reg_start + offset;
+    double now = m_master_last_recv_time.wallSeconds();
+    auto iter = std::lower_bound(subscriptions.begin(), subscriptions.end(), first_addr,
+                                 [](const PlotSubscription &x, int addr) { return x.reg_addr < addr; });
+    for (; iter != subscriptions.end() && iter->reg_addr < first_addr + quantity; ++iter) {
+        int index = iter->reg_addr - first_addr;
+        int width = cellFormatWidth(iter->format);
+        // a cell is only plotted from a response holding all of its registers
+        if (index + width > quantity) {
+            continue;
+        }
+        // the deadband of a cell is in the unit of its table format, a plot of the registers in another format sees
+        // every change of them
+        bool table_format = regs_table_data->cell_formats[offset + index] == iter->format;
+        bool changed = anyDirty(table_format ? m_changed_bits : m_dirty_bits, index, width);
+        bool decoded = false;
+        double value = 0;
+        for (PlotRegisterData *plot : iter->plots) {
+            PlotTrace &trace = *plot->trace;
+            // a plot without samples yet takes the current value whether it changed or not
+            if (changed || plot->last_append_x == 0) {
+                if (!decoded) {
+                    value = get_double_by_format(iter->format, &regs_table_data->reg_values[offset + index]);
+                    decoded = true;
+                }
+                // the old value holds up to the poll before the change
+                if (trace.last_poll_x > plot->last_append_x) {
+                    trace.ring.append(trace.last_poll_x, trace.last_y);
+                }
+                trace.ring.append(now, value);
+                plot->last_append_x = now;
+                trace.last_y = value;
+            }
+            trace.last_poll_x = now;
+        }
     }
-    ImGui::End();
 }
 
 void ModbusWindow::read_data_callback(const char *buffer, size_t buffer_size) {
+    m_master_last_recv_time = timestampNow();
+    requestRedraw(1000 / m_max_redraw_rate);
     if (m_modbus->validPack(buffer, buffer_size)) {
-        ModbusFrameInfo frame_info{};
         if (m_identifier == ModbusMaster) {
-            char msg[1024];
-            size_t str_size = toHexString((const uint8_t *)buffer, buffer_size, msg);
-            LogInfo("<< {}", msg);
-            frame_info = m_modbus->masterPack2Frame(buffer, buffer_size);
-            m_master_last_send_frame =
-                m_modbus->slavePack2Frame(m_master_last_send_data->packet, m_master_last_send_data->packet_size);
-            LogInfo("Frame_info.id: {}, last_send_frame.id:{}", frame_info.id, m_master_last_send_frame.id);
-            if (frame_info.id == m_master_last_send_frame.id) {
-                LogInfo("frame_info.trans_id:{},last_send_frame.trans_id:{}", frame_info.trans_id,
-                        m_master_last_send_frame.trans_id);
-                if (((m_protocol == MODBUS_TCP || m_protocol == MODBUS_UDP) &&
-                     frame_info.trans_id == m_master_last_send_frame.trans_id) ||
-                    (m_protocol != MODBUS_TCP && m_protocol != MODBUS_UDP)) {
-                    if (m_communication_traffic_dialog_visible && !m_communication_traffic_window_data.stopped) {
-                        msg[str_size++] = '\n';
-                        msg[str_size++] = '\0';
-                        char time_stamp[32] = "";
-                        if (m_communication_traffic_window_data.timestamp) {
-                            getTimeStampString(time_stamp, sizeof(time_stamp));
-                        }
-                        m_communication_traffic_window_data.communication_traffic_text.append(time_stamp)
-                            .append("Rx : ")
-                            .append(msg);
-                        if (m_communication_traffic_window_data.stop_on_error) {
-                            m_communication_traffic_window_data.stopped = frame_info.function > ModbusFunctionError;
-                        }
-                    }
-                    SDL_RemoveTimer(m_recv_timer_id);
-                    process_master_frame(frame_info);
-                    m_send_timer_id = SDL_AddTimer(1, Send_timer_callback, this);
+            // the view refers into the receive buffer, it must be consumed before clear()
+            ModbusPduView frame_view = m_modbus->pack2View(buffer, buffer_size, m_pdu_scratch);
+            bool matched = frame_view.data != nullptr && frame_view.id == m_master_last_request.id &&
+                           ((m_protocol != MODBUS_TCP && m_protocol != MODBUS_UDP) ||
+                            frame_view.trans_id == m_master_last_request.trans_id);
+            if (matched) {
+                SDL_RemoveTimer(m_recv_timer_id);
+                // the answer shows before the next request, whose timer thread appends to the traffic text too
+                trace_frame(false, m_master_last_recv_time, buffer, buffer_size, true, false);
+                if (m_communication_traffic_dialog_visible && !m_communication_traffic_window_data.stopped &&
+                    m_communication_traffic_window_data.stop_on_error) {
+                    m_communication_traffic_window_data.stopped = frame_view.function > ModbusFunctionError;
                 }
+                process_master_frame(frame_view);
+                m_send_timer_id = SDL_AddTimer(1, Send_timer_callback, this);
             }
+            // the next request is already scheduled, the log dump does not delay it
+            trace_frame(false, m_master_last_recv_time, buffer, buffer_size, false);
+            LogInfo("frame id:{} trans_id:{}, request id:{} trans_id:{}", frame_view.id, frame_view.trans_id,
+                    m_master_last_request.id, m_master_last_request.trans_id);
         } else if (m_identifier == ModbusSlave) {
-            frame_info = m_modbus->slavePack2Frame(buffer, buffer_size);
+            ModbusFrameInfo frame_info = m_modbus->slavePack2Frame(buffer, buffer_size);
             ModbusErrorCode error_code{ModbusErrorCode_OK};
-            RegistersTableData *slave_reg_table_data =
-                getSlaveReadTableData(frame_info.id, frame_info.function, frame_info.reg_addr,
-                                      frame_info.reg_addr + frame_info.quantity - 1, error_code);
-            if (slave_reg_table_data) {
-                if (m_communication_traffic_dialog_visible && !m_communication_traffic_window_data.stopped) {
-                    char msg[1024];
-                    size_t str_size = toHexString((const uint8_t *)buffer, buffer_size, msg);
-                    LogInfo("<< {}", msg);
-                    msg[str_size++] = '\n';
-                    msg[str_size++] = '\0';
-                    char time_stamp[32] = "";
-                    if (m_communication_traffic_window_data.timestamp) {
-                        getTimeStampString(time_stamp, sizeof(time_stamp));
-                    }
-                    m_communication_traffic_window_data.communication_traffic_text.append(time_stamp)
-                        .append("Rx : ")
-                        .append(msg);
+            RegistersTableData *slave_reg_table_data = nullptr;
+            bool addressed{false};
+            m_slave_diagnostics_counters.bus_message_count++;
+            // diagnostics and identification address the device, not one of its tables
+            if (frame_info.function == ModbusDiagnostics || frame_info.function == ModbusEncapsulatedInterface) {
+                addressed = hasSlaveId(frame_info.id);
+            } else if (!valid_slave_quantity(frame_info)) {
+                // checked before the tables, a reply can not hold more than the limit whatever the tables hold
+                error_code = ModbusErrorCode_Illegal_Data_Value;
+                addressed = hasSlaveId(frame_info.id);
+            } else {
+                slave_reg_table_data = getSlaveReadTableData(frame_info.id, frame_info.function, frame_info.reg_addr,
+                                                             frame_info.reg_addr + frame_info.quantity - 1, error_code);
+                addressed = slave_reg_table_data != nullptr;
+                if (!addressed && hasSlaveId(frame_info.id)) {
+                    m_slave_diagnostics_counters.slave_no_response_count++;
                 }
+            }
+            if (addressed) {
+                m_slave_diagnostics_counters.slave_message_count++;
+                trace_frame(false, m_master_last_recv_time, buffer, buffer_size, true);
                 process_slave_frame(frame_info, slave_reg_table_data, error_code);
             }
         }
@@ -1404,111 +2572,231 @@ void ModbusWindow::read_data_callback(const char *buffer, size_t buffer_size) {
 }
 
 uint32_t ModbusWindow::scan_timer_callback(uint32_t interval, void *param) {
-    if (!m_cycle_list.empty()) {
-        return interval;
-    }
     uint32_t tick = SDL_GetTicks();
+    m_alarms.tick(timestampNow().wallUs());
+    std::vector<RegistersTableData *> due_tables;
     for (auto &regs_table_data : m_registers_table_datas) {
-        if (tick - m_last_scan_timestamp_map[regs_table_data] >= regs_table_data->scan_rate) {
-            ModbusPacket *mdb_pack = new ModbusPacket;
-            if (regs_table_data->function == ModbusReadCoils || regs_table_data->function == ModbusReadDescreteInputs ||
-                regs_table_data->function == ModbusReadHoldingRegisters ||
-                regs_table_data->function == ModbusReadInputRegisters) {
-                memcpy(mdb_pack->packet, regs_table_data->packet, regs_table_data->packet_size);
-                mdb_pack->packet_size = regs_table_data->packet_size;
-            } else {
-                ModbusFrameInfo frame_info{};
-                frame_info.id = regs_table_data->id;
-                frame_info.function = regs_table_data->function;
-                frame_info.reg_addr = regs_table_data->reg_start;
-                frame_info.quantity = regs_table_data->reg_quantity;
-                memcpy(frame_info.reg_values, regs_table_data->reg_values,
-                       regs_table_data->reg_quantity * sizeof(uint16_t));
-                mdb_pack->packet_size = m_modbus->masterFrame2Pack(frame_info, mdb_pack->packet);
-            }
-            m_cycle_list.push_back(mdb_pack);
-            m_cycle_table_list.push_back(regs_table_data);
+        // a table is queued again only after its previous requests are done
+        if (tick - m_last_scan_timestamp_map[regs_table_data] < regs_table_data->scan_rate ||
+            m_bus_scheduler.pending(regs_table_data)) {
+            continue;
+        }
+        // a quarantined slave stays due, once its suspension ends a single table probes it in the background.
+        // unlike the shortened timeout this holds on serial lines too, where a dead slave costs the most
+        const ResponseTimeout &timeout = m_slave_timeouts[regs_table_data->id & 0xff];
+        if (timeout.failures() >= RESPONSE_TIMEOUT_SUSPEND_AFTER) {
+            if (timeout.suspended(tick) || m_bus_scheduler.slavePending(regs_table_data->id)) {
+                continue;
+            }
             m_last_scan_timestamp_map[regs_table_data] = tick;
+            queue_scan_packets(regs_table_data, ScanPriorityBackground);
+            continue;
+        }
+        due_tables.push_back(regs_table_data);
+        m_last_scan_timestamp_map[regs_table_data] = tick;
+    }
+    std::vector<bool> queued(due_tables.size(), false);
+    if (m_combine_read_write) {
+        for (size_t i = 0; i < due_tables.size(); ++i) {
+            RegistersTableData *write_table = due_tables[i];
+            if ((write_table->function != ModbusWriteSingleRegister &&
+                 write_table->function != ModbusWriteMultipleRegisters) ||
+                write_table->reg_quantity > MODBUS_MAX_RW_WRITE_REGISTERS) {
+                continue;
+            }
+            for (size_t j = 0; j < due_tables.size(); ++j) {
+                RegistersTableData *read_table = due_tables[j];
+                if (!queued[j] && read_table->id == write_table->id &&
+                    read_table->function == ModbusReadHoldingRegisters &&
+                    read_table->reg_quantity <= MODBUS_MAX_READ_REGISTERS) {
+                    queue_read_write_packet(read_table, write_table);
+                    queued[i] = true;
+                    queued[j] = true;
+                    break;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < due_tables.size(); ++i) {
+        if (!queued[i]) {
+            queue_scan_packets(due_tables[i], due_tables[i]->priority);
         }
     }
     return interval;
 }
 
+void ModbusWindow::queue_scan_packets(RegistersTableData *regs_table_data, ScanPriority priority) {
+    bool is_read = regs_table_data->function == ModbusReadCoils ||
+                   regs_table_data->function == ModbusReadDescreteInputs ||
+                   regs_table_data->function == ModbusReadHoldingRegisters ||
+                   regs_table_data->function == ModbusReadInputRegisters;
+    // tables larger than one request are split into as few requests as the protocol allows
+    int max_quantity = modbusMaxQuantity(regs_table_data->function);
+    for (int offset = 0; offset < regs_table_data->reg_quantity; offset += max_quantity) {
+        int quantity = std::min(max_quantity, regs_table_data->reg_quantity - offset);
+        ModbusPacket *mdb_pack = new ModbusPacket;
+        if (is_read && quantity == regs_table_data->reg_quantity) {
+            memcpy(mdb_pack->packet, regs_table_data->packet, regs_table_data->packet_size);
+            mdb_pack->packet_size = regs_table_data->packet_size;
+        } else {
+            mdb_pack->packet_size =
+                m_modbus->scanFrame2Pack(regs_table_data->id, regs_table_data->function,
+                                         regs_table_data->reg_start + offset, quantity,
+                                         regs_table_data->reg_values + offset, mdb_pack->packet);
+        }
+        m_bus_scheduler.push(priority, mdb_pack, regs_table_data);
+    }
+}
+
+void ModbusWindow::report_table_error(RegistersTableData *regs_table_data, const char *msg) {
+    regs_table_data->error_count++;
+    regs_table_data->update_info();
+    snprintf(regs_table_data->msg, sizeof(regs_table_data->msg), "%s", msg);
+}
+
+void ModbusWindow::queue_read_write_packet(RegistersTableData *read_table, RegistersTableData *write_table) {
+    ModbusFrameInfo frame_info{};
+    frame_info.id = read_table->id;
+    frame_info.function = ModbusReadWriteMultipleRegisters;
+    frame_info.reg_addr = read_table->reg_start;
+    frame_info.quantity = read_table->reg_quantity;
+    frame_info.write_reg_addr = write_table->reg_start;
+    frame_info.write_quantity = write_table->reg_quantity;
+    memcpy(frame_info.write_reg_values, write_table->reg_values, write_table->reg_quantity * sizeof(uint16_t));
+    ModbusPacket *mdb_pack = new ModbusPacket;
+    mdb_pack->packet_size = m_modbus->masterFrame2Pack(frame_info, mdb_pack->packet);
+    // the response carries the read registers, so the transaction is accounted to the read table
+    m_bus_scheduler.push(std::min(read_table->priority, write_table->priority), mdb_pack, read_table, write_table);
+    write_table->send_count++;
+    write_table->update_info();
+}
+
 uint32_t ModbusWindow::send_timer_callback(uint32_t interval, void *param) {
     bool has_pack = false;
-    RegistersTableData *regs_table_data = nullptr;
+    ScheduledRequest request;
+    queue_register_writes();
     if (!m_manual_list.empty()) {
         has_pack = true;
         m_master_last_send_data = m_manual_list.front();
-    } else if (!m_cycle_list.empty()) {
+    } else if (m_bus_scheduler.current(request)) {
         has_pack = true;
-        m_master_last_send_data = m_cycle_list.front();
-        regs_table_data = m_cycle_table_list.front();
-        regs_table_data->send_count++;
-        regs_table_data->update_info();
+        m_master_last_send_data = request.packet;
+        if (request.table) {
+            request.table->send_count++;
+            request.table->update_info();
+        }
     }
     if (has_pack) {
         if (m_protocol == MODBUS_TCP || m_protocol == MODBUS_UDP) {
             setModbusPacketTransID(m_master_last_send_data->packet, m_trans_id);
             m_trans_id++;
         }
+        m_master_last_request =
+            m_modbus->requestHeader(m_master_last_send_data->packet, m_master_last_send_data->packet_size);
+        m_master_last_send_time = timestampNow();
         m_myIODevice->write(m_master_last_send_data->packet, m_master_last_send_data->packet_size);
         SDL_RemoveTimer(m_send_timer_id);
-        m_recv_timer_id = SDL_AddTimer(m_recv_timeout_ms, Recv_timer_callback, this);
-        char msg[1024];
-        size_t str_size =
-            toHexString((const uint8_t *)m_master_last_send_data->packet, m_master_last_send_data->packet_size, msg);
-        LogInfo(">> {}", msg);
-        if (m_communication_traffic_dialog_visible && !m_communication_traffic_window_data.stopped) {
-            msg[str_size++] = '\n';
-            msg[str_size++] = '\0';
-            char time_stamp[32] = "";
-            if (m_communication_traffic_window_data.timestamp) {
-                getTimeStampString(time_stamp, sizeof(time_stamp));
-            }
-            m_communication_traffic_window_data.communication_traffic_text.append(time_stamp)
-                .append("Tx : ")
-                .append(msg);
-        }
+        m_recv_timer_id = SDL_AddTimer(response_timeout_ms(m_master_last_request.id), Recv_timer_callback, this);
+        trace_frame(true, m_master_last_send_time, m_master_last_send_data->packet,
+                    m_master_last_send_data->packet_size, true);
     }
     return interval;
 }
 
+void ModbusWindow::trace_frame(bool tx, const Timestamp &timestamp, const char *packet, size_t packet_size,
+                               bool show_in_traffic, bool log_frame) {
+    show_in_traffic =
+        show_in_traffic && m_communication_traffic_dialog_visible && !m_communication_traffic_window_data.stopped;
+    log_frame = log_frame && LogEnabled(spdlog::level::info);
+    if (!show_in_traffic && !log_frame) {
+        return;
+    }
+    char msg[2048];
+    size_t str_size = toHexString((const uint8_t *)packet, packet_size, msg);
+    if (log_frame) {
+        LogInfo("{} {}", tx ? ">>" : "<<", msg);
+    }
+    if (show_in_traffic) {
+        msg[str_size++] = '\n';
+        msg[str_size++] = '\0';
+        char time_stamp[32] = "";
+        if (m_communication_traffic_window_data.timestamp) {
+            formatTimestamp(timestamp, time_stamp, sizeof(time_stamp));
+        }
+        m_communication_traffic_window_data.communication_traffic_text.append(time_stamp)
+            .append(tx ? "Tx : " : "Rx : ")
+            .append(msg);
+    }
+}
+
 uint32_t ModbusWindow::recv_timer_callback(uint32_t interval, void *param) {
     SDL_RemoveTimer(m_recv_timer_id);
+    uint64_t timeout_us = bus_time_us(timestampNow());
+    m_bus_stats.busy_us += timeout_us;
+    m_bus_stats.timeout_us += timeout_us;
     RegistersTableData *regs_table_data = nullptr;
+    ScheduledRequest request;
     bool is_manual_frame{false};
+    bool is_register_write{false};
     if (!m_manual_list.empty()) {
         is_manual_frame = true;
-        delete m_manual_list.front();
-        m_manual_list.pop_front();
-    } else if (!m_cycle_list.empty()) {
-        delete m_cycle_list.front();
-        m_cycle_list.pop_front();
-        regs_table_data = m_cycle_table_list.front();
-        m_cycle_table_list.pop_front();
-        regs_table_data->error_count++;
-        regs_table_data->update_info();
-        snprintf(regs_table_data->msg, sizeof(regs_table_data->msg), "Timeout Error");
+        is_register_write = pop_manual_frame();
+    } else if (m_bus_scheduler.pop(timeout_us, request)) {
+        delete request.packet;
+        regs_table_data = request.table;
+    }
+    if (is_register_write) {
+        report_register_writes(ModbusErrorCode_Timeout);
+    } else if (regs_table_data) {
+        report_table_error(regs_table_data, "Timeout Error");
         LogInfo("Timeout Error");
     }
-    m_master_last_send_frame =
-        m_modbus->slavePack2Frame(m_master_last_send_data->packet, m_master_last_send_data->packet_size);
-    if ((m_master_last_send_frame.function == ModbusWriteSingleCoil ||
-         m_master_last_send_frame.function == ModbusWriteMultipleCoils ||
-         m_master_last_send_frame.function == ModbusWriteSingleRegister ||
-         m_master_last_send_frame.function == ModbusWriteMultipleRegisters) &&
-        is_manual_frame) {
+    if (request.write_table) {
+        report_table_error(request.write_table, "Timeout Error");
+    }
+    if ((m_master_last_request.function == ModbusWriteSingleCoil ||
+         m_master_last_request.function == ModbusWriteMultipleCoils ||
+         m_master_last_request.function == ModbusWriteSingleRegister ||
+         m_master_last_request.function == ModbusWriteMultipleRegisters ||
+         m_master_last_request.function == ModbusMaskWriteRegister) &&
+        is_manual_frame && !is_register_write) {
         if (m_write_frame_response_callback) {
             m_write_frame_response_callback(ModbusErrorCode_Timeout);
         }
     }
+    if (m_master_last_request.function == ModbusDiagnostics && is_manual_frame && m_latency_probe_data.running) {
+        m_latency_probe_data.timeout_count++;
+    }
+    if (m_master_last_request.id > 0) {
+        m_slave_timeouts[m_master_last_request.id].onTimeout(SDL_GetTicks());
+    }
+    m_alarms.slaveResult(m_master_last_request.id, ModbusErrorCode_Timeout, timestampNow().wallUs());
     m_error_count_map[ModbusErrorCode_Timeout]++;
+    requestRedraw(1000 / m_max_redraw_rate);
     m_myIODevice->clear();
     m_send_timer_id = SDL_AddTimer(1, Send_timer_callback, this);
     return interval;
 }
 
+uint32_t ModbusWindow::probe_timer_callback(uint32_t interval, void *param) {
+    // skip a tick instead of piling up echoes when the link is slower than the probe rate
+    if (m_manual_list.empty()) {
+        ModbusFrameInfo frame_info{};
+        frame_info.id = m_latency_probe_data.slave_id;
+        frame_info.function = ModbusDiagnostics;
+        frame_info.reg_addr = ModbusDiagReturnQueryData;
+        frame_info.reg_values[0] = ++m_latency_probe_data.token;
+        queue_manual_frame(frame_info);
+    }
+    return interval;
+}
+
+void ModbusWindow::queue_manual_frame(const ModbusFrameInfo &frame_info) {
+    ModbusPacket *mdb_pack = new ModbusPacket;
+    mdb_pack->packet_size = m_modbus->masterFrame2Pack(frame_info, mdb_pack->packet);
+    m_manual_list.push_back(mdb_pack);
+}
+
 void ModbusWindow::error_handle(const char *error_msg) { LogError("{}", error_msg); }
 
 void ModbusWindow::write_master_register_value(CellFormat format, const char *value_str,
@@ -1769,72 +3057,251 @@ void ModbusWindow::write_master_register_value(CellFormat format, const char *va
         break;
     }
     if (data_valid) {
-        ModbusPacket *mdb_packet = new ModbusPacket();
-        mdb_packet->packet_size = m_modbus->masterFrame2Pack(frame_info, mdb_packet->packet);
-        m_manual_list.push_back(mdb_packet);
+        RegisterWrite write;
+        write.id = frame_info.id;
+        write.coil = frame_info.function == ModbusWriteSingleCoil;
+        write.reg_addr = frame_info.reg_addr;
+        write.quantity = frame_info.quantity;
+        memcpy(write.values, frame_info.reg_values, write.quantity * sizeof(write.values[0]));
+        write.table = reg_table_data;
+        m_write_combiner.push(write);
+    }
+}
+
+void ModbusWindow::queue_register_writes() {
+    if (!m_manual_list.empty() || m_write_combiner.empty()) {
+        return;
+    }
+    ModbusFrameInfo frame_info;
+    if (m_write_combiner.take(frame_info, m_register_writes)) {
+        m_register_write_packet = new ModbusPacket;
+        m_register_write_packet->packet_size = m_modbus->masterFrame2Pack(frame_info, m_register_write_packet->packet);
+        m_manual_list.push_back(m_register_write_packet);
+        LogInfo("{} cell writes of id:{} merged into function:{} addr:{} quantity:{}", m_register_writes.size(),
+                frame_info.id, frame_info.function, frame_info.reg_addr, frame_info.quantity);
     }
 }
 
-void ModbusWindow::process_master_frame(const ModbusFrameInfo &frame_info) {
+bool ModbusWindow::pop_manual_frame() {
+    ModbusPacket *mdb_pack = m_manual_list.front();
+    m_manual_list.pop_front();
+    bool is_register_write = mdb_pack == m_register_write_packet;
+    delete mdb_pack;
+    if (is_register_write) {
+        m_register_write_packet = nullptr;
+    }
+    return is_register_write;
+}
+
+void ModbusWindow::report_register_writes(ModbusErrorCode error_code) {
+    for (auto &write : m_register_writes) {
+        if (write.table && error_code != ModbusErrorCode_OK) {
+            snprintf(write.table->msg, sizeof(write.table->msg), "%s %d: %s", gettext("Write"), write.reg_addr,
+                     m_error_code_options.labelOf(error_code));
+        }
+        if (m_write_frame_response_callback) {
+            m_write_frame_response_callback(error_code);
+        }
+    }
+    m_register_writes.clear();
+}
+
+void ModbusWindow::publish_changes(RegistersTableData *regs_table_data, int offset, int quantity) {
+    memset(m_changed_bits, 0, sizeof(m_changed_bits));
+    int changes = 0;
+    for (int i = 0; i < quantity;) {
+        int cell = offset + i;
+        CellFormat format = regs_table_data->cell_formats[cell];
+        int width = cellFormatWidth(format);
+        // a cell cut off by the end of the table or the response is passed on as raw registers
+        bool whole = width <= regs_table_data->reg_quantity - cell;
+        width = std::min(width, quantity - i);
+        if (anyDirty(m_dirty_bits, i, width)) {
+            ReportedCell &reported = regs_table_data->reported_cells[cell];
+            float deadband_abs = regs_table_data->deadband_abs[cell];
+            float deadband_pct = regs_table_data->deadband_pct[cell];
+            bool changed = true;
+            double value = NAN;
+            if (whole && format != Format_None && format != Format_Coil) {
+                value = get_double_by_format(format, &regs_table_data->reg_values[cell]);
+                if ((deadband_abs > 0 || deadband_pct > 0) && reported.format == format && !isnan(reported.value)) {
+                    double delta = fabs(value - reported.value);
+                    changed = (deadband_abs > 0 && delta > deadband_abs) ||
+                              (deadband_pct > 0 && delta > deadband_pct / 100.0 * fabs(reported.value));
+                }
+            }
+            if (changed) {
+                reported.value = value;
+                reported.format = format;
+                for (int k = 0; k < width; ++k) {
+                    setDirty(m_changed_bits, i + k);
+                }
+                changes += width;
+            }
+        }
+        i += width;
+    }
+    m_bus_stats.polled_registers += quantity;
+    m_bus_stats.changed_registers += changes;
+    m_historian.append(regs_table_data, offset, quantity, &regs_table_data->reg_values[offset],
+                       m_master_last_recv_time.wallUs(), changes > 0);
+    // the alarms see every change, the deadbands only thin out what is recorded and plotted
+    m_alarms.update(uint8_t(regs_table_data->id), uint8_t(modbusReadSpace(regs_table_data->function)),
+                    uint16_t(regs_table_data->reg_start + offset), &regs_table_data->reg_values[offset], quantity,
+                    m_dirty_bits, m_master_last_recv_time.wallUs());
+    m_exporter.push(regs_table_data, offset, quantity, &regs_table_data->reg_values[offset],
+                    m_master_last_recv_time.wallUs());
+}
+
+void ModbusWindow::update_derived_channels(RegistersTableData *regs_table_data, int offset, int quantity) {
+    m_derived_channels.update(uint8_t(regs_table_data->id), uint8_t(modbusReadSpace(regs_table_data->function)),
+                              uint16_t(regs_table_data->reg_start + offset), &regs_table_data->reg_values[offset],
+                              quantity, m_dirty_bits);
+    m_derived_changed.clear();
+    m_derived_channels.evaluate(m_derived_changed);
+    double now = m_master_last_recv_time.wallSeconds();
+    std::lock_guard<std::mutex> lock(m_plot_mutex);
+    for (PlotRegisterData *plot : m_derived_plots) {
+        PlotTrace &trace = *plot->trace;
+        bool changed =
+            std::find(m_derived_changed.begin(), m_derived_changed.end(), plot->channel) != m_derived_changed.end();
+        double value;
+        if ((changed || plot->last_append_x == 0) && m_derived_channels.value(plot->channel, value) && !isnan(value)) {
+            if (trace.last_poll_x > plot->last_append_x) {
+                trace.ring.append(trace.last_poll_x, trace.last_y);
+            }
+            trace.ring.append(now, value);
+            plot->last_append_x = now;
+            trace.last_y = value;
+        }
+        trace.last_poll_x = now;
+    }
+}
+
+RegistersTableData *ModbusWindow::find_read_table(const ExpressionInput &input) {
+    for (auto &table : m_registers_table_datas) {
+        if (table->id == input.id && modbusReadSpace(table->function) == input.function &&
+            table->reg_start <= input.reg_addr && input.reg_addr <= table->reg_end) {
+            return table;
+        }
+    }
+    return nullptr;
+}
+
+double ModbusWindow::current_register_value(const ExpressionInput &input) {
+    RegistersTableData *table = find_read_table(input);
+    return table ? table->reg_values[input.reg_addr - table->reg_start] : 0;
+}
+
+void ModbusWindow::process_master_frame(const ModbusPduView &frame_view) {
+    uint64_t latency_us = bus_time_us(m_master_last_recv_time);
+    m_bus_stats.busy_us += latency_us;
     RegistersTableData *regs_table_data = nullptr;
+    ScheduledRequest request;
     bool is_manual_frame{false};
+    bool is_register_write{false};
     if (!m_manual_list.empty()) {
         is_manual_frame = true;
-        delete m_manual_list.front();
-        m_manual_list.pop_front();
-    } else if (!m_cycle_list.empty()) {
-        delete m_cycle_list.front();
-        m_cycle_list.pop_front();
-        regs_table_data = m_cycle_table_list.front();
-        m_cycle_table_list.pop_front();
-    }
-    if (frame_info.function > ModbusFunctionError) {
-        ModbusErrorCode error_code = (ModbusErrorCode)frame_info.reg_values[0];
-        int func_code = frame_info.function - ModbusFunctionError;
+        is_register_write = pop_manual_frame();
+    } else if (m_bus_scheduler.pop(latency_us, request)) {
+        delete request.packet;
+        regs_table_data = request.table;
+    }
+    record_latency(regs_table_data, frame_view.id, latency_us);
+    m_alarms.slaveResult(frame_view.id, frame_view.function > ModbusFunctionError ? frame_view.exceptionCode() : 0,
+                         m_master_last_recv_time.wallUs());
+    if (frame_view.function > ModbusFunctionError) {
+        ModbusErrorCode error_code = (ModbusErrorCode)frame_view.exceptionCode();
+        int func_code = frame_view.function - ModbusFunctionError;
         if ((func_code == ModbusWriteSingleCoil || func_code == ModbusWriteMultipleCoils ||
-             func_code == ModbusWriteSingleRegister || func_code == ModbusWriteMultipleRegisters) &&
+             func_code == ModbusWriteSingleRegister || func_code == ModbusWriteMultipleRegisters ||
+             func_code == ModbusMaskWriteRegister) &&
             is_manual_frame) {
-            if (m_write_frame_response_callback) {
+            if (is_register_write) {
+                report_register_writes(error_code);
+            } else if (m_write_frame_response_callback) {
                 m_write_frame_response_callback(error_code);
             }
         }
         m_error_count_map[error_code]++;
         if (regs_table_data) {
-            regs_table_data->error_count++;
-            regs_table_data->update_info();
-        }
-        snprintf(regs_table_data->msg, sizeof(regs_table_data->msg), "%s", modbus_error_code_map[error_code]);
-    } else if (frame_info.function == ModbusReadCoils || frame_info.function == ModbusReadDescreteInputs) {
-        uint8_t *coils = (uint8_t *)frame_info.reg_values;
-        for (int i = 0; i < m_master_last_send_frame.quantity; ++i) {
-            int byte_index = i / 8;
-            int bit_index = i % 8;
-            regs_table_data->reg_values[i] = getBit(coils[byte_index], bit_index);
-        }
+            report_table_error(regs_table_data, m_error_code_options.labelOf(error_code));
+        }
+        if (request.write_table) {
+            report_table_error(request.write_table, m_error_code_options.labelOf(error_code));
+        }
+    } else if ((frame_view.function == ModbusReadCoils || frame_view.function == ModbusReadDescreteInputs) &&
+               regs_table_data) {
+        int quantity = std::min<int>(m_master_last_request.quantity, frame_view.byteCount() * 8);
+        quantity = std::min<int>(quantity, (frame_view.data_size - 1) * 8);
+        int offset = m_master_last_request.reg_addr - regs_table_data->reg_start;
+        quantity = std::min<int>(quantity, regs_table_data->reg_quantity - offset);
+        for (int i = 0; i < quantity; ++i) {
+            m_coil_scratch[i] = frame_view.coil(i);
+        }
+        memset(m_dirty_bits, 0, sizeof(m_dirty_bits));
+        storeValues(&regs_table_data->reg_values[offset], m_coil_scratch, quantity, m_dirty_bits);
         regs_table_data->msg[0] = '\0';
-    } else if (frame_info.function == ModbusReadHoldingRegisters || frame_info.function == ModbusReadInputRegisters) {
-        memcpy(regs_table_data->reg_values + (m_master_last_send_frame.reg_addr - regs_table_data->reg_start),
-               frame_info.reg_values, frame_info.quantity * sizeof(frame_info.reg_values[0]));
+        publish_changes(regs_table_data, offset, quantity);
+        update_derived_channels(regs_table_data, offset, quantity);
+        publish_plot_samples(regs_table_data, offset, quantity);
+    } else if ((frame_view.function == ModbusReadHoldingRegisters ||
+                frame_view.function == ModbusReadInputRegisters ||
+                frame_view.function == ModbusReadWriteMultipleRegisters) &&
+               regs_table_data) {
+        int offset = m_master_last_request.reg_addr - regs_table_data->reg_start;
+        int quantity = std::min<int>(frame_view.regCount(), regs_table_data->reg_quantity - offset);
+        memset(m_dirty_bits, 0, sizeof(m_dirty_bits));
+        storeRegisters(&regs_table_data->reg_values[offset], frame_view.data + 1, quantity, m_dirty_bits);
         regs_table_data->msg[0] = '\0';
-        for (auto &var : m_plot_register_datas) {
-            if (frame_info.reg_addr <= var.reg_addr && var.reg_addr <= frame_info.reg_addr + frame_info.quantity) {
-                var.x_data.push_back(time(nullptr));
-                // TODO : add y data
-                char value_str[32]{0};
-                get_value_by_format(var.format, &frame_info.reg_values[var.reg_addr - frame_info.reg_addr], value_str,
-                                    sizeof(value_str));
-                var.y_data.push_back(atof(value_str));
-            }
-        }
-    } else if ((frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteMultipleCoils ||
-                frame_info.function == ModbusWriteSingleRegister ||
-                frame_info.function == ModbusWriteMultipleRegisters) &&
+        if (request.write_table) {
+            request.write_table->msg[0] = '\0';
+        }
+        publish_changes(regs_table_data, offset, quantity);
+        update_derived_channels(regs_table_data, offset, quantity);
+        publish_plot_samples(regs_table_data, offset, quantity);
+    } else if ((frame_view.function == ModbusWriteSingleCoil || frame_view.function == ModbusWriteMultipleCoils ||
+                frame_view.function == ModbusWriteSingleRegister ||
+                frame_view.function == ModbusWriteMultipleRegisters ||
+                frame_view.function == ModbusMaskWriteRegister) &&
                is_manual_frame) {
-        if (m_write_frame_response_callback) {
+        if (is_register_write) {
+            report_register_writes(ModbusErrorCode_OK);
+        } else if (m_write_frame_response_callback) {
             m_write_frame_response_callback(ModbusErrorCode_OK);
         }
+    } else if (frame_view.function == ModbusDiagnostics && frame_view.data_size >= 4 && is_manual_frame) {
+        uint16_t sub_function = frame_view.word(0);
+        uint16_t value = frame_view.word(2);
+        if (sub_function == ModbusDiagReturnQueryData) {
+            // a late echo of an earlier probe carries an older token and is not counted
+            if (m_latency_probe_data.running && value == m_master_last_request.quantity) {
+                m_latency_probe_data.rtt.record(m_master_last_recv_time.sinceNs(m_master_last_send_time) / 1000);
+            }
+        } else if (sub_function >= ModbusDiagBusMessageCount && sub_function <= ModbusDiagSlaveNoResponseCount) {
+            m_device_diagnostics_data.counters[sub_function - ModbusDiagBusMessageCount] = value;
+        }
+    } else if (frame_view.function == ModbusEncapsulatedInterface && frame_view.data_size >= 6 &&
+               frame_view.data[0] == MODBUS_MEI_READ_DEVICE_ID && is_manual_frame) {
+        // mei type, read device id code, conformity level, more follows, next object id, number of objects, objects
+        DeviceDiagnosticsData &diag_data = m_device_diagnostics_data;
+        diag_data.conformity_level = frame_view.data[2];
+        size_t index = 6;
+        for (int i = 0; i < frame_view.data[5] && index + 2 <= frame_view.data_size; ++i) {
+            uint8_t object_id = frame_view.data[index];
+            int object_size = std::min<int>(frame_view.data[index + 1], frame_view.data_size - index - 2);
+            const char *object_value = (const char *)frame_view.data + index + 2;
+            if (object_id == ModbusDeviceIdVendorName) {
+                snprintf(diag_data.vendor_name, sizeof(diag_data.vendor_name), "%.*s", object_size, object_value);
+            } else if (object_id == ModbusDeviceIdProductCode) {
+                snprintf(diag_data.product_code, sizeof(diag_data.product_code), "%.*s", object_size, object_value);
+            } else if (object_id == ModbusDeviceIdMajorMinorRevision) {
+                snprintf(diag_data.revision, sizeof(diag_data.revision), "%.*s", object_size, object_value);
+            }
+            index += 2 + object_size;
+        }
     } else {
-        LogWarn("Unknown Function:{}", frame_info.function);
+        LogWarn("Unknown Function:{}", frame_view.function);
     }
 }
 
@@ -1846,29 +3313,48 @@ void ModbusWindow::process_slave_frame(const ModbusFrameInfo &frame_info, Regist
     reply_frame.function = frame_info.function;
     reply_frame.reg_addr = frame_info.reg_addr;
     reply_frame.quantity = frame_info.quantity;
-    if (frame_info.function == ModbusReadHoldingRegisters || frame_info.function == ModbusReadInputRegisters) {
+    if (slave_reg_table_data == nullptr && error_code != ModbusErrorCode_OK) {
+        reply_frame.function = frame_info.function + ModbusFunctionError;
+        reply_frame.reg_values[0] = error_code;
+    } else if (frame_info.function == ModbusDiagnostics) {
+        SlaveDiagnosticsCounters &counters = m_slave_diagnostics_counters;
+        reply_frame.reg_values[0] = frame_info.reg_values[0];
+        if (frame_info.reg_addr == ModbusDiagClearCounters) {
+            counters = SlaveDiagnosticsCounters{};
+        } else if (frame_info.reg_addr == ModbusDiagBusMessageCount) {
+            reply_frame.reg_values[0] = counters.bus_message_count;
+        } else if (frame_info.reg_addr == ModbusDiagBusCommErrorCount) {
+            // a pack failing its check is kept waiting for more bytes, so framing errors are never seen here
+            reply_frame.reg_values[0] = 0;
+        } else if (frame_info.reg_addr == ModbusDiagBusExceptionErrorCount) {
+            reply_frame.reg_values[0] = counters.bus_exception_count;
+        } else if (frame_info.reg_addr == ModbusDiagSlaveMessageCount) {
+            reply_frame.reg_values[0] = counters.slave_message_count;
+        } else if (frame_info.reg_addr == ModbusDiagSlaveNoResponseCount) {
+            reply_frame.reg_values[0] = counters.slave_no_response_count;
+        } else if (frame_info.reg_addr != ModbusDiagReturnQueryData) {
+            reply_frame.function = frame_info.function + ModbusFunctionError;
+            reply_frame.reg_values[0] = ModbusErrorCode_Illegal_Function;
+        }
+    } else if (frame_info.function == ModbusEncapsulatedInterface) {
+        fill_device_identification(frame_info, reply_frame);
+    } else if (frame_info.function == ModbusReadHoldingRegisters || frame_info.function == ModbusReadInputRegisters) {
         memcpy(reply_frame.reg_values,
                slave_reg_table_data->reg_values + (frame_info.reg_addr - slave_reg_table_data->reg_start),
                frame_info.quantity * sizeof(frame_info.reg_values[0]));
     } else if (frame_info.function == ModbusReadCoils || frame_info.function == ModbusReadDescreteInputs) {
-        uint8_t *coils = (uint8_t *)reply_frame.reg_values;
         for (int i = 0; i < frame_info.quantity; ++i) {
-            int byte_index = i / 8;
-            int bit_index = i % 8;
-            setBit(coils[byte_index], bit_index,
-                   slave_reg_table_data->reg_values[i + (frame_info.reg_addr - slave_reg_table_data->reg_start)]);
+            reply_frame.coils.set(i,
+                                  slave_reg_table_data->reg_values[i + (frame_info.reg_addr - slave_reg_table_data->reg_start)]);
         }
     } else if (frame_info.function == ModbusWriteSingleCoil) {
         reply_frame.reg_values[0] = frame_info.reg_values[0];
         slave_reg_table_data->reg_values[frame_info.reg_addr - slave_reg_table_data->reg_start] =
             frame_info.reg_values[0] >> 8 & 0xFF ? 1 : 0;
     } else if (frame_info.function == ModbusWriteMultipleCoils) {
-        uint8_t *coils = (uint8_t *)frame_info.reg_values;
         for (int i = 0; i < frame_info.quantity; ++i) {
-            int byte_index = i / 8;
-            int bit_index = i % 8;
             slave_reg_table_data->reg_values[frame_info.reg_addr - slave_reg_table_data->reg_start + i] =
-                getBit(coils[byte_index], bit_index);
+                frame_info.coils.get(i);
         }
     } else if (frame_info.function == ModbusWriteSingleRegister) {
         reply_frame.reg_values[0] = frame_info.reg_values[0];
@@ -1877,15 +3363,57 @@ void ModbusWindow::process_slave_frame(const ModbusFrameInfo &frame_info, Regist
     } else if (frame_info.function == ModbusWriteMultipleRegisters) {
         memcpy(slave_reg_table_data->reg_values + (frame_info.reg_addr - slave_reg_table_data->reg_start),
                frame_info.reg_values, frame_info.quantity * sizeof(frame_info.reg_values[0]));
+    } else if (frame_info.function == ModbusMaskWriteRegister) {
+        uint16_t &value = slave_reg_table_data->reg_values[frame_info.reg_addr - slave_reg_table_data->reg_start];
+        value = (value & frame_info.reg_values[0]) | (frame_info.reg_values[1] & ~frame_info.reg_values[0]);
+        reply_frame.reg_values[0] = frame_info.reg_values[0];
+        reply_frame.reg_values[1] = frame_info.reg_values[1];
+    } else if (frame_info.function == ModbusReadWriteMultipleRegisters) {
+        // the write is performed before the read, the written range may live in another table
+        ModbusErrorCode write_error_code{ModbusErrorCode_OK};
+        RegistersTableData *write_table_data = getSlaveReadTableData(
+            frame_info.id, frame_info.function, frame_info.write_reg_addr,
+            frame_info.write_reg_addr + frame_info.write_quantity - 1, write_error_code);
+        if (write_table_data) {
+            memcpy(write_table_data->reg_values + (frame_info.write_reg_addr - write_table_data->reg_start),
+                   frame_info.write_reg_values, frame_info.write_quantity * sizeof(frame_info.write_reg_values[0]));
+            memcpy(reply_frame.reg_values,
+                   slave_reg_table_data->reg_values + (frame_info.reg_addr - slave_reg_table_data->reg_start),
+                   frame_info.quantity * sizeof(frame_info.reg_values[0]));
+        } else {
+            reply_frame.function = frame_info.function + ModbusFunctionError;
+            reply_frame.reg_values[0] = write_error_code;
+        }
     } else {
         reply_frame.function = frame_info.function + ModbusFunctionError;
         reply_frame.reg_values[0] = error_code;
     }
+    if (reply_frame.function > ModbusFunctionError) {
+        m_slave_diagnostics_counters.bus_exception_count++;
+    }
     ModbusPacket reply_packet;
     reply_packet.packet_size = m_modbus->slaveFrame2Pack(reply_frame, reply_packet.packet);
     m_myIODevice->write(reply_packet.packet, reply_packet.packet_size);
 }
 
+bool ModbusWindow::valid_slave_quantity(const ModbusFrameInfo &frame_info) {
+    switch (frame_info.function) {
+    case ModbusReadCoils:
+    case ModbusReadDescreteInputs:
+    case ModbusReadHoldingRegisters:
+    case ModbusReadInputRegisters:
+    case ModbusWriteMultipleCoils:
+    case ModbusWriteMultipleRegisters:
+        return frame_info.quantity >= 1 && frame_info.quantity <= modbusMaxQuantity(frame_info.function);
+    case ModbusReadWriteMultipleRegisters:
+        return frame_info.quantity >= 1 && frame_info.quantity <= MODBUS_MAX_READ_REGISTERS &&
+               frame_info.write_quantity >= 1 && frame_info.write_quantity <= MODBUS_MAX_RW_WRITE_REGISTERS;
+    default:
+        // the other functions carry no quantity of their own
+        return true;
+    }
+}
+
 RegistersTableData *ModbusWindow::getSlaveReadTableData(int id, int function, int reg_start, int reg_end,
                                                         ModbusErrorCode &error_code) {
     bool found_function{false};
@@ -1896,7 +3424,8 @@ RegistersTableData *ModbusWindow::getSlaveReadTableData(int id, int function, in
             if (x->function == function ||
                 ((function == ModbusWriteSingleCoil || function == ModbusWriteMultipleCoils) &&
                  x->function == ModbusCoilStatus) ||
-                ((function == ModbusWriteSingleRegister || function == ModbusWriteMultipleRegisters) &&
+                ((function == ModbusWriteSingleRegister || function == ModbusWriteMultipleRegisters ||
+                  function == ModbusMaskWriteRegister || function == ModbusReadWriteMultipleRegisters) &&
                  x->function == ModbusHoldingRegisters)) {
                 found_function = true;
                 if (x->reg_start <= reg_start && x->reg_end >= reg_end) {
@@ -1914,6 +3443,53 @@ RegistersTableData *ModbusWindow::getSlaveReadTableData(int id, int function, in
     return ret;
 }
 
+bool ModbusWindow::hasSlaveId(int id) {
+    return std::any_of(m_registers_table_datas.begin(), m_registers_table_datas.end(),
+                       [id](RegistersTableData *x) { return x->id == id; });
+}
+
+void ModbusWindow::fill_device_identification(const ModbusFrameInfo &frame_info, ModbusFrameInfo &reply_frame) {
+    static const char *device_objects[] = {"DebugMyProtocol", "DebugMyProtocol_IMGUI", "0.0.1"};
+    int mei_type = frame_info.reg_addr >> 8 & 0xFF;
+    int read_code = frame_info.reg_addr & 0xFF;
+    int object_id = frame_info.quantity;
+    int last_object_id = ModbusDeviceIdMajorMinorRevision;
+    if (mei_type != MODBUS_MEI_READ_DEVICE_ID || read_code < ModbusDeviceIdBasicStream ||
+        read_code > ModbusDeviceIdSpecificObject) {
+        reply_frame.function = frame_info.function + ModbusFunctionError;
+        reply_frame.reg_values[0] = ModbusErrorCode_Illegal_Data_Value;
+        return;
+    }
+    if (read_code == ModbusDeviceIdSpecificObject) {
+        if (object_id > ModbusDeviceIdMajorMinorRevision) {
+            reply_frame.function = frame_info.function + ModbusFunctionError;
+            reply_frame.reg_values[0] = ModbusErrorCode_Illegal_Data_Address;
+            return;
+        }
+        last_object_id = object_id;
+    } else if (object_id > ModbusDeviceIdMajorMinorRevision) {
+        // only the basic objects exist, a stream starting past them restarts at the first one
+        object_id = ModbusDeviceIdVendorName;
+    }
+    uint8_t *data = reply_frame.mei_data;
+    int index = 0;
+    data[index++] = MODBUS_MEI_READ_DEVICE_ID;
+    data[index++] = uint8_t(read_code);
+    // basic identification, stream and individual access
+    data[index++] = 0x81;
+    data[index++] = 0x00;
+    data[index++] = 0x00;
+    data[index++] = uint8_t(last_object_id - object_id + 1);
+    for (int id = object_id; id <= last_object_id; ++id) {
+        size_t object_size = strlen(device_objects[id]);
+        data[index++] = uint8_t(id);
+        data[index++] = uint8_t(object_size);
+        memcpy(data + index, device_objects[id], object_size);
+        index += object_size;
+    }
+    reply_frame.mei_data_size = index;
+}
+
 uint32_t Scan_timer_callback(uint32_t interval, void *param) {
     ModbusWindow *window = (ModbusWindow *)param;
     return window->scan_timer_callback(interval, param);
@@ -1928,3 +3504,8 @@ uint32_t Recv_timer_callback(uint32_t interval, void *param) {
     ModbusWindow *window = (ModbusWindow *)param;
     return window->recv_timer_callback(interval, param);
 }
+
+uint32_t Probe_timer_callback(uint32_t interval, void *param) {
+    ModbusWindow *window = (ModbusWindow *)param;
+    return window->probe_timer_callback(interval, param);
+}
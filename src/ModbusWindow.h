@@ -1,14 +1,31 @@
 #ifndef __MODBUSWINDOW_H__
 #define __MODBUSWINDOW_H__
 
+#include "Alarms.h"
+#include "BusScheduler.h"
+#include "DataExporter.h"
+#include "DerivedChannels.h"
+#include "Historian.h"
+#include "HistorianStore.h"
 #include "ModbusBase.h"
+#include "LatencyHistogram.h"
 #include "ModbusFrameInfo.h"
+#include "ResponseTimeout.h"
+#include "Timestamp.h"
 #include "MyIODevice.h"
+#include "OptionTable.h"
+#include "PlotWorkspace.h"
+#include "RegisterChanges.h"
+#include "WriteCombiner.h"
 #include "utils.h"
 #include <SDL.h>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <list>
+#include <math.h>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
@@ -16,6 +33,8 @@
 #include <vector>
 
 #define REGISTER_ALIAS_MAX_LEN 64
+// samples kept per plot, about a day at 5 samples per second
+#define PLOT_SERIES_CAPACITY (1 << 19)
 
 enum CellFormat {
     Format_None = 0,
@@ -51,6 +70,25 @@ enum CellFormat {
     Format_64_Bit_Float_Little_Endian_Byte_Swap,
 };
 
+// registers a cell of the format spans
+inline int cellFormatWidth(CellFormat format) {
+    return format >= Format_64_Bit_Signed_Big_Endian ? 4 : format >= Format_32_Bit_Signed_Big_Endian ? 2 : 1;
+}
+
+// a cell as last formatted for display, formatted again only when its registers or its format changed
+struct CellText {
+    uint16_t raw[4]{0};
+    CellFormat format{Format_None};
+    bool valid{false};
+    char text[32]{0};
+};
+
+// the value of a cell last passed on to the plots and the historian
+struct ReportedCell {
+    double value{NAN};
+    CellFormat format{Format_None};
+};
+
 struct RegistersTableData {
     ModbusIdentifier identifier;
     char table_title[128]{0};
@@ -72,6 +110,14 @@ struct RegistersTableData {
     uint16_t packet_size{0};
     CellFormat *cell_formats{nullptr};
     bool table_visible{true};
+    ScanPriority priority{ScanPriorityNormal};
+    // round trip of every answered request of this table
+    LatencyHistogram latency;
+    // report by exception, a change of a cell smaller than both deadbands is not passed on, 0 turns one off
+    float *deadband_abs{nullptr};
+    float *deadband_pct{nullptr};
+    ReportedCell *reported_cells{nullptr};
+    CellText *cell_texts{nullptr};
     RegistersTableData(uint16_t _id, uint16_t _reg_start, uint16_t _reg_end, uint8_t _function, uint32_t _scan_rate,
                        ModbusIdentifier _identifier)
         : identifier(_identifier), id(_id), reg_start(_reg_start), reg_end(_reg_end),
@@ -94,6 +140,18 @@ struct RegistersTableData {
             memset(reg_alias[i], 0, REGISTER_ALIAS_MAX_LEN);
             reg_alias_selected[i] = false;
         }
+        reset_change_state();
+    }
+
+    void reset_change_state() {
+        delete[] deadband_abs;
+        delete[] deadband_pct;
+        delete[] reported_cells;
+        delete[] cell_texts;
+        deadband_abs = new float[reg_quantity]();
+        deadband_pct = new float[reg_quantity]();
+        reported_cells = new ReportedCell[reg_quantity];
+        cell_texts = new CellText[reg_quantity];
     }
 
     void update_info() {
@@ -124,6 +182,7 @@ struct RegistersTableData {
             memset(reg_alias[i], 0, REGISTER_ALIAS_MAX_LEN);
             reg_alias_selected[i] = false;
         }
+        reset_change_state();
     }
 
     ~RegistersTableData() {
@@ -135,6 +194,10 @@ struct RegistersTableData {
         delete[] reg_alias;
         delete[] reg_alias_selected;
         delete[] reg_values_selected;
+        delete[] deadband_abs;
+        delete[] deadband_pct;
+        delete[] reported_cells;
+        delete[] cell_texts;
     }
 };
 
@@ -151,6 +214,7 @@ struct RegistersDefineData {
     int reg_addr{0};
     int quantity{0};
     int scan_rate{1000};
+    ComboBoxData priority_combo_box_data;
     ModbusFrameInfo frame_info{};
     char hex_str[512], packet[512];
     size_t packet_size;
@@ -171,6 +235,16 @@ struct Function_05_06_Data {
     char hex_str[512]{0};
 };
 
+struct Function_22_Data {
+    int slave_id{0};
+    int address{0};
+    int and_mask{0xFFFF};
+    int or_mask{0};
+    char packet[512]{0};
+    size_t packet_size{0};
+    char hex_str[512]{0};
+};
+
 union Value_Data {
     bool bool_value;
     int32_t s32_value;
@@ -179,12 +253,13 @@ union Value_Data {
     double f64_value;
 };
 
-struct Function_15_16_Data {
+// sized to the quantity a single 15 or 16 request may carry
+template <int MaxValues> struct Function_15_16_Data {
     int slave_id{0};
     int address{0};
     int quantity{0};
-    Value_Data values[MODBUS_FRAME_MAX_REGISTERS]{0};
-    char value_name[MODBUS_FRAME_MAX_REGISTERS][8]{0};
+    Value_Data values[MaxValues]{};
+    char value_name[MaxValues][8]{};
     CellFormat format{Format_Unsigned};
     ComboBoxData format_combo_box_data{};
 };
@@ -195,8 +270,17 @@ struct PlotRegisterData {
     int reg_addr{0};
     CellFormat format{Format_Unsigned};
     ComboBoxData format_combo_box_data{};
-    std::vector<double> x_data;
-    std::vector<double> y_data;
+    // the table the register was picked from, its history fills the plot when it is added
+    RegistersTableData *table{nullptr};
+    // the slave and read function of that table, any table reading the register feeds the plot. 0 for none
+    uint8_t slave_id{0};
+    uint8_t function{0};
+    // handle of the derived channel the plot shows instead of a register, 0 for none
+    uint32_t channel{0};
+    // appended on the io thread, drawn by the plot workspace
+    std::shared_ptr<PlotTrace> trace;
+    // x of the last sample appended, only touched by the io thread once the plot is added
+    double last_append_x{0};
     double min_value{0};
     double max_value{0};
     void clearState() {
@@ -205,21 +289,96 @@ struct PlotRegisterData {
         reg_addr = 0;
         format = Format_Unsigned;
         format_combo_box_data = ComboBoxData{};
-        x_data.clear();
-        y_data.clear();
+        table = nullptr;
+        slave_id = 0;
+        function = 0;
+        channel = 0;
+        trace.reset();
+        last_append_x = 0;
         min_value = 0;
         max_value = 0;
     }
 };
 
+// the register plots of one cell, its value is decoded once per response for all of them
+struct PlotSubscription {
+    uint16_t reg_addr;
+    CellFormat format;
+    std::vector<PlotRegisterData *> plots;
+};
+
+struct DerivedChannelInputData {
+    char name[DERIVED_NAME_MAX_LEN]{0};
+    char text[DERIVED_TEXT_MAX_LEN]{0};
+    int default_id{1};
+    char error[128]{0};
+};
+
+struct AlarmInputData {
+    AlarmDefinition definition;
+    ComboBoxData kind_combo_box_data{};
+    char error[128]{0};
+};
+
+// time the master kept the bus busy, for the utilisation shown in the latency dialog
+struct BusStatsData {
+    std::atomic<uint64_t> busy_us{0};
+    std::atomic<uint64_t> timeout_us{0};
+    // registers answered and those of them passed on as changed
+    std::atomic<uint64_t> polled_registers{0};
+    std::atomic<uint64_t> changed_registers{0};
+    // the ui derives the rates from the difference to its last sample
+    uint32_t sample_tick{0};
+    uint64_t sample_busy_us{0};
+    uint64_t sample_timeout_us{0};
+    float utilisation{0};
+    float timeout_share{0};
+};
+
+// counters a slave reports through the 08 function
+struct SlaveDiagnosticsCounters {
+    uint16_t bus_message_count{0};
+    uint16_t bus_exception_count{0};
+    uint16_t slave_message_count{0};
+    uint16_t slave_no_response_count{0};
+};
+
+struct DeviceDiagnosticsData {
+    int slave_id{1};
+    int conformity_level{-1};
+    char vendor_name[128]{0};
+    char product_code[128]{0};
+    char revision[128]{0};
+    // indexed by sub-function - ModbusDiagBusMessageCount, -1 until read
+    int counters[ModbusDiagSlaveNoResponseCount - ModbusDiagBusMessageCount + 1]{-1, -1, -1, -1, -1};
+};
+
+// round trips of the 08 echo, the samples are allocated on start so the io thread never reallocates them
+// the io thread records the echoes and timeouts while the ui thread reads them
+struct LatencyProbeData {
+    int slave_id{1};
+    int interval_ms{100};
+    std::atomic<bool> running{false};
+    uint16_t token{0};
+    LatencyHistogram rtt;
+    std::atomic<int> timeout_count{0};
+    void start(int id) {
+        slave_id = id;
+        rtt.reset();
+        timeout_count = 0;
+        running = true;
+    }
+};
+
 class ModbusWindow {
     friend uint32_t Scan_timer_callback(uint32_t interval, void *param);
     friend uint32_t Send_timer_callback(uint32_t interval, void *param);
     friend uint32_t Recv_timer_callback(uint32_t interval, void *param);
+    friend uint32_t Probe_timer_callback(uint32_t interval, void *param);
 
   public:
     ModbusWindow(MyIODevice *myIODevice, const char *window_name, ModbusIdentifier identifier, Protocols protocol,
-                 ModbusBase *modbus_base);
+                 ModbusBase *modbus_base, PlotWorkspace *plot_workspace);
 
     ~ModbusWindow();
     void render();
@@ -253,35 +412,136 @@ class ModbusWindow {
 
     void render_modbus_function_16_dialog();
 
+    void render_modbus_function_22_dialog();
+
+    void render_diagnostics_dialog();
+
+    void render_latency_dialog();
+
+    // the occupied buckets of a round trip time histogram
+    void render_latency_histogram(const LatencyHistogram &latency);
+
+    void render_history_setting_dialog();
+
+    void render_derived_channels_dialog();
+
+    void render_alarms_dialog();
+
+    void render_export_setting_dialog();
+
+    // snapshots the aliases and formats of the tables and starts writing every answered read
+    void start_export();
+
+    // the event callback of the alarms, called with them locked, logs the event and queues it for the journal
+    void record_alarm_event(const AlarmEvent &event);
+
+    // appends the queued alarm events to the journal next to the history segments, on the ui thread
+    void write_alarm_journal();
+
+    void close_history_store();
+
+    // segments of this window go to a directory of its own under m_history_directory
+    void open_history_store();
+
+    void record_latency(RegistersTableData *regs_table_data, int slave_id, uint64_t latency_us);
+
+    // time since the last request went out
+    uint64_t bus_time_us(const Timestamp &timestamp);
+
+    uint32_t response_timeout_ms(int slave_id);
+
     void render_input_plot_reg_data_dialog();
 
-    void render_register_plots();
+    // forgets the plots removed from the workspace
+    void prune_register_plots();
+
+    // indexes m_plot_register_datas again, called with m_plot_mutex held
+    void rebuild_plot_subscriptions();
+
+    // appends the cells of a response marked in m_changed_bits to the plots subscribed to them
+    void publish_plot_samples(RegistersTableData *regs_table_data, int offset, int quantity);
+
+    // applies the deadbands to the registers of a response marked in m_dirty_bits, marks the cells to pass on in
+    // m_changed_bits and records the response in the historian
+    void publish_changes(RegistersTableData *regs_table_data, int offset, int quantity);
+
+    // passes the registers of a response marked in m_dirty_bits to the derived channels and plots those that changed
+    void update_derived_channels(RegistersTableData *regs_table_data, int offset, int quantity);
+
+    // the value of a register as the table polling it holds it, 0 when no table polls it
+    double current_register_value(const ExpressionInput &input);
+
+    RegistersTableData *find_read_table(const ExpressionInput &input);
+
+    // the recorded rows of the registers [offset, offset + count) of a table, from disk and memory, in time order
+    size_t query_history(const RegistersTableData *table, int offset, int count, std::vector<uint64_t> &times_us,
+                         std::vector<uint16_t> &words);
+
+    // appends the recorded history of the register to a plot that was just added
+    void backfill_plot(PlotRegisterData &plot);
+
+    // evaluates the expression of the channel over the recorded history of its inputs at once
+    void backfill_derived_plot(PlotRegisterData &plot);
 
     void get_value_by_format(CellFormat format, const uint16_t *value_ptr, char *value_str, int max_len);
 
+    // the numeric value of a cell, without formatting it to text first
+    double get_double_by_format(CellFormat format, const uint16_t *value_ptr);
+
     void set_value_by_format(CellFormat format, uint16_t *value_ptr, const char *value_str);
 
     void read_data_callback(const char *buffer, size_t size);
 
     uint32_t scan_timer_callback(uint32_t interval, void *param);
 
+    void queue_scan_packets(RegistersTableData *regs_table_data, ScanPriority priority);
+
+    void queue_read_write_packet(RegistersTableData *read_table, RegistersTableData *write_table);
+
+    // counts a failed transaction of the table and shows msg on it
+    void report_table_error(RegistersTableData *regs_table_data, const char *msg);
+
     uint32_t send_timer_callback(uint32_t interval, void *param);
 
+    // hex dump of a frame for the log when log_frame, and the communication traffic window when show_in_traffic,
+    // skipped when neither would show it
+    void trace_frame(bool tx, const Timestamp &timestamp, const char *packet, size_t packet_size,
+                     bool show_in_traffic, bool log_frame = true);
+
     uint32_t recv_timer_callback(uint32_t interval, void *param);
 
+    uint32_t probe_timer_callback(uint32_t interval, void *param);
+
+    void queue_manual_frame(const ModbusFrameInfo &frame_info);
+
+    // queues the next merged cell write once no other manual frame waits
+    void queue_register_writes();
+
+    // removes the manual frame on the bus, returns true when it carried the merged cell writes
+    bool pop_manual_frame();
+
+    void report_register_writes(ModbusErrorCode error_code);
+
     void error_handle(const char *error_msg);
 
     void write_master_register_value(CellFormat format, const char *value_str, RegistersTableData *reg_table_data,
                                      int reg_index);
 
-    void process_master_frame(const ModbusFrameInfo &frame_info);
+    void process_master_frame(const ModbusPduView &frame_view);
 
     void process_slave_frame(const ModbusFrameInfo &frame_info, RegistersTableData *slave_reg_table_data,
                              ModbusErrorCode &error_code);
 
+    // the quantity of a request the slave serves is within the limit of its function, 03 is answered otherwise
+    static bool valid_slave_quantity(const ModbusFrameInfo &frame_info);
+
     RegistersTableData *getSlaveReadTableData(int id, int function, int reg_start, int reg_end,
                                               ModbusErrorCode &error_code);
 
+    bool hasSlaveId(int id);
+
+    void fill_device_identification(const ModbusFrameInfo &frame_info, ModbusFrameInfo &reply_frame);
+
   private:
     MyIODevice *m_myIODevice;
     char m_window_name[128];
@@ -298,32 +558,107 @@ class ModbusWindow {
     bool m_modbus_function_06_dialog_visible;
     bool m_modbus_function_15_dialog_visible;
     bool m_modbus_function_16_dialog_visible;
+    bool m_modbus_function_22_dialog_visible;
+    bool m_diagnostics_dialog_visible;
+    bool m_latency_dialog_visible;
+    bool m_history_setting_dialog_visible;
+    bool m_derived_channels_dialog_visible;
+    bool m_alarms_dialog_visible;
+    bool m_export_setting_dialog_visible;
     bool m_inplut_plot_reg_data_dialog_visible;
 
     std::vector<RegistersTableData *> m_registers_table_datas;
-    std::list<ModbusPacket *> m_cycle_list;
+    BusScheduler m_bus_scheduler;
     std::list<ModbusPacket *> m_manual_list;
-    std::list<RegistersTableData *> m_cycle_table_list;
+    WriteCombiner m_write_combiner;
+    // the cell edits carried by m_register_write_packet while it waits in m_manual_list
+    std::vector<RegisterWrite> m_register_writes;
+    ModbusPacket *m_register_write_packet;
     std::list<PlotRegisterData> m_plot_register_datas;
+    // the register plots by slave id << 8 | read function, each sorted by address, so a response only visits the
+    // plots of its range. with the plots of derived channels rebuilt by the ui thread when plots come and go, read by
+    // the io thread, both under m_plot_mutex
+    std::unordered_map<uint16_t, std::vector<PlotSubscription>> m_plot_subscriptions;
+    std::vector<PlotRegisterData *> m_derived_plots;
+    std::mutex m_plot_mutex;
+    // shared by all windows, draws the traces of m_plot_register_datas
+    PlotWorkspace *m_plot_workspace;
+    // every answered read of the tables, appended on the io thread
+    Historian m_historian;
+    int m_history_budget_mb;
+    // the chunks the historian seals, spilled to segment files under m_history_directory
+    HistorianStore m_history_store;
+    bool m_history_to_disk;
+    char m_history_directory[256];
+    DerivedChannels m_derived_channels;
+    // handles of the channels a response changed, reused across responses
+    std::vector<uint32_t> m_derived_changed;
+    DerivedChannelInputData m_derived_input_data;
+    // checked with every response, timeout and scan tick
+    Alarms m_alarms;
+    AlarmInputData m_alarm_input_data;
+    // the events of the alarms, while the history is recorded to disk. only the ui thread touches the file, the
+    // events reach it through m_alarm_journal_queue
+    FILE *m_alarm_journal;
+    std::vector<AlarmEvent> m_alarm_journal_queue;
+    std::vector<AlarmEvent> m_alarm_journal_events;
+    std::mutex m_alarm_journal_mutex;
+    std::string m_alarm_journal_line;
+    // streams every answered read to files, decoded as the tables show it
+    DataExporter m_exporter;
+    ExportOptions m_export_options;
+    ComboBoxData m_export_format_combo_box_data;
+    ComboBoxData m_export_sync_combo_box_data;
 
     ModbusPacket *m_master_last_send_data;
-    ModbusFrameInfo m_master_last_send_frame;
+    ModbusRequestHeader m_master_last_request;
+    uint8_t m_pdu_scratch[MODBUS_PDU_SCRATCH_SIZE];
+    // registers of the response being processed whose value changed, and of those the ones beyond their deadband
+    uint64_t m_dirty_bits[DIRTY_BITMAP_WORDS(MODBUS_MAX_READ_COILS)];
+    uint64_t m_changed_bits[DIRTY_BITMAP_WORDS(MODBUS_MAX_READ_COILS)];
+    uint16_t m_coil_scratch[MODBUS_MAX_READ_COILS];
     ModbusBase *m_modbus;
 
     SDL_TimerID m_scan_timer_id;
     SDL_TimerID m_send_timer_id;
     SDL_TimerID m_recv_timer_id;
+    SDL_TimerID m_probe_timer_id;
+    // when the last request was written, for round trip measurement
+    Timestamp m_master_last_send_time;
+    // taken first thing in read_data_callback, the time of everything the frame leads to
+    Timestamp m_master_last_recv_time;
+    // created by the io thread on the first answer of a slave, read by the ui thread
+    std::atomic<LatencyHistogram *> m_slave_latency[256];
+    // slave id, or -1 - index of a registers table
+    int m_latency_selected;
+    std::vector<double> m_latency_plot_xs;
+    std::vector<double> m_latency_plot_ys;
 
     std::unordered_map<RegistersTableData *, uint32_t> m_last_scan_timestamp_map;
-    std::unordered_map<const char *, ModbusFunctions> modbus_function_map;
-    std::unordered_map<const char *, ModbusFunctions> modbus_slave_function_map;
-    std::unordered_map<ModbusErrorCode, const char *> modbus_error_code_map;
-    std::unordered_map<ModbusErrorCode, const char *> modbus_error_code_comment_map;
+    // a slave only offers the leading read functions
+    OptionTable<ModbusFunctions> m_function_options;
+    OptionTable<ModbusErrorCode> m_error_code_options;
+    OptionTable<ModbusErrorCode> m_error_comment_options;
+    OptionTable<CellFormat> m_write_format_options;
+    OptionTable<ScanPriority> m_scan_priority_options;
+    OptionTable<AlarmKind> m_alarm_kind_options;
+    OptionTable<ExportFormat> m_export_format_options;
+    OptionTable<ExportSync> m_export_sync_options;
     std::unordered_map<ModbusErrorCode, uint32_t> m_error_count_map;
-    std::unordered_map<const char *, CellFormat> m_write_format_map;
+    // titles of the modify dialog combo box, refilled every frame without giving up its capacity
+    std::vector<const char *> m_reg_table_names;
 
     uint16_t m_trans_id;
+    // fixed timeout, the ceiling of the adaptive one
     uint32_t m_recv_timeout_ms;
+    bool m_adaptive_timeout;
+    int m_min_recv_timeout_ms;
+    // broadcasts are never answered, id 0 is not estimated
+    ResponseTimeout m_slave_timeouts[256];
+    // merge a due register write and a due read of the same slave into one 23 request
+    bool m_combine_read_write;
+    // frames per second this window asks for while data keeps arriving
+    int m_max_redraw_rate;
 
     std::function<void(ModbusErrorCode)> m_write_frame_response_callback;
     CommunicationTrafficWindowData m_communication_traffic_window_data;
@@ -335,8 +670,13 @@ class ModbusWindow {
     bool m_close_on_resp_ok;
     Function_05_06_Data m_function_05_data;
     Function_05_06_Data m_function_06_data;
-    Function_15_16_Data m_function_15_data;
-    Function_15_16_Data m_function_16_data;
+    Function_15_16_Data<MODBUS_MAX_WRITE_COILS> m_function_15_data;
+    Function_15_16_Data<MODBUS_MAX_WRITE_REGISTERS> m_function_16_data;
+    Function_22_Data m_function_22_data;
+    DeviceDiagnosticsData m_device_diagnostics_data;
+    LatencyProbeData m_latency_probe_data;
+    SlaveDiagnosticsCounters m_slave_diagnostics_counters;
+    BusStatsData m_bus_stats;
     PlotRegisterData m_input_plot_reg_data;
     ModbusFrameInfo m_write_frame_info;
 };
@@ -347,4 +687,6 @@ uint32_t Send_timer_callback(uint32_t interval, void *param);
 
 uint32_t Recv_timer_callback(uint32_t interval, void *param);
 
+uint32_t Probe_timer_callback(uint32_t interval, void *param);
+
 #endif // __MODBUSWINDOW_H__
@@ -0,0 +1,73 @@
+#ifndef OPTIONTABLE_H
+#define OPTIONTABLE_H
+
+#include <algorithm>
+#include <libintl.h>
+#include <stddef.h>
+
+// marks a string for translation where gettext can not be called yet, OptionTable translates it later
+#define N_(str) str
+
+template <class T> struct Option {
+    const char *label;
+    T value;
+};
+
+// ordered options of a combo box, built once from a static array, the labels can be handed to render_combo_box
+// directly and the combo box index maps back to the value without hashing or allocating in the frame loop. a copy
+// of the options sorted by value maps a value back to its index
+template <class T> class OptionTable {
+  public:
+    template <size_t N> explicit OptionTable(const Option<T> (&options)[N]) : m_size(int(N)) {
+        m_labels = new const char *[N];
+        m_values = new T[N];
+        m_sorted = new int[N];
+        for (size_t i = 0; i < N; ++i) {
+            // gettext returns the msgid itself when there is no translation, so numbers pass through unchanged
+            m_labels[i] = gettext(options[i].label);
+            m_values[i] = options[i].value;
+            m_sorted[i] = int(i);
+        }
+        // a value listed twice maps to its first index
+        std::stable_sort(m_sorted, m_sorted + N, [this](int a, int b) { return m_values[a] < m_values[b]; });
+    }
+
+    ~OptionTable() {
+        delete[] m_labels;
+        delete[] m_values;
+        delete[] m_sorted;
+    }
+
+    OptionTable(const OptionTable &) = delete;
+    OptionTable &operator=(const OptionTable &) = delete;
+
+    const char **labels() const { return m_labels; }
+
+    int size() const { return m_size; }
+
+    int last() const { return m_size - 1; }
+
+    const char *label(int index) const { return m_labels[index]; }
+
+    T value(int index) const { return m_values[index]; }
+
+    int indexOf(T value) const {
+        const int *found = std::lower_bound(m_sorted, m_sorted + m_size, value,
+                                            [this](int index, T x) { return m_values[index] < x; });
+        return found != m_sorted + m_size && m_values[*found] == value ? *found : -1;
+    }
+
+    const char *labelOf(T value, const char *fallback = "") const {
+        int index = indexOf(value);
+        return index < 0 ? fallback : m_labels[index];
+    }
+
+  private:
+    const char **m_labels;
+    T *m_values;
+    // indexes into m_values in the order of their values
+    int *m_sorted;
+    int m_size;
+};
+
+#endif // OPTIONTABLE_H
@@ -0,0 +1,232 @@
+#include "PlotWorkspace.h"
+#include "implot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <imgui.h>
+#include <libintl.h>
+
+#define PLOT_TRACE_PAYLOAD "DMP_PLOT_TRACE"
+
+PlotWorkspace::PlotWorkspace()
+    : m_next_id(1), m_subplot_count(1), m_follow(false), m_follow_seconds(60), m_auto_fit_y(true),
+      m_fit_requested(true) {}
+
+void PlotWorkspace::add(std::shared_ptr<PlotTrace> trace) {
+    trace->id = m_next_id++;
+    trace->subplot = std::min(trace->subplot, m_subplot_count - 1);
+    // the view is fitted to the first trace, later ones join the view as it is
+    if (m_traces.empty()) {
+        m_fit_requested = true;
+    }
+    m_traces.push_back(std::move(trace));
+}
+
+void PlotWorkspace::render() {
+    if (m_traces.empty()) {
+        return;
+    }
+    if (ImGui::Begin(gettext("Plots"))) {
+        ImGui::Checkbox(gettext("Local Time"), &ImPlot::GetStyle().UseLocalTime);
+        ImGui::SameLine();
+        ImGui::Checkbox(gettext("ISO 8601"), &ImPlot::GetStyle().UseISO8601);
+        ImGui::SameLine();
+        ImGui::Checkbox(gettext("24 Hour Clock"), &ImPlot::GetStyle().Use24HourClock);
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputInt(gettext("Subplots"), &m_subplot_count)) {
+            m_subplot_count = std::max(1, std::min(m_subplot_count, PLOT_WORKSPACE_MAX_SUBPLOTS));
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox(gettext("Follow"), &m_follow);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputInt(gettext("Seconds"), &m_follow_seconds, 10, 60)) {
+            m_follow_seconds = std::max(1, std::min(m_follow_seconds, 7 * 86400));
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox(gettext("Auto Fit Y"), &m_auto_fit_y);
+        ImGui::SameLine();
+        if (ImGui::Button(gettext("Fit"))) {
+            m_fit_requested = true;
+        }
+        ImGui::BeginChild("trace_panel", ImVec2(ImGui::GetWindowWidth() / 4, 0), ImGuiChildFlags_Border);
+        render_trace_list();
+        ImGui::EndChild();
+        ImGui::SameLine();
+        double x_first = 0, x_last = 0;
+        bool has_data = time_bounds(x_first, x_last);
+        if (ImPlot::BeginSubplots("##workspace", m_subplot_count, 1, ImVec2(-1, -1),
+                                  ImPlotSubplotFlags_NoTitle | ImPlotSubplotFlags_LinkAllX)) {
+            for (int i = 0; i < m_subplot_count; ++i) {
+                render_subplot(i, has_data ? x_first : 0, has_data ? x_last : 0);
+            }
+            ImPlot::EndSubplots();
+        }
+        // a fit waits for the first samples
+        if (has_data) {
+            m_fit_requested = false;
+        }
+    }
+    ImGui::End();
+}
+
+void PlotWorkspace::render_trace_list() {
+    uint32_t remove_id = 0;
+    for (auto &trace : m_traces) {
+        ImGui::PushID(int(trace->id));
+        ImGui::Selectable(trace->name);
+        if (ImGui::BeginDragDropSource()) {
+            ImGui::SetDragDropPayload(PLOT_TRACE_PAYLOAD, &trace->id, sizeof(trace->id));
+            ImGui::TextUnformatted(trace->name);
+            ImGui::EndDragDropSource();
+        }
+        ImGui::SetItemTooltip("%s", gettext("Drag onto a plot, or onto one of its value axes"));
+        int subplot = std::min(trace->subplot, m_subplot_count - 1) + 1;
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 5);
+        if (ImGui::SliderInt("##subplot", &subplot, 1, m_subplot_count, gettext("Plot %d"))) {
+            trace->subplot = subplot - 1;
+        }
+        ImGui::SameLine();
+        int y_axis = trace->y_axis + 1;
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 4);
+        if (ImGui::SliderInt("##axis", &y_axis, 1, PLOT_WORKSPACE_Y_AXES, "Y%d")) {
+            trace->y_axis = y_axis - 1;
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton(gettext("Remove"))) {
+            remove_id = trace->id;
+        }
+        ImGui::Separator();
+        ImGui::PopID();
+    }
+    if (remove_id != 0) {
+        auto found = std::find_if(m_traces.begin(), m_traces.end(),
+                                  [remove_id](const std::shared_ptr<PlotTrace> &x) { return x->id == remove_id; });
+        (*found)->removed = true;
+        m_traces.erase(found);
+    }
+}
+
+void PlotWorkspace::render_subplot(int index, double x_first, double x_last) {
+    // the y axes the traces of this subplot use, an axis with a trace of fixed limits takes the first such limits
+    bool used[PLOT_WORKSPACE_Y_AXES]{true};
+    bool fixed[PLOT_WORKSPACE_Y_AXES]{false};
+    double y_min[PLOT_WORKSPACE_Y_AXES]{0};
+    double y_max[PLOT_WORKSPACE_Y_AXES]{0};
+    for (auto &trace : m_traces) {
+        int axis = trace->y_axis;
+        if (std::min(trace->subplot, m_subplot_count - 1) != index) {
+            continue;
+        }
+        used[axis] = true;
+        if (!fixed[axis] && trace->min_value < trace->max_value) {
+            fixed[axis] = true;
+            y_min[axis] = trace->min_value;
+            y_max[axis] = trace->max_value;
+        }
+    }
+    for (int axis = 0; axis < PLOT_WORKSPACE_Y_AXES; ++axis) {
+        if (m_fit_requested && used[axis] && !fixed[axis]) {
+            ImPlot::SetNextAxisToFit(ImAxis_Y1 + axis);
+        }
+    }
+    char title[32];
+    snprintf(title, sizeof(title), "##subplot%d", index);
+    if (!ImPlot::BeginPlot(title)) {
+        return;
+    }
+    ImPlot::SetupAxis(ImAxis_X1, nullptr);
+    ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+    for (int axis = 0; axis < PLOT_WORKSPACE_Y_AXES; ++axis) {
+        if (!used[axis]) {
+            continue;
+        }
+        ImPlotAxisFlags flags = axis == 0 ? ImPlotAxisFlags_None : ImPlotAxisFlags_AuxDefault;
+        if (m_auto_fit_y && !fixed[axis]) {
+            flags |= ImPlotAxisFlags_AutoFit;
+        }
+        ImPlot::SetupAxis(ImAxis_Y1 + axis, nullptr, flags);
+        if (fixed[axis]) {
+            ImPlot::SetupAxisLimits(ImAxis_Y1 + axis, y_min[axis], y_max[axis],
+                                    m_fit_requested ? ImPlotCond_Always : ImPlotCond_Once);
+        }
+    }
+    // the linked time axes of the other subplots follow the first
+    if (x_last > x_first && m_follow) {
+        ImPlot::SetupAxisLimits(ImAxis_X1, x_last - m_follow_seconds, x_last, ImPlotCond_Always);
+    } else if (x_last > x_first && m_fit_requested) {
+        ImPlot::SetupAxisLimits(ImAxis_X1, x_first, x_last, ImPlotCond_Always);
+    }
+    // only the visible range, reduced to about two points per pixel column
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    size_t max_points = std::max<size_t>(size_t(ImPlot::GetPlotSize().x) * 2, 64);
+    char label[PLOT_TRACE_NAME_MAX_LEN + 16];
+    for (auto &trace : m_traces) {
+        if (std::min(trace->subplot, m_subplot_count - 1) != index) {
+            continue;
+        }
+        ImPlot::SetAxes(ImAxis_X1, ImAxis_Y1 + trace->y_axis);
+        trace->ring.query(limits.X.Min, limits.X.Max, max_points, m_xs, m_ys);
+        // the last value holds until the last poll, which appended nothing when it did not change
+        double last_poll_x = trace->last_poll_x;
+        if (!m_xs.empty() && limits.X.Max >= m_xs.back() && last_poll_x > m_xs.back()) {
+            m_xs.push_back(last_poll_x);
+            m_ys.push_back(trace->last_y);
+        }
+        // the id keeps the color of a trace when another one is removed
+        snprintf(label, sizeof(label), "%s##%u", trace->name, trace->id);
+        if (trace->stairs) {
+            ImPlot::PlotStairs(label, m_xs.data(), m_ys.data(), int(m_xs.size()));
+        } else {
+            ImPlot::PlotLine(label, m_xs.data(), m_ys.data(), int(m_xs.size()));
+        }
+        if (ImPlot::BeginDragDropSourceItem(label)) {
+            ImGui::SetDragDropPayload(PLOT_TRACE_PAYLOAD, &trace->id, sizeof(trace->id));
+            ImGui::TextUnformatted(trace->name);
+            ImPlot::EndDragDropSource();
+        }
+    }
+    if (ImPlot::BeginDragDropTargetPlot()) {
+        accept_trace_drop(index, -1);
+        ImPlot::EndDragDropTarget();
+    }
+    for (int axis = 0; axis < PLOT_WORKSPACE_Y_AXES; ++axis) {
+        if (used[axis] && ImPlot::BeginDragDropTargetAxis(ImAxis_Y1 + axis)) {
+            accept_trace_drop(index, axis);
+            ImPlot::EndDragDropTarget();
+        }
+    }
+    ImPlot::EndPlot();
+}
+
+bool PlotWorkspace::time_bounds(double &x_first, double &x_last) {
+    bool found = false;
+    for (auto &trace : m_traces) {
+        double first, last, y_min, y_max;
+        if (!trace->ring.bounds(first, last, y_min, y_max)) {
+            continue;
+        }
+        last = std::max<double>(last, trace->last_poll_x);
+        x_first = found ? std::min(x_first, first) : first;
+        x_last = found ? std::max(x_last, last) : last;
+        found = true;
+    }
+    return found;
+}
+
+void PlotWorkspace::accept_trace_drop(int subplot, int y_axis) {
+    const ImGuiPayload *payload = ImGui::AcceptDragDropPayload(PLOT_TRACE_PAYLOAD);
+    if (payload == nullptr) {
+        return;
+    }
+    uint32_t id;
+    memcpy(&id, payload->Data, sizeof(id));
+    for (auto &trace : m_traces) {
+        if (trace->id == id) {
+            trace->subplot = subplot;
+            if (y_axis >= 0) {
+                trace->y_axis = y_axis;
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef PLOTWORKSPACE_H
+#define PLOTWORKSPACE_H
+
+#include "TimeSeriesRing.h"
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define PLOT_TRACE_NAME_MAX_LEN 192
+#define PLOT_WORKSPACE_MAX_SUBPLOTS 8
+// a subplot has this many y axes the traces on it are spread over
+#define PLOT_WORKSPACE_Y_AXES 3
+
+// a register or a derived channel as the workspace draws it. the window polling it appends on its io thread, the
+// workspace only reads, either may go away first
+struct PlotTrace {
+    explicit PlotTrace(size_t capacity) : ring(capacity) {}
+
+    char name[PLOT_TRACE_NAME_MAX_LEN]{0};
+    TimeSeriesRing ring;
+    // only changes are appended, the value held since the last one is drawn up to the last poll
+    std::atomic<double> last_poll_x{0};
+    std::atomic<double> last_y{0};
+    // fixed limits of its y axis, fitted to the data when min is not below max
+    double min_value{0};
+    double max_value{0};
+    // on and off values, drawn as steps
+    bool stairs{false};
+    // set by the workspace, its label id stays the same while the trace is shown
+    uint32_t id{0};
+    int subplot{0};
+    int y_axis{0};
+    // dropped from the workspace, the window stops feeding it
+    std::atomic<bool> removed{false};
+};
+
+// the plots of all windows in one place. traces of any window and slave are laid out on subplots stacked over one
+// linked time axis, each on one of the y axes of its subplot, and are moved between them by dragging. the traces are
+// the store the windows append to, a frame reads only the visible range of each reduced to about two points per
+// pixel column, so its cost follows the width of the plots rather than the samples recorded
+class PlotWorkspace {
+  public:
+    PlotWorkspace();
+
+    void add(std::shared_ptr<PlotTrace> trace);
+
+    void render();
+
+  private:
+    void render_trace_list();
+
+    void render_subplot(int index, double x_first, double x_last);
+
+    // the time covered by all traces, false when none has samples yet
+    bool time_bounds(double &x_first, double &x_last);
+
+    // takes a trace dragged from the list or a legend, onto the subplot or one of its y axes
+    void accept_trace_drop(int subplot, int y_axis);
+
+  private:
+    std::vector<std::shared_ptr<PlotTrace>> m_traces;
+    uint32_t m_next_id;
+    int m_subplot_count;
+    // the time axis keeps the last m_follow_seconds in view
+    bool m_follow;
+    int m_follow_seconds;
+    bool m_auto_fit_y;
+    bool m_fit_requested;
+    // points of the trace being drawn, reused across traces and frames
+    std::vector<double> m_xs;
+    std::vector<double> m_ys;
+};
+
+#endif // PLOTWORKSPACE_H
@@ -0,0 +1,83 @@
+#include "RegisterChanges.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGISTER_CHANGES_SSE2
+#endif
+
+bool anyDirty(const uint64_t *dirty, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+        if (testDirty(dirty, i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef REGISTER_CHANGES_SSE2
+// one bit per 16 bit lane that differs, the compare result is packed to bytes for the mask
+static inline uint32_t changed_lanes(__m128i old_values, __m128i new_values) {
+    __m128i equal = _mm_cmpeq_epi16(old_values, new_values);
+    return ~uint32_t(_mm_movemask_epi8(_mm_packs_epi16(equal, _mm_setzero_si128()))) & 0xFF;
+}
+
+static inline void set_lanes(uint64_t *dirty, int index, uint32_t lanes) {
+    // index is a multiple of 8, the 8 bits never straddle two words
+    dirty[index / 64] |= uint64_t(lanes) << (index % 64);
+}
+#endif
+
+int storeRegisters(uint16_t *values, const uint8_t *big_endian, int count, uint64_t *dirty) {
+    int changes = 0;
+    int i = 0;
+#ifdef REGISTER_CHANGES_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(big_endian + 2 * i));
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        uint32_t lanes = changed_lanes(current, swapped);
+        if (lanes) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), swapped);
+            set_lanes(dirty, i, lanes);
+            for (uint32_t bits = lanes; bits; bits &= bits - 1) {
+                changes++;
+            }
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        uint16_t value = uint16_t(big_endian[2 * i] << 8 | big_endian[2 * i + 1]);
+        if (values[i] != value) {
+            values[i] = value;
+            setDirty(dirty, i);
+            changes++;
+        }
+    }
+    return changes;
+}
+
+int storeValues(uint16_t *values, const uint16_t *new_values, int count, uint64_t *dirty) {
+    int changes = 0;
+    int i = 0;
+#ifdef REGISTER_CHANGES_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        __m128i incoming = _mm_loadu_si128(reinterpret_cast<const __m128i *>(new_values + i));
+        uint32_t lanes = changed_lanes(current, incoming);
+        if (lanes) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), incoming);
+            set_lanes(dirty, i, lanes);
+            for (uint32_t bits = lanes; bits; bits &= bits - 1) {
+                changes++;
+            }
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (values[i] != new_values[i]) {
+            values[i] = new_values[i];
+            setDirty(dirty, i);
+            changes++;
+        }
+    }
+    return changes;
+}
@@ -0,0 +1,23 @@
+#ifndef REGISTERCHANGES_H
+#define REGISTERCHANGES_H
+
+#include <stdint.h>
+
+// 64 bit words of a bitmap with one bit per register
+#define DIRTY_BITMAP_WORDS(count) (((count) + 63) / 64)
+
+inline bool testDirty(const uint64_t *dirty, int index) { return dirty[index / 64] >> (index % 64) & 1; }
+
+inline void setDirty(uint64_t *dirty, int index) { dirty[index / 64] |= uint64_t(1) << (index % 64); }
+
+// true when any of the registers [first, first + count) is dirty
+bool anyDirty(const uint64_t *dirty, int first, int count);
+
+// stores count big endian registers of a read response into values and sets the bit in dirty of every register
+// whose value changed, eight registers per compare with sse2. dirty is not cleared. returns the number of changes
+int storeRegisters(uint16_t *values, const uint8_t *big_endian, int count, uint64_t *dirty);
+
+// the same for values already in host order, the unpacked coils of a response
+int storeValues(uint16_t *values, const uint16_t *new_values, int count, uint64_t *dirty);
+
+#endif // REGISTERCHANGES_H
@@ -0,0 +1,105 @@
+#include "RenderLoop.h"
+#include <atomic>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define RENDER_STATS_INTERVAL_MS 1000
+
+static uint32_t redraw_event_type = (uint32_t)-1;
+static std::atomic<bool> redraw_pending(false);
+static std::atomic<uint32_t> redraw_deadline(0);
+static std::atomic<uint32_t> last_frame_ticks(0);
+
+// only touched by the ui thread
+static RenderLoopStats stats;
+static uint32_t stats_start_ticks = 0;
+static double stats_start_cpu_seconds = 0;
+static uint32_t stats_frame_count = 0;
+
+static double process_cpu_seconds() {
+#ifdef _WIN32
+    // clock() is wall time on windows
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    uint64_t kernel_100ns = (uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    uint64_t user_100ns = (uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return (kernel_100ns + user_100ns) / 1e7;
+#else
+    return double(clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+void initRenderLoop() {
+    redraw_event_type = SDL_RegisterEvents(1);
+    stats_start_ticks = SDL_GetTicks();
+    stats_start_cpu_seconds = process_cpu_seconds();
+}
+
+void requestRedraw(uint32_t interval_ms) {
+    uint32_t deadline = last_frame_ticks.load() + interval_ms;
+    if (!redraw_pending.exchange(true)) {
+        redraw_deadline = deadline;
+        // one event per frame at most, the flag is only reset when the frame starts
+        if (redraw_event_type != (uint32_t)-1) {
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = redraw_event_type;
+            SDL_PushEvent(&event);
+        }
+        return;
+    }
+    // the earliest deadline wins, so the fastest window sets the pace
+    uint32_t current = redraw_deadline.load();
+    while (SDL_TICKS_PASSED(current, deadline) && !redraw_deadline.compare_exchange_weak(current, deadline)) {
+    }
+}
+
+bool isRedrawEvent(const SDL_Event &event) { return event.type == redraw_event_type; }
+
+int renderLoopWaitTimeout() {
+    uint32_t now = SDL_GetTicks();
+    int32_t timeout = int32_t(last_frame_ticks.load() + RENDER_IDLE_INTERVAL_MS - now);
+    if (redraw_pending) {
+        int32_t redraw_timeout = int32_t(redraw_deadline.load() - now);
+        if (redraw_timeout < timeout) {
+            timeout = redraw_timeout;
+        }
+    }
+    return timeout > 0 ? int(timeout) : 0;
+}
+
+bool renderLoopFrameDue() { return renderLoopWaitTimeout() == 0; }
+
+void renderLoopBeginFrame() {
+    last_frame_ticks = SDL_GetTicks();
+    // data arriving while this frame is drawn asks for the next one
+    redraw_pending = false;
+}
+
+void renderLoopEndFrame() {
+    stats_frame_count++;
+    uint32_t now = SDL_GetTicks();
+    uint32_t elapsed = now - stats_start_ticks;
+    if (elapsed < RENDER_STATS_INTERVAL_MS) {
+        return;
+    }
+    double cpu_seconds = process_cpu_seconds();
+    stats.frames_per_second = stats_frame_count * 1000.0f / elapsed;
+    stats.cpu_percent = float((cpu_seconds - stats_start_cpu_seconds) * 100000.0 / elapsed);
+    stats_start_ticks = now;
+    stats_start_cpu_seconds = cpu_seconds;
+    stats_frame_count = 0;
+}
+
+RenderLoopStats renderLoopStats() { return stats; }
+
+void renderLoopSetFirstFrameMs(float first_frame_ms) { stats.first_frame_ms = first_frame_ms; }
+
+void renderLoopSetAtlas(int glyphs, float build_ms) {
+    stats.atlas_glyphs = glyphs;
+    stats.atlas_build_ms = build_ms;
+}
@@ -0,0 +1,50 @@
+#ifndef RENDERLOOP_H
+#define RENDERLOOP_H
+
+#include <SDL.h>
+#include <stdint.h>
+
+// without input or data the ui is still redrawn at this interval, e.g. for time based text
+#define RENDER_IDLE_INTERVAL_MS 1000
+// imgui needs a few frames to settle hover and focus after an input event
+#define RENDER_FRAMES_AFTER_INPUT 3
+// default redraw cap for new data, a window may ask for a different one
+#define RENDER_DATA_INTERVAL_MS 33
+
+struct RenderLoopStats {
+    float frames_per_second{0.0f};
+    // process cpu time over wall time, all threads, in percent of one core
+    float cpu_percent{0.0f};
+    // from the start of main to the first frame on screen, 0 until then
+    float first_frame_ms{0.0f};
+    // of the font atlas as it was built last
+    int atlas_glyphs{0};
+    float atlas_build_ms{0.0f};
+};
+
+// registers the wake up event, call after SDL_Init
+void initRenderLoop();
+
+// may be called from any thread: wakes the main loop so it draws a frame at most interval_ms after the previous
+// one, requests arriving before that frame are merged into it
+void requestRedraw(uint32_t interval_ms = RENDER_DATA_INTERVAL_MS);
+
+bool isRedrawEvent(const SDL_Event &event);
+
+// how long the main loop may block in SDL_WaitEventTimeout, 0 when a frame is due now
+int renderLoopWaitTimeout();
+
+bool renderLoopFrameDue();
+
+void renderLoopBeginFrame();
+
+void renderLoopEndFrame();
+
+// updated about once per second
+RenderLoopStats renderLoopStats();
+
+void renderLoopSetFirstFrameMs(float first_frame_ms);
+
+void renderLoopSetAtlas(int glyphs, float build_ms);
+
+#endif // RENDERLOOP_H
@@ -0,0 +1,59 @@
+#include "ResponseTimeout.h"
+#include <algorithm>
+
+ResponseTimeout::ResponseTimeout() { reset(); }
+
+void ResponseTimeout::reset() {
+    m_srtt_us = 0;
+    m_rttvar_us = 0;
+    m_failures = 0;
+    m_backoff_shift = 0;
+    m_resume_tick = 0;
+    m_measured = false;
+}
+
+void ResponseTimeout::onResponse(uint64_t rtt_us) {
+    uint32_t rtt = uint32_t(std::min<uint64_t>(rtt_us, UINT32_MAX / 2));
+    if (!m_measured) {
+        m_srtt_us = rtt;
+        m_rttvar_us = rtt / 2;
+        m_measured = true;
+    } else {
+        // rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, srtt = 7/8 srtt + 1/8 rtt
+        uint32_t delta = m_srtt_us > rtt ? m_srtt_us - rtt : rtt - m_srtt_us;
+        m_rttvar_us = m_rttvar_us - m_rttvar_us / 4 + delta / 4;
+        m_srtt_us = m_srtt_us - m_srtt_us / 8 + rtt / 8;
+    }
+    m_failures = 0;
+    m_backoff_shift = 0;
+}
+
+void ResponseTimeout::onTimeout(uint32_t now_ms) {
+    m_failures++;
+    m_backoff_shift = std::min<uint32_t>(m_backoff_shift + 1, RESPONSE_TIMEOUT_MAX_BACKOFF_SHIFT);
+    if (m_failures >= RESPONSE_TIMEOUT_SUSPEND_AFTER) {
+        uint32_t shift = std::min<uint32_t>(m_failures - RESPONSE_TIMEOUT_SUSPEND_AFTER, 16);
+        uint32_t suspend_ms =
+            std::min<uint64_t>(uint64_t(RESPONSE_TIMEOUT_SUSPEND_BASE_MS) << shift, RESPONSE_TIMEOUT_SUSPEND_MAX_MS);
+        m_resume_tick = now_ms + suspend_ms;
+    }
+}
+
+uint32_t ResponseTimeout::timeoutMs(uint32_t floor_ms, uint32_t ceiling_ms) const {
+    if (!m_measured) {
+        return ceiling_ms;
+    }
+    uint64_t rto_us = m_srtt_us + std::max<uint64_t>(RESPONSE_TIMEOUT_GRANULARITY_US, 4 * uint64_t(m_rttvar_us));
+    uint64_t rto_ms = ((rto_us + 999) / 1000) << m_backoff_shift;
+    return uint32_t(std::max<uint64_t>(floor_ms, std::min<uint64_t>(rto_ms, ceiling_ms)));
+}
+
+bool ResponseTimeout::suspended(uint32_t now_ms) const { return suspendedForMs(now_ms) > 0; }
+
+uint32_t ResponseTimeout::suspendedForMs(uint32_t now_ms) const {
+    if (m_failures < RESPONSE_TIMEOUT_SUSPEND_AFTER) {
+        return 0;
+    }
+    int32_t remaining = int32_t(m_resume_tick - now_ms);
+    return remaining > 0 ? uint32_t(remaining) : 0;
+}
@@ -0,0 +1,54 @@
+#ifndef RESPONSETIMEOUT_H
+#define RESPONSETIMEOUT_H
+
+#include <stdint.h>
+
+// sdl timers fire on a 10 ms grid on some platforms, the variance term never drops below it
+#define RESPONSE_TIMEOUT_GRANULARITY_US 10000
+// after a timeout the next one is doubled up to 2^6 times the estimate, still limited by the ceiling
+#define RESPONSE_TIMEOUT_MAX_BACKOFF_SHIFT 6
+// consecutive timeouts before a slave is polled less often
+#define RESPONSE_TIMEOUT_SUSPEND_AFTER 2
+#define RESPONSE_TIMEOUT_SUSPEND_BASE_MS 500
+#define RESPONSE_TIMEOUT_SUSPEND_MAX_MS 30000
+
+// response timeout of one slave, estimated from its round trip times the way tcp derives its rto (rfc 6298),
+// a slave that stops answering gets a doubled timeout and is skipped by the scan for exponentially longer
+// periods until it answers again
+class ResponseTimeout {
+  public:
+    ResponseTimeout();
+
+    void reset();
+
+    void onResponse(uint64_t rtt_us);
+
+    void onTimeout(uint32_t now_ms);
+
+    // the ceiling until the first round trip is measured
+    uint32_t timeoutMs(uint32_t floor_ms, uint32_t ceiling_ms) const;
+
+    // true while the scan should leave the slave alone
+    bool suspended(uint32_t now_ms) const;
+
+    bool measured() const { return m_measured; }
+
+    uint32_t srttUs() const { return m_srtt_us; }
+
+    uint32_t rttvarUs() const { return m_rttvar_us; }
+
+    uint32_t failures() const { return m_failures; }
+
+    // remaining suspension, 0 when polled normally
+    uint32_t suspendedForMs(uint32_t now_ms) const;
+
+  private:
+    uint32_t m_srtt_us;
+    uint32_t m_rttvar_us;
+    uint32_t m_failures;
+    uint32_t m_backoff_shift;
+    uint32_t m_resume_tick;
+    bool m_measured;
+};
+
+#endif // RESPONSETIMEOUT_H
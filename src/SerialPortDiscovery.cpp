@@ -0,0 +1,139 @@
+#include "SerialPortDiscovery.h"
+#include "utils.h"
+#include <CSerialPort/SerialPortInfo.h>
+#include <chrono>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// without hotplug events the list is refreshed at this interval
+#define SERIAL_PORT_RESCAN_INTERVAL_MS 3000
+// udev creates a node before its links and permissions are in place, events within this window are merged
+#define SERIAL_PORT_SETTLE_MS 200
+
+SerialPortDiscovery::SerialPortDiscovery()
+    : m_running(false), m_snapshot(std::make_shared<SerialPortSnapshot>()), m_inotify_fd(-1), m_wake_fd(-1) {}
+
+SerialPortDiscovery::~SerialPortDiscovery() { stop(); }
+
+void SerialPortDiscovery::start() {
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+#ifdef __linux__
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd >= 0 &&
+        inotify_add_watch(m_inotify_fd, "/dev", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+        LogWarn("can not watch /dev, falling back to periodic rescans: {}", strerror(errno));
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+    }
+#endif
+    m_thread = std::thread(&SerialPortDiscovery::run, this);
+}
+
+void SerialPortDiscovery::stop() {
+    if (!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_stop_cv.notify_all();
+#ifdef __linux__
+    if (m_wake_fd >= 0) {
+        uint64_t value = 1;
+        (void)write(m_wake_fd, &value, sizeof(value));
+    }
+#endif
+    m_thread.join();
+#ifdef __linux__
+    if (m_inotify_fd >= 0) {
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+    }
+    if (m_wake_fd >= 0) {
+        close(m_wake_fd);
+        m_wake_fd = -1;
+    }
+#endif
+}
+
+std::shared_ptr<const SerialPortSnapshot> SerialPortDiscovery::snapshot() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_snapshot;
+}
+
+void SerialPortDiscovery::setChangedCallback(
+    std::function<void(std::shared_ptr<const SerialPortSnapshot>)> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed_callback = callback;
+}
+
+void SerialPortDiscovery::run() {
+    enumerate();
+    while (m_running) {
+        if (wait_for_change()) {
+            enumerate();
+        }
+    }
+}
+
+bool SerialPortDiscovery::wait_for_change() {
+#ifdef __linux__
+    if (m_inotify_fd >= 0 && m_wake_fd >= 0) {
+        pollfd fds[2] = {{m_inotify_fd, POLLIN, 0}, {m_wake_fd, POLLIN, 0}};
+        int ret = poll(fds, 2, SERIAL_PORT_RESCAN_INTERVAL_MS);
+        if (!m_running) {
+            return false;
+        }
+        if (ret > 0 && (fds[0].revents & POLLIN)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SERIAL_PORT_SETTLE_MS));
+            // only the fact that something changed matters, drop the events queued meanwhile
+            char buffer[4096];
+            while (read(m_inotify_fd, buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        return true;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop_cv.wait_for(lock, std::chrono::milliseconds(SERIAL_PORT_RESCAN_INTERVAL_MS), [this] { return !m_running; });
+    return m_running;
+}
+
+void SerialPortDiscovery::enumerate() {
+    std::shared_ptr<SerialPortSnapshot> snapshot = std::make_shared<SerialPortSnapshot>();
+    snapshot->infos = itas109::CSerialPortInfo::availablePortInfos();
+    std::shared_ptr<const SerialPortSnapshot> current = this->snapshot();
+    bool changed = current->generation == 0 || snapshot->infos.size() != current->infos.size();
+    for (size_t i = 0; !changed && i < snapshot->infos.size(); ++i) {
+        changed = strcmp(snapshot->infos[i].portName, current->infos[i].portName) != 0;
+    }
+    if (!changed) {
+        return;
+    }
+    snapshot->names.reserve(snapshot->infos.size());
+    for (auto &info : snapshot->infos) {
+        snapshot->names.push_back(info.portName);
+    }
+    snapshot->generation = current->generation + 1;
+    std::function<void(std::shared_ptr<const SerialPortSnapshot>)> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_snapshot = snapshot;
+        callback = m_changed_callback;
+    }
+    LogInfo("serial ports changed, {} found", snapshot->infos.size());
+    if (callback) {
+        callback(snapshot);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SERIALPORTDISCOVERY_H
+#define SERIALPORTDISCOVERY_H
+
+#include <CSerialPort/SerialPort_global.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// result of one enumeration, never modified once published, names point into infos
+struct SerialPortSnapshot {
+    std::vector<itas109::SerialPortInfo> infos;
+    std::vector<const char *> names;
+    // increases whenever the port list changes
+    uint64_t generation{0};
+};
+
+// enumerates the serial ports on a background thread, again whenever a device node is added to or removed from
+// /dev (inotify on linux) and otherwise every few seconds, the ui thread only takes the latest snapshot
+class SerialPortDiscovery {
+  public:
+    SerialPortDiscovery();
+
+    ~SerialPortDiscovery();
+
+    void start();
+
+    void stop();
+
+    std::shared_ptr<const SerialPortSnapshot> snapshot();
+
+    // called on the discovery thread after a changed snapshot was published
+    void setChangedCallback(std::function<void(std::shared_ptr<const SerialPortSnapshot>)> callback);
+
+  private:
+    void run();
+
+    // returns true when a device node changed, or after the fallback interval
+    bool wait_for_change();
+
+    void enumerate();
+
+  private:
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+    std::shared_ptr<const SerialPortSnapshot> m_snapshot;
+    std::function<void(std::shared_ptr<const SerialPortSnapshot>)> m_changed_callback;
+    int m_inotify_fd;
+    // wakes the poll on stop()
+    int m_wake_fd;
+};
+
+#endif // SERIALPORTDISCOVERY_H
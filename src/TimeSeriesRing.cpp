@@ -0,0 +1,178 @@
+#include "TimeSeriesRing.h"
+#include <algorithm>
+
+TimeSeriesRing::TimeSeriesRing(size_t capacity)
+    : m_xs(capacity), m_ys(capacity), m_capacity(capacity), m_total(0), m_level_count(0) {
+    while (m_level_count < TIME_SERIES_MAX_LEVELS &&
+           (capacity >> (TIME_SERIES_FAN_OUT_BITS * (m_level_count + 1))) >= 2) {
+        Level &level = m_levels[m_level_count++];
+        level.capacity = capacity >> (TIME_SERIES_FAN_OUT_BITS * m_level_count);
+        level.buckets.resize(level.capacity);
+        level.open_count = 0;
+    }
+}
+
+void TimeSeriesRing::append(double x, double y) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_xs[m_total % m_capacity] = x;
+    m_ys[m_total % m_capacity] = y;
+    m_total++;
+    // a completed bucket moves up into the open bucket of the next level
+    Bucket bucket{x, y, x, y};
+    for (int i = 0; i < m_level_count; ++i) {
+        Level &level = m_levels[i];
+        fold(level.open, bucket, level.open_count == 0);
+        if (++level.open_count < TIME_SERIES_FAN_OUT) {
+            break;
+        }
+        uint64_t index = (m_total >> (TIME_SERIES_FAN_OUT_BITS * (i + 1))) - 1;
+        level.buckets[index % level.capacity] = level.open;
+        level.open_count = 0;
+        bucket = level.open;
+    }
+}
+
+bool TimeSeriesRing::bounds(double &x_first, double &x_last, double &y_min, double &y_max) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_total == 0) {
+        return false;
+    }
+    uint64_t oldest = m_total > m_capacity ? m_total - m_capacity : 0;
+    x_first = m_xs[oldest % m_capacity];
+    x_last = m_xs[(m_total - 1) % m_capacity];
+    Bucket range{};
+    fold_range(oldest, range);
+    y_min = range.y_min;
+    y_max = range.y_max;
+    return true;
+}
+
+void TimeSeriesRing::query(double x_begin, double x_end, size_t max_points, std::vector<double> &xs,
+                           std::vector<double> &ys) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    xs.clear();
+    ys.clear();
+    if (m_total == 0) {
+        return;
+    }
+    uint64_t oldest = m_total > m_capacity ? m_total - m_capacity : 0;
+    uint64_t begin = lower_bound(oldest, m_total, x_begin);
+    uint64_t end = begin;
+    // the upper bound, first sample with x > x_end
+    for (uint64_t count = m_total - begin; count > 0;) {
+        uint64_t step = count / 2;
+        if (m_xs[(end + step) % m_capacity] <= x_end) {
+            end += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    begin = begin > oldest ? begin - 1 : begin;
+    end = end < m_total ? end + 1 : end;
+    uint64_t count = end - begin;
+    if (count <= max_points) {
+        for (uint64_t i = begin; i < end; ++i) {
+            xs.push_back(m_xs[i % m_capacity]);
+            ys.push_back(m_ys[i % m_capacity]);
+        }
+        return;
+    }
+    if (m_level_count == 0) {
+        return;
+    }
+    // every bucket gives two points
+    int level = 0;
+    while (level < m_level_count - 1 && (count >> (TIME_SERIES_FAN_OUT_BITS * (level + 1))) * 2 > max_points) {
+        level++;
+    }
+    const Level &selected = m_levels[level];
+    int shift = TIME_SERIES_FAN_OUT_BITS * (level + 1);
+    uint64_t completed = m_total >> shift;
+    uint64_t first_bucket = std::max<uint64_t>(begin >> shift, completed > selected.capacity
+                                                                   ? completed - selected.capacity
+                                                                   : 0);
+    uint64_t last_bucket = (end - 1) >> shift;
+    for (uint64_t i = first_bucket; i <= last_bucket && i < completed; ++i) {
+        emit(selected.buckets[i % selected.capacity], xs, ys);
+    }
+    if (last_bucket >= completed) {
+        // the samples after the last completed bucket sit in the open buckets of this level and the ones below
+        Bucket partial{};
+        bool has_partial = false;
+        for (int i = 0; i <= level; ++i) {
+            if (m_levels[i].open_count > 0) {
+                fold(partial, m_levels[i].open, !has_partial);
+                has_partial = true;
+            }
+        }
+        if (has_partial) {
+            emit(partial, xs, ys);
+        }
+    }
+}
+
+void TimeSeriesRing::fold(Bucket &into, const Bucket &from, bool first) {
+    if (first) {
+        into = from;
+        return;
+    }
+    if (from.y_min < into.y_min) {
+        into.y_min = from.y_min;
+        into.x_min_at = from.x_min_at;
+    }
+    if (from.y_max > into.y_max) {
+        into.y_max = from.y_max;
+        into.x_max_at = from.x_max_at;
+    }
+}
+
+uint64_t TimeSeriesRing::lower_bound(uint64_t begin, uint64_t end, double value) const {
+    for (uint64_t count = end - begin; count > 0;) {
+        uint64_t step = count / 2;
+        if (m_xs[(begin + step) % m_capacity] < value) {
+            begin += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return begin;
+}
+
+void TimeSeriesRing::fold_range(uint64_t begin, Bucket &range) const {
+    // level -1 are the raw samples. climbs while begin is aligned to the next level, then steps down again for the
+    // samples after the last completed bucket, so at most 2 * 8 units are read per level
+    int level = -1;
+    uint64_t size = 1;
+    bool first = true;
+    while (begin < m_total) {
+        uint64_t next_size = size << TIME_SERIES_FAN_OUT_BITS;
+        if (level + 1 < m_level_count && begin % next_size == 0 && begin + next_size <= m_total) {
+            level++;
+            size = next_size;
+            continue;
+        }
+        while (begin + size > m_total) {
+            level--;
+            size >>= TIME_SERIES_FAN_OUT_BITS;
+        }
+        if (level < 0) {
+            double x = m_xs[begin % m_capacity], y = m_ys[begin % m_capacity];
+            fold(range, Bucket{x, y, x, y}, first);
+        } else {
+            const Level &unit = m_levels[level];
+            fold(range, unit.buckets[(begin / size) % unit.capacity], first);
+        }
+        first = false;
+        begin += size;
+    }
+}
+
+void TimeSeriesRing::emit(const Bucket &bucket, std::vector<double> &xs, std::vector<double> &ys) const {
+    bool min_first = bucket.x_min_at <= bucket.x_max_at;
+    xs.push_back(min_first ? bucket.x_min_at : bucket.x_max_at);
+    ys.push_back(min_first ? bucket.y_min : bucket.y_max);
+    xs.push_back(min_first ? bucket.x_max_at : bucket.x_min_at);
+    ys.push_back(min_first ? bucket.y_max : bucket.y_min);
+}
@@ -0,0 +1,68 @@
+#ifndef TIMESERIESRING_H
+#define TIMESERIESRING_H
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// every level of the pyramid folds this many buckets of the level below into one
+#define TIME_SERIES_FAN_OUT_BITS 3
+#define TIME_SERIES_FAN_OUT (1 << TIME_SERIES_FAN_OUT_BITS)
+#define TIME_SERIES_MAX_LEVELS 8
+
+// fixed capacity series of (x, y) samples with non decreasing x, the oldest samples are overwritten. beside the raw
+// samples it keeps min/max buckets of 8, 64, 512... samples, so a view of any length is reduced to a bounded number
+// of points by reading the coarsest level that still gives enough of them. one thread appends, another queries
+class TimeSeriesRing {
+  public:
+    explicit TimeSeriesRing(size_t capacity);
+
+    void append(double x, double y);
+
+    // false when empty. the y range is that of the samples still held, read from the coarsest buckets that fit
+    bool bounds(double &x_first, double &x_last, double &y_min, double &y_max);
+
+    // fills xs and ys with at most about max_points points covering [x_begin, x_end], the raw samples when they are
+    // few enough, otherwise the min and max of each bucket in x order. the neighbours just outside the range are
+    // included so the line reaches the plot edges
+    void query(double x_begin, double x_end, size_t max_points, std::vector<double> &xs, std::vector<double> &ys);
+
+  private:
+    struct Bucket {
+        double x_min_at;
+        double y_min;
+        double x_max_at;
+        double y_max;
+    };
+
+    struct Level {
+        std::vector<Bucket> buckets;
+        size_t capacity;
+        // bucket still being filled and how many buckets of the level below it holds
+        Bucket open;
+        int open_count;
+    };
+
+    static void fold(Bucket &into, const Bucket &from, bool first);
+
+    // first sample index with x >= value, within [begin, end)
+    uint64_t lower_bound(uint64_t begin, uint64_t end, double value) const;
+
+    // folds the samples [begin, m_total) into range, from the raw samples and completed buckets that cover them
+    void fold_range(uint64_t begin, Bucket &range) const;
+
+    void emit(const Bucket &bucket, std::vector<double> &xs, std::vector<double> &ys) const;
+
+  private:
+    std::mutex m_mutex;
+    std::vector<double> m_xs;
+    std::vector<double> m_ys;
+    size_t m_capacity;
+    // samples appended, the ring holds the last m_capacity of them
+    uint64_t m_total;
+    Level m_levels[TIME_SERIES_MAX_LEVELS];
+    int m_level_count;
+};
+
+#endif // TIMESERIESRING_H
@@ -0,0 +1,103 @@
+#include "Timestamp.h"
+#include <atomic>
+#include <chrono>
+#include <time.h>
+
+// the local time zone offset is assumed to hold until the next quarter hour, time zones change on those
+#define TIMEZONE_CACHE_SECONDS 900
+
+static std::atomic<uint64_t> anchor_mono_ns{0};
+static std::atomic<int64_t> wall_offset_ns{0};
+
+Timestamp timestampNow() {
+    Timestamp timestamp;
+    timestamp.mono_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+    uint64_t anchor = anchor_mono_ns.load(std::memory_order_relaxed);
+    if (anchor == 0 || timestamp.mono_ns - anchor >= TIMESTAMP_REANCHOR_NS) {
+        // two threads may anchor at once, either result is as good
+        int64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+        wall_offset_ns.store(wall_ns - int64_t(timestamp.mono_ns), std::memory_order_relaxed);
+        anchor_mono_ns.store(timestamp.mono_ns, std::memory_order_relaxed);
+        timestamp.wall_ns = wall_ns;
+    } else {
+        timestamp.wall_ns = int64_t(timestamp.mono_ns) + wall_offset_ns.load(std::memory_order_relaxed);
+    }
+    return timestamp;
+}
+
+// days since 1970-01-01 of a civil date
+static int64_t days_from_civil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+static int64_t local_offset_seconds(int64_t wall_seconds) {
+    thread_local int64_t valid_from = 1;
+    thread_local int64_t valid_until = 0;
+    thread_local int64_t offset = 0;
+    if (wall_seconds >= valid_from && wall_seconds < valid_until) {
+        return offset;
+    }
+    time_t now = time_t(wall_seconds);
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    int64_t local_seconds = days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400 +
+                            local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    offset = local_seconds - wall_seconds;
+    valid_from = wall_seconds - ((wall_seconds % TIMEZONE_CACHE_SECONDS) + TIMEZONE_CACHE_SECONDS) %
+                                    TIMEZONE_CACHE_SECONDS;
+    valid_until = valid_from + TIMEZONE_CACHE_SECONDS;
+    return offset;
+}
+
+size_t formatTimestamp(const Timestamp &timestamp, char *buffer, size_t buffer_size, int fraction_digits) {
+    if (fraction_digits < 0 || fraction_digits > 9) {
+        fraction_digits = 6;
+    }
+    // hh:mm:ss, the fraction with its point, a space and the terminator
+    size_t length = 9 + (fraction_digits ? fraction_digits + 1 : 0);
+    if (buffer_size < length + 1) {
+        if (buffer_size > 0) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    int64_t wall_seconds = timestamp.wall_ns / 1000000000;
+    int64_t fraction_ns = timestamp.wall_ns % 1000000000;
+    if (fraction_ns < 0) {
+        wall_seconds--;
+        fraction_ns += 1000000000;
+    }
+    int64_t local_seconds = wall_seconds + local_offset_seconds(wall_seconds);
+    int seconds_of_day = int((local_seconds % 86400 + 86400) % 86400);
+    char *ptr = buffer;
+    int fields[3] = {seconds_of_day / 3600, seconds_of_day / 60 % 60, seconds_of_day % 60};
+    for (int i = 0; i < 3; ++i) {
+        *ptr++ = char('0' + fields[i] / 10);
+        *ptr++ = char('0' + fields[i] % 10);
+        *ptr++ = i < 2 ? ':' : '.';
+    }
+    if (fraction_digits == 0) {
+        ptr--;
+    }
+    for (int i = 0; i < fraction_digits; ++i) {
+        ptr[i] = char('0' + fraction_ns / 100000000);
+        fraction_ns = fraction_ns % 100000000 * 10;
+    }
+    ptr += fraction_digits;
+    *ptr++ = ' ';
+    *ptr = '\0';
+    return length;
+}
@@ -0,0 +1,34 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the monotonic clock is mapped onto the wall clock again after this long, to follow adjustments of the system time
+#define TIMESTAMP_REANCHOR_NS 1000000000ull
+
+// a moment taken once, on the monotonic clock for measuring intervals and as wall clock time for display and
+// storage, both in nanoseconds
+struct Timestamp {
+    uint64_t mono_ns{0};
+    // since the epoch
+    int64_t wall_ns{0};
+
+    uint64_t wallUs() const { return uint64_t(wall_ns / 1000); }
+
+    double wallSeconds() const { return wall_ns / 1e9; }
+
+    // monotonic time from earlier to this one, 0 if earlier is later
+    uint64_t sinceNs(const Timestamp &earlier) const {
+        return mono_ns > earlier.mono_ns ? mono_ns - earlier.mono_ns : 0;
+    }
+};
+
+// reads the monotonic clock, the wall clock only once a second. safe on any thread
+Timestamp timestampNow();
+
+// local time of day as "HH:MM:SS.ffffff " with fraction_digits (0 to 9) digits, returns the length. the offset of
+// the local time zone is looked up once per quarter hour and thread, not for every call
+size_t formatTimestamp(const Timestamp &timestamp, char *buffer, size_t buffer_size, int fraction_digits = 6);
+
+#endif // TIMESTAMP_H
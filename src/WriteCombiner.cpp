@@ -0,0 +1,90 @@
+#include "WriteCombiner.h"
+#include <algorithm>
+
+WriteCombiner::WriteCombiner() : m_sequence(0) {}
+
+void WriteCombiner::push(const RegisterWrite &write) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writes.push_back(write);
+    m_writes.back().sequence = m_sequence++;
+}
+
+bool WriteCombiner::empty() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writes.empty();
+}
+
+bool WriteCombiner::take(ModbusFrameInfo &frame_info, std::vector<RegisterWrite> &writes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    writes.clear();
+    if (m_writes.empty()) {
+        return false;
+    }
+    const RegisterWrite first = m_writes.front();
+    int max_quantity = first.coil ? MODBUS_MAX_WRITE_COILS : MODBUS_MAX_WRITE_REGISTERS;
+    int start = first.reg_addr, end = first.reg_addr + first.quantity;
+    writes.push_back(first);
+    m_writes.pop_front();
+    // a merged edit can make a skipped one adjacent, so scan until the range stops growing
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        for (auto iter = m_writes.begin(); iter != m_writes.end();) {
+            if (iter->id != first.id || iter->coil != first.coil) {
+                ++iter;
+                continue;
+            }
+            int write_end = iter->reg_addr + iter->quantity;
+            bool adjacent = iter->reg_addr <= end && write_end >= start;
+            bool fits = std::max(end, write_end) - std::min(start, iter->reg_addr) <= max_quantity;
+            if (adjacent && fits) {
+                grown = grown || iter->reg_addr < start || write_end > end;
+                start = std::min(start, iter->reg_addr);
+                end = std::max(end, write_end);
+                writes.push_back(*iter);
+                iter = m_writes.erase(iter);
+            } else if (iter->reg_addr < end && write_end > start) {
+                // an overlapping edit that does not fit must not be overtaken by the ones after it
+                break;
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    // a later pass can pick up an edit older than the ones merged before it
+    std::sort(writes.begin(), writes.end(),
+              [](const RegisterWrite &a, const RegisterWrite &b) { return a.sequence < b.sequence; });
+    frame_info = ModbusFrameInfo{};
+    frame_info.id = first.id;
+    frame_info.reg_addr = start;
+    frame_info.quantity = end - start;
+    // registers that no edit covers inside the range can not occur, every merged edit touches it
+    for (auto &write : writes) {
+        for (int i = 0; i < write.quantity; ++i) {
+            int index = write.reg_addr - start + i;
+            if (first.coil) {
+                frame_info.coils.set(index, write.values[i]);
+            } else {
+                frame_info.reg_values[index] = write.values[i];
+            }
+        }
+    }
+    if (first.coil) {
+        frame_info.function = frame_info.quantity == 1 ? ModbusWriteSingleCoil : ModbusWriteMultipleCoils;
+        // 05 sends on as 0xFF00
+        frame_info.reg_values[0] = frame_info.coils.get(0) ? 0xFF00 : 0x0000;
+    } else {
+        frame_info.function = frame_info.quantity == 1 ? ModbusWriteSingleRegister : ModbusWriteMultipleRegisters;
+    }
+    return true;
+}
+
+void WriteCombiner::removeTable(const RegistersTableData *table) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &write : m_writes) {
+        if (write.table == table) {
+            write.table = nullptr;
+        }
+    }
+}
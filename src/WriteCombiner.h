@@ -0,0 +1,47 @@
+#ifndef WRITECOMBINER_H
+#define WRITECOMBINER_H
+
+#include "ModbusFrameInfo.h"
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+struct RegistersTableData;
+
+// one edit of a cell, up to four registers of a 64 bit format or a single coil
+struct RegisterWrite {
+    int id{0};
+    bool coil{false};
+    int reg_addr{0};
+    int quantity{0};
+    uint16_t values[4]{0};
+    // where the edit came from, for reporting its result, null once the table is removed
+    RegistersTableData *table{nullptr};
+    // order of the edits, assigned by push()
+    uint64_t sequence{0};
+};
+
+// collects the cell edits of a master until the bus is free, then merges the oldest one with every queued edit of
+// the same slave that touches or overlaps its range into a single 15 or 16 request, within the protocol limits.
+// edits are applied in the order they were made, so a later edit of a register wins
+class WriteCombiner {
+  public:
+    WriteCombiner();
+
+    void push(const RegisterWrite &write);
+
+    bool empty();
+
+    // builds the next request into frame_info and moves the edits it carries to writes
+    bool take(ModbusFrameInfo &frame_info, std::vector<RegisterWrite> &writes);
+
+    void removeTable(const RegistersTableData *table);
+
+  private:
+    std::mutex m_mutex;
+    std::list<RegisterWrite> m_writes;
+    uint64_t m_sequence;
+};
+
+#endif // WRITECOMBINER_H
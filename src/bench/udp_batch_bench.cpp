@@ -0,0 +1,113 @@
+// requests per second of the cli poller over udp, one request in flight against a whole scan cycle per
+// sendmmsg/recvmmsg, both against a batched responder on the loopback interface
+//
+//   udp-batch-bench [-n tables] [-d seconds] [-p port]
+#include "ModbusPoller.h"
+#include "modbus_tcp.h"
+#include "myudpbatchsocket.h"
+#include "myudpsocket.h"
+#include <atomic>
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static std::atomic<bool> responder_running(true);
+
+// answers every read holding registers request with the register addresses as values
+static void run_responder(MyUdpBatchSocket *socket) {
+    Modbus_TCP modbus;
+    std::vector<UdpDatagram> requests(UDP_BATCH_MAX_MESSAGES);
+    std::vector<UdpDatagram> responses(UDP_BATCH_MAX_MESSAGES);
+    ModbusFrameInfo *frame_info = new ModbusFrameInfo;
+    while (responder_running) {
+        int received = socket->receiveBatch(requests.data(), int(requests.size()), 50);
+        int count = 0;
+        for (int i = 0; i < received; ++i) {
+            if (!modbus.validPack(requests[i].data, requests[i].size)) {
+                continue;
+            }
+            *frame_info = modbus.slavePack2Frame(requests[i].data, requests[i].size);
+            for (int reg = 0; reg < frame_info->quantity && reg < MODBUS_MAX_READ_REGISTERS; ++reg) {
+                frame_info->reg_values[reg] = uint16_t(frame_info->reg_addr + reg);
+            }
+            responses[count].endpoint = requests[i].endpoint;
+            responses[count].size = modbus.slaveFrame2Pack(*frame_info, responses[count].data);
+            count++;
+        }
+        socket->sendBatch(responses.data(), count);
+    }
+    delete frame_info;
+}
+
+static double run_poller(bool batch, int tables, int seconds, uint16_t port) {
+    Modbus_TCP modbus;
+    MyUdpSocket *udp_socket = nullptr;
+    if (!batch) {
+        udp_socket = new MyUdpSocket();
+        if (!udp_socket->connectTo("127.0.0.1", port)) {
+            delete udp_socket;
+            return 0;
+        }
+    }
+    uint64_t answered = 0;
+    {
+        ModbusPoller poller(udp_socket, &modbus, MODBUS_UDP, 300);
+        for (int i = 0; i < tables; ++i) {
+            PollTable table;
+            snprintf(table.name, sizeof(table.name), "t%d", i);
+            table.id = 1 + i % 247;
+            table.reg_start = i * 10;
+            table.reg_quantity = 10;
+            table.scan_rate_ms = 0;
+            poller.addTable(table);
+        }
+        if (batch && !poller.enableBatch("127.0.0.1", port)) {
+            return 0;
+        }
+        poller.setSampleCallback([&answered](const PollSample &sample) {
+            if (sample.error_code == ModbusErrorCode_OK) {
+                answered++;
+            }
+        });
+        poller.run(uint64_t(seconds) * 1000);
+    }
+    if (udp_socket) {
+        udp_socket->close();
+        delete udp_socket;
+    }
+    return double(answered) / seconds;
+}
+
+int main(int argc, char **argv) {
+    int tables = 256;
+    int seconds = 3;
+    uint16_t port = 15020;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            tables = std::max(1, atoi(argv[i + 1]));
+        } else if (strcmp(argv[i], "-d") == 0) {
+            seconds = std::max(1, atoi(argv[i + 1]));
+        } else if (strcmp(argv[i], "-p") == 0) {
+            port = uint16_t(atoi(argv[i + 1]));
+        }
+    }
+    spdlog::set_level(spdlog::level::warn);
+    MyUdpBatchSocket responder;
+    if (!responder.bind(port)) {
+        fprintf(stderr, "can not bind port %u\n", port);
+        return 1;
+    }
+    std::thread responder_thread(run_responder, &responder);
+    double single = run_poller(false, tables, seconds, port);
+    double batched = run_poller(true, tables, seconds, port);
+    responder_running = false;
+    responder_thread.join();
+    printf("%d tables, %d s each\n", tables, seconds);
+    printf("one request in flight: %10.0f requests/s\n", single);
+    printf("batched scan cycle:    %10.0f requests/s\n", batched);
+    return 0;
+}
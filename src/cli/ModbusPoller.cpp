@@ -0,0 +1,288 @@
+#include "ModbusPoller.h"
+#include "Timestamp.h"
+#include "utils.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace std::chrono;
+
+ModbusPoller::ModbusPoller(MyIODevice *io_device, ModbusBase *modbus, Protocols protocol, uint32_t timeout_ms)
+    : m_io_device(io_device), m_modbus(modbus), m_protocol(protocol), m_timeout_ms(timeout_ms), m_trans_id(0),
+      m_stopped(false), m_response_size(0), m_response_ready(false), m_batch_socket(nullptr) {
+    if (m_io_device) {
+        m_io_device->setReadDataCallback(
+            std::bind(&ModbusPoller::read_data_callback, this, std::placeholders::_1, std::placeholders::_2));
+    }
+}
+
+ModbusPoller::~ModbusPoller() {
+    if (m_io_device) {
+        m_io_device->setReadDataCallback(nullptr);
+    }
+    delete m_batch_socket;
+}
+
+void ModbusPoller::addTable(const PollTable &table) {
+    m_tables.push_back(table);
+    m_tables.back().reg_values.assign(table.reg_quantity, 0);
+}
+
+void ModbusPoller::setSampleCallback(std::function<void(const PollSample &)> callback) {
+    m_sample_callback = callback;
+}
+
+bool ModbusPoller::enableBatch(const char *host, uint16_t port) {
+    m_batch_socket = new MyUdpBatchSocket();
+    m_batch_socket->setErrorCallback([](const char *msg) { LogError("{}", msg); });
+    if (!m_batch_socket->open()) {
+        return false;
+    }
+    m_table_endpoints.resize(m_tables.size());
+    for (size_t i = 0; i < m_tables.size(); ++i) {
+        const char *table_host = m_tables[i].host[0] ? m_tables[i].host : host;
+        uint16_t table_port = m_tables[i].port ? m_tables[i].port : port;
+        if (!m_batch_socket->resolve(table_host, table_port, m_table_endpoints[i])) {
+            fprintf(stderr, "can not resolve %s:%u of table %s\n", table_host, table_port, m_tables[i].name);
+            return false;
+        }
+    }
+    m_send_datagrams.resize(POLLER_MAX_BATCH_REQUESTS);
+    m_receive_datagrams.resize(UDP_BATCH_MAX_MESSAGES);
+    return true;
+}
+
+void ModbusPoller::run(uint64_t duration_ms) {
+    steady_clock::time_point start = steady_clock::now();
+    steady_clock::time_point end = duration_ms ? start + milliseconds(duration_ms) : steady_clock::time_point::max();
+    for (auto &table : m_tables) {
+        table.next_scan = start;
+    }
+    if (m_batch_socket) {
+        run_batched(end);
+        return;
+    }
+    while (!m_stopped && !m_tables.empty()) {
+        auto table = std::min_element(m_tables.begin(), m_tables.end(), [](const PollTable &a, const PollTable &b) {
+            return a.next_scan < b.next_scan;
+        });
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= end) {
+            break;
+        }
+        if (table->next_scan > now) {
+            // wake up regularly so stop() from a signal handler is noticed without a notify
+            steady_clock::time_point wake = std::min({table->next_scan, end, now + milliseconds(100)});
+            std::unique_lock<std::mutex> lock(m_response_mutex);
+            m_response_cv.wait_until(lock, wake);
+            continue;
+        }
+        poll_table(*table);
+        // keep the scan period, but do not burst to catch up after a slow link
+        table->next_scan += milliseconds(table->scan_rate_ms);
+        now = steady_clock::now();
+        if (table->next_scan < now) {
+            table->next_scan = now;
+        }
+    }
+}
+
+void ModbusPoller::poll_table(PollTable &table) {
+    int max_quantity = modbusMaxQuantity(table.function);
+    for (int offset = 0; offset < table.reg_quantity && !m_stopped; offset += max_quantity) {
+        int quantity = std::min(max_quantity, table.reg_quantity - offset);
+        char request[512];
+        size_t request_size = m_modbus->scanFrame2Pack(table.id, table.function, table.reg_start + offset, quantity,
+                                                       table.reg_values.data() + offset, request);
+        if (m_protocol == MODBUS_TCP || m_protocol == MODBUS_UDP) {
+            setModbusPacketTransID(request, m_trans_id);
+            m_trans_id++;
+        }
+        table.send_count++;
+        int error_code = transact(request, request_size);
+        emit_sample(table, offset, quantity, error_code, m_frame_view);
+    }
+}
+
+void ModbusPoller::emit_sample(PollTable &table, int offset, int quantity, int error_code,
+                               const ModbusPduView &frame_view) {
+    bool is_coil = table.function == ModbusReadCoils || table.function == ModbusReadDescreteInputs;
+    PollSample sample;
+    sample.error_code = error_code;
+    sample.timestamp_us = timestampNow().wallUs();
+    sample.table = &table;
+    sample.reg_addr = table.reg_start + offset;
+    if (sample.error_code == ModbusErrorCode_OK) {
+        uint16_t *values = table.reg_values.data() + offset;
+        if (is_coil) {
+            int byte_count = std::min<int>(frame_view.byteCount(), int(frame_view.data_size) - 1);
+            sample.quantity = std::min(quantity, byte_count * 8);
+            for (int i = 0; i < sample.quantity; ++i) {
+                values[i] = frame_view.coil(i);
+            }
+        } else {
+            sample.quantity = std::min(quantity, frame_view.regCount());
+            for (int i = 0; i < sample.quantity; ++i) {
+                values[i] = frame_view.regValue(i);
+            }
+        }
+        sample.values = values;
+    } else {
+        table.error_count++;
+        LogInfo("table {} request at {} failed: {}", table.name, sample.reg_addr, sample.error_code);
+    }
+    if (m_sample_callback) {
+        m_sample_callback(sample);
+    }
+}
+
+void ModbusPoller::run_batched(steady_clock::time_point end) {
+    std::vector<int> queued_tables;
+    while (!m_stopped) {
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= end) {
+            break;
+        }
+        steady_clock::time_point next_scan = end;
+        m_batch_requests.clear();
+        queued_tables.clear();
+        for (int i = 0; i < int(m_tables.size()); ++i) {
+            if (m_tables[i].next_scan > now) {
+                next_scan = std::min(next_scan, m_tables[i].next_scan);
+            } else if (queue_batch_requests(i)) {
+                queued_tables.push_back(i);
+            }
+        }
+        if (m_batch_requests.empty()) {
+            std::unique_lock<std::mutex> lock(m_response_mutex);
+            m_response_cv.wait_until(lock, std::min(next_scan, now + milliseconds(100)));
+            continue;
+        }
+        transact_batch();
+        now = steady_clock::now();
+        for (int i : queued_tables) {
+            PollTable &table = m_tables[i];
+            table.next_scan += milliseconds(table.scan_rate_ms);
+            if (table.next_scan < now) {
+                table.next_scan = now;
+            }
+        }
+    }
+}
+
+bool ModbusPoller::queue_batch_requests(int table_index) {
+    const PollTable &table = m_tables[table_index];
+    int max_quantity = modbusMaxQuantity(table.function);
+    int count = (table.reg_quantity + max_quantity - 1) / max_quantity;
+    // the largest table is 65536 registers, 525 requests, so a table always fits into an empty cycle
+    if (m_batch_requests.size() + count > POLLER_MAX_BATCH_REQUESTS) {
+        return false;
+    }
+    for (int offset = 0; offset < table.reg_quantity; offset += max_quantity) {
+        BatchRequest request;
+        request.table = table_index;
+        request.offset = offset;
+        request.quantity = std::min(max_quantity, table.reg_quantity - offset);
+        m_batch_requests.push_back(request);
+    }
+    return true;
+}
+
+void ModbusPoller::transact_batch() {
+    int count = int(m_batch_requests.size());
+    uint16_t first_trans_id = m_trans_id;
+    for (int i = 0; i < count; ++i) {
+        BatchRequest &request = m_batch_requests[i];
+        PollTable &table = m_tables[request.table];
+        UdpDatagram &datagram = m_send_datagrams[i];
+        datagram.endpoint = m_table_endpoints[request.table];
+        datagram.size = m_modbus->scanFrame2Pack(table.id, table.function, table.reg_start + request.offset,
+                                                 request.quantity, table.reg_values.data() + request.offset,
+                                                 datagram.data);
+        setModbusPacketTransID(datagram.data, m_trans_id++);
+        table.send_count++;
+    }
+    int outstanding = m_batch_socket->sendBatch(m_send_datagrams.data(), count);
+    steady_clock::time_point deadline = steady_clock::now() + milliseconds(m_timeout_ms);
+    while (outstanding > 0 && !m_stopped) {
+        int64_t remaining_ms = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+        if (remaining_ms <= 0) {
+            break;
+        }
+        // short waits so stop() is noticed
+        int received = m_batch_socket->receiveBatch(m_receive_datagrams.data(), int(m_receive_datagrams.size()),
+                                                    int(std::min<int64_t>(remaining_ms, 100)));
+        for (int i = 0; i < received; ++i) {
+            const UdpDatagram &datagram = m_receive_datagrams[i];
+            if (!m_modbus->validPack(datagram.data, datagram.size)) {
+                continue;
+            }
+            ModbusPduView frame_view = m_modbus->pack2View(datagram.data, datagram.size, m_pdu_scratch);
+            int index = uint16_t(frame_view.trans_id - first_trans_id);
+            if (frame_view.data == nullptr || index >= count || m_batch_requests[index].answered) {
+                // a late response of an earlier cycle
+                continue;
+            }
+            BatchRequest &request = m_batch_requests[index];
+            PollTable &table = m_tables[request.table];
+            if (frame_view.id != table.id ||
+                !MyUdpBatchSocket::sameEndpoint(datagram.endpoint, m_table_endpoints[request.table])) {
+                continue;
+            }
+            request.answered = true;
+            outstanding--;
+            int error_code =
+                frame_view.function > ModbusFunctionError ? frame_view.exceptionCode() : int(ModbusErrorCode_OK);
+            emit_sample(table, request.offset, request.quantity, error_code, frame_view);
+        }
+    }
+    for (auto &request : m_batch_requests) {
+        if (!request.answered) {
+            emit_sample(m_tables[request.table], request.offset, request.quantity, ModbusErrorCode_Timeout,
+                        m_frame_view);
+        }
+    }
+}
+
+int ModbusPoller::transact(const char *request, size_t request_size) {
+    ModbusRequestHeader request_header = m_modbus->requestHeader(request, request_size);
+    steady_clock::time_point deadline = steady_clock::now() + milliseconds(m_timeout_ms);
+    std::unique_lock<std::mutex> lock(m_response_mutex);
+    m_response_ready = false;
+    m_io_device->clear();
+    m_io_device->write(request, request_size);
+    while (m_response_cv.wait_until(lock, deadline, [this] { return m_response_ready || m_stopped; })) {
+        if (m_stopped) {
+            break;
+        }
+        m_response_ready = false;
+        memcpy(m_frame, m_response, m_response_size);
+        m_frame_view = m_modbus->pack2View(m_frame, m_response_size, m_pdu_scratch);
+        bool same_trans = (m_protocol != MODBUS_TCP && m_protocol != MODBUS_UDP) ||
+                          m_frame_view.trans_id == request_header.trans_id;
+        if (m_frame_view.data != nullptr && m_frame_view.id == request_header.id && same_trans) {
+            if (m_frame_view.function > ModbusFunctionError) {
+                return m_frame_view.exceptionCode();
+            }
+            return ModbusErrorCode_OK;
+        }
+        // a late response to an earlier request, keep waiting for ours
+    }
+    return ModbusErrorCode_Timeout;
+}
+
+void ModbusPoller::read_data_callback(const char *buffer, size_t size) {
+    // an invalid pack is kept by the device until the rest of it arrives
+    if (!m_modbus->validPack(buffer, size)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_response_mutex);
+        if (size <= sizeof(m_response)) {
+            memcpy(m_response, buffer, size);
+            m_response_size = size;
+            m_response_ready = true;
+        }
+    }
+    m_io_device->clear();
+    m_response_cv.notify_one();
+}
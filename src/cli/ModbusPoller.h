@@ -0,0 +1,125 @@
+#ifndef MODBUSPOLLER_H
+#define MODBUSPOLLER_H
+
+#include "ModbusBase.h"
+#include "ModbusFrameInfo.h"
+#include "MyIODevice.h"
+#include "myudpbatchsocket.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+struct PollTable {
+    char name[64]{0};
+    int id{1};
+    int function{ModbusReadHoldingRegisters};
+    int reg_start{0};
+    int reg_quantity{1};
+    uint32_t scan_rate_ms{1000};
+    // endpoint of a batched udp poll, the global one when empty or 0
+    char host[128]{0};
+    uint16_t port{0};
+    std::vector<uint16_t> reg_values;
+    std::chrono::steady_clock::time_point next_scan{};
+    uint32_t send_count{0};
+    uint32_t error_count{0};
+};
+
+// the outcome of one request, values point into the table and are only valid during the sample callback
+struct PollSample {
+    // wall clock, microseconds since the epoch
+    uint64_t timestamp_us{0};
+    const PollTable *table{nullptr};
+    int reg_addr{0};
+    int quantity{0};
+    const uint16_t *values{nullptr};
+    // a ModbusErrorCode, values are only set when it is ModbusErrorCode_OK
+    int error_code{ModbusErrorCode_OK};
+};
+
+// requests a batched scan cycle may put on the wire at once
+#define POLLER_MAX_BATCH_REQUESTS 4096
+
+// one chunk of a table in a batched scan cycle
+struct BatchRequest {
+    int table{0};
+    int offset{0};
+    int quantity{0};
+    bool answered{false};
+};
+
+// headless master, scans the tables on the calling thread with one request in flight like ModbusWindow does,
+// but waits on the response instead of hopping through 1 ms timers. in batch mode (udp only) every due table is
+// sent at once to its own endpoint and the responses are matched by transaction id as they arrive
+class ModbusPoller {
+  public:
+    ModbusPoller(MyIODevice *io_device, ModbusBase *modbus, Protocols protocol, uint32_t timeout_ms);
+
+    ~ModbusPoller();
+
+    void addTable(const PollTable &table);
+
+    void setSampleCallback(std::function<void(const PollSample &)> callback);
+
+    // switches to batched udp polling, io_device may then be null, call after all tables are added
+    bool enableBatch(const char *host, uint16_t port);
+
+    // scan until stop() is called or duration_ms elapses, 0 runs until stopped
+    void run(uint64_t duration_ms);
+
+    // only sets a flag, safe to call from a signal handler
+    void stop() { m_stopped = true; }
+
+    const std::vector<PollTable> &tables() const { return m_tables; }
+
+  private:
+    void poll_table(PollTable &table);
+
+    void run_batched(std::chrono::steady_clock::time_point end);
+
+    // queues the chunks of a table, false when they do not fit into the cycle
+    bool queue_batch_requests(int table_index);
+
+    void transact_batch();
+
+    void emit_sample(PollTable &table, int offset, int quantity, int error_code, const ModbusPduView &frame_view);
+
+    int transact(const char *request, size_t request_size);
+
+    void read_data_callback(const char *buffer, size_t size);
+
+  private:
+    MyIODevice *m_io_device;
+    ModbusBase *m_modbus;
+    Protocols m_protocol;
+    uint32_t m_timeout_ms;
+    uint16_t m_trans_id;
+    std::atomic<bool> m_stopped;
+    std::vector<PollTable> m_tables;
+    std::function<void(const PollSample &)> m_sample_callback;
+
+    // filled by the io thread
+    std::mutex m_response_mutex;
+    std::condition_variable m_response_cv;
+    char m_response[MODBUS_PDU_SCRATCH_SIZE * 2 + 8];
+    size_t m_response_size;
+    bool m_response_ready;
+
+    // owned by the polling thread, frame_view refers into m_frame or m_pdu_scratch
+    char m_frame[MODBUS_PDU_SCRATCH_SIZE * 2 + 8];
+    uint8_t m_pdu_scratch[MODBUS_PDU_SCRATCH_SIZE];
+    ModbusPduView m_frame_view;
+
+    // batch mode, endpoints are indexed like m_tables
+    MyUdpBatchSocket *m_batch_socket;
+    std::vector<UdpEndpoint> m_table_endpoints;
+    std::vector<BatchRequest> m_batch_requests;
+    std::vector<UdpDatagram> m_send_datagrams;
+    std::vector<UdpDatagram> m_receive_datagrams;
+};
+
+#endif // MODBUSPOLLER_H
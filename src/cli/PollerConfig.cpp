@@ -0,0 +1,226 @@
+#include "PollerConfig.h"
+#include "utils.h"
+#include <ctype.h>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+static const std::unordered_map<std::string, Protocols> protocol_map = {
+    {"rtu", MODBUS_RTU}, {"ascii", MODBUS_ASCII}, {"tcp", MODBUS_TCP}, {"udp", MODBUS_UDP}};
+
+static const std::unordered_map<std::string, itas109::DataBits> data_bits_map = {
+    {"5", itas109::DataBits5}, {"6", itas109::DataBits6}, {"7", itas109::DataBits7}, {"8", itas109::DataBits8}};
+
+static const std::unordered_map<std::string, itas109::Parity> parity_map = {{"none", itas109::ParityNone},
+                                                                            {"odd", itas109::ParityOdd},
+                                                                            {"even", itas109::ParityEven},
+                                                                            {"mark", itas109::ParityMark},
+                                                                            {"space", itas109::ParitySpace}};
+
+static const std::unordered_map<std::string, itas109::StopBits> stop_bits_map = {
+    {"1", itas109::StopOne}, {"1.5", itas109::StopOneAndHalf}, {"2", itas109::StopTwo}};
+
+static const std::unordered_map<std::string, SampleFormat> format_map = {
+    {"csv", SampleFormat_CSV}, {"json", SampleFormat_JSON}, {"binary", SampleFormat_Binary}};
+
+static std::string trim(const std::string &str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+static bool parseInt(const std::string &value, long min, long max, long &result) {
+    char *end = nullptr;
+    result = strtol(value.c_str(), &end, 0);
+    return !value.empty() && *end == '\0' && result >= min && result <= max;
+}
+
+template <class T>
+static bool lookup(const std::unordered_map<std::string, T> &map, const std::string &value, T &result) {
+    auto iter = map.find(value);
+    if (iter == map.end()) {
+        return false;
+    }
+    result = iter->second;
+    return true;
+}
+
+// names end up unescaped in csv and json output
+static bool validTableName(const std::string &name) {
+    if (name.empty() || name.size() >= sizeof(PollTable::name)) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseGlobal(PollerConfig &config, const std::string &key, const std::string &value) {
+    long number = 0;
+    if (key == "protocol") {
+        return lookup(protocol_map, value, config.protocol);
+    } else if (key == "serial_port") {
+        snprintf(config.serial_port, sizeof(config.serial_port), "%s", value.c_str());
+        return true;
+    } else if (key == "baud_rate") {
+        if (!parseInt(value, 1, 4000000, number)) {
+            return false;
+        }
+        config.baud_rate = int(number);
+        return true;
+    } else if (key == "data_bits") {
+        return lookup(data_bits_map, value, config.data_bits);
+    } else if (key == "parity") {
+        return lookup(parity_map, value, config.parity);
+    } else if (key == "stop_bits") {
+        return lookup(stop_bits_map, value, config.stop_bits);
+    } else if (key == "host") {
+        snprintf(config.host, sizeof(config.host), "%s", value.c_str());
+        return true;
+    } else if (key == "port") {
+        if (!parseInt(value, 1, 65535, number)) {
+            return false;
+        }
+        config.port = uint16_t(number);
+        return true;
+    } else if (key == "timeout_ms") {
+        if (!parseInt(value, 1, 60000, number)) {
+            return false;
+        }
+        config.timeout_ms = uint32_t(number);
+        return true;
+    } else if (key == "batch") {
+        if (!parseInt(value, 0, 1, number)) {
+            return false;
+        }
+        config.batch = number != 0;
+        return true;
+    } else if (key == "format") {
+        return parseSampleFormat(value.c_str(), config.format);
+    } else if (key == "output") {
+        snprintf(config.output, sizeof(config.output), "%s", value.c_str());
+        return true;
+    } else if (key == "duration_s") {
+        return parseDuration(value.c_str(), config.duration_ms);
+    }
+    return false;
+}
+
+static bool parseTable(PollTable &table, const std::string &key, const std::string &value) {
+    long number = 0;
+    if (key == "slave_id") {
+        if (!parseInt(value, 0, 255, number)) {
+            return false;
+        }
+        table.id = int(number);
+    } else if (key == "function") {
+        // only reads are polled, writes stay with the interactive master
+        if (!parseInt(value, ModbusReadCoils, ModbusReadInputRegisters, number)) {
+            return false;
+        }
+        table.function = int(number);
+    } else if (key == "address") {
+        if (!parseInt(value, 0, 65535, number)) {
+            return false;
+        }
+        table.reg_start = int(number);
+    } else if (key == "quantity") {
+        if (!parseInt(value, 1, 65536, number)) {
+            return false;
+        }
+        table.reg_quantity = int(number);
+    } else if (key == "scan_rate_ms") {
+        if (!parseInt(value, 0, 24L * 3600 * 1000, number)) {
+            return false;
+        }
+        table.scan_rate_ms = uint32_t(number);
+    } else if (key == "host") {
+        snprintf(table.host, sizeof(table.host), "%s", value.c_str());
+    } else if (key == "port") {
+        if (!parseInt(value, 1, 65535, number)) {
+            return false;
+        }
+        table.port = uint16_t(number);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseSampleFormat(const char *value, SampleFormat &format) { return lookup(format_map, value, format); }
+
+bool parseDuration(const char *value, uint64_t &duration_ms) {
+    long seconds;
+    if (!parseInt(value, 0, 10L * 365 * 24 * 3600, seconds)) {
+        return false;
+    }
+    duration_ms = uint64_t(seconds) * 1000;
+    return true;
+}
+
+bool loadPollerConfig(const char *file_name, PollerConfig &config) {
+    std::ifstream file(file_name);
+    if (!file.is_open()) {
+        LogError("can not open config file {}", file_name);
+        fprintf(stderr, "can not open config file %s\n", file_name);
+        return false;
+    }
+    std::string line;
+    int line_number = 0;
+    PollTable *table = nullptr;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        bool ok = false;
+        if (line.front() == '[' && line.back() == ']') {
+            std::string section = trim(line.substr(1, line.size() - 2));
+            if (section.compare(0, 6, "table ") == 0 && validTableName(trim(section.substr(6)))) {
+                config.tables.emplace_back();
+                table = &config.tables.back();
+                snprintf(table->name, sizeof(table->name), "%s", trim(section.substr(6)).c_str());
+                ok = true;
+            }
+        } else {
+            size_t equal = line.find('=');
+            if (equal != std::string::npos) {
+                std::string key = trim(line.substr(0, equal));
+                std::string value = trim(line.substr(equal + 1));
+                ok = table ? parseTable(*table, key, value) : parseGlobal(config, key, value);
+            }
+        }
+        if (!ok) {
+            LogError("{}:{}: invalid line: {}", file_name, line_number, line);
+            fprintf(stderr, "%s:%d: invalid line: %s\n", file_name, line_number, line.c_str());
+            return false;
+        }
+    }
+    if (config.tables.empty()) {
+        fprintf(stderr, "%s: no [table NAME] section\n", file_name);
+        return false;
+    }
+    if (config.batch && config.protocol != MODBUS_UDP) {
+        fprintf(stderr, "%s: batch is only supported for udp\n", file_name);
+        return false;
+    }
+    if ((config.protocol == MODBUS_RTU || config.protocol == MODBUS_ASCII) && config.serial_port[0] == '\0') {
+        fprintf(stderr, "%s: serial_port is required for rtu and ascii\n", file_name);
+        return false;
+    }
+    return true;
+}
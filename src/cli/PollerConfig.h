@@ -0,0 +1,59 @@
+#ifndef POLLERCONFIG_H
+#define POLLERCONFIG_H
+
+#include "ModbusFrameInfo.h"
+#include "ModbusPoller.h"
+#include "SampleWriter.h"
+#include <CSerialPort/SerialPort_global.h>
+#include <stdint.h>
+#include <vector>
+
+// ini style poller configuration:
+//
+//   protocol = rtu            # rtu, ascii, tcp or udp
+//   serial_port = /dev/ttyUSB0
+//   baud_rate = 9600
+//   data_bits = 8
+//   parity = none             # none, odd, even, mark or space
+//   stop_bits = 1             # 1, 1.5 or 2
+//   host = 127.0.0.1
+//   port = 502
+//   timeout_ms = 300
+//   batch = 0                 # 1 sends each udp scan cycle at once (linux sendmmsg/recvmmsg)
+//   format = csv              # csv, json or binary
+//   output = -                # file name, - is stdout
+//   duration_s = 0            # 0 polls until interrupted
+//
+//   [table holding]
+//   slave_id = 1
+//   function = 3              # 1 to 4
+//   address = 0
+//   quantity = 10
+//   scan_rate_ms = 100
+//   host = 10.0.0.7           # batch only, overrides the global host and port
+//   port = 502
+struct PollerConfig {
+    Protocols protocol{MODBUS_RTU};
+    char serial_port[256]{0};
+    int baud_rate{9600};
+    itas109::DataBits data_bits{itas109::DataBits8};
+    itas109::Parity parity{itas109::ParityNone};
+    itas109::StopBits stop_bits{itas109::StopOne};
+    char host[128]{"127.0.0.1"};
+    uint16_t port{502};
+    uint32_t timeout_ms{300};
+    bool batch{false};
+    SampleFormat format{SampleFormat_CSV};
+    char output[256]{"-"};
+    uint64_t duration_ms{0};
+    std::vector<PollTable> tables;
+};
+
+bool loadPollerConfig(const char *file_name, PollerConfig &config);
+
+bool parseSampleFormat(const char *value, SampleFormat &format);
+
+// whole seconds, 0 for no limit
+bool parseDuration(const char *value, uint64_t &duration_ms);
+
+#endif // POLLERCONFIG_H
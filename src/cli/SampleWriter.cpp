@@ -0,0 +1,127 @@
+#include "SampleWriter.h"
+#include "utils.h"
+#include <string.h>
+
+SampleWriter::SampleWriter() : m_file(nullptr), m_first_table(nullptr) {}
+
+SampleWriter::~SampleWriter() { close(); }
+
+bool SampleWriter::open(const char *file_name, const std::vector<PollTable> &tables) {
+    if (strcmp(file_name, "-") == 0) {
+        m_file = stdout;
+    } else {
+        m_file = fopen(file_name, "wb");
+    }
+    if (m_file == nullptr) {
+        LogError("can not open output file {}", file_name);
+        return false;
+    }
+    // samples arrive at the poll rate, let stdio batch them into large writes
+    setvbuf(m_file, nullptr, _IOFBF, 64 * 1024);
+    m_first_table = tables.data();
+    write_header(tables);
+    return true;
+}
+
+void SampleWriter::close() {
+    if (m_file == stdout) {
+        fflush(m_file);
+    } else if (m_file) {
+        fclose(m_file);
+    }
+    m_file = nullptr;
+}
+
+uint16_t SampleWriter::table_index(const PollTable *table) const { return uint16_t(table - m_first_table); }
+
+void CsvSampleWriter::write_header(const std::vector<PollTable> & /*tables*/) {
+    fprintf(m_file, "timestamp_us,table,slave_id,function,address,value,error\n");
+}
+
+void CsvSampleWriter::write(const PollSample &sample) {
+    const PollTable *table = sample.table;
+    if (sample.error_code != ModbusErrorCode_OK) {
+        fprintf(m_file, "%llu,%s,%d,%d,%d,,%d\n", (unsigned long long)sample.timestamp_us, table->name, table->id,
+                table->function, sample.reg_addr, sample.error_code);
+        return;
+    }
+    for (int i = 0; i < sample.quantity; ++i) {
+        fprintf(m_file, "%llu,%s,%d,%d,%d,%u,0\n", (unsigned long long)sample.timestamp_us, table->name, table->id,
+                table->function, sample.reg_addr + i, sample.values[i]);
+    }
+}
+
+void JsonSampleWriter::write_header(const std::vector<PollTable> & /*tables*/) {}
+
+void JsonSampleWriter::write(const PollSample &sample) {
+    const PollTable *table = sample.table;
+    // table names are restricted to characters that need no escaping when the config is loaded
+    fprintf(m_file,
+            "{\"timestamp_us\":%llu,\"table\":\"%s\",\"slave_id\":%d,\"function\":%d,\"address\":%d,\"error\":%d,"
+            "\"values\":[",
+            (unsigned long long)sample.timestamp_us, table->name, table->id, table->function, sample.reg_addr,
+            sample.error_code);
+    for (int i = 0; i < sample.quantity; ++i) {
+        fprintf(m_file, i == 0 ? "%u" : ",%u", sample.values[i]);
+    }
+    fprintf(m_file, "]}\n");
+}
+
+// file:   "DMPS", uint16 version, uint16 table count, tables
+// table:  uint8 slave id, uint8 function, uint16 start address, uint16 quantity, uint8 name size, name
+// record: uint64 timestamp_us, uint16 table index, uint16 address, uint16 quantity, int16 error, uint16 values[]
+void BinarySampleWriter::write_header(const std::vector<PollTable> &tables) {
+    uint8_t buffer[128];
+    size_t index = 0;
+    memcpy(buffer, "DMPS", 4);
+    index += 4;
+    myToLittleEndian<uint16_t>(1, buffer + index);
+    index += 2;
+    myToLittleEndian<uint16_t>(uint16_t(tables.size()), buffer + index);
+    index += 2;
+    fwrite(buffer, 1, index, m_file);
+    for (auto &table : tables) {
+        index = 0;
+        buffer[index++] = uint8_t(table.id);
+        buffer[index++] = uint8_t(table.function);
+        myToLittleEndian<uint16_t>(uint16_t(table.reg_start), buffer + index);
+        index += 2;
+        myToLittleEndian<uint16_t>(uint16_t(table.reg_quantity), buffer + index);
+        index += 2;
+        uint8_t name_size = uint8_t(strlen(table.name));
+        buffer[index++] = name_size;
+        fwrite(buffer, 1, index, m_file);
+        fwrite(table.name, 1, name_size, m_file);
+    }
+}
+
+void BinarySampleWriter::write(const PollSample &sample) {
+    uint8_t buffer[16 + MODBUS_MAX_READ_COILS * 2];
+    size_t index = 0;
+    myToLittleEndian<uint64_t>(sample.timestamp_us, buffer + index);
+    index += 8;
+    myToLittleEndian<uint16_t>(table_index(sample.table), buffer + index);
+    index += 2;
+    myToLittleEndian<uint16_t>(uint16_t(sample.reg_addr), buffer + index);
+    index += 2;
+    myToLittleEndian<uint16_t>(uint16_t(sample.quantity), buffer + index);
+    index += 2;
+    myToLittleEndian<int16_t>(int16_t(sample.error_code), buffer + index);
+    index += 2;
+    for (int i = 0; i < sample.quantity; ++i) {
+        myToLittleEndian<uint16_t>(sample.values[i], buffer + index);
+        index += 2;
+    }
+    fwrite(buffer, 1, index, m_file);
+}
+
+SampleWriter *createSampleWriter(SampleFormat format) {
+    switch (format) {
+    case SampleFormat_JSON:
+        return new JsonSampleWriter();
+    case SampleFormat_Binary:
+        return new BinarySampleWriter();
+    default:
+        return new CsvSampleWriter();
+    }
+}
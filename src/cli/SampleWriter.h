@@ -0,0 +1,67 @@
+#ifndef SAMPLEWRITER_H
+#define SAMPLEWRITER_H
+
+#include "ModbusPoller.h"
+#include <stdio.h>
+#include <vector>
+
+enum SampleFormat {
+    SampleFormat_CSV,
+    SampleFormat_JSON,
+    SampleFormat_Binary,
+};
+
+class SampleWriter {
+  public:
+    SampleWriter();
+
+    virtual ~SampleWriter();
+
+    // "-" writes to stdout
+    bool open(const char *file_name, const std::vector<PollTable> &tables);
+
+    void close();
+
+    virtual void write(const PollSample &sample) = 0;
+
+  protected:
+    virtual void write_header(const std::vector<PollTable> &tables) = 0;
+
+    // index of the table in the list given to open(), the binary format refers to tables by index
+    uint16_t table_index(const PollTable *table) const;
+
+  protected:
+    FILE *m_file;
+    const PollTable *m_first_table;
+};
+
+// one row per register: timestamp_us,table,slave_id,function,address,value,error
+class CsvSampleWriter : public SampleWriter {
+  public:
+    void write(const PollSample &sample) override;
+
+  protected:
+    void write_header(const std::vector<PollTable> &tables) override;
+};
+
+// one json object per request and line
+class JsonSampleWriter : public SampleWriter {
+  public:
+    void write(const PollSample &sample) override;
+
+  protected:
+    void write_header(const std::vector<PollTable> &tables) override;
+};
+
+// little-endian records after a table directory, see write_header() for the layout
+class BinarySampleWriter : public SampleWriter {
+  public:
+    void write(const PollSample &sample) override;
+
+  protected:
+    void write_header(const std::vector<PollTable> &tables) override;
+};
+
+SampleWriter *createSampleWriter(SampleFormat format);
+
+#endif // SAMPLEWRITER_H
@@ -0,0 +1,185 @@
+#include "ModbusPoller.h"
+#include "MySerialPort.h"
+#include "PollerConfig.h"
+#include "SampleWriter.h"
+#include "modbus_ascii.h"
+#include "modbus_rtu.h"
+#include "modbus_tcp.h"
+#include "mytcpsocket.h"
+#include "myudpsocket.h"
+#include "utils.h"
+#include <CSerialPort/SerialPort.h>
+#include <chrono>
+#include <future>
+#include <signal.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ModbusPoller *poller_instance = nullptr;
+
+static void signal_handler(int) {
+    if (poller_instance) {
+        poller_instance->stop();
+    }
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-f csv|json|binary] [-o output] [-d seconds] [-v] config\n"
+            "  -f  sample format, overrides the config\n"
+            "  -o  output file, - is stdout, overrides the config\n"
+            "  -d  poll duration in seconds, 0 polls until interrupted, overrides the config\n"
+            "  -v  log each failed request to stderr\n",
+            program);
+}
+
+static MyIODevice *open_io_device(const PollerConfig &config, itas109::CSerialPort *&cserial_port) {
+    if (config.protocol == MODBUS_RTU || config.protocol == MODBUS_ASCII) {
+        cserial_port = new itas109::CSerialPort();
+        cserial_port->setPortName(config.serial_port);
+        cserial_port->setBaudRate(config.baud_rate);
+        cserial_port->setDataBits(config.data_bits);
+        cserial_port->setStopBits(config.stop_bits);
+        cserial_port->setParity(config.parity);
+        cserial_port->setFlowControl(itas109::FlowNone);
+        MySerialPort *serial_port = new MySerialPort(cserial_port);
+        cserial_port->connectReadEvent(serial_port);
+        if (!cserial_port->open()) {
+            fprintf(stderr, "can not open %s: %s\n", config.serial_port, cserial_port->getLastErrorMsg());
+            delete serial_port;
+            return nullptr;
+        }
+        return serial_port;
+    } else if (config.protocol == MODBUS_TCP) {
+        MyTcpSocket *tcp_socket = new MyTcpSocket();
+        std::promise<bool> connected;
+        tcp_socket->setConnectedCallback([&connected](bool ok) { connected.set_value(ok); });
+        tcp_socket->connectToHost(config.host, config.port);
+        std::future<bool> connected_future = connected.get_future();
+        if (connected_future.wait_for(std::chrono::seconds(5)) != std::future_status::ready || !connected_future.get()) {
+            fprintf(stderr, "can not connect to %s:%u\n", config.host, config.port);
+            tcp_socket->setConnectedCallback(nullptr);
+            delete tcp_socket;
+            return nullptr;
+        }
+        tcp_socket->setConnectedCallback(nullptr);
+        return tcp_socket;
+    } else {
+        MyUdpSocket *udp_socket = new MyUdpSocket();
+        if (!udp_socket->connectTo(config.host, config.port)) {
+            fprintf(stderr, "can not connect to %s:%u\n", config.host, config.port);
+            delete udp_socket;
+            return nullptr;
+        }
+        return udp_socket;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *config_file = nullptr;
+    const char *format = nullptr;
+    const char *output = nullptr;
+    const char *duration = nullptr;
+    bool verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            duration = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (argv[i][0] != '-' && config_file == nullptr) {
+            config_file = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config_file == nullptr) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // samples may go to stdout, so the log stays on stderr
+    auto logger = spdlog::stderr_color_mt("debugmyprotocol-cli");
+    logger->set_level(verbose ? spdlog::level::info : spdlog::level::warn);
+    spdlog::set_default_logger(logger);
+    spdlog::set_pattern("%Y-%m-%d %H:%M:%S:%e [%l] - %v");
+
+    PollerConfig config;
+    if (!loadPollerConfig(config_file, config)) {
+        return 1;
+    }
+    if (format && !parseSampleFormat(format, config.format)) {
+        fprintf(stderr, "unknown format %s\n", format);
+        return 1;
+    }
+    if (output) {
+        snprintf(config.output, sizeof(config.output), "%s", output);
+    }
+    if (duration && !parseDuration(duration, config.duration_ms)) {
+        fprintf(stderr, "invalid duration %s\n", duration);
+        return 1;
+    }
+
+    ModbusBase *modbus = nullptr;
+    if (config.protocol == MODBUS_RTU) {
+        modbus = new Modbus_RTU();
+    } else if (config.protocol == MODBUS_ASCII) {
+        modbus = new Modbus_ASCII();
+    } else {
+        modbus = new Modbus_TCP();
+    }
+    itas109::CSerialPort *cserial_port = nullptr;
+    MyIODevice *io_device = nullptr;
+    // a batched poll talks to its endpoints through its own socket
+    if (!config.batch) {
+        io_device = open_io_device(config, cserial_port);
+        if (io_device == nullptr) {
+            delete cserial_port;
+            delete modbus;
+            return 1;
+        }
+        io_device->setErrorCallback([](const char *msg) { LogError("{}", msg); });
+    }
+
+    int ret = 0;
+    {
+        ModbusPoller poller(io_device, modbus, config.protocol, config.timeout_ms);
+        for (auto &table : config.tables) {
+            poller.addTable(table);
+        }
+        SampleWriter *writer = createSampleWriter(config.format);
+        // the writer refers to tables by their position, so open it after all tables are added
+        if (config.batch && !poller.enableBatch(config.host, config.port)) {
+            fprintf(stderr, "can not set up batched udp polling\n");
+            ret = 1;
+        } else if (writer->open(config.output, poller.tables())) {
+            poller.setSampleCallback([writer](const PollSample &sample) { writer->write(sample); });
+            poller_instance = &poller;
+            signal(SIGINT, signal_handler);
+            signal(SIGTERM, signal_handler);
+            poller.run(config.duration_ms);
+            poller_instance = nullptr;
+            writer->close();
+            for (auto &table : poller.tables()) {
+                fprintf(stderr, "%s: %u requests, %u errors\n", table.name, table.send_count, table.error_count);
+            }
+        } else {
+            ret = 1;
+        }
+        delete writer;
+    }
+    if (io_device) {
+        io_device->close();
+    }
+    delete io_device;
+    delete cserial_port;
+    delete modbus;
+    return ret;
+}
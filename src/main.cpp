@@ -12,7 +12,10 @@
 // **Prefer using the code in the example_sdl2_opengl3/ folder**
 // See imgui_impl_sdl2.cpp for details.
 
+#include "AsyncLog.h"
+#include "GlyphCache.h"
 #include "MainWindow.h"
+#include "RenderLoop.h"
 #include "font_CN.h"
 #include "imgui.h"
 #include "imgui_impl_opengl2.h"
@@ -26,19 +29,36 @@
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/spdlog.h>
 #include <stdio.h>
+#include <string.h>
 
 // Main code
-int main(int, char **) {
+int main(int argc, char **argv) {
+    uint64_t startup_start = SDL_GetPerformanceCounter();
     setlocale(LC_ALL, "");
     bindtextdomain("DebugMyProtocol", "./locale");
     textdomain("DebugMyProtocol");
 
-    auto logger = spdlog::rotating_logger_mt("DebugMyProtocol", "./log/DebugMyProtocol.log", 1024 * 1024 * 5, 3);
-    logger->flush_on(spdlog::level::err);
+    bool binary_log = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--binary-log") == 0) {
+            binary_log = true;
+        }
+    }
+    // the io threads only queue their messages, the file is written by the sink's own thread which also flushes
+    // after errors, see AsyncLogSink
+    std::shared_ptr<spdlog::sinks::rotating_file_sink_mt> file_sink =
+        std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+            binary_log ? "./log/DebugMyProtocol.dlog" : "./log/DebugMyProtocol.log", 1024 * 1024 * 5, 3);
+    if (binary_log) {
+        file_sink->set_formatter(std::unique_ptr<spdlog::formatter>(new BinaryLogFormatter()));
+    } else {
+        file_sink->set_pattern("%Y-%m-%d %H:%M:%S:%e [%l] [%t] - <%s>|<%#>|<%!> : %v");
+    }
+    auto logger = std::make_shared<spdlog::logger>("DebugMyProtocol", std::make_shared<AsyncLogSink>(file_sink));
     logger->set_level(spdlog::level::warn);
+    spdlog::register_logger(logger);
     spdlog::flush_every(std::chrono::seconds(3));
     spdlog::set_default_logger(logger);
-    spdlog::set_pattern("%Y-%m-%d %H:%M:%S:%e [%l] [%t] - <%s>|<%#>|<%!> : %v");
     LogCritical("------------------------------------------------------------------------------------------------------"
                 "-----------");
     // Setup SDL
@@ -47,6 +67,8 @@ int main(int, char **) {
         return -1;
     }
 
+    initRenderLoop();
+
     // From 2.0.18: Enable native IME.
 #ifdef SDL_HINT_IME_SHOW_UI
     SDL_SetHint(SDL_HINT_IME_SHOW_UI, "1");
@@ -117,14 +139,16 @@ int main(int, char **) {
     // io.Fonts->AddFontFromFileTTF("../../misc/fonts/DroidSans.ttf", 16.0f);
     // io.Fonts->AddFontFromFileTTF("../../misc/fonts/Roboto-Medium.ttf", 16.0f);
     // io.Fonts->AddFontFromFileTTF("../../misc/fonts/Cousine-Regular.ttf", 15.0f);
-    ImFont *font = io.Fonts->AddFontFromMemoryTTF((void *)CN_font_data, CN_font_size, 22.0f, nullptr,
-                                                  io.Fonts->GetGlyphRangesChineseFull());
-    IM_ASSERT(font != nullptr);
+    // only the glyphs the ui uses are rasterised, see GlyphCache
+    GlyphCache glyph_cache(CN_font_data, CN_font_size, 22.0f);
+    glyph_cache.addCatalog("DebugMyProtocol");
+    bool first_frame = true;
 
     // Our state
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
     bool done = false;
     MainWindow main_window(&done);
+    int frames_to_render = RENDER_FRAMES_AFTER_INPUT;
     // Main loop
 
     while (!done) {
@@ -136,14 +160,40 @@ int main(int, char **) {
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or
         // clear/overwrite your copy of the keyboard data. Generally you may always pass all inputs to dear imgui, and
         // hide them from your application based on those two flags.
+        // Nothing changes on screen without input or new data, so block until either arrives, the io threads post a
+        // redraw event through requestRedraw().
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            if (event.type == SDL_QUIT)
-                done = true;
-            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE &&
-                event.window.windowID == SDL_GetWindowID(window))
-                done = true;
+        int timeout = frames_to_render > 0 ? 0 : renderLoopWaitTimeout();
+        bool has_event = timeout > 0 ? SDL_WaitEventTimeout(&event, timeout) : SDL_PollEvent(&event);
+        while (has_event) {
+            if (!isRedrawEvent(event)) {
+                frames_to_render = RENDER_FRAMES_AFTER_INPUT;
+                ImGui_ImplSDL2_ProcessEvent(&event);
+                if (event.type == SDL_TEXTINPUT) {
+                    glyph_cache.addText(event.text.text);
+                }
+                if (event.type == SDL_CLIPBOARDUPDATE && SDL_HasClipboardText()) {
+                    // pasted text does not come through SDL_TEXTINPUT
+                    char *text = SDL_GetClipboardText();
+                    glyph_cache.addText(text);
+                    SDL_free(text);
+                }
+                if (event.type == SDL_QUIT)
+                    done = true;
+                if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE &&
+                    event.window.windowID == SDL_GetWindowID(window))
+                    done = true;
+            }
+            has_event = SDL_PollEvent(&event);
+        }
+        if (frames_to_render > 0) {
+            frames_to_render--;
+        } else if (!renderLoopFrameDue()) {
+            continue;
+        }
+        renderLoopBeginFrame();
+        if (glyph_cache.rebuildIfNeeded()) {
+            renderLoopSetAtlas(glyph_cache.glyphCount(), float(glyph_cache.lastBuildMs()));
         }
 
         // Start the Dear ImGui frame
@@ -170,6 +220,13 @@ int main(int, char **) {
         // glUseProgram(0); // You may want this if using this code in an OpenGL 3+ context where shaders may be bound
         ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(window);
+        renderLoopEndFrame();
+        if (first_frame) {
+            first_frame = false;
+            // the logger only writes warnings, the main window shows it
+            renderLoopSetFirstFrameMs(float((SDL_GetPerformanceCounter() - startup_start) * 1000.0 /
+                                            SDL_GetPerformanceFrequency()));
+        }
     }
 
     // Cleanup
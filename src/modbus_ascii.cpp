@@ -1,5 +1,7 @@
 #include "modbus_ascii.h"
 #include "utils.h"
+#include <algorithm>
+#include <string.h>
 #include <stdio.h>
 
 const char Modbus_ASCII::pack_start_character = ':';
@@ -12,18 +14,21 @@ size_t Modbus_ASCII::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *b
     pack[index++] = uint8_t(frame_info.function);
     pack[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
     pack[index++] = uint8_t(frame_info.reg_addr & 0XFF);
-    if (frame_info.function != ModbusWriteSingleCoil && frame_info.function != ModbusWriteSingleRegister) {
+    if (frame_info.function != ModbusWriteSingleCoil && frame_info.function != ModbusWriteSingleRegister &&
+        frame_info.function != ModbusMaskWriteRegister && frame_info.function != ModbusDiagnostics &&
+        frame_info.function != ModbusEncapsulatedInterface) {
         pack[index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         pack[index++] = uint8_t(frame_info.quantity & 0xFF);
     }
-    if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister) {
+    if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister ||
+        frame_info.function == ModbusDiagnostics) {
         pack[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
         pack[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
     }
     if (frame_info.function == ModbusWriteMultipleCoils) {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         pack[index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             pack[index++] = coils[i];
         }
@@ -33,6 +38,23 @@ size_t Modbus_ASCII::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *b
             pack[index++] = uint8_t(frame_info.reg_values[i] >> 8 & 0xFF);
             pack[index++] = uint8_t(frame_info.reg_values[i] & 0xFF);
         }
+    } else if (frame_info.function == ModbusMaskWriteRegister) {
+        pack[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    } else if (frame_info.function == ModbusReadWriteMultipleRegisters) {
+        pack[index++] = uint8_t(frame_info.write_reg_addr >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.write_reg_addr & 0xFF);
+        pack[index++] = uint8_t(frame_info.write_quantity >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.write_quantity & 0xFF);
+        pack[index++] = uint8_t(frame_info.write_quantity * 2);
+        for (int i = 0; i < frame_info.write_quantity; ++i) {
+            pack[index++] = uint8_t(frame_info.write_reg_values[i] >> 8 & 0xFF);
+            pack[index++] = uint8_t(frame_info.write_reg_values[i] & 0xFF);
+        }
+    } else if (frame_info.function == ModbusEncapsulatedInterface) {
+        pack[index++] = uint8_t(frame_info.quantity & 0xFF);
     }
     pack[index] = LRC(buffer, index);
     index++;
@@ -51,13 +73,14 @@ ModbusFrameInfo Modbus_ASCII::masterPack2Frame(const char *buffer, size_t size)
     ret.id = uint8_t(hex_pack[0]);
     ret.function = uint8_t(hex_pack[1]);
     if (ret.function == ModbusReadCoils || ret.function == ModbusReadDescreteInputs) {
-        ret.quantity = uint8_t(hex_pack[2]);
-        uint8_t *coils = (uint8_t *)ret.reg_values;
+        ret.quantity = std::min<int>(uint8_t(hex_pack[2]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for (int i = 0; i < ret.quantity; ++i) {
             coils[i] = hex_pack[3 + i];
         }
-    } else if (ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters) {
-        ret.quantity = uint8_t(hex_pack[2]) / 2;
+    } else if (ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters ||
+               ret.function == ModbusReadWriteMultipleRegisters) {
+        ret.quantity = std::min<int>(uint8_t(hex_pack[2]) / 2, MODBUS_MAX_READ_REGISTERS);
         for (int i = 0; i < ret.quantity; ++i) {
             ret.reg_values[i] = uint16_t(hex_pack[3 + 2 * i]) << 8 | uint8_t(hex_pack[4 + 2 * i]);
         }
@@ -68,6 +91,18 @@ ModbusFrameInfo Modbus_ASCII::masterPack2Frame(const char *buffer, size_t size)
         coils[1] = hex_pack[5];
     } else if (ret.function == ModbusWriteMultipleCoils || ret.function == ModbusWriteMultipleRegisters) {
         ret.quantity = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
+    } else if (ret.function == ModbusMaskWriteRegister) {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
+        ret.reg_values[0] = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
+        ret.reg_values[1] = uint16_t(hex_pack[6]) << 8 | uint8_t(hex_pack[7]);
+    } else if (ret.function == ModbusDiagnostics) {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
+        ret.reg_values[0] = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
+    } else if (ret.function == ModbusEncapsulatedInterface) {
+        ret.mei_data_size = std::min<int>(int(size - 3) / 2 - 3, sizeof(ret.mei_data));
+        memcpy(ret.mei_data, hex_pack + 2, ret.mei_data_size);
     } else if (ret.function > ModbusFunctionError) {
         ret.reg_values[0] = hex_pack[2];
     } else {
@@ -84,18 +119,20 @@ size_t Modbus_ASCII::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *bu
     if (frame_info.function == ModbusCoilStatus || frame_info.function == ModbusInputStatus) {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         pack[index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             pack[index++] = coils[i];
         }
-    } else if (frame_info.function == ModbusHoldingRegisters || frame_info.function == ModbusInputRegisters) {
+    } else if (frame_info.function == ModbusHoldingRegisters || frame_info.function == ModbusInputRegisters ||
+               frame_info.function == ModbusReadWriteMultipleRegisters) {
         uint8_t byte_num = uint8_t(frame_info.quantity << 1);
         pack[index++] = byte_num;
         for (int i = 0; i < frame_info.quantity; ++i) {
             pack[index++] = uint8_t(frame_info.reg_values[i] >> 8 & 0xFF);
             pack[index++] = uint8_t(frame_info.reg_values[i] & 0xFF);
         }
-    } else if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister) {
+    } else if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister ||
+               frame_info.function == ModbusDiagnostics) {
         pack[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
         pack[index++] = uint8_t(frame_info.reg_addr & 0xFF);
         pack[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
@@ -105,6 +142,17 @@ size_t Modbus_ASCII::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *bu
         pack[index++] = uint8_t(frame_info.reg_addr & 0xFF);
         pack[index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         pack[index++] = uint8_t(frame_info.quantity & 0xFF);
+    } else if (frame_info.function == ModbusMaskWriteRegister) {
+        pack[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_addr & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        pack[index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    } else if (frame_info.function == ModbusEncapsulatedInterface) {
+        for (int i = 0; i < frame_info.mei_data_size; ++i) {
+            pack[index++] = frame_info.mei_data[i];
+        }
     } else if (frame_info.function > ModbusFunctionError) {
         pack[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
     }
@@ -128,25 +176,56 @@ ModbusFrameInfo Modbus_ASCII::slavePack2Frame(const char *buffer, size_t buffer_
         ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters) {
         ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
         ret.quantity = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
-    } else if (ret.function == ModbusWriteSingleCoil || ret.function == ModbusWriteSingleRegister) {
+    } else if (ret.function == ModbusWriteSingleCoil || ret.function == ModbusWriteSingleRegister ||
+               ret.function == ModbusDiagnostics) {
         ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
         ret.quantity = 1;
         ret.reg_values[0] = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
     } else if (ret.function == ModbusWriteMultipleCoils) {
         ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
         ret.quantity = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
-        int byte_num = uint8_t(hex_pack[6]);
-        uint8_t *coils = (uint8_t *)ret.reg_values;
+        int byte_num = std::min<int>(uint8_t(hex_pack[6]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             coils[i] = hex_pack[7 + i];
         }
     } else if (ret.function == ModbusWriteMultipleRegisters) {
         ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
         ret.quantity = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
-        for (int i = 0; i < ret.quantity; ++i) {
+        // a quantity beyond the limit is answered with an exception, its values are not read
+        for (int i = 0; i < std::min<int>(ret.quantity, MODBUS_MAX_WRITE_REGISTERS); ++i) {
             ret.reg_values[i] = uint16_t(hex_pack[7 + 2 * i]) << 8 | uint8_t(hex_pack[8 + i * 2]);
         }
+    } else if (ret.function == ModbusMaskWriteRegister) {
+        ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
+        ret.quantity = 1;
+        ret.reg_values[0] = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
+        ret.reg_values[1] = uint16_t(hex_pack[6]) << 8 | uint8_t(hex_pack[7]);
+    } else if (ret.function == ModbusReadWriteMultipleRegisters) {
+        ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
+        ret.quantity = uint16_t(hex_pack[4]) << 8 | uint8_t(hex_pack[5]);
+        ret.write_reg_addr = uint16_t(hex_pack[6]) << 8 | uint8_t(hex_pack[7]);
+        ret.write_quantity = uint16_t(hex_pack[8]) << 8 | uint8_t(hex_pack[9]);
+        for (int i = 0; i < std::min<int>(ret.write_quantity, MODBUS_MAX_RW_WRITE_REGISTERS); ++i) {
+            ret.write_reg_values[i] = uint16_t(hex_pack[11 + 2 * i]) << 8 | uint8_t(hex_pack[12 + 2 * i]);
+        }
+    } else if (ret.function == ModbusEncapsulatedInterface) {
+        ret.reg_addr = uint16_t(hex_pack[2]) << 8 | uint8_t(hex_pack[3]);
+        ret.quantity = uint8_t(hex_pack[4]);
+    }
+    return ret;
+}
+
+ModbusPduView Modbus_ASCII::pack2View(const char *buffer, size_t buffer_size, uint8_t *scratch) {
+    ModbusPduView ret;
+    if (buffer_size < 9 || buffer_size - 3 > MODBUS_PDU_SCRATCH_SIZE * 2) {
+        return ret;
     }
+    size_t size = fromHexString(buffer + 1, buffer_size - 3, scratch);
+    ret.id = scratch[0];
+    ret.function = scratch[1];
+    ret.data = scratch + 2;
+    ret.data_size = size - 3;
     return ret;
 }
 
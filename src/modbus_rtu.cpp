@@ -1,5 +1,7 @@
 #include "modbus_rtu.h"
 #include "utils.h"
+#include <algorithm>
+#include <string.h>
 
 size_t Modbus_RTU::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buffer) {
     size_t index = 0;
@@ -7,18 +9,21 @@ size_t Modbus_RTU::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buf
     buffer[index++] = uint8_t(frame_info.function);
     buffer[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
     buffer[index++] = uint8_t(frame_info.reg_addr & 0xFF);
-    if (frame_info.function != ModbusWriteSingleCoil && frame_info.function != ModbusWriteSingleRegister) {
+    if (frame_info.function != ModbusWriteSingleCoil && frame_info.function != ModbusWriteSingleRegister &&
+        frame_info.function != ModbusMaskWriteRegister && frame_info.function != ModbusDiagnostics &&
+        frame_info.function != ModbusEncapsulatedInterface) {
         buffer[index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         buffer[index++] = uint8_t(frame_info.quantity & 0xFF);
     }
-    if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister) {
+    if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister ||
+        frame_info.function == ModbusDiagnostics) {
         buffer[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
         buffer[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
     }
     if (frame_info.function == ModbusWriteMultipleCoils) {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         buffer[index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             buffer[index++] = coils[i];
         }
@@ -28,6 +33,23 @@ size_t Modbus_RTU::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buf
             buffer[index++] = uint8_t(frame_info.reg_values[i] >> 8 & 0xFF);
             buffer[index++] = uint8_t(frame_info.reg_values[i] & 0xFF);
         }
+    } else if (frame_info.function == ModbusMaskWriteRegister) {
+        buffer[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    } else if (frame_info.function == ModbusReadWriteMultipleRegisters) {
+        buffer[index++] = uint8_t(frame_info.write_reg_addr >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.write_reg_addr & 0xFF);
+        buffer[index++] = uint8_t(frame_info.write_quantity >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.write_quantity & 0xFF);
+        buffer[index++] = uint8_t(frame_info.write_quantity * 2);
+        for (int i = 0; i < frame_info.write_quantity; ++i) {
+            buffer[index++] = uint8_t(frame_info.write_reg_values[i] >> 8 & 0xFF);
+            buffer[index++] = uint8_t(frame_info.write_reg_values[i] & 0xFF);
+        }
+    } else if (frame_info.function == ModbusEncapsulatedInterface) {
+        buffer[index++] = uint8_t(frame_info.quantity & 0xFF);
     }
     uint16_t crc_value = CRC_16(buffer, index);
     buffer[index++] = uint8_t(crc_value & 0xFF);
@@ -40,13 +62,14 @@ ModbusFrameInfo Modbus_RTU::masterPack2Frame(const char *buffer, size_t buffer_s
     ret.id = uint8_t(buffer[0]);
     ret.function = uint8_t(buffer[1]);
     if (ret.function == ModbusReadCoils || ret.function == ModbusReadDescreteInputs) {
-        ret.quantity = uint8_t(buffer[2]);
-        uint8_t *coils = (uint8_t *)ret.reg_values;
+        ret.quantity = std::min<int>(uint8_t(buffer[2]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for (int i = 0; i < ret.quantity; ++i) {
             coils[i] = buffer[3 + i];
         }
-    } else if (ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters) {
-        ret.quantity = uint8_t(buffer[2]) / 2;
+    } else if (ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters ||
+               ret.function == ModbusReadWriteMultipleRegisters) {
+        ret.quantity = std::min<int>(uint8_t(buffer[2]) / 2, MODBUS_MAX_READ_REGISTERS);
         for (int i = 0; i < ret.quantity; ++i) {
             ret.reg_values[i] = uint16_t(buffer[3 + 2 * i]) << 8 | uint8_t(buffer[4 + 2 * i]);
         }
@@ -57,6 +80,18 @@ ModbusFrameInfo Modbus_RTU::masterPack2Frame(const char *buffer, size_t buffer_s
         coils[1] = buffer[5];
     } else if (ret.function == ModbusWriteMultipleCoils || ret.function == ModbusWriteMultipleRegisters) {
         ret.quantity = uint16_t(buffer[4]) << 8 | uint8_t(buffer[5]);
+    } else if (ret.function == ModbusMaskWriteRegister) {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(buffer[2]) << 8 | uint8_t(buffer[3]);
+        ret.reg_values[0] = uint16_t(buffer[4]) << 8 | uint8_t(buffer[5]);
+        ret.reg_values[1] = uint16_t(buffer[6]) << 8 | uint8_t(buffer[7]);
+    } else if (ret.function == ModbusDiagnostics) {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(buffer[2]) << 8 | uint8_t(buffer[3]);
+        ret.reg_values[0] = uint16_t(buffer[4]) << 8 | uint8_t(buffer[5]);
+    } else if (ret.function == ModbusEncapsulatedInterface) {
+        ret.mei_data_size = std::min<int>(int(buffer_size) - 4, sizeof(ret.mei_data));
+        memcpy(ret.mei_data, buffer + 2, ret.mei_data_size);
     } else if (ret.function > ModbusFunctionError) {
         ret.reg_values[0] = buffer[2];
     } else {
@@ -72,18 +107,20 @@ size_t Modbus_RTU::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buff
     if (frame_info.function == ModbusCoilStatus || frame_info.function == ModbusInputStatus) {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         buffer[index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             buffer[index++] = coils[i];
         }
-    } else if (frame_info.function == ModbusHoldingRegisters || frame_info.function == ModbusInputRegisters) {
+    } else if (frame_info.function == ModbusHoldingRegisters || frame_info.function == ModbusInputRegisters ||
+               frame_info.function == ModbusReadWriteMultipleRegisters) {
         uint8_t byte_num = uint8_t(frame_info.quantity << 1);
         buffer[index++] = byte_num;
         for (int i = 0; i < frame_info.quantity; ++i) {
             buffer[index++] = uint8_t(frame_info.reg_values[i] >> 8 & 0xFF);
             buffer[index++] = uint8_t(frame_info.reg_values[i] & 0xFF);
         }
-    } else if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister) {
+    } else if (frame_info.function == ModbusWriteSingleCoil || frame_info.function == ModbusWriteSingleRegister ||
+               frame_info.function == ModbusDiagnostics) {
         buffer[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
         buffer[index++] = uint8_t(frame_info.reg_addr & 0xFF);
         buffer[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
@@ -93,6 +130,17 @@ size_t Modbus_RTU::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buff
         buffer[index++] = uint8_t(frame_info.reg_addr & 0xFF);
         buffer[index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         buffer[index++] = uint8_t(frame_info.quantity & 0xFF);
+    } else if (frame_info.function == ModbusMaskWriteRegister) {
+        buffer[index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_addr & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        buffer[index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    } else if (frame_info.function == ModbusEncapsulatedInterface) {
+        for (int i = 0; i < frame_info.mei_data_size; ++i) {
+            buffer[index++] = frame_info.mei_data[i];
+        }
     } else if (frame_info.function > ModbusFunctionError) {
         buffer[index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
     }
@@ -110,28 +158,59 @@ ModbusFrameInfo Modbus_RTU::slavePack2Frame(const char *pack, size_t pack_size)
         ret.function == ModbusReadHoldingRegisters || ret.function == ModbusReadInputRegisters) {
         ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
         ret.quantity = uint16_t(pack[4]) << 8 | uint8_t(pack[5]);
-    } else if (ret.function == ModbusWriteSingleCoil || ret.function == ModbusWriteSingleRegister) {
+    } else if (ret.function == ModbusWriteSingleCoil || ret.function == ModbusWriteSingleRegister ||
+               ret.function == ModbusDiagnostics) {
         ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
         ret.quantity = 1;
         ret.reg_values[0] = uint16_t(pack[4]) << 8 | uint8_t(pack[5]);
     } else if (ret.function == ModbusWriteMultipleCoils) {
         ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
         ret.quantity = uint16_t(pack[4]) << 8 | uint8_t(pack[5]);
-        int byte_num = uint8_t(pack[6]);
-        uint8_t *coils = (uint8_t *)ret.reg_values;
+        int byte_num = std::min<int>(uint8_t(pack[6]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for (int i = 0; i < byte_num; ++i) {
             coils[i] = pack[7 + i];
         }
     } else if (ret.function == ModbusWriteMultipleRegisters) {
         ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
-        ret.quantity = uint16_t(pack[4]) << 8 | uint8_t(pack[5]);
-        for (int i = 0; i < ret.quantity; ++i) {
+        ret.quantity = uint16_t(uint8_t(pack[4])) << 8 | uint8_t(pack[5]);
+        // a quantity beyond the limit is answered with an exception, its values are not read
+        for (int i = 0; i < std::min<int>(ret.quantity, MODBUS_MAX_WRITE_REGISTERS); ++i) {
             ret.reg_values[i] = uint16_t(pack[7 + 2 * i]) << 8 | uint8_t(pack[8 + 2 * i]);
         }
+    } else if (ret.function == ModbusMaskWriteRegister) {
+        ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
+        ret.quantity = 1;
+        ret.reg_values[0] = uint16_t(pack[4]) << 8 | uint8_t(pack[5]);
+        ret.reg_values[1] = uint16_t(pack[6]) << 8 | uint8_t(pack[7]);
+    } else if (ret.function == ModbusReadWriteMultipleRegisters) {
+        // pack is signed, a high byte of 0x80 or more would spread into the upper bits
+        ret.reg_addr = uint16_t(uint8_t(pack[2])) << 8 | uint8_t(pack[3]);
+        ret.quantity = uint16_t(uint8_t(pack[4])) << 8 | uint8_t(pack[5]);
+        ret.write_reg_addr = uint16_t(uint8_t(pack[6])) << 8 | uint8_t(pack[7]);
+        ret.write_quantity = uint16_t(uint8_t(pack[8])) << 8 | uint8_t(pack[9]);
+        for (int i = 0; i < std::min<int>(ret.write_quantity, MODBUS_MAX_RW_WRITE_REGISTERS); ++i) {
+            ret.write_reg_values[i] = uint16_t(uint8_t(pack[11 + 2 * i])) << 8 | uint8_t(pack[12 + 2 * i]);
+        }
+    } else if (ret.function == ModbusEncapsulatedInterface) {
+        ret.reg_addr = uint16_t(pack[2]) << 8 | uint8_t(pack[3]);
+        ret.quantity = uint8_t(pack[4]);
     }
     return ret;
 }
 
+ModbusPduView Modbus_RTU::pack2View(const char *buffer, size_t buffer_size, uint8_t * /*scratch*/) {
+    ModbusPduView ret;
+    if (buffer_size < 4) {
+        return ret;
+    }
+    ret.id = uint8_t(buffer[0]);
+    ret.function = uint8_t(buffer[1]);
+    ret.data = (const uint8_t *)buffer + 2;
+    ret.data_size = buffer_size - 4;
+    return ret;
+}
+
 bool Modbus_RTU::validPack(const char *buffer, size_t buffer_size) { return CRC_16(buffer, buffer_size) == 0; }
 
 Modbus_RTU::Modbus_RTU() {}
@@ -10,6 +10,7 @@ class Modbus_RTU : public ModbusBase {
     size_t slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buffer) override;
     ModbusFrameInfo slavePack2Frame(const char *buffer, size_t buffer_size) override;
     bool validPack(const char *buffer, size_t buffer_size) override;
+    ModbusPduView pack2View(const char *buffer, size_t buffer_size, uint8_t *scratch) override;
     Modbus_RTU();
 };
 
@@ -1,5 +1,6 @@
 #include "modbus_tcp.h"
 #include "utils.h"
+#include <algorithm>
 
 
 size_t Modbus_TCP::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buffer)
@@ -16,13 +17,17 @@ size_t Modbus_TCP::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buf
     data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
     data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr & 0xFF);
     if(frame_info.function != ModbusWriteSingleCoil &&
-        frame_info.function != ModbusWriteSingleRegister)
+        frame_info.function != ModbusWriteSingleRegister &&
+        frame_info.function != ModbusMaskWriteRegister &&
+        frame_info.function != ModbusDiagnostics &&
+        frame_info.function != ModbusEncapsulatedInterface)
     {
         data_pack[data_pack_index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         data_pack[data_pack_index++] = uint8_t(frame_info.quantity & 0xFF);
     }
     if(frame_info.function == ModbusWriteSingleCoil ||
-        frame_info.function == ModbusWriteSingleRegister)
+        frame_info.function == ModbusWriteSingleRegister ||
+        frame_info.function == ModbusDiagnostics)
     {
         data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
         data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
@@ -31,7 +36,7 @@ size_t Modbus_TCP::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buf
     {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         data_pack[data_pack_index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for(int i = 0;i < byte_num;++i)
         {
             data_pack[data_pack_index++] = coils[i];
@@ -46,6 +51,30 @@ size_t Modbus_TCP::masterFrame2Pack(const ModbusFrameInfo &frame_info, char *buf
             data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[i] & 0xFF);
         }
     }
+    else if(frame_info.function == ModbusMaskWriteRegister)
+    {
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    }
+    else if(frame_info.function == ModbusReadWriteMultipleRegisters)
+    {
+        data_pack[data_pack_index++] = uint8_t(frame_info.write_reg_addr >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.write_reg_addr & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.write_quantity >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.write_quantity & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.write_quantity * 2);
+        for(int i = 0;i < frame_info.write_quantity;++i)
+        {
+            data_pack[data_pack_index++] = uint8_t(frame_info.write_reg_values[i] >> 8 & 0xFF);
+            data_pack[data_pack_index++] = uint8_t(frame_info.write_reg_values[i] & 0xFF);
+        }
+    }
+    else if(frame_info.function == ModbusEncapsulatedInterface)
+    {
+        data_pack[data_pack_index++] = uint8_t(frame_info.quantity & 0xFF);
+    }
     buffer[index++] = uint8_t(data_pack_index >> 8 & 0xFF);
     buffer[index++] = uint8_t(data_pack_index & 0xFF);
     memcpy(buffer + index, data_pack, data_pack_index);
@@ -63,17 +92,18 @@ ModbusFrameInfo Modbus_TCP::masterPack2Frame(const char *pack, size_t pack_size)
     if(ret.function == ModbusReadCoils ||
         ret.function == ModbusReadDescreteInputs)
     {
-        ret.quantity = uint8_t(data_pack[2]);
-        uint8_t *coils = (uint8_t *)ret.reg_values;
+        ret.quantity = std::min<int>(uint8_t(data_pack[2]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for(int i = 0;i < ret.quantity;++i)
         {
             coils[i] = data_pack[3 + i];
         }
     }
     else if(ret.function == ModbusReadHoldingRegisters ||
-             ret.function == ModbusReadInputRegisters)
+             ret.function == ModbusReadInputRegisters ||
+             ret.function == ModbusReadWriteMultipleRegisters)
     {
-        ret.quantity = uint8_t(data_pack[2]) / 2;
+        ret.quantity = std::min<int>(uint8_t(data_pack[2]) / 2, MODBUS_MAX_READ_REGISTERS);
         for(int i = 0;i < ret.quantity;++i)
         {
             ret.reg_values[i] = uint16_t(data_pack[3 + 2 * i]) << 8 | uint8_t(data_pack[4 + 2 * i]);
@@ -92,6 +122,24 @@ ModbusFrameInfo Modbus_TCP::masterPack2Frame(const char *pack, size_t pack_size)
     {
         ret.quantity = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
     }
+    else if(ret.function == ModbusMaskWriteRegister)
+    {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
+        ret.reg_values[0] = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
+        ret.reg_values[1] = uint16_t(data_pack[6]) << 8 | uint8_t(data_pack[7]);
+    }
+    else if(ret.function == ModbusDiagnostics)
+    {
+        ret.quantity = 1;
+        ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
+        ret.reg_values[0] = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
+    }
+    else if(ret.function == ModbusEncapsulatedInterface)
+    {
+        ret.mei_data_size = std::min<int>(int(pack_size) - 8, sizeof(ret.mei_data));
+        memcpy(ret.mei_data, data_pack + 2, ret.mei_data_size);
+    }
     else if(ret.function > ModbusFunctionError)
     {
         ret.reg_values[0] = data_pack[2];
@@ -119,14 +167,15 @@ size_t Modbus_TCP::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buff
     {
         uint8_t byte_num = uint8_t(pageConvert(frame_info.quantity, 8));
         data_pack[data_pack_index++] = byte_num;
-        uint8_t const *coils = (uint8_t const *)frame_info.reg_values;
+        uint8_t const *coils = frame_info.coils.bytes;
         for(int i = 0; i < byte_num; ++i)
         {
             data_pack[data_pack_index++] = coils[i];
         }
     }
     else if(frame_info.function == ModbusHoldingRegisters ||
-             frame_info.function == ModbusInputRegisters)
+             frame_info.function == ModbusInputRegisters ||
+             frame_info.function == ModbusReadWriteMultipleRegisters)
     {
         uint8_t byte_num = uint8_t(frame_info.quantity << 1);
         data_pack[data_pack_index++] = byte_num;
@@ -137,7 +186,8 @@ size_t Modbus_TCP::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buff
         }
     }
     else if(frame_info.function == ModbusWriteSingleCoil ||
-             frame_info.function == ModbusWriteSingleRegister)
+             frame_info.function == ModbusWriteSingleRegister ||
+             frame_info.function == ModbusDiagnostics)
     {
         data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
         data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr & 0xFF);
@@ -152,6 +202,22 @@ size_t Modbus_TCP::slaveFrame2Pack(const ModbusFrameInfo &frame_info, char *buff
         data_pack[data_pack_index++] = uint8_t(frame_info.quantity >> 8 & 0xFF);
         data_pack[data_pack_index++] = uint8_t(frame_info.quantity & 0xFF);
     }
+    else if(frame_info.function == ModbusMaskWriteRegister)
+    {
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_addr & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[1] >> 8 & 0xFF);
+        data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[1] & 0xFF);
+    }
+    else if(frame_info.function == ModbusEncapsulatedInterface)
+    {
+        for(int i = 0;i < frame_info.mei_data_size;++i)
+        {
+            data_pack[data_pack_index++] = frame_info.mei_data[i];
+        }
+    }
     else if(frame_info.function > ModbusFunctionError)
     {
         data_pack[data_pack_index++] = uint8_t(frame_info.reg_values[0] & 0xFF);
@@ -179,7 +245,8 @@ ModbusFrameInfo Modbus_TCP::slavePack2Frame(const char *pack, size_t pack_size)
         ret.quantity = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
     }
     else if(ret.function == ModbusWriteSingleCoil ||
-             ret.function == ModbusWriteSingleRegister)
+             ret.function == ModbusWriteSingleRegister ||
+             ret.function == ModbusDiagnostics)
     {
         ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
         ret.quantity = 1;
@@ -189,8 +256,8 @@ ModbusFrameInfo Modbus_TCP::slavePack2Frame(const char *pack, size_t pack_size)
     {
         ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
         ret.quantity = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
-        int byte_num =  uint8_t(data_pack[6]);
-        unsigned char *coils = (unsigned char *)ret.reg_values;
+        int byte_num = std::min<int>(uint8_t(data_pack[6]), sizeof(ret.coils.bytes));
+        uint8_t *coils = ret.coils.bytes;
         for(int i = 0;i < byte_num;++i)
         {
             coils[i] = data_pack[7 + i];
@@ -200,11 +267,50 @@ ModbusFrameInfo Modbus_TCP::slavePack2Frame(const char *pack, size_t pack_size)
     {
         ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
         ret.quantity = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
-        for(int i = 0;i < ret.quantity; ++i)
+        // a quantity beyond the limit is answered with an exception, its values are not read
+        for(int i = 0;i < std::min<int>(ret.quantity, MODBUS_MAX_WRITE_REGISTERS); ++i)
         {
             ret.reg_values[i] = uint16_t(data_pack[7 + 2 * i]) << 8 | uint8_t(data_pack[8 + 2 * i]);
         }
     }
+    else if(ret.function == ModbusMaskWriteRegister)
+    {
+        ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
+        ret.quantity = 1;
+        ret.reg_values[0] = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
+        ret.reg_values[1] = uint16_t(data_pack[6]) << 8 | uint8_t(data_pack[7]);
+    }
+    else if(ret.function == ModbusReadWriteMultipleRegisters)
+    {
+        ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
+        ret.quantity = uint16_t(data_pack[4]) << 8 | uint8_t(data_pack[5]);
+        ret.write_reg_addr = uint16_t(data_pack[6]) << 8 | uint8_t(data_pack[7]);
+        ret.write_quantity = uint16_t(data_pack[8]) << 8 | uint8_t(data_pack[9]);
+        for(int i = 0;i < std::min<int>(ret.write_quantity, MODBUS_MAX_RW_WRITE_REGISTERS); ++i)
+        {
+            ret.write_reg_values[i] = uint16_t(data_pack[11 + 2 * i]) << 8 | uint8_t(data_pack[12 + 2 * i]);
+        }
+    }
+    else if(ret.function == ModbusEncapsulatedInterface)
+    {
+        ret.reg_addr = uint16_t(data_pack[2]) << 8 | uint8_t(data_pack[3]);
+        ret.quantity = uint8_t(data_pack[4]);
+    }
+    return ret;
+}
+
+ModbusPduView Modbus_TCP::pack2View(const char *pack, size_t pack_size, uint8_t * /*scratch*/)
+{
+    ModbusPduView ret;
+    if(pack_size < 8)
+    {
+        return ret;
+    }
+    ret.trans_id = uint16_t(pack[0]) << 8 | uint8_t(pack[1]);
+    ret.id = uint8_t(pack[6]);
+    ret.function = uint8_t(pack[7]);
+    ret.data = (const uint8_t *)pack + 8;
+    ret.data_size = pack_size - 8;
     return ret;
 }
 
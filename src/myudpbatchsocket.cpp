@@ -0,0 +1,242 @@
+#include "myudpbatchsocket.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// a scan cycle answers all at once, the default receive buffer drops part of a large one
+#define UDP_BATCH_RECEIVE_BUFFER (4 * 1024 * 1024)
+
+MyUdpBatchSocket::MyUdpBatchSocket() : m_fd(-1), m_family(0) {}
+
+MyUdpBatchSocket::~MyUdpBatchSocket() { close(); }
+
+void MyUdpBatchSocket::error(const char *what) {
+    if (m_error_callback) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "%s: %s", what, strerror(errno));
+        m_error_callback(msg);
+    }
+}
+
+#ifdef _WIN32
+
+bool MyUdpBatchSocket::open() {
+    error("batched udp is not supported on windows");
+    return false;
+}
+
+bool MyUdpBatchSocket::bind(uint16_t) { return open(); }
+
+void MyUdpBatchSocket::close() {}
+
+bool MyUdpBatchSocket::resolve(const char *, uint16_t, UdpEndpoint &) { return false; }
+
+bool MyUdpBatchSocket::sameEndpoint(const UdpEndpoint &, const UdpEndpoint &) { return false; }
+
+int MyUdpBatchSocket::sendBatch(const UdpDatagram *, int) { return 0; }
+
+int MyUdpBatchSocket::receiveBatch(UdpDatagram *, int, int) { return -1; }
+
+#else
+
+bool MyUdpBatchSocket::open() {
+    close();
+    // ipv6 with mapped addresses reaches both families from one socket
+    m_fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    m_family = AF_INET6;
+    if (m_fd >= 0) {
+        int off = 0;
+        setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    } else {
+        m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        m_family = AF_INET;
+    }
+    if (m_fd < 0) {
+        error("socket");
+        return false;
+    }
+    // SOCK_NONBLOCK and SOCK_CLOEXEC are linux only
+    if (fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK) < 0 || fcntl(m_fd, F_SETFD, FD_CLOEXEC) < 0) {
+        error("fcntl");
+        close();
+        return false;
+    }
+    int size = UDP_BATCH_RECEIVE_BUFFER;
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return true;
+}
+
+bool MyUdpBatchSocket::bind(uint16_t port) {
+    if (!open()) {
+        return false;
+    }
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+    if (m_family == AF_INET6) {
+        sockaddr_in6 *v6 = (sockaddr_in6 *)&addr;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_addr = in6addr_any;
+        v6->sin6_port = htons(port);
+        addr_len = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in *v4 = (sockaddr_in *)&addr;
+        v4->sin_family = AF_INET;
+        v4->sin_addr.s_addr = htonl(INADDR_ANY);
+        v4->sin_port = htons(port);
+        addr_len = sizeof(sockaddr_in);
+    }
+    if (::bind(m_fd, (const sockaddr *)&addr, addr_len) < 0) {
+        error("bind");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MyUdpBatchSocket::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool MyUdpBatchSocket::resolve(const char *host, uint16_t port, UdpEndpoint &endpoint) {
+    addrinfo hints{};
+    hints.ai_family = m_family == AF_INET ? AF_INET : AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host, service, &hints, &result) != 0 || result == nullptr) {
+        return false;
+    }
+    // the socket is ipv6 when possible, so ipv4 peers are addressed through their mapped address
+    endpoint = UdpEndpoint{};
+    if (result->ai_family == AF_INET && m_family == AF_INET6) {
+        sockaddr_in6 *mapped = (sockaddr_in6 *)&endpoint.addr;
+        const sockaddr_in *v4 = (const sockaddr_in *)result->ai_addr;
+        mapped->sin6_family = AF_INET6;
+        mapped->sin6_port = v4->sin_port;
+        mapped->sin6_addr.s6_addr[10] = 0xff;
+        mapped->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&mapped->sin6_addr.s6_addr[12], &v4->sin_addr, 4);
+        endpoint.addr_len = sizeof(sockaddr_in6);
+    } else {
+        memcpy(&endpoint.addr, result->ai_addr, result->ai_addrlen);
+        endpoint.addr_len = result->ai_addrlen;
+    }
+    freeaddrinfo(result);
+    return true;
+}
+
+bool MyUdpBatchSocket::sameEndpoint(const UdpEndpoint &a, const UdpEndpoint &b) {
+    if (a.addr.ss_family != b.addr.ss_family) {
+        return false;
+    }
+    if (a.addr.ss_family == AF_INET6) {
+        const sockaddr_in6 *x = (const sockaddr_in6 *)&a.addr, *y = (const sockaddr_in6 *)&b.addr;
+        return x->sin6_port == y->sin6_port && memcmp(&x->sin6_addr, &y->sin6_addr, sizeof(x->sin6_addr)) == 0;
+    }
+    const sockaddr_in *x = (const sockaddr_in *)&a.addr, *y = (const sockaddr_in *)&b.addr;
+    return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+}
+
+int MyUdpBatchSocket::sendBatch(const UdpDatagram *datagrams, int count) {
+    int sent = 0;
+    while (sent < count) {
+#ifdef __linux__
+        mmsghdr messages[UDP_BATCH_MAX_MESSAGES];
+        iovec iovecs[UDP_BATCH_MAX_MESSAGES];
+        int batch = std::min(count - sent, UDP_BATCH_MAX_MESSAGES);
+        for (int i = 0; i < batch; ++i) {
+            const UdpDatagram &datagram = datagrams[sent + i];
+            iovecs[i].iov_base = (void *)datagram.data;
+            iovecs[i].iov_len = datagram.size;
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_name = (void *)&datagram.endpoint.addr;
+            messages[i].msg_hdr.msg_namelen = datagram.endpoint.addr_len;
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int ret = sendmmsg(m_fd, messages, batch, 0);
+#else
+        const UdpDatagram &datagram = datagrams[sent];
+        int ret = sendto(m_fd, datagram.data, datagram.size, 0, (const sockaddr *)&datagram.endpoint.addr,
+                         datagram.endpoint.addr_len) < 0
+                      ? -1
+                      : 1;
+#endif
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                // the send buffer is full, wait until it drains
+                pollfd fd = {m_fd, POLLOUT, 0};
+                poll(&fd, 1, 100);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            error("send");
+            break;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+int MyUdpBatchSocket::receiveBatch(UdpDatagram *datagrams, int max_count, int timeout_ms) {
+    pollfd fd = {m_fd, POLLIN, 0};
+    int ret = poll(&fd, 1, std::max(timeout_ms, 0));
+    if (ret <= 0) {
+        return ret < 0 && errno != EINTR ? -1 : 0;
+    }
+    int received = 0;
+    while (received < max_count) {
+#ifdef __linux__
+        mmsghdr messages[UDP_BATCH_MAX_MESSAGES];
+        iovec iovecs[UDP_BATCH_MAX_MESSAGES];
+        int batch = std::min(max_count - received, UDP_BATCH_MAX_MESSAGES);
+        for (int i = 0; i < batch; ++i) {
+            UdpDatagram &datagram = datagrams[received + i];
+            iovecs[i].iov_base = datagram.data;
+            iovecs[i].iov_len = sizeof(datagram.data);
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_name = &datagram.endpoint.addr;
+            messages[i].msg_hdr.msg_namelen = sizeof(datagram.endpoint.addr);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        ret = recvmmsg(m_fd, messages, batch, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < ret; ++i) {
+            datagrams[received + i].size = messages[i].msg_len;
+            datagrams[received + i].endpoint.addr_len = messages[i].msg_hdr.msg_namelen;
+        }
+#else
+        UdpDatagram &datagram = datagrams[received];
+        datagram.endpoint.addr_len = sizeof(datagram.endpoint.addr);
+        ssize_t size = recvfrom(m_fd, datagram.data, sizeof(datagram.data), MSG_DONTWAIT,
+                                (sockaddr *)&datagram.endpoint.addr, &datagram.endpoint.addr_len);
+        ret = size < 0 ? -1 : 1;
+        datagram.size = size < 0 ? 0 : size_t(size);
+#endif
+        if (ret <= 0) {
+            if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                error("receive");
+            }
+            break;
+        }
+        received += ret;
+    }
+    return received;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef MYUDPBATCHSOCKET_H
+#define MYUDPBATCHSOCKET_H
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+// the largest modbus tcp adu is 260 bytes
+#define UDP_BATCH_MAX_DATAGRAM 260
+// datagrams handed to the kernel per sendmmsg and recvmmsg call
+#define UDP_BATCH_MAX_MESSAGES 256
+
+struct UdpEndpoint {
+#ifndef _WIN32
+    sockaddr_storage addr{};
+    socklen_t addr_len{0};
+#endif
+};
+
+struct UdpDatagram {
+    UdpEndpoint endpoint;
+    char data[UDP_BATCH_MAX_DATAGRAM];
+    size_t size{0};
+};
+
+// unconnected udp socket that sends and receives many datagrams per system call (sendmmsg and recvmmsg on linux,
+// one sendto or recvfrom per datagram elsewhere), used by the poller to put a whole scan cycle of requests to many
+// unit ids and endpoints on the wire at once. not available on windows
+class MyUdpBatchSocket {
+  public:
+    MyUdpBatchSocket();
+
+    ~MyUdpBatchSocket();
+
+    bool open();
+
+    // opens and listens on port of every local address, for a responder
+    bool bind(uint16_t port);
+
+    void close();
+
+    // only valid after open(), ipv4 addresses are mapped when the socket is ipv6
+    bool resolve(const char *host, uint16_t port, UdpEndpoint &endpoint);
+
+    static bool sameEndpoint(const UdpEndpoint &a, const UdpEndpoint &b);
+
+    // returns the number of datagrams sent, less than count only on an error
+    int sendBatch(const UdpDatagram *datagrams, int count);
+
+    // waits up to timeout_ms for the first datagram and then takes every datagram already queued, returns the
+    // number received, 0 on timeout and -1 on an error
+    int receiveBatch(UdpDatagram *datagrams, int max_count, int timeout_ms);
+
+    void setErrorCallback(std::function<void(const char *)> callback) { m_error_callback = callback; }
+
+  private:
+    void error(const char *what);
+
+  private:
+    int m_fd;
+    int m_family;
+    std::function<void(const char *)> m_error_callback;
+};
+
+#endif // MYUDPBATCHSOCKET_H
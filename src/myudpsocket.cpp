@@ -74,9 +74,9 @@ bool MyUdpSocket::bind(uint16_t port)
 void MyUdpSocket::close()
 {
     std::unique_lock<std::mutex> lock(m_socket_mutex);
-    m_asio_socket->cancel();
     if(m_asio_socket->is_open())
     {
+        m_asio_socket->cancel();
         try
         {
             m_asio_socket->shutdown(ip::tcp::socket::shutdown_type::shutdown_both);
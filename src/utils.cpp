@@ -1,30 +1,7 @@
 #include "utils.h"
 #include <stdlib.h>
 #include <unordered_map>
-#include <imgui.h>
-#include <ctime>
-#include <chrono>
-
-void render_combo_box(ComboBoxData &combo_box_data, const char *combo_box_label, const char **items, int start, int end)
-{
-    combo_box_data.text = items[combo_box_data.index];
-    if (ImGui::BeginCombo(combo_box_label, combo_box_data.text))
-    {
-        for (int i = start; i <= end; ++i)
-        {
-            combo_box_data.item_selected = (i == combo_box_data.index);
-            if (ImGui::Selectable(items[i], &combo_box_data.item_selected))
-            {
-                combo_box_data.index = i;
-            }
-            if (combo_box_data.item_selected)
-            {
-                ImGui::SetItemDefaultFocus();
-            }
-        }
-        ImGui::EndCombo();
-    }
-}
+#include <stdio.h>
 
 const char *hex_chars = "0123456789ABCDEF";
 
@@ -140,13 +117,21 @@ size_t fromHexString(const char *buffer, int len, uint8_t *data)
     return size;
 }
 
-void getTimeStampString(char *buffer, size_t buffer_size)
+void appendCsvField(std::string &out, const char *field)
 {
-    auto now = std::chrono::system_clock::now();
-    uint64_t dis_millseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
-    time_t tt = std::chrono::system_clock::to_time_t(now);
-    auto time_tm = localtime(&tt);
-    snprintf(buffer, buffer_size, "%02d:%02d:%02d.%03lu ", time_tm->tm_hour, time_tm->tm_min, time_tm->tm_sec, dis_millseconds);
+    if(strpbrk(field, ",\"\r\n") == nullptr)
+    {
+        out.append(field);
+        return;
+    }
+    out.push_back('"');
+    for(const char *c = field; *c; ++c)
+    {
+        if(*c == '"')
+        {
+            out.push_back('"');
+        }
+        out.push_back(*c);
+    }
+    out.push_back('"');
 }
-
-
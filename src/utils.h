@@ -4,17 +4,37 @@
 #include <spdlog/spdlog.h>
 #include <stdint.h>
 #include <string.h>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #define SPDLOG_LOGGER_CALL_(level, ...)                                                                                \
     spdlog::log(spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION}, level, __VA_ARGS__)
+// calls below SPDLOG_ACTIVE_LEVEL are compiled out, the rest check the run time level before formatting
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
 #define LogTrace(...) SPDLOG_LOGGER_CALL_(spdlog::level::trace, __VA_ARGS__)
+#else
+#define LogTrace(...) (void)0
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
 #define LogDebug(...) SPDLOG_LOGGER_CALL_(spdlog::level::debug, __VA_ARGS__)
+#else
+#define LogDebug(...) (void)0
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
 #define LogInfo(...) SPDLOG_LOGGER_CALL_(spdlog::level::info, __VA_ARGS__)
+#else
+#define LogInfo(...) (void)0
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
 #define LogWarn(...) SPDLOG_LOGGER_CALL_(spdlog::level::warn, __VA_ARGS__)
+#else
+#define LogWarn(...) (void)0
+#endif
 #define LogError(...) SPDLOG_LOGGER_CALL_(spdlog::level::err, __VA_ARGS__)
 #define LogCritical(...) SPDLOG_LOGGER_CALL_(spdlog::level::critical, __VA_ARGS__)
+// guards arguments that are expensive to build, e.g. hex dumps
+#define LogEnabled(level) (SPDLOG_ACTIVE_LEVEL <= (level) && spdlog::should_log(level))
 
 struct ComboBoxData {
     const char *text;
@@ -23,9 +43,6 @@ struct ComboBoxData {
     ComboBoxData() : text(nullptr), index(0), item_selected(false) {}
 };
 
-void render_combo_box(ComboBoxData &combo_box_data, const char *combo_box_label, const char **items, int start,
-                      int end);
-
 uint16_t getBit(uint8_t data, int bit_index);
 
 void setBit(uint8_t &data, int bit_index, uint16_t value);
@@ -42,7 +59,8 @@ size_t toHexString(const uint8_t *data, int len, char *buffer, char sep = ' ');
 
 size_t fromHexString(const char *buffer, int len, uint8_t *data);
 
-void getTimeStampString(char *buffer, size_t buffer_size);
+// appends field to a csv line, quoted when it holds a separator, a quote or a line break
+void appendCsvField(std::string &out, const char *field);
 
 template <class T> T myFromLittleEndianByteSwap(const void *src) {
     const size_t size = sizeof(T);
@@ -115,22 +133,4 @@ template <class T> void myToBigEndian(T val, void *dest) {
     }
 }
 
-template <class K, class V> std::vector<K> getKeysOfMap(const std::unordered_map<K, V> &map) {
-    std::vector<K> keys;
-    keys.reserve(map.size());
-    for (auto &it : map) {
-        keys.push_back(it.first);
-    }
-    return keys;
-}
-
-template <class K, class V> K getKeyOfValueInMap(const std::unordered_map<K, V> &map, const V &value) {
-    for (auto &it : map) {
-        if (it.second == value) {
-            return it.first;
-        }
-    }
-    return K{};
-}
-
 #endif
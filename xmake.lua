@@ -19,10 +19,34 @@ add_requires("opengl")
 add_requires("spdlog")
 add_requires("boost")
 
+-- trace and debug logging only exists in debug builds
+if is_mode("debug") then
+    add_defines("SPDLOG_ACTIVE_LEVEL=SPDLOG_LEVEL_TRACE")
+end
+
 target("DebugMyProtocol_IMGUI")
     set_kind("binary")
     add_packages("imgui", gettext_lib_str, "cserialport", "libsdl", "opengl", "spdlog", "boost")
     add_files("./src/*.cpp")
+    if is_mode("debug") then
+        add_defines("DMP_COUNT_ALLOCATIONS")
+    end
 
+target("debugmyprotocol-cli")
+    set_kind("binary")
+    add_packages("cserialport", "spdlog", "boost")
+    add_includedirs("./src")
+    add_files("./src/cli/*.cpp")
+    add_files("./src/utils.cpp", "./src/MyIODevice.cpp", "./src/MySerialPort.cpp", "./src/mytcpsocket.cpp",
+              "./src/myudpsocket.cpp", "./src/myudpbatchsocket.cpp", "./src/modbus_rtu.cpp", "./src/modbus_ascii.cpp",
+              "./src/modbus_tcp.cpp", "./src/Timestamp.cpp")
 
-
+-- requests per second of the cli poller over loopback udp, with and without batching
+target("udp-batch-bench")
+    set_kind("binary")
+    set_default(false)
+    add_packages("spdlog", "boost")
+    add_includedirs("./src", "./src/cli")
+    add_files("./src/bench/udp_batch_bench.cpp", "./src/cli/ModbusPoller.cpp")
+    add_files("./src/utils.cpp", "./src/MyIODevice.cpp", "./src/mytcpsocket.cpp", "./src/myudpsocket.cpp",
+              "./src/myudpbatchsocket.cpp", "./src/modbus_tcp.cpp", "./src/Timestamp.cpp")